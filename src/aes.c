@@ -0,0 +1,285 @@
+#include "aes.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AES_X86
+#include <immintrin.h>
+#endif
+
+static void expand_key(aes_context* ctx, const uint8_t* key);
+static void encrypt_block(const aes_context* ctx, const uint8_t* in, uint8_t* out);
+static uint8_t multiply_by_2(uint8_t x);
+
+#ifdef AES_X86
+static void aesni_cfb_encrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t blocks);
+static void aesni_cfb_decrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t blocks);
+static size_t vaes_cfb_decrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t blocks);
+#endif
+
+static const uint8_t sbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+void aes_init(aes_context* ctx, const uint8_t* key)
+{
+    expand_key(ctx, key);
+
+    ctx->backend = AES_BACKEND_PORTABLE;
+#ifdef AES_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("aes"))
+    {
+        ctx->backend = AES_BACKEND_AESNI;
+    }
+    if(__builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx512f"))
+    {
+        ctx->backend = AES_BACKEND_VAES;
+    }
+#endif
+}
+
+void aes_cfb_encrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t len)
+{
+    size_t blocks = len / AES_BLOCK_SIZE;
+
+#ifdef AES_X86
+    // Each block depends on the previous one, wider instructions don't help
+    if(ctx->backend != AES_BACKEND_PORTABLE)
+    {
+        aesni_cfb_encrypt(ctx, iv, data, blocks);
+        return;
+    }
+#endif
+
+    for(size_t i = 0; i < blocks; ++i)
+    {
+        uint8_t* block = data + i * AES_BLOCK_SIZE;
+        uint8_t stream[AES_BLOCK_SIZE];
+        encrypt_block(ctx, iv, stream);
+
+        for(int j = 0; j < AES_BLOCK_SIZE; ++j) block[j] ^= stream[j];
+        memcpy(iv, block, AES_BLOCK_SIZE);
+    }
+}
+
+void aes_cfb_decrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t len)
+{
+    size_t blocks = len / AES_BLOCK_SIZE;
+
+#ifdef AES_X86
+    // The ciphertext is known ahead, so many blocks are decrypted at once
+    if(ctx->backend == AES_BACKEND_VAES)
+    {
+        size_t done = vaes_cfb_decrypt(ctx, iv, data, blocks);
+        data += done * AES_BLOCK_SIZE;
+        blocks -= done;
+    }
+    if(ctx->backend != AES_BACKEND_PORTABLE)
+    {
+        aesni_cfb_decrypt(ctx, iv, data, blocks);
+        return;
+    }
+#endif
+
+    for(size_t i = 0; i < blocks; ++i)
+    {
+        uint8_t* block = data + i * AES_BLOCK_SIZE;
+        uint8_t stream[AES_BLOCK_SIZE];
+        encrypt_block(ctx, iv, stream);
+
+        memcpy(iv, block, AES_BLOCK_SIZE);
+        for(int j = 0; j < AES_BLOCK_SIZE; ++j) block[j] ^= stream[j];
+    }
+}
+
+static void expand_key(aes_context* ctx, const uint8_t* key)
+{
+    uint8_t* words = (uint8_t*)ctx->round_keys;
+    uint8_t rcon = 0x01;
+
+    memcpy(words, key, AES_KEY_SIZE);
+
+    // 60 words of 4 bytes, 8 of them from the key
+    for(int i = 8; i < 60; ++i)
+    {
+        uint8_t temp[4];
+        memcpy(temp, words + (i - 1) * 4, 4);
+
+        if(i % 8 == 0)
+        {
+            uint8_t first = temp[0];
+            temp[0] = sbox[temp[1]] ^ rcon;
+            temp[1] = sbox[temp[2]];
+            temp[2] = sbox[temp[3]];
+            temp[3] = sbox[first];
+            rcon = multiply_by_2(rcon);
+        }
+        else if(i % 8 == 4)
+        {
+            for(int j = 0; j < 4; ++j) temp[j] = sbox[temp[j]];
+        }
+
+        for(int j = 0; j < 4; ++j) words[i * 4 + j] = words[(i - 8) * 4 + j] ^ temp[j];
+    }
+}
+
+static void encrypt_block(const aes_context* ctx, const uint8_t* in, uint8_t* out)
+{
+    uint8_t state[AES_BLOCK_SIZE];
+    for(int i = 0; i < AES_BLOCK_SIZE; ++i) state[i] = in[i] ^ ctx->round_keys[0][i];
+
+    for(int round = 1; round < 15; ++round)
+    {
+        // SubBytes and ShiftRows, the state is stored column by column
+        uint8_t shifted[AES_BLOCK_SIZE];
+        for(int column = 0; column < 4; ++column)
+        {
+            for(int row = 0; row < 4; ++row) shifted[column * 4 + row] = sbox[state[((column + row) % 4) * 4 + row]];
+        }
+
+        // MixColumns, except on the last round
+        if(round < 14)
+        {
+            for(int column = 0; column < 4; ++column)
+            {
+                uint8_t* c = shifted + column * 4;
+                uint8_t all = c[0] ^ c[1] ^ c[2] ^ c[3];
+                uint8_t first = c[0];
+
+                c[0] ^= all ^ multiply_by_2(c[0] ^ c[1]);
+                c[1] ^= all ^ multiply_by_2(c[1] ^ c[2]);
+                c[2] ^= all ^ multiply_by_2(c[2] ^ c[3]);
+                c[3] ^= all ^ multiply_by_2(c[3] ^ first);
+            }
+        }
+
+        for(int i = 0; i < AES_BLOCK_SIZE; ++i) state[i] = shifted[i] ^ ctx->round_keys[round][i];
+    }
+
+    memcpy(out, state, AES_BLOCK_SIZE);
+}
+
+static uint8_t multiply_by_2(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00));
+}
+
+#ifdef AES_X86
+__attribute__((target("aes,sse2")))
+static void aesni_cfb_encrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t blocks)
+{
+    __m128i keys[15];
+    for(int i = 0; i < 15; ++i) keys[i] = _mm_loadu_si128((const __m128i*)ctx->round_keys[i]);
+
+    __m128i previous = _mm_loadu_si128((const __m128i*)iv);
+    for(size_t i = 0; i < blocks; ++i)
+    {
+        __m128i stream = _mm_xor_si128(previous, keys[0]);
+        for(int round = 1; round < 14; ++round) stream = _mm_aesenc_si128(stream, keys[round]);
+        stream = _mm_aesenclast_si128(stream, keys[14]);
+
+        __m128i* block = (__m128i*)(data + i * AES_BLOCK_SIZE);
+        previous = _mm_xor_si128(_mm_loadu_si128(block), stream);
+        _mm_storeu_si128(block, previous);
+    }
+
+    _mm_storeu_si128((__m128i*)iv, previous);
+}
+
+__attribute__((target("aes,sse2")))
+static void aesni_cfb_decrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t blocks)
+{
+    __m128i keys[15];
+    for(int i = 0; i < 15; ++i) keys[i] = _mm_loadu_si128((const __m128i*)ctx->round_keys[i]);
+
+    __m128i previous = _mm_loadu_si128((const __m128i*)iv);
+    size_t i = 0;
+
+    // 8 blocks at a time, so the latency of each round is hidden
+    for(; i + 8 <= blocks; i += 8)
+    {
+        __m128i* block = (__m128i*)(data + i * AES_BLOCK_SIZE);
+        __m128i cipher[8], stream[8];
+        for(int j = 0; j < 8; ++j) cipher[j] = _mm_loadu_si128(block + j);
+
+        stream[0] = _mm_xor_si128(previous, keys[0]);
+        for(int j = 1; j < 8; ++j) stream[j] = _mm_xor_si128(cipher[j - 1], keys[0]);
+
+        for(int round = 1; round < 14; ++round)
+        {
+            for(int j = 0; j < 8; ++j) stream[j] = _mm_aesenc_si128(stream[j], keys[round]);
+        }
+
+        for(int j = 0; j < 8; ++j) _mm_storeu_si128(block + j, _mm_xor_si128(cipher[j], _mm_aesenclast_si128(stream[j], keys[14])));
+        previous = cipher[7];
+    }
+
+    for(; i < blocks; ++i)
+    {
+        __m128i* block = (__m128i*)(data + i * AES_BLOCK_SIZE);
+        __m128i cipher = _mm_loadu_si128(block);
+
+        __m128i stream = _mm_xor_si128(previous, keys[0]);
+        for(int round = 1; round < 14; ++round) stream = _mm_aesenc_si128(stream, keys[round]);
+        stream = _mm_aesenclast_si128(stream, keys[14]);
+
+        _mm_storeu_si128(block, _mm_xor_si128(cipher, stream));
+        previous = cipher;
+    }
+
+    _mm_storeu_si128((__m128i*)iv, previous);
+}
+
+// Decrypts 16 blocks at a time, 4 per register. Returns the number of blocks decrypted, the rest is left to AES-NI
+__attribute__((target("avx512f,vaes")))
+static size_t vaes_cfb_decrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t blocks)
+{
+    __m512i keys[15];
+    for(int i = 0; i < 15; ++i) keys[i] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)ctx->round_keys[i]));
+
+    // Only the last block of the previous register is used
+    __m512i previous = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)iv));
+    size_t i = 0;
+
+    for(; i + 16 <= blocks; i += 16)
+    {
+        uint8_t* block = data + i * AES_BLOCK_SIZE;
+        __m512i cipher[4], stream[4];
+        for(int j = 0; j < 4; ++j) cipher[j] = _mm512_loadu_si512(block + j * 64);
+
+        // Each block is encrypted from the ciphertext before it
+        stream[0] = _mm512_alignr_epi64(cipher[0], previous, 6);
+        for(int j = 1; j < 4; ++j) stream[j] = _mm512_alignr_epi64(cipher[j], cipher[j - 1], 6);
+
+        for(int j = 0; j < 4; ++j) stream[j] = _mm512_xor_si512(stream[j], keys[0]);
+        for(int round = 1; round < 14; ++round)
+        {
+            for(int j = 0; j < 4; ++j) stream[j] = _mm512_aesenc_epi128(stream[j], keys[round]);
+        }
+
+        for(int j = 0; j < 4; ++j) _mm512_storeu_si512(block + j * 64, _mm512_xor_si512(cipher[j], _mm512_aesenclast_epi128(stream[j], keys[14])));
+        previous = cipher[3];
+    }
+
+    _mm_storeu_si128((__m128i*)iv, _mm512_extracti32x4_epi32(previous, 3));
+
+    return i;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef TOOL_GDPC_AES_H
+#define TOOL_GDPC_AES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AES_KEY_SIZE 32 // AES-256
+#define AES_BLOCK_SIZE 16
+
+enum
+{
+    AES_BACKEND_PORTABLE = 0,
+    AES_BACKEND_AESNI = 1,
+    AES_BACKEND_VAES = 2
+};
+
+typedef struct
+{
+    uint8_t round_keys[15][AES_BLOCK_SIZE];
+    int backend; // Fastest instructions the processor supports
+} aes_context;
+
+void aes_init(aes_context* ctx, const uint8_t* key);
+
+// CFB-128 over whole blocks, in place. The IV is updated so consecutive calls continue the same stream
+void aes_cfb_encrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t len);
+void aes_cfb_decrypt(const aes_context* ctx, uint8_t* iv, uint8_t* data, size_t len);
+
+#endif
\ No newline at end of file
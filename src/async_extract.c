@@ -0,0 +1,387 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "async_extract.h"
+#include "file_utils.h"
+#include "pack_crypto.h"
+#include "buffer_pool.h"
+#include "progress.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Platform-dependant functions
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_QUEUE_DEPTH 256
+#define URING_OPERATIONS_PER_FILE 4 // Read, open, write, close
+#define URING_BUFFER_SIZE (128 * 1024) // Larger files are copied synchronously, in the kernel
+
+enum
+{
+    OPERATION_READ = 0,
+    OPERATION_OPEN = 1,
+    OPERATION_WRITE = 2,
+    OPERATION_CLOSE = 3
+};
+
+typedef struct
+{
+    int fd;
+
+    // Submission queue
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned sq_entries;
+    unsigned to_submit;
+
+    // Completion queue
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} uring;
+
+// A file in flight, each one owns a buffer and a slot of the registered file table
+typedef struct
+{
+    extract_request* request;
+    uint8_t* buffer;
+    int pending; // Operations not completed yet
+    bool failed;
+} uring_slot;
+
+static int uring_init(uring* ring);
+static void uring_free(uring* ring);
+static struct io_uring_sqe* uring_get_sqe(uring* ring);
+static int uring_submit(uring* ring, unsigned wait);
+static void submit_file(uring* ring, uring_slot* slots, int slot, int source_fd);
+static int extract_sync(FILE* source, extract_request* request);
+
+/* Each file is extracted by a chain of linked operations, each one starting once the previous one succeeded:
+ * read the file from the package into the slot's buffer, open the destination directly into the slot of the
+ * registered file table, write the buffer and close the slot. A queue of these chains is kept in flight, and
+ * a chain that fails (short read, unsupported operation...) is retried synchronously.
+*/
+int extract_files_async(FILE* source, extract_request* requests, int count)
+{
+    // Without io_uring (old kernel, disabled by the system...), every file is extracted synchronously
+    uring ring;
+    bool initialized = (uring_init(&ring) == 0);
+    bool available = initialized;
+
+    int slot_count = available ? (int)(ring.sq_entries / URING_OPERATIONS_PER_FILE) : 0;
+    uring_slot* slots = NULL;
+    uint8_t* buffers = NULL;
+
+    // Files are opened into a sparse table of registered files, one per slot
+    if(available)
+    {
+        int* files = malloc(slot_count * sizeof(int));
+        slots = calloc(slot_count, sizeof(uring_slot));
+        buffers = buffer_pool_acquire((int64_t)slot_count * URING_BUFFER_SIZE);
+        if(files == NULL || slots == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        for(int i = 0; i < slot_count; ++i)
+        {
+            files[i] = -1;
+            slots[i].buffer = buffers + (size_t)i * URING_BUFFER_SIZE;
+        }
+
+        if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_FILES, files, slot_count) != 0)
+        {
+            available = false;
+        }
+
+        free(files);
+    }
+
+    int source_fd = fileno(source);
+    int next = 0;
+    int in_flight = 0;
+    bool broken = !available;
+
+    while(next < count || in_flight > 0)
+    {
+        // Fill the free slots, large and encrypted files, and every file once io_uring failed, are extracted synchronously
+        for(int i = 0; i < slot_count && next < count && broken == false; ++i)
+        {
+            if(slots[i].request != NULL) continue;
+
+            while(next < count && (requests[next].size > URING_BUFFER_SIZE || requests[next].key != NULL))
+            {
+                requests[next].error = extract_sync(source, &requests[next]);
+                next++;
+            }
+            if(next == count) break;
+
+            slots[i].request = &requests[next++];
+            submit_file(&ring, slots, i, source_fd);
+            in_flight++;
+        }
+
+        if(broken)
+        {
+            while(next < count)
+            {
+                requests[next].error = extract_sync(source, &requests[next]);
+                next++;
+            }
+            if(in_flight == 0) break;
+        }
+
+        if(in_flight == 0) continue;
+
+        if(uring_submit(&ring, 1) != 0)
+        {
+            // Completions can't be waited for, the files in flight are extracted again synchronously
+            for(int i = 0; i < slot_count; ++i)
+            {
+                if(slots[i].request == NULL) continue;
+
+                extract_request* request = slots[i].request;
+                request->error = extract_sync(source, request);
+                slots[i].request = NULL;
+            }
+
+            in_flight = 0;
+            broken = true;
+            ring.to_submit = 0;
+            continue;
+        }
+
+        // Reap the completions
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head)
+        {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+            int slot = (int)(cqe->user_data >> 2);
+            int operation = (int)(cqe->user_data & 3);
+            uring_slot* itr = &slots[slot];
+
+            // A short read or write cancels the rest of the chain
+            if(cqe->res < 0 || ((operation == OPERATION_READ || operation == OPERATION_WRITE) && cqe->res != itr->request->size))
+            {
+                itr->failed = true;
+
+                // Kernels without direct descriptors can't run the chains at all
+                if(operation == OPERATION_OPEN && cqe->res == -EINVAL) broken = true;
+            }
+
+            if(--itr->pending == 0)
+            {
+                extract_request* request = itr->request;
+                request->error = itr->failed ? extract_sync(source, request) : 0;
+                if(itr->failed == false) progress_add(request->size, 1);
+
+                itr->request = NULL;
+                in_flight--;
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if(initialized) uring_free(&ring);
+    free(slots);
+    buffer_pool_release(buffers);
+
+    int errors = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        if(requests[i].error != 0) errors++;
+    }
+
+    return errors;
+}
+
+static void submit_file(uring* ring, uring_slot* slots, int slot, int source_fd)
+{
+    uring_slot* itr = &slots[slot];
+    extract_request* request = itr->request;
+    uint64_t user_data = (uint64_t)slot << 2;
+
+    itr->failed = false;
+    itr->pending = (request->size > 0) ? 4 : 2;
+
+    struct io_uring_sqe* sqe;
+    if(request->size > 0)
+    {
+        sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_READ;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = source_fd;
+        sqe->addr = (uint64_t)(uintptr_t)itr->buffer;
+        sqe->len = (uint32_t)request->size;
+        sqe->off = (uint64_t)request->offset;
+        sqe->user_data = user_data | OPERATION_READ;
+    }
+
+    sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)request->dest;
+    sqe->len = 0666;
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC; // Direct descriptors can't be close-on-exec
+    sqe->file_index = slot + 1;
+    sqe->user_data = user_data | OPERATION_OPEN;
+
+    if(request->size > 0)
+    {
+        sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->flags = IOSQE_IO_LINK | IOSQE_FIXED_FILE;
+        sqe->fd = slot;
+        sqe->addr = (uint64_t)(uintptr_t)itr->buffer;
+        sqe->len = (uint32_t)request->size;
+        sqe->off = 0;
+        sqe->user_data = user_data | OPERATION_WRITE;
+    }
+
+    sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = user_data | OPERATION_CLOSE;
+}
+
+// Extracts the file without io_uring, decrypting it if needed
+static int extract_sync(FILE* source, extract_request* request)
+{
+    if(request->key != NULL)
+    {
+        return extract_encrypted_file(request->dest, source, request->offset, request->key);
+    }
+
+    int error = extract_range(request->dest, source, request->offset, request->size);
+    progress_add(request->size, 1);
+
+    return error;
+}
+
+static struct io_uring_sqe* uring_get_sqe(uring* ring)
+{
+    unsigned tail = *ring->sq_tail + ring->to_submit;
+    unsigned index = tail & *ring->sq_mask;
+
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    ring->to_submit++;
+
+    return sqe;
+}
+
+// Submits the queued operations and waits for at least `wait` completions
+static int uring_submit(uring* ring, unsigned wait)
+{
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->to_submit, __ATOMIC_RELEASE);
+
+    while(true)
+    {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(submitted < 0)
+        {
+            if(errno == EINTR) continue;
+            return 1;
+        }
+
+        ring->to_submit -= (unsigned)submitted;
+        if(ring->to_submit == 0) return 0;
+        wait = 0;
+    }
+}
+
+static int uring_init(uring* ring)
+{
+    memset(ring, 0, sizeof(uring));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_QUEUE_DEPTH, &params);
+    if(ring->fd < 0) return 1;
+
+    // Map the rings, in a single mapping if the kernel supports it
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = 0;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sq_ring == MAP_FAILED)
+    {
+        close(ring->fd);
+        return 1;
+    }
+
+    ring->cq_ring = ring->sq_ring;
+    if(ring->cq_ring_size > 0)
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cq_ring == MAP_FAILED)
+        {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            return 1;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED)
+    {
+        if(ring->cq_ring_size > 0) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return 1;
+    }
+
+    char* sq = ring->sq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+
+    char* cq = ring->cq_ring;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+static void uring_free(uring* ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if(ring->cq_ring_size > 0) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef TOOL_GDPC_ASYNC_EXTRACT_H
+#define TOOL_GDPC_ASYNC_EXTRACT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+    const char* dest;
+    int64_t offset;
+    int64_t size;
+    const uint8_t* key; // Key to decrypt the file with, NULL if it isn't encrypted
+    int error; // Set once the file is extracted, 0 on success
+} extract_request;
+
+int extract_files_async(FILE* source, extract_request* requests, int count); // Platform-dependant
+
+#endif
\ No newline at end of file
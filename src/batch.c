@@ -0,0 +1,315 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "batch.h"
+#include "gdpc.h"
+#include "file_utils.h"
+#include "thread_pool.h"
+#include "pack_cache.h"
+#include "pack_analysis.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+    config cfg;
+    int line;
+    int error;
+
+    char* output;
+    size_t output_size;
+
+    pack_cache* cache;
+} batch_operation;
+
+DEFINE_VECTOR(operation_vector, batch_operation)
+DEFINE_SMALL_VECTOR(argument_vector, char*, 16) // Arguments of a line of the manifest, rarely more than a few
+
+static int read_manifest(FILE* manifest, operation_vector* operations, pack_cache* cache);
+static int split_arguments(char* line, argument_vector* args);
+static bool asks_for_help(argument_vector* args);
+
+static void run_operation(void* arg);
+static void flush_operations(thread_pool* pool, batch_operation* operations, size_t first, size_t last);
+
+int run_batch(config* cfg)
+{
+    // Open the manifest ("-" being the standard input)
+    FILE* manifest = stdin;
+    if(strcmp(cfg->batch_file, "-") != 0)
+    {
+        manifest = fopen(cfg->batch_file, "r");
+        if(manifest == NULL)
+        {
+            printf("gdpc: Failed to open file \"%s\"\n", cfg->batch_file);
+            return 1;
+        }
+    }
+
+    pack_cache cache;
+    pack_cache_init(&cache);
+
+    // Parse every operation up front
+    operation_vector operations;
+    operation_vector_init(&operations);
+
+    int error = read_manifest(manifest, &operations, &cache);
+    if(manifest != stdin) fclose(manifest);
+
+    batch_operation* ops = operations.data;
+
+    // Listing and extraction run concurrently, creating or updating a package waits for everything before it
+    thread_pool pool;
+    thread_pool_init(&pool, get_processor_count());
+
+    size_t first = 0;
+    for(size_t i = 0; i < operations.size && error == 0; ++i)
+    {
+        batch_operation* op = &ops[i];
+        if(op->cfg.operation_mode != OPERATION_MODE_CREATE && op->cfg.operation_mode != OPERATION_MODE_UPDATE)
+        {
+            thread_pool_submit(&pool, run_operation, op);
+            continue;
+        }
+
+        flush_operations(&pool, ops, first, i);
+        first = i + 1;
+
+        op->error = create_pack(&op->cfg);
+
+        // The package has changed, drop it from the cache
+        if(op->cfg.operation_mode == OPERATION_MODE_CREATE)
+        {
+            pack_cache_invalidate(&cache, op->cfg.destination);
+        }
+        else
+        {
+            pack_cache_invalidate(&cache, op->cfg.input_files.data[op->cfg.input_files.size - 1]);
+        }
+    }
+
+    if(error == 0)
+    {
+        flush_operations(&pool, ops, first, operations.size);
+    }
+
+    thread_pool_free(&pool);
+
+    // Clean-up
+    for(size_t i = 0; i < operations.size; ++i)
+    {
+        if(ops[i].error != 0) error = 1;
+        free_config(&ops[i].cfg);
+    }
+    operation_vector_free(&operations);
+
+    pack_cache_free(&cache);
+
+    return error;
+}
+
+/* Manifest
+ * One operation per line, written like the command line arguments of gdpc (e.g. "-e -w=levels/w1.tscn game.pck out/").
+ * Empty lines and lines starting with '#' are ignored.
+*/
+static int read_manifest(FILE* manifest, operation_vector* operations, pack_cache* cache)
+{
+    char* line = NULL;
+    size_t capacity = 0;
+    int line_number = 0;
+    int error = 0;
+
+    argument_vector args;
+    argument_vector_init(&args);
+
+    while(getline(&line, &capacity, manifest) != -1)
+    {
+        ++line_number;
+
+        // Split the line into arguments, "gdpc" being the first one
+        args.size = 0;
+        argument_vector_push_back(&args, "gdpc");
+
+        if(split_arguments(line, &args) != 0)
+        {
+            printf("gdpc: Unterminated quote on line %d of the manifest\n", line_number);
+            error = 1;
+            continue;
+        }
+        if(args.size == 1 || args.data[1][0] == '#')
+        {
+            continue;
+        }
+
+        // The help message exits, it would end the whole batch
+        if(asks_for_help(&args) == true)
+        {
+            printf("gdpc: --help isn't an operation (line %d of the manifest)\n", line_number);
+            error = 1;
+            continue;
+        }
+
+        // Parse the operation
+        batch_operation op;
+        op.line = line_number;
+        op.error = 0;
+        op.output = NULL;
+        op.output_size = 0;
+        op.cache = cache;
+
+        if(parse_command_line_arguments(args.size, args.data, &op.cfg) != 0)
+        {
+            printf("gdpc: Invalid operation on line %d of the manifest\n", line_number);
+            free_config(&op.cfg);
+            error = 1;
+            continue;
+        }
+        if(op.cfg.operation_mode == OPERATION_MODE_BATCH)
+        {
+            printf("gdpc: Batches can't be nested (line %d of the manifest)\n", line_number);
+            free_config(&op.cfg);
+            error = 1;
+            continue;
+        }
+
+        operation_vector_push_back(operations, op);
+    }
+
+    free(line);
+    argument_vector_free(&args);
+
+    return error;
+}
+
+// Splits the line in place on whitespace, keeping quoted strings together
+static int split_arguments(char* line, argument_vector* args)
+{
+    char* read = line;
+    while(*read != '\0')
+    {
+        // Skip whitespace
+        while(*read == ' ' || *read == '\t' || *read == '\r' || *read == '\n') ++read;
+        if(*read == '\0') break;
+
+        // Copy the argument over itself, without the quotes
+        char* arg = read;
+        char* write = read;
+        char quote = '\0';
+        while(*read != '\0' && (quote != '\0' || (*read != ' ' && *read != '\t' && *read != '\r' && *read != '\n')))
+        {
+            if(quote == '\0' && (*read == '"' || *read == '\''))
+            {
+                quote = *read++;
+            }
+            else if(*read == quote)
+            {
+                quote = '\0';
+                ++read;
+            }
+            else
+            {
+                *write++ = *read++;
+            }
+        }
+
+        if(quote != '\0')
+        {
+            return 1;
+        }
+
+        if(*read != '\0') ++read;
+        *write = '\0';
+
+        argument_vector_push_back(args, arg);
+    }
+
+    return 0;
+}
+
+// Returns true if the arguments hold --help, or -h among short options
+static bool asks_for_help(argument_vector* args)
+{
+    for(size_t i = 1; i < args->size; ++i)
+    {
+        const char* arg = args->data[i];
+        if(strcmp(arg, "--help") == 0)
+        {
+            return true;
+        }
+
+        // Short options, not values like -w="path"
+        if(arg[0] == '-' && arg[1] != '-' && arg[1] != '\0' && arg[2] != '=' && strchr(arg + 1, 'h') != NULL)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void run_operation(void* arg)
+{
+    batch_operation* op = (batch_operation*)arg;
+
+    // Buffer the output so that operations print in the order of the manifest
+    op->cfg.output = open_memstream(&op->output, &op->output_size);
+    if(op->cfg.output == NULL)
+    {
+        fprintf(stderr, "open_memstream(): failed to allocate memory.\n");
+        abort();
+    }
+
+    if(op->cfg.operation_mode == OPERATION_MODE_LIST)
+    {
+        print_list_header(&op->cfg);
+    }
+
+    // The analysis reads every package at once
+    if(op->cfg.operation_mode == OPERATION_MODE_ANALYZE)
+    {
+        op->error = analyze_packs(&op->cfg);
+    }
+
+    // For each pack in the inputs...
+    for(size_t i = 0; i < op->cfg.input_files.size && op->cfg.operation_mode != OPERATION_MODE_ANALYZE; ++i)
+    {
+        char* file = op->cfg.input_files.data[i];
+
+        // Get the parsed pack, loading it if no other operation did
+        cached_pack* entry = pack_cache_acquire(op->cache, file, &op->cfg);
+        if(entry == NULL)
+        {
+            op->error = 1;
+            continue;
+        }
+
+        if(process_pack(&entry->pack, &op->cfg) != 0)
+        {
+            op->error = 1;
+        }
+
+        pack_cache_release(entry);
+    }
+
+    fclose(op->cfg.output);
+    op->cfg.output = stdout;
+}
+
+// Waits for the operations in [first, last) and prints their output in order
+static void flush_operations(thread_pool* pool, batch_operation* operations, size_t first, size_t last)
+{
+    thread_pool_wait(pool);
+
+    for(size_t i = first; i < last; ++i)
+    {
+        if(operations[i].output == NULL) continue;
+
+        fwrite(operations[i].output, 1, operations[i].output_size, stdout);
+        free(operations[i].output);
+        operations[i].output = NULL;
+    }
+    fflush(stdout);
+}
\ No newline at end of file
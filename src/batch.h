@@ -0,0 +1,8 @@
+#ifndef TOOL_GDPC_BATCH_H
+#define TOOL_GDPC_BATCH_H
+
+#include "config.h"
+
+int run_batch(config* cfg);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1314 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "binary_resource.h"
+#include "file_utils.h"
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define READER_BUFFER_SIZE 65536
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define MAX_VARIANT_DEPTH 64
+#define MAX_STRING_SIZE (1 << 30)
+
+#define SCENE_FLAG_ID_IS_PATH (1 << 30)
+#define SCENE_FLAG_INSTANCE_IS_PLACEHOLDER (1 << 30)
+#define SCENE_FLAG_MASK ((1 << 24) - 1)
+#define SCENE_TYPE_INSTANCED 0x7FFFFFFF
+#define SCENE_NAME_INDEX_BITS 18
+#define SCENE_CONNECT_PERSIST 2
+
+// Variant types, as numbered by Godot 3's binary resource format
+enum
+{
+    VARIANT_NIL = 1,
+    VARIANT_BOOL = 2,
+    VARIANT_INT = 3,
+    VARIANT_REAL = 4,
+    VARIANT_STRING = 5,
+    VARIANT_VECTOR2 = 10,
+    VARIANT_RECT2 = 11,
+    VARIANT_VECTOR3 = 12,
+    VARIANT_PLANE = 13,
+    VARIANT_QUAT = 14,
+    VARIANT_AABB = 15,
+    VARIANT_BASIS = 16,
+    VARIANT_TRANSFORM = 17,
+    VARIANT_TRANSFORM2D = 18,
+    VARIANT_COLOR = 20,
+    VARIANT_NODE_PATH = 22,
+    VARIANT_RID = 23,
+    VARIANT_OBJECT = 24,
+    VARIANT_INPUT_EVENT = 25,
+    VARIANT_DICTIONARY = 26,
+    VARIANT_ARRAY = 30,
+    VARIANT_RAW_ARRAY = 31,
+    VARIANT_INT_ARRAY = 32,
+    VARIANT_REAL_ARRAY = 33,
+    VARIANT_STRING_ARRAY = 34,
+    VARIANT_VECTOR3_ARRAY = 35,
+    VARIANT_COLOR_ARRAY = 36,
+    VARIANT_VECTOR2_ARRAY = 37,
+    VARIANT_INT64 = 40,
+    VARIANT_DOUBLE = 41
+};
+
+enum
+{
+    OBJECT_EMPTY = 0,
+    OBJECT_EXTERNAL_RESOURCE = 1,
+    OBJECT_INTERNAL_RESOURCE = 2,
+    OBJECT_EXTERNAL_RESOURCE_INDEX = 3
+};
+
+// Buffered reader over a range of the pack, several readers can share the stream
+typedef struct
+{
+    FILE* file;
+    int64_t start;
+    int64_t size;
+    int64_t position; // Relative to the start of the resource
+
+    uint8_t* buffer;
+    int64_t buffer_position;
+    size_t buffer_size;
+
+    bool big_endian;
+    bool real64;
+    bool error;
+} resource_reader;
+
+typedef struct
+{
+    char* type;
+    char* path;
+} external_resource;
+
+typedef struct
+{
+    int64_t offset;
+    int id; // Sub-resource id, from its "local://<id>" path
+} internal_resource;
+
+typedef struct
+{
+    resource_reader reader;
+    FILE* out;
+    uint32_t format_version;
+    char* type;
+
+    char** strings;
+    uint32_t string_count;
+    external_resource* externals;
+    uint32_t external_count;
+    internal_resource* internals;
+    uint32_t internal_count;
+} binary_resource;
+
+// PackedScene's "_bundled" dictionary, with the variants and node data left in the file
+typedef struct
+{
+    char** names;
+    uint32_t name_count;
+    int64_t* variants;
+    uint32_t variant_count;
+
+    int32_t node_count;
+    int64_t nodes;
+    uint32_t nodes_length;
+    int32_t connection_count;
+    int64_t connections;
+    uint32_t connections_length;
+
+    char** node_paths;
+    uint32_t node_path_count;
+    char** editable_instances;
+    uint32_t editable_instance_count;
+    int32_t base_scene;
+
+    int32_t* parents; // Filled while the nodes are written
+    int32_t* node_names;
+} packed_scene;
+
+static void reader_init(resource_reader* reader, FILE* file, int64_t start, int64_t size);
+static void reader_free(resource_reader* reader);
+static void reader_seek(resource_reader* reader, int64_t position);
+static void read_bytes(resource_reader* reader, void* dest, size_t size);
+static void skip_bytes(resource_reader* reader, int64_t size);
+static uint32_t read_u32(resource_reader* reader);
+static uint64_t read_u64(resource_reader* reader);
+static float read_f32(resource_reader* reader);
+static double read_f64(resource_reader* reader);
+static double read_real(resource_reader* reader);
+static char* read_string(resource_reader* reader);
+static const char* read_string_reference(binary_resource* res, resource_reader* reader, char** owned);
+
+static void write_escaped(FILE* out, const char* str, size_t len, bool multiline);
+static void write_real(FILE* out, double value, bool standalone);
+static void write_variant(binary_resource* res, resource_reader* reader, FILE* out, int depth);
+static char* read_node_path(binary_resource* res, resource_reader* reader);
+static void write_properties(binary_resource* res, int64_t offset, bool* is_scene, int64_t* bundled);
+
+static bool read_scene(binary_resource* res, int64_t bundled, packed_scene* scene);
+static void write_scene(binary_resource* res, packed_scene* scene);
+static void free_scene(packed_scene* scene);
+
+static void free_resource(binary_resource* res);
+
+/* Binary resource (.res/.scn)
+ * 1 x 4B  | String | Magic Number (RSRC, RSCC if compressed)
+ * 2 x 4B  | Int    | Big endian, 64-bit reals
+ * 3 x 4B  | Int    | Engine major and minor version, format version
+ *         | String | Type of the main resource (4B length, including the null terminator, then UTF-8)
+ * 1 x 8B  | Int    | Offset of the import metadata
+ * 14 x 4B | Void   | Reserved
+ * 1 x 4B  | Int    | Number of strings, then the strings property names refer to
+ * 1 x 4B  | Int    | Number of external resources, then the type and path of each one
+ * 1 x 4B  | Int    | Number of internal resources, then the path and offset of each one. The main resource is last.
+ *
+ * Each internal resource is its type, its number of properties, then each property: its name (an index in the
+ * string table, or an inline string if the high bit is set) and its variant-encoded value.
+ *
+ * The text resource is written as the binary one is read, only the tables (and a scene's names and the offset
+ * of each of its variants) are kept in memory.
+*/
+int convert_binary_resource(FILE* pack, int64_t offset, int64_t size, const char* dest)
+{
+    binary_resource res;
+    memset(&res, 0, sizeof(res));
+    reader_init(&res.reader, pack, offset, size);
+    resource_reader* reader = &res.reader;
+
+    char magic[4];
+    read_bytes(reader, magic, 4);
+    if(reader->error || strncmp(magic, "RSRC", 4) != 0)
+    {
+        reader_free(reader);
+        return (reader->error == false && strncmp(magic, "RSCC", 4) == 0) ? BINARY_RESOURCE_UNSUPPORTED : BINARY_RESOURCE_INVALID;
+    }
+
+    reader->big_endian = (read_u32(reader) != 0);
+    reader->real64 = (read_u32(reader) != 0);
+    uint32_t version_major = read_u32(reader);
+    read_u32(reader); // Minor version
+    res.format_version = read_u32(reader);
+
+    // Godot 4 resources use another text format
+    if(version_major > 3)
+    {
+        reader_free(reader);
+        return BINARY_RESOURCE_UNSUPPORTED;
+    }
+
+    res.type = read_string(reader);
+    read_u64(reader); // Import metadata
+    skip_bytes(reader, 14 * 4);
+
+    // String table
+    res.string_count = read_u32(reader);
+    if(reader->error == false && res.string_count <= (uint64_t)(reader->size - reader->position) / 4)
+    {
+        res.strings = calloc(res.string_count + 1, sizeof(char*));
+        for(uint32_t i = 0; i < res.string_count && reader->error == false; ++i) res.strings[i] = read_string(reader);
+    }
+    else reader->error = true;
+
+    // External resources
+    res.external_count = read_u32(reader);
+    if(reader->error == false && res.external_count <= (uint64_t)(reader->size - reader->position) / 8)
+    {
+        res.externals = calloc(res.external_count + 1, sizeof(external_resource));
+        for(uint32_t i = 0; i < res.external_count && reader->error == false; ++i)
+        {
+            res.externals[i].type = read_string(reader);
+            res.externals[i].path = read_string(reader);
+        }
+    }
+    else reader->error = true;
+
+    // Internal resources
+    res.internal_count = read_u32(reader);
+    if(reader->error == false && res.internal_count > 0 && res.internal_count <= (uint64_t)(reader->size - reader->position) / 12)
+    {
+        res.internals = calloc(res.internal_count, sizeof(internal_resource));
+        for(uint32_t i = 0; i < res.internal_count && reader->error == false; ++i)
+        {
+            char* path = read_string(reader);
+            res.internals[i].offset = (int64_t)read_u64(reader);
+            res.internals[i].id = (path != NULL && strncmp(path, "local://", 8) == 0) ? atoi(path + 8) : (int)i + 1;
+            free(path);
+        }
+    }
+    else reader->error = true;
+
+    if(res.strings == NULL || res.externals == NULL || res.internals == NULL || res.type == NULL)
+    {
+        reader->error = true;
+    }
+
+    if(reader->error)
+    {
+        free_resource(&res);
+        return BINARY_RESOURCE_INVALID;
+    }
+
+    res.out = fopen(dest, "wb");
+    if(res.out == NULL)
+    {
+        free_resource(&res);
+        return BINARY_RESOURCE_WRITE_FAILED;
+    }
+    setvbuf(res.out, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    // Header, the format is the one of Godot 3's text resources
+    bool is_scene = (strcmp(res.type, "PackedScene") == 0);
+    uint32_t load_steps = res.external_count + res.internal_count;
+
+    if(is_scene) fputs("[gd_scene", res.out);
+    else fprintf(res.out, "[gd_resource type=\"%s\"", res.type);
+    if(load_steps > 1) fprintf(res.out, " load_steps=%u", load_steps);
+    fputs(" format=2]\n\n", res.out);
+
+    for(uint32_t i = 0; i < res.external_count; ++i)
+    {
+        fputs("[ext_resource path=\"", res.out);
+        write_escaped(res.out, res.externals[i].path, strlen(res.externals[i].path), false);
+        fprintf(res.out, "\" type=\"%s\" id=%u]\n", res.externals[i].type, i + 1);
+    }
+    if(res.external_count > 0) fputs("\n", res.out);
+
+    // Sub-resources
+    for(uint32_t i = 0; i + 1 < res.internal_count && reader->error == false; ++i)
+    {
+        reader_seek(reader, res.internals[i].offset);
+        char* type = read_string(reader);
+        if(type == NULL) break;
+
+        fprintf(res.out, "[sub_resource type=\"%s\" id=%d]\n", type, res.internals[i].id);
+        free(type);
+
+        write_properties(&res, res.internals[i].offset, NULL, NULL);
+        fputs("\n", res.out);
+    }
+
+    // Main resource, a scene's nodes are stored in its "_bundled" property
+    if(reader->error == false)
+    {
+        int64_t bundled = -1;
+        internal_resource* main = &res.internals[res.internal_count - 1];
+
+        if(is_scene)
+        {
+            write_properties(&res, main->offset, &is_scene, &bundled);
+
+            packed_scene scene;
+            if(bundled >= 0 && read_scene(&res, bundled, &scene) == true)
+            {
+                write_scene(&res, &scene);
+            }
+            else reader->error = true;
+
+            free_scene(&scene);
+        }
+        else
+        {
+            fputs("[resource]\n", res.out);
+            write_properties(&res, main->offset, NULL, NULL);
+        }
+    }
+
+    int error = BINARY_RESOURCE_OK;
+    if(reader->error) error = BINARY_RESOURCE_INVALID;
+    if(ferror(res.out) || fclose(res.out) != 0) error = BINARY_RESOURCE_WRITE_FAILED;
+
+    free_resource(&res);
+
+    return error;
+}
+
+// Writes "name = value" for each property. For scenes, finds the offset of "_bundled" instead of writing it.
+static void write_properties(binary_resource* res, int64_t offset, bool* is_scene, int64_t* bundled)
+{
+    resource_reader* reader = &res->reader;
+
+    reader_seek(reader, offset);
+    free(read_string(reader)); // Type
+
+    uint32_t count = read_u32(reader);
+    for(uint32_t i = 0; i < count && reader->error == false; ++i)
+    {
+        char* owned;
+        const char* name = read_string_reference(res, reader, &owned);
+        if(name == NULL) break;
+
+        if(is_scene != NULL)
+        {
+            if(strcmp(name, "_bundled") == 0) *bundled = reader->position;
+            write_variant(res, reader, NULL, 0);
+            free(owned);
+            continue;
+        }
+
+        // Names with spaces, quotes, '=' or non-ASCII characters are quoted
+        bool quote = false;
+        for(const unsigned char* itr = (const unsigned char*)name; *itr != '\0'; ++itr)
+        {
+            if(*itr == '=' || *itr == '"' || *itr < 33 || *itr > 126) quote = true;
+        }
+
+        if(quote)
+        {
+            fputs("\"", res->out);
+            write_escaped(res->out, name, strlen(name), true);
+            fputs("\"", res->out);
+        }
+        else fputs(name, res->out);
+
+        fputs(" = ", res->out);
+        write_variant(res, reader, res->out, 0);
+        fputs("\n", res->out);
+
+        free(owned);
+    }
+}
+
+/* Variants
+ * 1 x 4B  | Int    | Type, followed by the value:
+ * Bool, int: 4B. Int64, double: 8B. Real: 4B float. String: 4B length then UTF-8.
+ * Vector2, Rect2, Vector3, Plane, Quat, AABB, Transform2D, Basis, Transform, Color: 2 to 12 reals (8B if the
+ * resource uses 64-bit reals). Node path: name and subname counts (2B each, absolute flag in the high bit), names.
+ * Object: 4B kind, then the internal or external resource index. Dictionary, array: 4B length then variants.
+ * Pool arrays: 4B length then the elements, byte arrays are padded to 4B.
+ *
+ * Written as in text resources. Nothing is written if out is NULL, the variant is only skipped.
+*/
+static void write_variant(binary_resource* res, resource_reader* reader, FILE* out, int depth)
+{
+    uint32_t type = read_u32(reader);
+    if(reader->error) return;
+
+    if(depth > MAX_VARIANT_DEPTH)
+    {
+        reader->error = true;
+        return;
+    }
+
+    // Math types, their number of reals and their name
+    int reals = 0;
+    const char* name = NULL;
+    switch(type)
+    {
+        case VARIANT_VECTOR2:     reals = 2;  name = "Vector2"; break;
+        case VARIANT_RECT2:       reals = 4;  name = "Rect2"; break;
+        case VARIANT_VECTOR3:     reals = 3;  name = "Vector3"; break;
+        case VARIANT_PLANE:       reals = 4;  name = "Plane"; break;
+        case VARIANT_QUAT:        reals = 4;  name = "Quat"; break;
+        case VARIANT_AABB:        reals = 6;  name = "AABB"; break;
+        case VARIANT_TRANSFORM2D: reals = 6;  name = "Transform2D"; break;
+        case VARIANT_BASIS:       reals = 9;  name = "Basis"; break;
+        case VARIANT_TRANSFORM:   reals = 12; name = "Transform"; break;
+        case VARIANT_COLOR:       reals = 4;  name = "Color"; break;
+    }
+
+    if(reals > 0)
+    {
+        if(out != NULL) fprintf(out, "%s( ", name);
+        for(int i = 0; i < reals; ++i)
+        {
+            double value = read_real(reader);
+            if(out == NULL) continue;
+
+            if(i > 0) fputs(", ", out);
+            write_real(out, value, false);
+        }
+        if(out != NULL) fputs(" )", out);
+        return;
+    }
+
+    switch(type)
+    {
+        case VARIANT_NIL:
+        case VARIANT_INPUT_EVENT:
+        {
+            if(out != NULL) fputs("null", out);
+            break;
+        }
+        case VARIANT_BOOL:
+        {
+            uint32_t value = read_u32(reader);
+            if(out != NULL) fputs(value ? "true" : "false", out);
+            break;
+        }
+        case VARIANT_INT:
+        {
+            int32_t value = (int32_t)read_u32(reader);
+            if(out != NULL) fprintf(out, "%d", value);
+            break;
+        }
+        case VARIANT_INT64:
+        {
+            int64_t value = (int64_t)read_u64(reader);
+            if(out != NULL) fprintf(out, "%lld", (long long)value);
+            break;
+        }
+        case VARIANT_REAL:
+        {
+            double value = read_f32(reader);
+            if(out != NULL) write_real(out, value, true);
+            break;
+        }
+        case VARIANT_DOUBLE:
+        {
+            double value = read_f64(reader);
+            if(out != NULL) write_real(out, value, true);
+            break;
+        }
+        case VARIANT_STRING:
+        {
+            // Written in chunks, strings can be as large as the resource
+            uint32_t length = read_u32(reader);
+            if(out != NULL) fputs("\"", out);
+
+            char chunk[4096];
+            bool terminated = false;
+            while(length > 0 && reader->error == false)
+            {
+                size_t count = (length < sizeof(chunk)) ? length : sizeof(chunk);
+                read_bytes(reader, chunk, count);
+                length -= count;
+
+                if(out != NULL && terminated == false)
+                {
+                    size_t used = strnlen(chunk, count);
+                    write_escaped(out, chunk, used, true);
+                    terminated = (used < count);
+                }
+            }
+
+            if(out != NULL) fputs("\"", out);
+            break;
+        }
+        case VARIANT_NODE_PATH:
+        {
+            char* path = read_node_path(res, reader);
+            if(out != NULL && path != NULL)
+            {
+                fputs("NodePath(\"", out);
+                write_escaped(out, path, strlen(path), false);
+                fputs("\")", out);
+            }
+            free(path);
+            break;
+        }
+        case VARIANT_RID:
+        {
+            read_u32(reader);
+            if(out != NULL) fputs("null", out);
+            break;
+        }
+        case VARIANT_OBJECT:
+        {
+            uint32_t kind = read_u32(reader);
+            if(kind == OBJECT_INTERNAL_RESOURCE)
+            {
+                uint32_t index = read_u32(reader);
+                if(out != NULL) fprintf(out, "SubResource( %u )", index);
+            }
+            else if(kind == OBJECT_EXTERNAL_RESOURCE_INDEX)
+            {
+                uint32_t index = read_u32(reader);
+                if(out != NULL) fprintf(out, "ExtResource( %u )", index + 1);
+            }
+            else if(kind == OBJECT_EXTERNAL_RESOURCE)
+            {
+                // Older format, the type and path are inline
+                free(read_string(reader));
+                char* path = read_string(reader);
+
+                uint32_t index = 0;
+                for(uint32_t i = 0; path != NULL && i < res->external_count; ++i)
+                {
+                    if(strcmp(res->externals[i].path, path) == 0) index = i + 1;
+                }
+                free(path);
+
+                if(out != NULL)
+                {
+                    if(index != 0) fprintf(out, "ExtResource( %u )", index);
+                    else fputs("null", out);
+                }
+            }
+            else if(out != NULL)
+            {
+                fputs("null", out);
+            }
+            break;
+        }
+        case VARIANT_DICTIONARY:
+        {
+            uint32_t length = read_u32(reader) & 0x7FFFFFFF; // The high bit marked shared dictionaries
+            if(out != NULL) fputs("{\n", out);
+
+            for(uint32_t i = 0; i < length && reader->error == false; ++i)
+            {
+                if(out != NULL && i > 0) fputs(",\n", out);
+                write_variant(res, reader, out, depth + 1);
+                if(out != NULL) fputs(": ", out);
+                write_variant(res, reader, out, depth + 1);
+            }
+
+            if(out != NULL) fputs((length > 0) ? "\n}" : "}", out);
+            break;
+        }
+        case VARIANT_ARRAY:
+        {
+            uint32_t length = read_u32(reader) & 0x7FFFFFFF;
+            if(out != NULL) fputs("[ ", out);
+
+            for(uint32_t i = 0; i < length && reader->error == false; ++i)
+            {
+                if(out != NULL && i > 0) fputs(", ", out);
+                write_variant(res, reader, out, depth + 1);
+            }
+
+            if(out != NULL) fputs(" ]", out);
+            break;
+        }
+        case VARIANT_RAW_ARRAY:
+        case VARIANT_INT_ARRAY:
+        case VARIANT_REAL_ARRAY:
+        case VARIANT_STRING_ARRAY:
+        case VARIANT_VECTOR2_ARRAY:
+        case VARIANT_VECTOR3_ARRAY:
+        case VARIANT_COLOR_ARRAY:
+        {
+            uint32_t length = read_u32(reader);
+            int real_size = reader->real64 ? 8 : 4;
+
+            // Size of each element, to reject lengths larger than the resource
+            int64_t element_size;
+            switch(type)
+            {
+                case VARIANT_RAW_ARRAY:     element_size = 1; name = "PoolByteArray"; break;
+                case VARIANT_INT_ARRAY:     element_size = 4; name = "PoolIntArray"; break;
+                case VARIANT_REAL_ARRAY:    element_size = real_size; name = "PoolRealArray"; break;
+                case VARIANT_STRING_ARRAY:  element_size = 4; name = "PoolStringArray"; break;
+                case VARIANT_VECTOR2_ARRAY: element_size = 2 * real_size; name = "PoolVector2Array"; break;
+                case VARIANT_VECTOR3_ARRAY: element_size = 3 * real_size; name = "PoolVector3Array"; break;
+                default:                    element_size = 16; name = "PoolColorArray"; break;
+            }
+
+            if((int64_t)length * element_size > reader->size - reader->position)
+            {
+                reader->error = true;
+                break;
+            }
+
+            if(out == NULL && type != VARIANT_STRING_ARRAY)
+            {
+                skip_bytes(reader, (int64_t)length * element_size);
+                if(type == VARIANT_RAW_ARRAY) skip_bytes(reader, (4 - length % 4) % 4);
+                break;
+            }
+
+            if(out != NULL) fprintf(out, "%s( ", name);
+
+            for(uint32_t i = 0; i < length && reader->error == false; ++i)
+            {
+                if(out != NULL && i > 0) fputs(", ", out);
+
+                if(type == VARIANT_RAW_ARRAY)
+                {
+                    uint8_t value;
+                    read_bytes(reader, &value, 1);
+                    fprintf(out, "%u", value);
+                }
+                else if(type == VARIANT_INT_ARRAY)
+                {
+                    fprintf(out, "%d", (int32_t)read_u32(reader));
+                }
+                else if(type == VARIANT_STRING_ARRAY)
+                {
+                    char* value = read_string(reader);
+                    if(out != NULL && value != NULL)
+                    {
+                        fputs("\"", out);
+                        write_escaped(out, value, strlen(value), true);
+                        fputs("\"", out);
+                    }
+                    free(value);
+                }
+                else
+                {
+                    int components = (type == VARIANT_REAL_ARRAY) ? 1 : (type == VARIANT_VECTOR2_ARRAY) ? 2 :
+                                     (type == VARIANT_VECTOR3_ARRAY) ? 3 : 4;
+
+                    for(int c = 0; c < components; ++c)
+                    {
+                        double value = (type == VARIANT_COLOR_ARRAY) ? read_f32(reader) : read_real(reader);
+                        if(c > 0) fputs(", ", out);
+                        write_real(out, value, false);
+                    }
+                }
+            }
+
+            if(type == VARIANT_RAW_ARRAY) skip_bytes(reader, (4 - length % 4) % 4);
+            if(out != NULL) fputs(" )", out);
+            break;
+        }
+        default:
+        {
+            reader->error = true;
+            break;
+        }
+    }
+}
+
+// Returns the node path as "name/name:subname:subname", with a leading '/' if absolute
+static char* read_node_path(binary_resource* res, resource_reader* reader)
+{
+    uint8_t counts[4];
+    read_bytes(reader, counts, 4);
+    if(reader->error) return NULL;
+
+    uint32_t name_count = reader->big_endian ? (uint32_t)(counts[0] << 8 | counts[1]) : (uint32_t)(counts[1] << 8 | counts[0]);
+    uint32_t subname_count = reader->big_endian ? (uint32_t)(counts[2] << 8 | counts[3]) : (uint32_t)(counts[3] << 8 | counts[2]);
+    bool absolute = (subname_count & 0x8000) != 0;
+    subname_count &= 0x7FFF;
+
+    // Older formats store the property separately
+    if(res->format_version < 3) subname_count++;
+
+    char* path = NULL;
+    size_t size = 0;
+    FILE* stream = open_memstream(&path, &size);
+    if(stream == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    if(absolute) fputs("/", stream);
+
+    for(uint32_t i = 0; i < name_count + subname_count && reader->error == false; ++i)
+    {
+        char* owned;
+        const char* name = read_string_reference(res, reader, &owned);
+        if(name == NULL) break;
+
+        if(i >= name_count && name[0] == '\0')
+        {
+            free(owned);
+            continue;
+        }
+
+        if(i > 0 && i < name_count) fputs("/", stream);
+        else if(i >= name_count) fputs(":", stream);
+        fputs(name, stream);
+
+        free(owned);
+    }
+
+    fclose(stream);
+
+    return path;
+}
+
+/* PackedScene "_bundled" dictionary
+ * names              | Strings | Node names and types, property names, groups, signals and methods
+ * variants           | Array   | Property values, instanced scenes, connection binds
+ * node_count, nodes  | Ints    | For each node: parent, owner, type, name (and index + 1 in the high bits), instance,
+ *                    |         | number of properties, name and value of each one, number of groups, the groups
+ * conn_count, conns  | Ints    | For each connection: from, to, signal, method, flags, number of binds, the binds
+ * node_paths         | Array   | Paths of the nodes outside of the scene, parents/owners flagged as paths index it
+ * editable_instances | Array   | Paths of the instanced scenes with editable children
+ * base_scene         | Int     | Variant of the inherited scene, if any
+*/
+static bool read_node_path_array(binary_resource* res, resource_reader* reader, char*** paths, uint32_t* count)
+{
+    if(read_u32(reader) != VARIANT_ARRAY) return false;
+
+    *count = read_u32(reader) & 0x7FFFFFFF;
+    if(reader->error || *count > (uint64_t)(reader->size - reader->position) / 8) return false;
+
+    *paths = calloc(*count + 1, sizeof(char*));
+    if(*paths == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(uint32_t i = 0; i < *count && reader->error == false; ++i)
+    {
+        if(read_u32(reader) != VARIANT_NODE_PATH) return false;
+        (*paths)[i] = read_node_path(res, reader);
+    }
+
+    return reader->error == false;
+}
+
+static bool read_scene(binary_resource* res, int64_t bundled, packed_scene* scene)
+{
+    resource_reader* reader = &res->reader;
+    memset(scene, 0, sizeof(packed_scene));
+    scene->base_scene = -1;
+
+    reader_seek(reader, bundled);
+    if(read_u32(reader) != VARIANT_DICTIONARY) return false;
+
+    uint32_t length = read_u32(reader) & 0x7FFFFFFF;
+    for(uint32_t i = 0; i < length && reader->error == false; ++i)
+    {
+        if(read_u32(reader) != VARIANT_STRING) return false;
+        char* key = read_string(reader);
+        if(key == NULL) return false;
+
+        int64_t value = reader->position;
+        uint32_t type = read_u32(reader);
+        bool valid = true;
+
+        if(strcmp(key, "names") == 0 && type == VARIANT_STRING_ARRAY && scene->names == NULL)
+        {
+            scene->name_count = read_u32(reader);
+            valid = (scene->name_count <= (uint64_t)(reader->size - reader->position) / 4);
+            if(valid)
+            {
+                scene->names = calloc(scene->name_count + 1, sizeof(char*));
+                for(uint32_t j = 0; j < scene->name_count && reader->error == false; ++j) scene->names[j] = read_string(reader);
+            }
+        }
+        else if(strcmp(key, "variants") == 0 && type == VARIANT_ARRAY && scene->variants == NULL)
+        {
+            // Only the offset of each variant is kept, they are read again when written
+            scene->variant_count = read_u32(reader) & 0x7FFFFFFF;
+            valid = (scene->variant_count <= (uint64_t)(reader->size - reader->position) / 4);
+            if(valid)
+            {
+                scene->variants = calloc(scene->variant_count + 1, sizeof(int64_t));
+                for(uint32_t j = 0; j < scene->variant_count && reader->error == false; ++j)
+                {
+                    scene->variants[j] = reader->position;
+                    write_variant(res, reader, NULL, 0);
+                }
+            }
+        }
+        else if((strcmp(key, "nodes") == 0 || strcmp(key, "conns") == 0) && type == VARIANT_INT_ARRAY)
+        {
+            uint32_t count = read_u32(reader);
+            valid = (count <= (uint64_t)(reader->size - reader->position) / 4);
+
+            if(key[0] == 'n')
+            {
+                scene->nodes = reader->position;
+                scene->nodes_length = count;
+            }
+            else
+            {
+                scene->connections = reader->position;
+                scene->connections_length = count;
+            }
+            skip_bytes(reader, (int64_t)count * 4);
+        }
+        else if((strcmp(key, "node_count") == 0 || strcmp(key, "conn_count") == 0 || strcmp(key, "base_scene") == 0) &&
+                type == VARIANT_INT)
+        {
+            int32_t count = (int32_t)read_u32(reader);
+            if(key[0] == 'n') scene->node_count = count;
+            else if(key[0] == 'c') scene->connection_count = count;
+            else scene->base_scene = count;
+        }
+        else if(strcmp(key, "node_paths") == 0 && scene->node_paths == NULL)
+        {
+            reader_seek(reader, value);
+            valid = read_node_path_array(res, reader, &scene->node_paths, &scene->node_path_count);
+        }
+        else if(strcmp(key, "editable_instances") == 0 && scene->editable_instances == NULL)
+        {
+            reader_seek(reader, value);
+            valid = read_node_path_array(res, reader, &scene->editable_instances, &scene->editable_instance_count);
+        }
+        else
+        {
+            reader_seek(reader, value);
+            write_variant(res, reader, NULL, 0);
+        }
+
+        free(key);
+        if(valid == false) return false;
+    }
+
+    if(reader->error || scene->names == NULL || scene->variants == NULL || scene->node_count < 1 ||
+       (uint64_t)scene->node_count > scene->nodes_length)
+    {
+        return false;
+    }
+
+    scene->parents = malloc(scene->node_count * sizeof(int32_t));
+    scene->node_names = malloc(scene->node_count * sizeof(int32_t));
+    if(scene->parents == NULL || scene->node_names == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    return true;
+}
+
+static const char* get_name(packed_scene* scene, uint32_t index)
+{
+    return (index < scene->name_count && scene->names[index] != NULL) ? scene->names[index] : "";
+}
+
+// Writes the path of a node relative to the root ("." for the root itself)
+static void write_scene_path(packed_scene* scene, int32_t node, FILE* out, int depth)
+{
+    if(node & SCENE_FLAG_ID_IS_PATH)
+    {
+        uint32_t index = node & SCENE_FLAG_MASK;
+        const char* path = (index < scene->node_path_count && scene->node_paths[index] != NULL) ? scene->node_paths[index] : ".";
+        fputs(path, out);
+        return;
+    }
+
+    if(node <= 0 || node >= scene->node_count || depth > scene->node_count)
+    {
+        fputs(".", out);
+        return;
+    }
+
+    int32_t parent = scene->parents[node];
+    bool parent_is_root = (parent == 0 || parent == -1);
+    if((parent & SCENE_FLAG_ID_IS_PATH) && parent != -1)
+    {
+        uint32_t index = parent & SCENE_FLAG_MASK;
+        parent_is_root = (index >= scene->node_path_count || scene->node_paths[index] == NULL ||
+                          strcmp(scene->node_paths[index], ".") == 0);
+    }
+
+    if(parent_is_root == false)
+    {
+        write_scene_path(scene, parent, out, depth + 1);
+        fputs("/", out);
+    }
+    fputs(get_name(scene, scene->node_names[node]), out);
+}
+
+static void write_scene_variant(binary_resource* res, resource_reader* values, packed_scene* scene, uint32_t index)
+{
+    if(index >= scene->variant_count)
+    {
+        fputs("null", res->out);
+        return;
+    }
+
+    reader_seek(values, scene->variants[index]);
+    write_variant(res, values, res->out, 0);
+}
+
+static void write_scene(binary_resource* res, packed_scene* scene)
+{
+    resource_reader* reader = &res->reader;
+    FILE* out = res->out;
+
+    // Property values are read with their own reader, so reading the nodes doesn't refill its buffer
+    resource_reader values;
+    reader_init(&values, reader->file, reader->start, reader->size);
+    values.big_endian = reader->big_endian;
+    values.real64 = reader->real64;
+
+    reader_seek(reader, scene->nodes);
+    int64_t nodes_end = scene->nodes + (int64_t)scene->nodes_length * 4;
+
+    for(int32_t i = 0; i < scene->node_count && reader->error == false && values.error == false; ++i)
+    {
+        int32_t parent = (int32_t)read_u32(reader);
+        int32_t owner = (int32_t)read_u32(reader);
+        uint32_t type = read_u32(reader);
+        uint32_t name_data = read_u32(reader);
+        int32_t instance = (int32_t)read_u32(reader);
+        uint32_t property_count = read_u32(reader);
+
+        if(reader->error || (parent >= i && (parent & SCENE_FLAG_ID_IS_PATH) == 0) ||
+           (int64_t)property_count * 8 > nodes_end - reader->position)
+        {
+            reader->error = true;
+            break;
+        }
+
+        scene->parents[i] = parent;
+        scene->node_names[i] = name_data & ((1 << SCENE_NAME_INDEX_BITS) - 1);
+        int32_t index = (int32_t)(name_data >> SCENE_NAME_INDEX_BITS) - 1;
+
+        // Groups are stored after the properties but written in the header
+        int64_t properties = reader->position;
+        skip_bytes(reader, (int64_t)property_count * 8);
+        uint32_t group_count = read_u32(reader);
+        if((int64_t)group_count * 4 > nodes_end - reader->position)
+        {
+            reader->error = true;
+            break;
+        }
+
+        fputs("[node name=\"", out);
+        const char* name = get_name(scene, scene->node_names[i]);
+        write_escaped(out, name, strlen(name), false);
+        fputs("\"", out);
+
+        if(type != SCENE_TYPE_INSTANCED) fprintf(out, " type=\"%s\"", get_name(scene, type));
+        if(parent != -1)
+        {
+            fputs(" parent=\"", out);
+            write_scene_path(scene, parent, out, 0);
+            fputs("\"", out);
+        }
+        if(owner != -1 && owner != 0)
+        {
+            fputs(" owner=\"", out);
+            write_scene_path(scene, owner, out, 0);
+            fputs("\"", out);
+        }
+        if(index >= 0) fprintf(out, " index=\"%d\"", index);
+
+        if(group_count > 0)
+        {
+            fputs(" groups=[\n", out);
+            for(uint32_t j = 0; j < group_count; ++j)
+            {
+                const char* group = get_name(scene, read_u32(reader));
+                fputs("\"", out);
+                write_escaped(out, group, strlen(group), false);
+                fputs("\",\n", out);
+            }
+            fputs("]", out);
+        }
+
+        // The root of an inherited scene instances the base scene
+        if(i == 0 && instance == -1 && scene->base_scene >= 0) instance = scene->base_scene;
+        if(instance != -1)
+        {
+            if(instance & SCENE_FLAG_INSTANCE_IS_PLACEHOLDER) fputs(" instance_placeholder=", out);
+            else fputs(" instance=", out);
+            write_scene_variant(res, &values, scene, instance & SCENE_FLAG_MASK);
+        }
+        fputs("]\n", out);
+
+        int64_t next = reader->position;
+
+        // Properties
+        reader_seek(reader, properties);
+        for(uint32_t j = 0; j < property_count && reader->error == false; ++j)
+        {
+            const char* property = get_name(scene, read_u32(reader));
+            uint32_t value = read_u32(reader);
+
+            fprintf(out, "%s = ", property);
+            write_scene_variant(res, &values, scene, value);
+            fputs("\n", out);
+        }
+
+        reader_seek(reader, next);
+        if(i + 1 < scene->node_count) fputs("\n", out);
+    }
+
+    // Connections
+    reader_seek(reader, scene->connections);
+    int64_t connections_end = scene->connections + (int64_t)scene->connections_length * 4;
+
+    for(int32_t i = 0; i < scene->connection_count && reader->error == false && values.error == false; ++i)
+    {
+        if(i == 0) fputs("\n", out);
+
+        int32_t from = (int32_t)read_u32(reader);
+        int32_t to = (int32_t)read_u32(reader);
+        uint32_t signal = read_u32(reader);
+        uint32_t method = read_u32(reader);
+        uint32_t flags = read_u32(reader);
+        uint32_t bind_count = read_u32(reader);
+
+        if(reader->error || reader->position > connections_end || (int64_t)bind_count * 4 > connections_end - reader->position)
+        {
+            reader->error = true;
+            break;
+        }
+
+        fprintf(out, "[connection signal=\"%s\" from=\"", get_name(scene, signal));
+        write_scene_path(scene, from, out, 0);
+        fputs("\" to=\"", out);
+        write_scene_path(scene, to, out, 0);
+        fprintf(out, "\" method=\"%s\"", get_name(scene, method));
+        if(flags != SCENE_CONNECT_PERSIST) fprintf(out, " flags=%u", flags);
+
+        if(bind_count > 0)
+        {
+            fputs(" binds= [ ", out);
+            for(uint32_t j = 0; j < bind_count; ++j)
+            {
+                if(j > 0) fputs(", ", out);
+                write_scene_variant(res, &values, scene, read_u32(reader));
+            }
+            fputs(" ]", out);
+        }
+        fputs("]\n", out);
+    }
+
+    // Instanced scenes with editable children
+    for(uint32_t i = 0; i < scene->editable_instance_count; ++i)
+    {
+        if(i == 0) fputs("\n", out);
+        fprintf(out, "[editable path=\"%s\"]\n", scene->editable_instances[i] ? scene->editable_instances[i] : "");
+    }
+
+    if(values.error) reader->error = true;
+    reader_free(&values);
+}
+
+static void free_scene(packed_scene* scene)
+{
+    for(uint32_t i = 0; scene->names != NULL && i < scene->name_count; ++i) free(scene->names[i]);
+    for(uint32_t i = 0; scene->node_paths != NULL && i < scene->node_path_count; ++i) free(scene->node_paths[i]);
+    for(uint32_t i = 0; scene->editable_instances != NULL && i < scene->editable_instance_count; ++i) free(scene->editable_instances[i]);
+
+    free(scene->names);
+    free(scene->variants);
+    free(scene->node_paths);
+    free(scene->editable_instances);
+    free(scene->parents);
+    free(scene->node_names);
+}
+
+static void free_resource(binary_resource* res)
+{
+    for(uint32_t i = 0; res->strings != NULL && i < res->string_count; ++i) free(res->strings[i]);
+    for(uint32_t i = 0; res->externals != NULL && i < res->external_count; ++i)
+    {
+        free(res->externals[i].type);
+        free(res->externals[i].path);
+    }
+
+    free(res->strings);
+    free(res->externals);
+    free(res->internals);
+    free(res->type);
+
+    reader_free(&res->reader);
+}
+
+// Escapes backslashes and quotes, and for single-line strings control characters too
+static void write_escaped(FILE* out, const char* str, size_t len, bool multiline)
+{
+    const char* start = str;
+    const char* end = str + len;
+
+    for(const char* itr = str; itr < end; ++itr)
+    {
+        const char* escape = NULL;
+        switch(*itr)
+        {
+            case '\\': escape = "\\\\"; break;
+            case '"':  escape = "\\\""; break;
+            case '\n': escape = multiline ? NULL : "\\n"; break;
+            case '\t': escape = multiline ? NULL : "\\t"; break;
+            case '\r': escape = multiline ? NULL : "\\r"; break;
+        }
+
+        if(escape != NULL)
+        {
+            fwrite(start, 1, itr - start, out);
+            fputs(escape, out);
+            start = itr + 1;
+        }
+    }
+
+    fwrite(start, 1, end - start, out);
+}
+
+// Reals are written with 6 significant digits, standalone reals always have a decimal point
+static void write_real(FILE* out, double value, bool standalone)
+{
+    char buffer[32];
+
+    if(value == 0.0) strcpy(buffer, "0");
+    else snprintf(buffer, sizeof(buffer), "%g", value);
+
+    if(standalone && strpbrk(buffer, ".ein") == NULL) strcat(buffer, ".0");
+
+    fputs(buffer, out);
+}
+
+static void reader_init(resource_reader* reader, FILE* file, int64_t start, int64_t size)
+{
+    reader->file = file;
+    reader->start = start;
+    reader->size = size;
+    reader->position = 0;
+    reader->buffer_position = 0;
+    reader->buffer_size = 0;
+    reader->big_endian = false;
+    reader->real64 = false;
+    reader->error = false;
+
+    reader->buffer = buffer_pool_acquire(READER_BUFFER_SIZE);
+}
+
+static void reader_free(resource_reader* reader)
+{
+    buffer_pool_release(reader->buffer);
+    reader->buffer = NULL;
+}
+
+static void reader_seek(resource_reader* reader, int64_t position)
+{
+    if(position < 0 || position > reader->size) reader->error = true;
+    else reader->position = position;
+}
+
+static void read_bytes(resource_reader* reader, void* dest, size_t size)
+{
+    if(reader->error || (int64_t)size > reader->size - reader->position)
+    {
+        reader->error = true;
+        memset(dest, 0, size);
+        return;
+    }
+
+    uint8_t* itr = dest;
+    while(size > 0)
+    {
+        // Refill the buffer if the position is outside of it
+        int64_t buffered = reader->buffer_position + (int64_t)reader->buffer_size - reader->position;
+        if(reader->position < reader->buffer_position || buffered <= 0)
+        {
+            int64_t remaining = reader->size - reader->position;
+            size_t count = (remaining < READER_BUFFER_SIZE) ? (size_t)remaining : READER_BUFFER_SIZE;
+
+            if(read_range(reader->file, reader->start + reader->position, reader->buffer, count) != 0)
+            {
+                reader->error = true;
+                memset(itr, 0, size);
+                return;
+            }
+
+            reader->buffer_position = reader->position;
+            reader->buffer_size = count;
+            buffered = count;
+        }
+
+        size_t offset = reader->position - reader->buffer_position;
+        size_t count = ((int64_t)size < buffered) ? size : (size_t)buffered;
+        memcpy(itr, reader->buffer + offset, count);
+
+        itr += count;
+        size -= count;
+        reader->position += count;
+    }
+}
+
+static void skip_bytes(resource_reader* reader, int64_t size)
+{
+    if(size > reader->size - reader->position) reader->error = true;
+    else reader->position += size;
+}
+
+static uint32_t read_u32(resource_reader* reader)
+{
+    uint8_t bytes[4];
+    read_bytes(reader, bytes, 4);
+
+    if(reader->big_endian) return (uint32_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+    return (uint32_t)bytes[3] << 24 | bytes[2] << 16 | bytes[1] << 8 | bytes[0];
+}
+
+static uint64_t read_u64(resource_reader* reader)
+{
+    uint64_t low = read_u32(reader);
+    uint64_t high = read_u32(reader);
+
+    // 64-bit values are stored as two 32-bit halves, low half first
+    return reader->big_endian ? (low << 32 | high) : (high << 32 | low);
+}
+
+static float read_f32(resource_reader* reader)
+{
+    uint32_t bits = read_u32(reader);
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+static double read_f64(resource_reader* reader)
+{
+    uint64_t bits = read_u64(reader);
+    double value;
+    memcpy(&value, &bits, 8);
+    return value;
+}
+
+static double read_real(resource_reader* reader)
+{
+    return reader->real64 ? read_f64(reader) : read_f32(reader);
+}
+
+// Reads a length-prefixed string, the length includes the null terminator
+static char* read_string(resource_reader* reader)
+{
+    uint32_t length = read_u32(reader);
+    if(reader->error || length > MAX_STRING_SIZE || length > reader->size - reader->position)
+    {
+        reader->error = true;
+        return NULL;
+    }
+
+    char* str = malloc(length + 1);
+    if(str == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    read_bytes(reader, str, length);
+    str[length] = '\0';
+
+    return str;
+}
+
+// Reads an index in the string table, or an inline string if the high bit is set
+static const char* read_string_reference(binary_resource* res, resource_reader* reader, char** owned)
+{
+    *owned = NULL;
+
+    uint32_t id = read_u32(reader);
+    if(reader->error) return NULL;
+
+    if(id & 0x80000000)
+    {
+        uint32_t length = id & 0x7FFFFFFF;
+        if(length > MAX_STRING_SIZE || length > reader->size - reader->position)
+        {
+            reader->error = true;
+            return NULL;
+        }
+
+        *owned = malloc(length + 1);
+        if(*owned == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        read_bytes(reader, *owned, length);
+        (*owned)[length] = '\0';
+        return *owned;
+    }
+
+    if(id >= res->string_count)
+    {
+        reader->error = true;
+        return NULL;
+    }
+
+    return res->strings[id];
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef TOOL_GDPC_BINARY_RESOURCE_H
+#define TOOL_GDPC_BINARY_RESOURCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum
+{
+    BINARY_RESOURCE_OK = 0,
+    BINARY_RESOURCE_INVALID = 1,
+    BINARY_RESOURCE_UNSUPPORTED = 2,
+    BINARY_RESOURCE_WRITE_FAILED = 3
+};
+
+int convert_binary_resource(FILE* pack, int64_t offset, int64_t size, const char* dest);
+
+#endif
\ No newline at end of file
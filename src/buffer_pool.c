@@ -0,0 +1,197 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "buffer_pool.h"
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BUFFER_HEADER_SIZE 16 // Size of the buffer, kept before it so the returned buffer stays aligned
+#define MAX_CACHED_BLOCKS 64 // Released blocks kept for the next copies, instead of going back to the system
+
+typedef struct
+{
+    int64_t limit;
+    int64_t acquired; // Bytes held by the threads
+    int64_t cached; // Bytes of the released blocks kept for reuse
+    int64_t peak;
+
+    void* blocks[MAX_CACHED_BLOCKS];
+    int block_count;
+
+    int64_t acquire_count;
+    int64_t wait_count;
+    int64_t wait_time; // Nanoseconds, summed over the threads
+
+    pthread_mutex_t mutex;
+    pthread_cond_t released;
+    pthread_key_t held; // Number of buffers the thread holds
+} buffer_pool;
+
+static buffer_pool pool = { 0, 0, 0, 0, { NULL }, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void create_held_key();
+static void add_held(intptr_t count);
+static void drop_cached_blocks();
+
+void buffer_pool_init(int64_t limit)
+{
+    pthread_once(&pool_once, create_held_key);
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.limit = limit;
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+void buffer_pool_free()
+{
+    pthread_mutex_lock(&pool.mutex);
+    drop_cached_blocks();
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+// Returns a buffer of size bytes, waiting until the pool has room for it
+void* buffer_pool_acquire(int64_t size)
+{
+    pthread_once(&pool_once, create_held_key);
+    bool nested = (intptr_t)pthread_getspecific(pool.held) > 0;
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.acquire_count++;
+
+    // Copies reuse the blocks released by the previous ones
+    char* buffer = NULL;
+    if(size == BUFFER_BLOCK_SIZE && pool.block_count > 0)
+    {
+        buffer = pool.blocks[--pool.block_count];
+        pool.cached -= BUFFER_BLOCK_SIZE;
+    }
+    else if(pool.limit != 0 && nested == false)
+    {
+        int64_t wait_start = -1;
+        while(pool.acquired + pool.cached + size > pool.limit && pool.acquired > 0)
+        {
+            // Idle blocks make room first
+            if(pool.cached > 0)
+            {
+                drop_cached_blocks();
+                continue;
+            }
+
+            if(wait_start < 0)
+            {
+                wait_start = get_monotonic_time();
+                pool.wait_count++;
+            }
+            pthread_cond_wait(&pool.released, &pool.mutex);
+        }
+
+        if(wait_start >= 0) pool.wait_time += get_monotonic_time() - wait_start;
+
+        // A buffer larger than the limit is only given once the pool is empty
+        if(pool.acquired == 0 && pool.cached > 0) drop_cached_blocks();
+    }
+
+    pool.acquired += size;
+    if(pool.acquired > pool.peak) pool.peak = pool.acquired;
+    pthread_mutex_unlock(&pool.mutex);
+
+    if(buffer == NULL)
+    {
+        buffer = malloc(BUFFER_HEADER_SIZE + size);
+        if(buffer == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+        *(int64_t*)buffer = size;
+    }
+
+    add_held(1);
+
+    return buffer + BUFFER_HEADER_SIZE;
+}
+
+void buffer_pool_release(void* buffer)
+{
+    if(buffer == NULL) return;
+
+    char* block = (char*)buffer - BUFFER_HEADER_SIZE;
+    int64_t size = *(int64_t*)block;
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.acquired -= size;
+
+    // Keep the block for the next copy if it fits in the limit
+    bool cache = size == BUFFER_BLOCK_SIZE && pool.block_count < MAX_CACHED_BLOCKS &&
+                 (pool.limit == 0 || pool.acquired + pool.cached + size <= pool.limit);
+    if(cache == true)
+    {
+        pool.blocks[pool.block_count++] = block;
+        pool.cached += BUFFER_BLOCK_SIZE;
+    }
+
+    pthread_cond_broadcast(&pool.released);
+    pthread_mutex_unlock(&pool.mutex);
+
+    if(cache == false) free(block);
+
+    add_held(-1);
+}
+
+void print_buffer_pool_stats(FILE* output)
+{
+    pthread_mutex_lock(&pool.mutex);
+
+    fprintf(output, "Peak RSS: %ldB\n", get_peak_memory_usage());
+    if(pool.limit != 0)
+    {
+        fprintf(output, "Buffer pool peak: %ldB of %ldB\n", pool.peak, pool.limit);
+    }
+    else
+    {
+        fprintf(output, "Buffer pool peak: %ldB\n", pool.peak);
+    }
+    fprintf(output, "Buffer pool waits: %ld of %ld buffers, %.3fs\n", pool.wait_count, pool.acquire_count, pool.wait_time / 1e9);
+
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+static void create_held_key()
+{
+    pthread_key_create(&pool.held, NULL);
+}
+
+static void add_held(intptr_t count)
+{
+    intptr_t held = (intptr_t)pthread_getspecific(pool.held);
+    pthread_setspecific(pool.held, (void*)(held + count));
+}
+
+// Must be called with the mutex held
+static void drop_cached_blocks()
+{
+    while(pool.block_count > 0)
+    {
+        free(pool.blocks[--pool.block_count]);
+    }
+    pool.cached = 0;
+}
+
+// Platform-dependant functions
+#ifdef __linux__
+#include <sys/resource.h>
+
+int64_t get_peak_memory_usage()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+    return (int64_t)usage.ru_maxrss * 1024;
+}
+#endif
\ No newline at end of file
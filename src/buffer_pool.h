@@ -0,0 +1,23 @@
+#ifndef TOOL_GDPC_BUFFER_POOL_H
+#define TOOL_GDPC_BUFFER_POOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define BUFFER_BLOCK_SIZE (1 << 20) // Size of the buffers data is streamed through, multiple of AES_BLOCK_SIZE
+
+/* Every buffer file data goes through comes from a single pool, shared by all the threads. With a limit, a thread
+ * asking for more memory than what's left waits for other threads to release theirs, so the memory used stays
+ * below the limit whatever the number of threads or the size of the files. A buffer larger than the limit waits
+ * for the pool to be empty. A thread already holding a buffer is never made to wait, it could be waiting on itself.
+*/
+void buffer_pool_init(int64_t limit); // 0 for no limit
+void buffer_pool_free();
+
+void* buffer_pool_acquire(int64_t size);
+void buffer_pool_release(void* buffer);
+
+void print_buffer_pool_stats(FILE* output);
+int64_t get_peak_memory_usage(); // Platform-dependant
+
+#endif
\ No newline at end of file
@@ -4,13 +4,18 @@
 #include <stdio.h>
 #include <string.h>
 #include "file_utils.h"
+#include "pack_crypto.h"
+#include "buffer_pool.h"
 
 static int parse_long_option(char* arg, config* cfg);
 static int parse_short_options(char* arg, config* cfg);
 static int parse_value(char* arg, config* cfg);
 static int parse_paths(char* arg, config* cfg);
 
-static int add_filter(dynamic_array* arr, char* arg);
+static int add_filter(filter_vector* arr, char* arg);
+static int read_key_file(const char* path, config* cfg);
+static int parse_size(const char* arg, int64_t* size);
+static void set_tar_file(const char* path, config* cfg);
 
 static void print_help_message();
 
@@ -19,21 +24,56 @@ bool parse_command_line_arguments(int argc, char** argv, config* cfg)
     // Default initialize the configuration
     cfg->verbose = false;
     cfg->convert = false;
+    cfg->pack_index = false;
+    cfg->encrypt = false;
+    cfg->has_encryption_key = false;
+    cfg->split_layers = false;
+    cfg->print_stats = false;
+    cfg->max_pack_size = 0;
+    cfg->memory_limit = 0;
+    cfg->list_reserve = 0;
     cfg->version_major = 0;
     cfg->version_minor = 0;
     cfg->version_revision = 0;
     cfg->operation_mode = OPERATION_MODE_UNSPECIFIED;
+    cfg->list_format = LIST_FORMAT_TEXT;
+    cfg->io_backend = IO_BACKEND_SYNC;
+    cfg->progress_format = PROGRESS_FORMAT_NONE;
+    cfg->durability = DURABILITY_COMMIT;
     cfg->destination = NULL;
+    cfg->batch_file = NULL;
+    cfg->socket_path = NULL;
+    cfg->grep_pattern = NULL;
+    cfg->tar_file = NULL;
+    cfg->output = stdout;
 
-    dynamic_array_init(&cfg->whitelist, sizeof(filter));
-    dynamic_array_init(&cfg->blacklist, sizeof(filter));
-    dynamic_array_init(&cfg->input_files, sizeof(char*));
+    filter_vector_init(&cfg->whitelist);
+    filter_vector_init(&cfg->blacklist);
+    string_vector_init(&cfg->input_files);
+    string_vector_reserve(&cfg->input_files, argc); // At most one input file per argument
 
     // For each argument, except the first one (the executable call)
     for(int i = 1; i < argc; ++i)
     {
-        // If the argument is a long option...
-        if(argv[i][0] == '-' && argv[i][1] == '-')
+        // If the argument is the batch option followed by the manifest...
+        if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            cfg->operation_mode = OPERATION_MODE_BATCH;
+            parse_paths(argv[++i], cfg);
+        }
+        // Else, if the argument is the serve option followed by the socket...
+        else if(strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            cfg->operation_mode = OPERATION_MODE_SERVE;
+            parse_paths(argv[++i], cfg);
+        }
+        // Else, if the argument is the tar option followed by the archive...
+        else if(strcmp(argv[i], "--from-tar") == 0 && i + 1 < argc)
+        {
+            set_tar_file(argv[++i], cfg);
+        }
+        // Else, if the argument is a long option...
+        else if(argv[i][0] == '-' && argv[i][1] == '-')
         {
             if(parse_long_option(argv[i], cfg) != 0) return 1;
         }
@@ -54,22 +94,87 @@ bool parse_command_line_arguments(int argc, char** argv, config* cfg)
         }
     }
 
+    // Take the key from the environment, like export templates built with encryption
+    const char* key = getenv("GODOT_SCRIPT_ENCRYPTION_KEY");
+    if(cfg->has_encryption_key == false && key != NULL && key[0] != '\0')
+    {
+        if(parse_encryption_key(key, cfg->encryption_key) == false)
+        {
+            printf("gdpc: Invalid encryption key in GODOT_SCRIPT_ENCRYPTION_KEY, it must be 64 hexadecimal digits.\n");
+            return 1;
+        }
+        cfg->has_encryption_key = true;
+    }
+
     // Error checking
+    if(cfg->operation_mode == OPERATION_MODE_BATCH || cfg->operation_mode == OPERATION_MODE_SERVE)
+    {
+        if(cfg->input_files.size != 1)
+        {
+            printf("gdpc: You must provide a single %s.\nTry 'gdpc --help' for more information.\n", (cfg->operation_mode == OPERATION_MODE_BATCH) ? "manifest in batch mode" : "socket path to serve");
+            return 1;
+        }
+
+        // Take the manifest or socket out of the list of input files
+        char* path = cfg->input_files.data[0];
+        string_vector_pop_back(&cfg->input_files);
+
+        if(cfg->operation_mode == OPERATION_MODE_BATCH) cfg->batch_file = path;
+        else cfg->socket_path = path;
+
+        return 0;
+    }
     if(cfg->operation_mode == OPERATION_MODE_UNSPECIFIED)
     {
         printf("gdpc: You must specify the operation mode.\nTry 'gdpc --help' for more information.\n");
         return 1;
     }
-    if(cfg->input_files.size < 1 && cfg->operation_mode == OPERATION_MODE_LIST)
+    if(cfg->input_files.size < 1 && (cfg->operation_mode == OPERATION_MODE_LIST || cfg->operation_mode == OPERATION_MODE_GREP || cfg->operation_mode == OPERATION_MODE_ANALYZE))
+    {
+        printf("gdpc: You must provide files to %s.\nTry 'gdpc --help' for more information.\n", (cfg->operation_mode == OPERATION_MODE_LIST) ? "list" : (cfg->operation_mode == OPERATION_MODE_GREP) ? "search" : "analyze");
+        return 1;
+    }
+    if(cfg->tar_file != NULL && (cfg->operation_mode != OPERATION_MODE_CREATE || cfg->input_files.size != 1))
+    {
+        printf("gdpc: --from-tar creates a single package, the destination must be the only other file.\nTry 'gdpc --help' for more information.\n");
+        return 1;
+    }
+    if(cfg->tar_file != NULL && cfg->max_pack_size != 0)
+    {
+        printf("gdpc: --max-pack-size can't split a package created from a tar stream.\nTry 'gdpc --help' for more information.\n");
+        return 1;
+    }
+    if(cfg->list_reserve != 0 && cfg->tar_file == NULL)
     {
-        printf("gdpc: You must provide files to list.\nTry 'gdpc --help' for more information.\n");
+        printf("gdpc: --list-reserve only applies when creating packages from a tar stream.\nTry 'gdpc --help' for more information.\n");
         return 1;
     }
-    if(cfg->input_files.size < 2 && cfg->operation_mode != OPERATION_MODE_LIST)
+    if(cfg->input_files.size < 2 && cfg->tar_file == NULL && cfg->operation_mode != OPERATION_MODE_LIST && cfg->operation_mode != OPERATION_MODE_GREP && cfg->operation_mode != OPERATION_MODE_ANALYZE &&
+       (cfg->operation_mode != OPERATION_MODE_UPDATE || cfg->input_files.size < 1))
     {
         printf("gdpc: You must provide file(s) to extract/package as well as a destination.\nTry 'gdpc --help' for more information.\n");
         return 1;
     }
+    if(cfg->encrypt == true && cfg->has_encryption_key == false)
+    {
+        printf("gdpc: You must provide an encryption key to encrypt a package.\nTry 'gdpc --help' for more information.\n");
+        return 1;
+    }
+    if(cfg->encrypt == true && cfg->operation_mode == OPERATION_MODE_CREATE && cfg->version_major != 0 && cfg->version_major < 4)
+    {
+        printf("gdpc: Encrypted packages need engine version 4 or later.\nTry 'gdpc --help' for more information.\n");
+        return 1;
+    }
+    if(cfg->max_pack_size != 0 && cfg->operation_mode != OPERATION_MODE_CREATE)
+    {
+        printf("gdpc: --max-pack-size only applies when creating packages.\nTry 'gdpc --help' for more information.\n");
+        return 1;
+    }
+    if(cfg->memory_limit != 0 && cfg->memory_limit < BUFFER_BLOCK_SIZE)
+    {
+        printf("gdpc: --mem-limit must be at least 1M.\nTry 'gdpc --help' for more information.\n");
+        return 1;
+    }
     if(cfg->operation_mode == OPERATION_MODE_CREATE && cfg->version_major == 0)
     {
         printf("gdpc: You must specify the engine version when creating packages.\nTry 'gdpc --help' for more information.\n");
@@ -79,8 +184,8 @@ bool parse_command_line_arguments(int argc, char** argv, config* cfg)
     // Set the last input file as the destination when creating or extracting packages
     if(cfg->operation_mode == OPERATION_MODE_CREATE || cfg->operation_mode == OPERATION_MODE_EXTRACT)
     {
-        cfg->destination = ((char**)cfg->input_files.data)[cfg->input_files.size - 1]; // Set last file as the destination
-        dynamic_array_pop_back(&cfg->input_files); // Remove it from the list of input files
+        cfg->destination = cfg->input_files.data[cfg->input_files.size - 1]; // Set last file as the destination
+        string_vector_pop_back(&cfg->input_files); // Remove it from the list of input files
 
         // If destination is not a folder, add '/'
         size_t len = strlen(cfg->destination);
@@ -100,7 +205,7 @@ bool parse_command_line_arguments(int argc, char** argv, config* cfg)
     // Set the last input file as the target pack when updating packages
     if(cfg->operation_mode == OPERATION_MODE_UPDATE)
     {
-        char* last_file = ((char**)cfg->input_files.data)[cfg->input_files.size - 1];
+        char* last_file = cfg->input_files.data[cfg->input_files.size - 1];
         size_t len = strlen(last_file) + 7; // Length of the last file + ".update"
         cfg->destination = calloc(len + 1, 1);
         if(cfg->destination == NULL)
@@ -114,9 +219,9 @@ bool parse_command_line_arguments(int argc, char** argv, config* cfg)
     }
 
     // Clean-up
-    dynamic_array_shrink(&cfg->whitelist);
-    dynamic_array_shrink(&cfg->blacklist);
-    dynamic_array_shrink(&cfg->input_files);
+    filter_vector_shrink(&cfg->whitelist);
+    filter_vector_shrink(&cfg->blacklist);
+    string_vector_shrink(&cfg->input_files);
 
     return 0;
 }
@@ -127,8 +232,57 @@ static int parse_long_option(char* arg, config* cfg)
     else if(strcmp(arg, "--extract") == 0) cfg->operation_mode = OPERATION_MODE_EXTRACT;
     else if(strcmp(arg, "--create") == 0) cfg->operation_mode = OPERATION_MODE_CREATE;
     else if(strcmp(arg, "--update") == 0) cfg->operation_mode = OPERATION_MODE_UPDATE;
+    else if(strcmp(arg, "--analyze") == 0) cfg->operation_mode = OPERATION_MODE_ANALYZE;
+
+    else if(strncmp(arg, "--batch=", 8) == 0)
+    {
+        cfg->operation_mode = OPERATION_MODE_BATCH;
+        parse_paths(arg + 8, cfg);
+    }
+    else if(strncmp(arg, "--grep=", 7) == 0)
+    {
+        cfg->operation_mode = OPERATION_MODE_GREP;
+
+        free(cfg->grep_pattern);
+        cfg->grep_pattern = malloc(strlen(arg + 7) + 1);
+        if(cfg->grep_pattern == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+        strcpy(cfg->grep_pattern, arg + 7);
+    }
+    else if(strncmp(arg, "--serve=", 8) == 0)
+    {
+        cfg->operation_mode = OPERATION_MODE_SERVE;
+        parse_paths(arg + 8, cfg);
+    }
+    else if(strncmp(arg, "--from-tar=", 11) == 0) set_tar_file(arg + 11, cfg);
+
+    else if(strcmp(arg, "--format=text") == 0) cfg->list_format = LIST_FORMAT_TEXT;
+    else if(strcmp(arg, "--format=json") == 0) cfg->list_format = LIST_FORMAT_JSON;
+    else if(strcmp(arg, "--format=csv") == 0) cfg->list_format = LIST_FORMAT_CSV;
+    else if(strcmp(arg, "--format=tsv") == 0) cfg->list_format = LIST_FORMAT_TSV;
+    else if(strcmp(arg, "--tree") == 0) cfg->list_format = LIST_FORMAT_TREE;
+    else if(strcmp(arg, "--du") == 0) cfg->list_format = LIST_FORMAT_DU;
+
+    else if(strcmp(arg, "--io=sync") == 0) cfg->io_backend = IO_BACKEND_SYNC;
+    else if(strcmp(arg, "--io=uring") == 0) cfg->io_backend = IO_BACKEND_URING;
 
     else if(strcmp(arg, "--convert") == 0) cfg->convert = true;
+    else if(strcmp(arg, "--index") == 0) cfg->pack_index = true;
+    else if(strcmp(arg, "--encrypt") == 0) cfg->encrypt = true;
+    else if(strncmp(arg, "--key-file=", 11) == 0) return read_key_file(arg + 11, cfg);
+    else if(strncmp(arg, "--max-pack-size=", 16) == 0) return parse_size(arg + 16, &cfg->max_pack_size);
+    else if(strncmp(arg, "--mem-limit=", 12) == 0) return parse_size(arg + 12, &cfg->memory_limit);
+    else if(strncmp(arg, "--list-reserve=", 15) == 0) return parse_size(arg + 15, &cfg->list_reserve);
+    else if(strcmp(arg, "--stats") == 0) cfg->print_stats = true;
+    else if(strcmp(arg, "--progress") == 0) cfg->progress_format = PROGRESS_FORMAT_LINE;
+    else if(strcmp(arg, "--progress=json") == 0) cfg->progress_format = PROGRESS_FORMAT_JSON;
+    else if(strcmp(arg, "--durability=none") == 0) cfg->durability = DURABILITY_NONE;
+    else if(strcmp(arg, "--durability=commit") == 0) cfg->durability = DURABILITY_COMMIT;
+    else if(strcmp(arg, "--durability=full") == 0) cfg->durability = DURABILITY_FULL;
+    else if(strcmp(arg, "--split-layers") == 0) cfg->split_layers = true;
     else if(strcmp(arg, "--verbose") == 0) cfg->verbose = true;
     else if(strcmp(arg, "--ignore-resources") == 0)
     {
@@ -203,7 +357,7 @@ static int parse_value(char* arg, config* cfg)
     return 0;
 }
 
-static int add_filter(dynamic_array* arr, char* arg)
+static int add_filter(filter_vector* arr, char* arg)
 {
     filter fil;
 
@@ -219,6 +373,13 @@ static int add_filter(dynamic_array* arr, char* arg)
     }
     strcpy(fil.data, arg + 3);
 
+    // "dir/**" selects the same files as "dir/*"
+    if(len >= 2 && strcmp(fil.data + len - 2, "**") == 0)
+    {
+        fil.data[--len] = '\0';
+        fil.end = fil.data + len + 1;
+    }
+
     // Find wildcard character
     fil.wildcard = NULL;
     for(char* itr = fil.data; *itr != '\0'; ++itr)
@@ -231,7 +392,7 @@ static int add_filter(dynamic_array* arr, char* arg)
     }
 
     // Push back
-    dynamic_array_push_back(arr, &fil);
+    filter_vector_push_back(arr, fil);
 
     return 0;
 }
@@ -243,11 +404,72 @@ static int parse_paths(char* arg, config* cfg)
     char* data = malloc(len + 1);
     strcpy(data, arg);
 
-    dynamic_array_push_back(&cfg->input_files, &data);
+    string_vector_push_back(&cfg->input_files, data);
 
     return 0;
 }
 
+static int read_key_file(const char* path, config* cfg)
+{
+    FILE* file = fopen(path, "r");
+    if(file == NULL)
+    {
+        printf("gdpc: Failed to open file \"%s\"\n", path);
+        return 1;
+    }
+
+    char key[128] = { 0 };
+    fread(key, 1, sizeof(key) - 1, file);
+    fclose(file);
+
+    if(parse_encryption_key(key, cfg->encryption_key) == false)
+    {
+        printf("gdpc: Invalid encryption key in \"%s\", it must be 64 hexadecimal digits.\n", path);
+        return 1;
+    }
+    cfg->has_encryption_key = true;
+
+    return 0;
+}
+
+// Takes a size in bytes, optionally followed by K, M, G or T
+static int parse_size(const char* arg, int64_t* size)
+{
+    char* end;
+    long long value = strtoll(arg, &end, 10);
+
+    int shift = 0;
+    switch(*end)
+    {
+        case 'K': case 'k': shift = 10; ++end; break;
+        case 'M': case 'm': shift = 20; ++end; break;
+        case 'G': case 'g': shift = 30; ++end; break;
+        case 'T': case 't': shift = 40; ++end; break;
+        default: break;
+    }
+
+    if(end == arg || *end != '\0' || value <= 0 || value > (INT64_MAX >> shift))
+    {
+        printf("gdpc: Invalid size '%s'\nTry 'gdpc --help' for more information.\n", arg);
+        return 1;
+    }
+    *size = (int64_t)value << shift;
+
+    return 0;
+}
+
+static void set_tar_file(const char* path, config* cfg)
+{
+    free(cfg->tar_file);
+    cfg->tar_file = malloc(strlen(path) + 1);
+    if(cfg->tar_file == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+    strcpy(cfg->tar_file, path);
+}
+
 static void print_help_message()
 {
     printf("usage: gdpc [-aceiluv] [--longoption ...] [[file ...] dest]\n");
@@ -257,7 +479,7 @@ static void print_help_message()
 void free_config(config* cfg)
 {
     // Free the heap allocated strings from the file list
-    char** files = (char**)cfg->input_files.data;
+    char** files = cfg->input_files.data;
     for(size_t i = 0; i < cfg->input_files.size; ++i) 
     {
         free(files[i]);
@@ -266,18 +488,22 @@ void free_config(config* cfg)
     // Free the heap allocated strings contained in the filters
     for(size_t i = 0; i < cfg->whitelist.size; ++i)
     {
-        filter* f = (filter*)&cfg->whitelist.data[i * sizeof(filter)];
+        filter* f = &cfg->whitelist.data[i];
         free(f->data);
     }
 
     for(size_t i = 0; i < cfg->blacklist.size; ++i)
     {
-        filter* f = (filter*)&cfg->blacklist.data[i * sizeof(filter)];
+        filter* f = &cfg->blacklist.data[i];
         free(f->data);
     }
 
-    dynamic_array_free(&cfg->input_files);
-    dynamic_array_free(&cfg->whitelist);
-    dynamic_array_free(&cfg->blacklist);
+    string_vector_free(&cfg->input_files);
+    filter_vector_free(&cfg->whitelist);
+    filter_vector_free(&cfg->blacklist);
     free(cfg->destination);
+    free(cfg->batch_file);
+    free(cfg->socket_path);
+    free(cfg->grep_pattern);
+    free(cfg->tar_file);
 }
\ No newline at end of file
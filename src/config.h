@@ -1,10 +1,11 @@
 #ifndef TOOL_GDPC_CONFIG_H
 #define TOOL_GDPC_CONFIG_H
 
-#include "dynamic_array.h"
+#include "vector.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 enum
 {
@@ -13,24 +14,89 @@ enum
     OPERATION_MODE_LIST = 2,
     OPERATION_MODE_EXTRACT = 3,
     OPERATION_MODE_CREATE = 4,
-    OPERATION_MODE_UPDATE = 5
+    OPERATION_MODE_UPDATE = 5,
+    OPERATION_MODE_BATCH = 6,
+    OPERATION_MODE_SERVE = 7,
+    OPERATION_MODE_GREP = 8,
+    OPERATION_MODE_ANALYZE = 9
+};
+
+enum
+{
+    LIST_FORMAT_TEXT = 0,
+    LIST_FORMAT_JSON = 1,
+    LIST_FORMAT_CSV = 2,
+    LIST_FORMAT_TSV = 3,
+    LIST_FORMAT_TREE = 4,
+    LIST_FORMAT_DU = 5
+};
+
+enum
+{
+    IO_BACKEND_SYNC = 0,
+    IO_BACKEND_URING = 1
+};
+
+enum
+{
+    DURABILITY_NONE = 0,
+    DURABILITY_COMMIT = 1,
+    DURABILITY_FULL = 2
+};
+
+enum
+{
+    PROGRESS_FORMAT_NONE = 0,
+    PROGRESS_FORMAT_LINE = 1,
+    PROGRESS_FORMAT_JSON = 2
 };
 
+typedef struct
+{
+    char* data;
+    char* wildcard;
+    char* end;
+} filter;
+
+DEFINE_VECTOR(filter_vector, filter)
+DEFINE_VECTOR(string_vector, char*)
+
 typedef struct
 {
     bool verbose;
     bool convert;
+    bool split_layers;
+    bool pack_index;
+    bool encrypt;
+    bool has_encryption_key;
+    bool print_stats;
 
     int32_t version_major;
     int32_t version_minor;
     int32_t version_revision;
 
+    int64_t max_pack_size; // Size budget of each package when splitting a created one, 0 if unlimited
+    int64_t memory_limit; // Size of the buffer pool, 0 if unlimited
+    int64_t list_reserve; // Space kept for the file list of a package created from a tar stream, 0 if it's measured
+
     int operation_mode;
+    int list_format;
+    int io_backend;
+    int progress_format;
+    int durability; // Syncs to disk when updating packages
 
-    dynamic_array whitelist;
-    dynamic_array blacklist;
-    dynamic_array input_files;
+    uint8_t encryption_key[32]; // AES-256 key of encrypted packages
+
+    filter_vector whitelist;
+    filter_vector blacklist;
+    string_vector input_files;
     char* destination;
+    char* batch_file;
+    char* socket_path;
+    char* grep_pattern; // Extended regular expression searched in the files
+    char* tar_file; // Archive to package when creating from a tar stream, "-" for the standard input
+
+    FILE* output;
 } config;
 
 bool parse_command_line_arguments(int argc, char** argv, config* cfg);
@@ -1,10 +1,17 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include "file_utils.h"
+#include "buffer_pool.h"
+#include "progress.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static bool filter_path(dynamic_array* filters, char* path, int len);
+static bool filter_path(filter_vector* filters, char* path, int len);
+static int compare_directory(const char* dir, int len, const char* str, int n);
 
 char* generate_path(const char* file, const char* dest, size_t dest_len)
 {
@@ -22,6 +29,19 @@ char* generate_path(const char* file, const char* dest, size_t dest_len)
     return path;
 }
 
+uint32_t hash_path(const char* path, int len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < len; ++i)
+    {
+        hash ^= (unsigned char)path[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
 bool is_whitelisted(char* file, int len, config* cfg) 
 { 
     if(cfg->whitelist.size == 0)
@@ -46,7 +66,79 @@ bool is_blacklisted(char* file, int len, config* cfg)
     }
 }
 
-static bool filter_path(dynamic_array* filters, char* path, int len)
+// Returns true if the filter selects a whole directory ("dir/*", or "*" for every file)
+bool is_directory_filter(filter* fil)
+{
+    if(fil->wildcard == NULL || fil->end - (fil->wildcard + 1) != 1)
+    {
+        return false;
+    }
+
+    return fil->wildcard == fil->data || fil->wildcard[-1] == '/';
+}
+
+bool is_directory_filtered(char* dir, int len, config* cfg)
+{
+    dir += 6; // Ignore "res://"
+    len -= 6;
+
+    // If a blacklist filter covers every path inside the directory (e.g. "dir/*"), skip it
+    for(size_t i = 0; i < cfg->blacklist.size; ++i)
+    {
+        filter* fil = &cfg->blacklist.data[i];
+        if(fil->wildcard == NULL || fil->end - (fil->wildcard + 1) != 1)
+        {
+            continue;
+        }
+
+        int prefix_len = fil->wildcard - fil->data;
+        if(prefix_len <= len + 1 && compare_directory(dir, len, fil->data, prefix_len) == 0)
+        {
+            return true;
+        }
+    }
+
+    if(cfg->whitelist.size == 0)
+    {
+        return false;
+    }
+
+    // If a whitelist filter could match a path inside the directory, keep it
+    for(size_t i = 0; i < cfg->whitelist.size; ++i)
+    {
+        filter* fil = &cfg->whitelist.data[i];
+        int prefix_len = (fil->wildcard != NULL) ? fil->wildcard - fil->data : (int)strlen(fil->data);
+
+        // Compare the common part of "dir/" and the filter's fixed prefix
+        int n = (prefix_len < len + 1) ? prefix_len : len + 1;
+        if(fil->wildcard == NULL && prefix_len <= len + 1)
+        {
+            continue; // An exact path can't be inside the directory unless it's longer than it
+        }
+        if(compare_directory(dir, len, fil->data, n) == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Compares the first n characters of "dir/" with str
+static int compare_directory(const char* dir, int len, const char* str, int n)
+{
+    int common = (n < len) ? n : len;
+    int result = strncmp(dir, str, common);
+
+    if(result == 0 && n > len)
+    {
+        result = (str[len] == '/') ? 0 : 1;
+    }
+
+    return result;
+}
+
+static bool filter_path(filter_vector* filters, char* path, int len)
 {
     path += 6; // Ignore "res://"
     len -= 6 - 1;
@@ -54,7 +146,7 @@ static bool filter_path(dynamic_array* filters, char* path, int len)
     // For each filter 
     for(size_t i = 0; i < filters->size; ++i)
     {
-        filter* fil = (filter*)&filters->data[sizeof(filter) * i];
+        filter* fil = &filters->data[i];
 
         // If there is no wildcard character...
         if(fil->wildcard == NULL)
@@ -82,10 +174,10 @@ static bool filter_path(dynamic_array* filters, char* path, int len)
     return false;
 }
 
-int extract_file(const char* dest, FILE* source, int length)
+int extract_file(const char* dest, FILE* source, int64_t length)
 {
     // Open/create extracted file
-    FILE* file = fopen(dest, "w");
+    FILE* file = fopen(dest, "wb");
     if(file == NULL)
     {
         fprintf(stderr, "fopen(): failed to open \"%s\"\n", dest);
@@ -93,23 +185,51 @@ int extract_file(const char* dest, FILE* source, int length)
     }
 
     // Copy the contents of the archive to the extracted file
-    int character;
-    for(int i = 0; i < length; ++i)
+    int error = (copy_data(file, source, length) == length) ? 0 : 1;
+
+    // Clean up
+    if(fclose(file) != 0) error = 1;
+
+    progress_add(0, 1);
+
+    return error;
+}
+
+int64_t copy_data(FILE* dest, FILE* source, int64_t length)
+{
+    char* buf = buffer_pool_acquire(BUFFER_BLOCK_SIZE);
+    int64_t copied = 0;
+
+    // Copy the data in chunks until the length is reached or the source runs out
+    while(copied < length)
     {
-        character = fgetc(source);
-        fputc(character, file);
+        size_t chunk = (length - copied < BUFFER_BLOCK_SIZE) ? (size_t)(length - copied) : BUFFER_BLOCK_SIZE;
+        size_t read = fread(buf, 1, chunk, source);
+        if(read == 0)
+        {
+            break;
+        }
+
+        fwrite(buf, 1, read, dest);
+        progress_add(read, 0);
+        copied += read;
     }
 
-    // Clean up
-    fclose(file);
+    buffer_pool_release(buf);
 
-    return 0;
+    return copied;
 }
 
 // Platform-dependant functions
 #ifdef __linux__
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 static void create_dir(char* path)
 {
@@ -134,11 +254,282 @@ void create_path(char* path)
     }
 }
 
-bool is_regular_file(char* path)
+bool stat_regular_file(char* path, int64_t* size)
+{
+    struct stat s;
+    if(stat(path, &s) != 0 || !S_ISREG(s.st_mode))
+    {
+        return false;
+    }
+
+    *size = s.st_size;
+    return true;
+}
+
+bool is_directory(char* path)
+{
+    struct stat s;
+    return stat(path, &s) == 0 && S_ISDIR(s.st_mode);
+}
+
+bool get_file_identity(const char* path, file_identity* id)
+{
+    struct stat s;
+    if(stat(path, &s) != 0)
+    {
+        return false;
+    }
+
+    id->size = s.st_size;
+    id->mtime_sec = s.st_mtim.tv_sec;
+    id->mtime_nsec = s.st_mtim.tv_nsec;
+    id->inode = s.st_ino;
+    id->device = s.st_dev;
+
+    return true;
+}
+
+char* resolve_path(const char* path)
+{
+    // Get the absolute path, or a copy of the path if it doesn't exist
+    char* resolved = realpath(path, NULL);
+    if(resolved == NULL)
+    {
+        resolved = malloc(strlen(path) + 1);
+        if(resolved == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+        strcpy(resolved, path);
+    }
+
+    return resolved;
+}
+
+void preallocate_file(FILE* file, int64_t size)
+{
+    // Reserve the whole file in one extent. Failure is harmless, the file will simply grow as it is written
+    fflush(file);
+    posix_fallocate(fileno(file), 0, size);
+}
+
+void advise_file_range(FILE* file, int64_t offset, int64_t length, bool needed)
+{
+    // Hints only, the kernel is free to ignore them
+    if(length > 0) posix_fadvise(fileno(file), offset, length, needed ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+}
+
+void advise_mapped_range(const char* data, int64_t offset, int64_t length)
+{
+    // madvise() takes whole pages
+    long page_size = sysconf(_SC_PAGESIZE);
+    int64_t begin = offset / page_size * page_size;
+    if(length > 0) madvise((void*)(data + begin), offset + length - begin, MADV_WILLNEED);
+}
+
+int write_buffers(FILE* file, io_buffer* buffers, int count)
+{
+    // Flush pending writes so the stream and the descriptor agree on the position
+    fflush(file);
+    long position = ftell(file);
+
+    struct iovec iov[count];
+    for(int i = 0; i < count; ++i)
+    {
+        iov[i].iov_base = (void*)buffers[i].data;
+        iov[i].iov_len = buffers[i].size;
+        position += buffers[i].size;
+    }
+
+    // Write every buffer with as few system calls as possible
+    struct iovec* itr = iov;
+    int remaining = count;
+    while(remaining > 0)
+    {
+        ssize_t written = writev(fileno(file), itr, remaining);
+        if(written < 0)
+        {
+            if(errno == EINTR) continue;
+
+            fprintf(stderr, "writev(): failed to write to file.\n");
+            return 1;
+        }
+
+        // Skip over the buffers that were fully written
+        while(remaining > 0 && (size_t)written >= itr->iov_len)
+        {
+            written -= itr->iov_len;
+            ++itr;
+            --remaining;
+        }
+
+        if(remaining > 0)
+        {
+            itr->iov_base = (char*)itr->iov_base + written;
+            itr->iov_len -= written;
+        }
+    }
+
+    // Resynchronize the stream with the descriptor
+    fseek(file, position, SEEK_SET);
+
+    return 0;
+}
+
+int extract_range(const char* dest, FILE* source, int64_t offset, int64_t length)
+{
+    int fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0)
+    {
+        fprintf(stderr, "open(): failed to open \"%s\"\n", dest);
+        return 1;
+    }
+
+    // Let the kernel copy the range, the position of the source stream isn't affected
+    int source_fd = fileno(source);
+    loff_t position = offset;
+    int64_t remaining = length;
+
+    while(remaining > 0)
+    {
+        ssize_t copied = copy_file_range(source_fd, &position, fd, NULL, remaining, 0);
+        if(copied <= 0)
+        {
+            if(copied < 0 && errno == EINTR) continue;
+            break;
+        }
+        remaining -= copied;
+    }
+
+    // Fall back to reading and writing if the file systems don't support it
+    char* buf = (remaining > 0) ? buffer_pool_acquire(BUFFER_BLOCK_SIZE) : NULL;
+    while(remaining > 0)
+    {
+        size_t chunk = (remaining < BUFFER_BLOCK_SIZE) ? (size_t)remaining : BUFFER_BLOCK_SIZE;
+        ssize_t read = pread(source_fd, buf, chunk, position);
+        if(read <= 0 || write(fd, buf, read) != read)
+        {
+            break;
+        }
+
+        position += read;
+        remaining -= read;
+    }
+
+    buffer_pool_release(buf);
+    close(fd);
+
+    return (remaining == 0) ? 0 : 1;
+}
+
+// Waits until what was written to the file is on disk, with its metadata if asked (times, not only the size)
+int sync_file(FILE* file, bool metadata)
+{
+    if(fflush(file) != 0)
+    {
+        return 1;
+    }
+
+    int result;
+    do
+    {
+        result = (metadata == true) ? fsync(fileno(file)) : fdatasync(fileno(file));
+    } while(result != 0 && errno == EINTR);
+
+    return (result == 0) ? 0 : 1;
+}
+
+int truncate_file(FILE* file, int64_t size)
+{
+    if(fflush(file) != 0)
+    {
+        return 1;
+    }
+
+    return (ftruncate(fileno(file), size) == 0) ? 0 : 1;
+}
+
+// Reads a range of the file without moving its position, so threads can share the stream
+int read_range(FILE* source, int64_t offset, void* buffer, int64_t length)
+{
+    int fd = fileno(source);
+    char* itr = buffer;
+
+    while(length > 0)
+    {
+        ssize_t read = pread(fd, itr, length, offset);
+        if(read <= 0)
+        {
+            if(read < 0 && errno == EINTR) continue;
+            return 1;
+        }
+
+        itr += read;
+        offset += read;
+        length -= read;
+    }
+
+    return 0;
+}
+
+int64_t get_file_size(FILE* file)
+{
+    struct stat s;
+    return (fstat(fileno(file), &s) == 0) ? (int64_t)s.st_size : -1;
+}
+
+const char* map_file(const char* path, size_t* size)
 {
+    *size = 0;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+
     struct stat s;
-    stat(path, &s);
+    if(fstat(fd, &s) != 0 || s.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    void* data = mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    *size = s.st_size;
+    return (const char*)data;
+}
+
+void unmap_file(const char* data, size_t size)
+{
+    if(data != NULL) munmap((void*)data, size);
+}
+
+bool get_random_bytes(void* buffer, size_t length)
+{
+    char* itr = buffer;
+    while(length > 0)
+    {
+        ssize_t read = getrandom(itr, length, 0);
+        if(read <= 0)
+        {
+            if(read < 0 && errno == EINTR) continue;
+            return false;
+        }
+
+        itr += read;
+        length -= read;
+    }
 
-    return S_ISREG(s.st_mode);
+    return true;
 }
 #endif
\ No newline at end of file
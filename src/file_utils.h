@@ -5,13 +5,6 @@
 #include <stdint.h>
 #include "config.h"
 
-typedef struct
-{
-    char* data;
-    char* wildcard;
-    char* end;
-} filter;
-
 typedef struct
 {
     char* path;
@@ -19,14 +12,52 @@ typedef struct
     
     int64_t offset;
     int64_t size;
+    uint8_t md5[16];
+    bool encrypted;
 } gd_file;
 
+typedef struct
+{
+    const void* data;
+    size_t size;
+} io_buffer;
+
+typedef struct
+{
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t inode;
+    uint64_t device;
+} file_identity;
+
 char* generate_path(const char* file, const char* dest, size_t dest_len);
 bool is_whitelisted(char* file, int len, config* cfg);
 bool is_blacklisted(char* file, int len, config* cfg);
-bool is_regular_file(char* path); // Platform-dependant
+bool is_directory_filtered(char* dir, int len, config* cfg);
+bool is_directory_filter(filter* fil);
+uint32_t hash_path(const char* path, int len);
+bool stat_regular_file(char* path, int64_t* size); // Platform-dependant
+bool is_directory(char* path); // Platform-dependant
+bool get_file_identity(const char* path, file_identity* id); // Platform-dependant
+char* resolve_path(const char* path); // Platform-dependant
 
 void create_path(char* path); // Platform-dependant
-int extract_file(const char* dest, FILE* source, int length);
+int extract_file(const char* dest, FILE* source, int64_t length);
+int64_t copy_data(FILE* dest, FILE* source, int64_t length);
+int extract_range(const char* dest, FILE* source, int64_t offset, int64_t length); // Platform-dependant
+int read_range(FILE* source, int64_t offset, void* buffer, int64_t length); // Platform-dependant
+int64_t get_file_size(FILE* file); // Platform-dependant
+
+void preallocate_file(FILE* file, int64_t size); // Platform-dependant
+void advise_file_range(FILE* file, int64_t offset, int64_t length, bool needed); // Platform-dependant
+int write_buffers(FILE* file, io_buffer* buffers, int count); // Platform-dependant
+int sync_file(FILE* file, bool metadata); // Platform-dependant
+int truncate_file(FILE* file, int64_t size); // Platform-dependant
+
+const char* map_file(const char* path, size_t* size); // Platform-dependant
+void advise_mapped_range(const char* data, int64_t offset, int64_t length); // Platform-dependant
+void unmap_file(const char* data, size_t size); // Platform-dependant
+bool get_random_bytes(void* buffer, size_t length); // Platform-dependant
 
 #endif
\ No newline at end of file
@@ -0,0 +1,218 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "file_walker.h"
+#include "file_utils.h"
+#include "thread_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Platform-dependant functions
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define DIRECTORY_INLINE_FILES 32 // Files of a directory gathered without allocating
+
+DEFINE_SMALL_VECTOR(directory_files, walked_file, DIRECTORY_INLINE_FILES)
+
+typedef struct
+{
+    thread_pool pool;
+    config* cfg;
+
+    pthread_mutex_t mutex;
+    walked_file_vector* files;
+    int error;
+} walker;
+
+typedef struct
+{
+    walker* w;
+    char* path; // "res://" followed by the path of the directory
+    int len;
+} walker_task;
+
+static void walk(void* arg);
+static void queue_directory(walker* w, char* path, int len);
+static char* join_path(const char* dir, int dir_len, const char* name, int* len);
+static int compare_walked_files(const void* a, const void* b);
+
+int walk_directory(const char* root, walked_file_vector* files, config* cfg)
+{
+    walker w;
+    w.cfg = cfg;
+    w.files = files;
+    w.error = 0;
+    pthread_mutex_init(&w.mutex, NULL);
+
+    // Strip "./" and trailing separators so that the paths match the ones given on the command line
+    while(strncmp(root, "./", 2) == 0) root += 2;
+    int root_len = strlen(root);
+    while(root_len > 1 && root[root_len - 1] == '/') --root_len;
+    if(root_len == 1 && root[0] == '.') root_len = 0;
+
+    int len = 6 + root_len;
+    char* path = malloc(len + 1);
+    if(path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    memcpy(path, "res://", 6);
+    memcpy(path + 6, root, root_len);
+    path[len] = '\0';
+
+    size_t first = files->size;
+
+    // Walk the tree, each directory being a task
+    thread_pool_init(&w.pool, get_processor_count());
+    queue_directory(&w, path, len);
+    thread_pool_wait(&w.pool);
+    thread_pool_free(&w.pool);
+
+    pthread_mutex_destroy(&w.mutex);
+
+    // Directories are walked in any order, sort the files to keep packages reproducible
+    qsort(&files->data[first], files->size - first, sizeof(walked_file), compare_walked_files);
+
+    return w.error;
+}
+
+static void queue_directory(walker* w, char* path, int len)
+{
+    walker_task* t = malloc(sizeof(walker_task));
+    if(t == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    t->w = w;
+    t->path = path;
+    t->len = len;
+
+    thread_pool_submit(&w->pool, walk, t);
+}
+
+static void walk(void* arg)
+{
+    walker_task* t = (walker_task*)arg;
+    walker* w = t->w;
+
+    // Open the directory ("res://" alone being the current directory)
+    const char* dir_path = (t->len > 6) ? t->path + 6 : ".";
+    DIR* dir = opendir(dir_path);
+    if(dir == NULL)
+    {
+        printf("gdpc: Failed to open directory \"%s\"\n", dir_path);
+
+        pthread_mutex_lock(&w->mutex);
+        w->error = 1;
+        pthread_mutex_unlock(&w->mutex);
+
+        free(t->path);
+        free(t);
+        return;
+    }
+
+    // Gather the files locally to keep the lock out of the loop
+    directory_files found;
+    directory_files_init(&found);
+
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        const char* name = entry->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+
+        int len;
+        char* path = join_path(t->path, t->len, name, &len);
+
+        // Directories are known from the entry type, everything else is stat'd relative to the directory
+        bool directory = (entry->d_type == DT_DIR);
+        struct stat s;
+        if(entry->d_type == DT_UNKNOWN && fstatat(dirfd(dir), name, &s, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            directory = S_ISDIR(s.st_mode);
+        }
+
+        if(directory == false)
+        {
+            if(fstatat(dirfd(dir), name, &s, 0) != 0 || !S_ISREG(s.st_mode))
+            {
+                // Don't follow symbolic links to directories to avoid cycles
+                free(path);
+                continue;
+            }
+        }
+
+        if(directory == true)
+        {
+            if(is_directory_filtered(path, len, w->cfg) == true)
+            {
+                free(path);
+                continue;
+            }
+
+            queue_directory(w, path, len);
+        }
+        else if(is_whitelisted(path, len, w->cfg) && !is_blacklisted(path, len, w->cfg))
+        {
+            walked_file file = { path, len, s.st_size };
+            directory_files_push_back(&found, file);
+        }
+        else
+        {
+            free(path);
+        }
+    }
+
+    closedir(dir);
+
+    // Store the files
+    pthread_mutex_lock(&w->mutex);
+    walked_file_vector_append(w->files, found.data, found.size);
+    pthread_mutex_unlock(&w->mutex);
+
+    // Clean-up
+    directory_files_free(&found);
+    free(t->path);
+    free(t);
+}
+
+static char* join_path(const char* dir, int dir_len, const char* name, int* len)
+{
+    int name_len = strlen(name);
+    bool separator = (dir_len > 6); // No separator right after "res://"
+
+    *len = dir_len + separator + name_len;
+    char* path = malloc(*len + 1);
+    if(path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    memcpy(path, dir, dir_len);
+    if(separator == true) path[dir_len] = '/';
+    memcpy(path + dir_len + separator, name, name_len + 1);
+
+    return path;
+}
+
+static int compare_walked_files(const void* a, const void* b)
+{
+    return strcmp(((walked_file*)a)->path, ((walked_file*)b)->path);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef TOOL_GDPC_FILE_WALKER_H
+#define TOOL_GDPC_FILE_WALKER_H
+
+#include "config.h"
+#include <stdint.h>
+
+typedef struct
+{
+    char* path; // "res://" followed by the path of the file on disk
+    int32_t len;
+    int64_t size;
+} walked_file;
+
+DEFINE_VECTOR(walked_file_vector, walked_file)
+
+int walk_directory(const char* root, walked_file_vector* files, config* cfg); // Platform-dependant
+
+#endif
\ No newline at end of file
@@ -1,9 +1,29 @@
 #include "gd_resources.h"
+#include "binary_resource.h"
 #include "file_utils.h"
+#include "image_decoder.h"
+#include "png_encoder.h"
+#include "pack_crypto.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#define IMPORT_MAX_SIZE (1 << 24)
+
+#define STEX_FORMAT_BIT_LOSSLESS (1 << 20)
+#define STEX_FORMAT_BIT_LOSSY (1 << 21)
+#define STEX_FORMAT_MASK_IMAGE_FORMAT ((1 << 20) - 1)
+
+#define PARALLEL_DECODE_PIXELS (1 << 20) // Images this large are decoded and encoded on a thread pool
+
+#define TEXTURE_FLAG_MIPMAPS 1
+#define TEXTURE_LAYERED_COMPRESSION_LOSSLESS 0
+#define TEXTURE_LAYERED_MAX_SIZE 16384
 
 enum 
 {
@@ -17,10 +37,28 @@ enum
     GD_RESOURCE_TYPE_TEXTURE_ATLAS = 6
 };
 
-static gd_file* get_mapped_file(gd_file* file_list, int file_count, FILE* pack);
-static int get_resource_type(FILE* pack);
+typedef struct
+{
+    char* importer;
+    char* type;
+    char* path; // "path", or the first "path.<format>" if the resource has one file per format
+    char* source_file;
+    int slices_horizontal; // Grid the layers of a texture array/3D texture were sliced from, 0 if unknown
+    int slices_vertical;
+} import_info;
+
+static char* read_import(gd_file* file_info, FILE* pack);
+static void parse_import(char* data, size_t size, import_info* info);
+static int get_resource_type(const char* type);
 
-static char* get_string(const char* item, FILE* pack);
+static int convert_stream_texture(gd_file* resource, FILE* pack, char* path, config* cfg);
+static int convert_raw_texture(gd_file* resource, FILE* pack, char* path, int format, int width, int height, config* cfg);
+static int convert_image(gd_file* resource, FILE* pack, char* path, config* cfg);
+static int convert_texture_layered(gd_file* resource, FILE* pack, char* path, import_info* info, config* cfg);
+static int extract_lossless_layers(gd_file* resource, FILE* pack, char* path, int depth, config* cfg);
+static char* get_layer_path(const char* path, int layer, const char* extension);
+static char* replace_extension(char* path, const char* extension);
+static char* get_text_resource_path(const char* path, const char* destination);
 
 bool is_import(const char* path)
 {
@@ -34,117 +72,923 @@ bool is_pck(const char* path)
     return (strncmp(path - 4, ".pck", 4) == 0) ? true : false;
 }
 
-int convert_resource(gd_file* file_info, gd_file* file_list, int file_count, FILE* pack, config* cfg)
+bool is_binary_resource(const char* path)
 {
+    size_t len = strlen(path);
+    return (len >= 4 && (strcmp(path + len - 4, ".res") == 0 || strcmp(path + len - 4, ".scn") == 0)) ? true : false;
+}
+
+int convert_resource(gd_file* file_info, gd_pack* pack, FILE* file, config* cfg)
+{
+    // Resources are converted straight from the package, encrypted ones are only extracted
+    if(file_info->encrypted == true)
+    {
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Ignoring \"%s\" (encrypted)\n", file_info->path);
+        }
+        return 1;
+    }
+
+    // Read and parse the .import file
+    char* data = read_import(file_info, file);
+    if(data == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to read \"%s\"\n", file_info->path);
+        return 1;
+    }
+
+    import_info info;
+    parse_import(data, file_info->size, &info);
+
     // Get mapped file
-    fseek(pack, file_info->offset, SEEK_SET);
-    gd_file* mapped_file = get_mapped_file(file_list, file_count, pack);
+    gd_file mapped;
+    gd_file* mapped_file = (info.path != NULL && find_file(pack, info.path, &mapped) == true) ? &mapped : NULL;
+    if(mapped_file == NULL || mapped_file->encrypted == true)
+    {
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Ignoring \"%s\" (%s)\n", file_info->path, (mapped_file == NULL) ? "no resource found" : "encrypted");
+        }
+
+        free(data);
+        return 1;
+    }
 
     if(cfg->verbose == true)
     {
-        printf("Converting \"%s\" (%ldB)\n", mapped_file->path, mapped_file->size);
+        fprintf(cfg->output, "Converting \"%s\" (%ldB)\n", mapped_file->path, mapped_file->size);
     }
 
     // Get resource type
-    fseek(pack, file_info->offset, SEEK_SET);
-    int resource_type = get_resource_type(pack);
+    int resource_type = (info.type != NULL) ? get_resource_type(info.type) : GD_RESOURCE_TYPE_UNKNOWN;
 
     // Create path to the extracted file
-    file_info->path[strlen(file_info->path) - 7] = '\0'; // remove ".import"
     char* path = generate_path(file_info->path, cfg->destination, strlen(cfg->destination));
+    path[strlen(path) - 7] = '\0'; // remove ".import"
     create_path(path);
 
     // Extract file
-    (void)resource_type;
-    (void)mapped_file;
+    int error = 0;
+    if(resource_type == GD_RESOURCE_TYPE_TEXTURE)
+    {
+        error = convert_stream_texture(mapped_file, file, path, cfg);
+    }
+    else if(resource_type == GD_RESOURCE_TYPE_IMAGE)
+    {
+        error = convert_image(mapped_file, file, path, cfg);
+    }
+    else if(resource_type == GD_RESOURCE_TYPE_TEXTURE_ARRAY || resource_type == GD_RESOURCE_TYPE_TEXTURE3D)
+    {
+        error = convert_texture_layered(mapped_file, file, path, &info, cfg);
+    }
+    else if(cfg->verbose == true)
+    {
+        fprintf(cfg->output, "Ignoring \"%s\" (unsupported resource type)\n", mapped_file->path);
+    }
 
     // Clean-up
-    file_info->path[strlen(file_info->path)] = '.';
     free(path);
+    free(data);
 
-    return 0;
+    return error;
 }
 
-static gd_file* get_mapped_file(gd_file* file_list, int file_count, FILE* pack)
+// Returns the path of the resource the .import file maps to, NULL if it has none or can't be read
+char* get_mapped_path(gd_file* file_info, FILE* file, config* cfg)
 {
-    // Get the path
-    char* path = get_string("path", pack);
+    int64_t size = file_info->size;
+    char* data = NULL;
+    if(file_info->encrypted == false)
+    {
+        data = read_import(file_info, file);
+    }
+    else if(cfg->has_encryption_key == true && file_info->size <= IMPORT_MAX_SIZE)
+    {
+        data = read_encrypted_data(file, file_info->offset, cfg->encryption_key, &size);
+    }
+
+    if(data == NULL)
+    {
+        return NULL;
+    }
+
+    import_info info;
+    parse_import(data, size, &info);
 
-    // Find the file in the file list
-    gd_file* file = NULL;
-    for(int i = 0; i < file_count; ++i)
+    char* path = NULL;
+    if(info.path != NULL)
     {
-        if(strcmp(path, file_list[i].path) == 0)
+        size_t len = strlen(info.path);
+        path = malloc(len + 1);
+        if(path == NULL)
         {
-            file = &file_list[i];
-            break;
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
         }
+        memcpy(path, info.path, len + 1);
     }
 
-    free(path);
+    // Encrypted files are decrypted in a buffer of the pool
+    if(file_info->encrypted == true) buffer_pool_release(data);
+    else free(data);
 
-    return file;
+    return path;
 }
 
-static int get_resource_type(FILE* pack)
+// Reads the whole .import file in a single call
+static char* read_import(gd_file* file_info, FILE* pack)
 {
-    // Get type
-    char* str = get_string("type", pack);
-    int resource_type = GD_RESOURCE_TYPE_UNKNOWN;
+    if(file_info->size < 0 || file_info->size > IMPORT_MAX_SIZE)
+    {
+        return NULL;
+    }
 
-    if(strcmp(str, "StreamTexture") == 0) resource_type = GD_RESOURCE_TYPE_TEXTURE;
-    else if(strcmp(str, "Image") == 0)    resource_type = GD_RESOURCE_TYPE_IMAGE;
-    else if(strcmp(str, "Texture") == 0)  resource_type = GD_RESOURCE_TYPE_TEXTURE_ATLAS;
+    char* data = malloc(file_info->size + 1);
+    if(data == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
 
-    free(str);
-    return resource_type;
+    fseek(pack, file_info->offset, SEEK_SET);
+    if(fread(data, 1, file_info->size, pack) != (size_t)file_info->size)
+    {
+        free(data);
+        return NULL;
+    }
+    data[file_info->size] = '\0';
+
+    return data;
 }
 
-static char* get_string(const char* item, FILE* pack)
+/* .import file
+ * [remap]
+ * importer="texture"
+ * type="StreamTexture"
+ * path="res://.import/icon.png-<md5>.stex"
+ *
+ * [deps]
+ * source_file="res://icon.png"
+ * ...
+ *
+ * [params]
+ * slices/horizontal=8 (texture arrays and 3D textures)
+ * ...
+ *
+ * Parses the file in place in a single pass, terminating each value where its closing quote was.
+ * Other keys are ignored.
+*/
+static void parse_import(char* data, size_t size, import_info* info)
 {
-    size_t len = 0;
-    size_t item_length = strlen(item);
-    char* buf = malloc(item_length);
-    char c = '\0';
+    info->importer = NULL;
+    info->type = NULL;
+    info->path = NULL;
+    info->source_file = NULL;
+    info->slices_horizontal = 0;
+    info->slices_vertical = 0;
 
-    // Find the line that starts with the item
-    while(1)
+    char* itr = data;
+    char* end = data + size;
+    bool remap = false;
+    bool deps = false;
+    bool params = false;
+
+    while(itr < end)
     {
-        // Check if the line starts with the item
-        fread(buf, 1, item_length, pack);
-        if(strncmp(buf, item, item_length) == 0) break;
+        // Find the end of the line
+        char* line_end = memchr(itr, '\n', end - itr);
+        if(line_end == NULL) line_end = end;
+
+        char* line = itr;
+        itr = line_end + 1;
+
+        // Section header
+        if(*line == '[')
+        {
+            remap = (line_end - line >= 7 && strncmp(line, "[remap]", 7) == 0);
+            deps = (line_end - line >= 6 && strncmp(line, "[deps]", 6) == 0);
+            params = (line_end - line >= 8 && strncmp(line, "[params]", 8) == 0);
+            continue;
+        }
+        if(params == true)
+        {
+            // Integer values, strtol stops at the end of the line
+            if(line_end - line > 18 && strncmp(line, "slices/horizontal=", 18) == 0)
+            {
+                info->slices_horizontal = (int)strtol(line + 18, NULL, 10);
+            }
+            else if(line_end - line > 16 && strncmp(line, "slices/vertical=", 16) == 0)
+            {
+                info->slices_vertical = (int)strtol(line + 16, NULL, 10);
+            }
+            continue;
+        }
+        if(remap == false && deps == false)
+        {
+            continue;
+        }
+
+        // Split "key="value"" on the first '=', the value must be a string
+        char* equal = memchr(line, '=', line_end - line);
+        if(equal == NULL || equal + 1 >= line_end || equal[1] != '"')
+        {
+            continue;
+        }
+
+        char* value = equal + 2;
+        char* quote = memchr(value, '"', line_end - value);
+        if(quote == NULL)
+        {
+            continue;
+        }
+
+        size_t key_len = equal - line;
+        char** field = NULL;
+
+        if(remap == true)
+        {
+            if(key_len == 8 && strncmp(line, "importer", 8) == 0) field = &info->importer;
+            else if(key_len == 4 && strncmp(line, "type", 4) == 0) field = &info->type;
+            else if(key_len == 4 && strncmp(line, "path", 4) == 0) field = &info->path;
+            else if(key_len > 5 && strncmp(line, "path.", 5) == 0 && info->path == NULL) field = &info->path;
+        }
+        else if(key_len == 11 && strncmp(line, "source_file", 11) == 0)
+        {
+            field = &info->source_file;
+        }
 
-        // Else, ignore that line
-        fseek(pack, -item_length, SEEK_CUR); // Reset cursor to the start of the line
-        do
+        if(field != NULL)
         {
-            fread(&c, 1, 1, pack);
-        } while (c != '\n');   
+            *quote = '\0';
+            *field = value;
+        }
     }
+}
+
+/* Stream texture (.stex) header
+ * 1 x 4B  | String | Magic Number (GDST)
+ * 2 x 2B  | Int    | Width, custom width
+ * 2 x 2B  | Int    | Height, custom height
+ * 1 x 4B  | Int    | Flags
+ * 1 x 4B  | Int    | Format (image format | lossless bit | lossy bit | ...)
+ *
+ * Lossless/lossy textures are followed by the mipmaps, each one packed as an image file
+ * 1 x 4B  | Int    | Number of mipmaps
+ * 1 x 4B  | Int    | Size of the mipmap
+ * 1 x 4B  | String | Image type ("PNG " or "WEBP")
+ *         | Void   | Image file
+ *
+ * Other textures are followed by the pixel data of every mipmap, in the image format
+*/
+static int convert_stream_texture(gd_file* resource, FILE* pack, char* path, config* cfg)
+{
+    unsigned char header[32];
 
-    // Get the length of the path
-    fseek(pack, 2, SEEK_CUR); // Skip ="
-    while(c != '"')
+    fseek(pack, resource->offset, SEEK_SET);
+    if(resource->size < 32 || fread(header, 1, 32, pack) != 32 || strncmp((char*)header, "GDST", 4) != 0)
     {
-        fread(&c, 1, 1, pack);
-        ++len;
+        fprintf(cfg->output, "gdpc: File is not a stream texture \"%s\"\n", resource->path);
+        return 1;
     }
 
-    // Store the path
-    fseek(pack, -len, SEEK_CUR); // Set cursor back to the start of the path
+    uint32_t format, mipmaps, size;
+    memcpy(&format, header + 16, 4);
+    memcpy(&mipmaps, header + 20, 4);
+    memcpy(&size, header + 24, 4);
 
-    char* str = malloc(len);
-    if(str == NULL)
+    // Textures that don't embed an image file are decoded and encoded as PNG
+    if((format & (STEX_FORMAT_BIT_LOSSLESS | STEX_FORMAT_BIT_LOSSY)) == 0)
+    {
+        int width = header[4] | header[5] << 8;
+        int height = header[8] | header[9] << 8;
+        return convert_raw_texture(resource, pack, path, format & STEX_FORMAT_MASK_IMAGE_FORMAT, width, height, cfg);
+    }
+
+    const char* extension;
+    if(strncmp((char*)header + 28, "PNG ", 4) == 0) extension = ".png";
+    else if(strncmp((char*)header + 28, "WEBP", 4) == 0) extension = ".webp";
+    else extension = NULL;
+
+    if(mipmaps < 1 || size < 4 || extension == NULL || 28 + (int64_t)size > resource->size)
+    {
+        fprintf(cfg->output, "gdpc: Invalid stream texture \"%s\"\n", resource->path);
+        return 1;
+    }
+
+    // The first mipmap is the original image, copy it without the image type
+    char* dest = replace_extension(path, extension);
+    int error = extract_range(dest, pack, resource->offset + 32, size - 4);
+
+    if(error != 0)
+    {
+        fprintf(cfg->output, "gdpc: Failed to write \"%s\"\n", dest);
+    }
+
+    if(dest != path) free(dest);
+
+    return error;
+}
+
+static int convert_raw_texture(gd_file* resource, FILE* pack, char* path, int format, int width, int height, config* cfg)
+{
+    if(is_image_format_supported(format) == false)
+    {
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Ignoring \"%s\" (unsupported image format %d)\n", resource->path, format);
+        }
+        return 1;
+    }
+
+    int64_t size = get_image_data_size(format, width, height, false);
+    if(size < 0 || 20 + size > resource->size)
+    {
+        fprintf(cfg->output, "gdpc: Invalid stream texture \"%s\"\n", resource->path);
+        return 1;
+    }
+
+    // Read the first mipmap, the compressed and decoded images are taken from the pool at once
+    uint8_t* rgba = buffer_pool_acquire((int64_t)width * height * 4 + size);
+    uint8_t* data = rgba + (size_t)width * height * 4;
+
+    fseek(pack, resource->offset + 20, SEEK_SET);
+    if(fread(data, 1, size, pack) != (size_t)size)
+    {
+        fprintf(cfg->output, "gdpc: Failed to read \"%s\"\n", resource->path);
+        buffer_pool_release(rgba);
+        return 1;
+    }
+
+    // Decode and encode large images in parallel
+    thread_pool pool;
+    thread_pool* workers = NULL;
+    if((int64_t)width * height >= PARALLEL_DECODE_PIXELS)
+    {
+        thread_pool_init(&pool, get_processor_count());
+        workers = &pool;
+    }
+
+    decode_image(data, format, width, height, rgba, workers);
+
+    char* dest = replace_extension(path, ".png");
+    int error = write_png(dest, rgba, width, height, workers);
+
+    if(error != 0)
+    {
+        fprintf(cfg->output, "gdpc: Failed to write \"%s\"\n", dest);
+    }
+
+    if(workers != NULL) thread_pool_free(workers);
+    if(dest != path) free(dest);
+    buffer_pool_release(rgba);
+
+    return error;
+}
+
+/* Image (.image) file
+ * 1 x 4B  | String | Magic Number (GDIM)
+ * 1 x 4B  | Int    | Length of the extension
+ *         | String | Extension of the original file
+ *         | Void   | Original file
+*/
+static int convert_image(gd_file* resource, FILE* pack, char* path, config* cfg)
+{
+    unsigned char header[8];
+
+    fseek(pack, resource->offset, SEEK_SET);
+    if(resource->size < 8 || fread(header, 1, 8, pack) != 8 || strncmp((char*)header, "GDIM", 4) != 0)
+    {
+        fprintf(cfg->output, "gdpc: File is not an image \"%s\"\n", resource->path);
+        return 1;
+    }
+
+    uint32_t length;
+    memcpy(&length, header + 4, 4);
+
+    char extension[17] = ".";
+    if(length < 1 || length > 15 || 8 + (int64_t)length > resource->size || fread(extension + 1, 1, length, pack) != length)
+    {
+        fprintf(cfg->output, "gdpc: Invalid image \"%s\"\n", resource->path);
+        return 1;
+    }
+    extension[length + 1] = '\0';
+
+    // The original file follows the header
+    char* dest = replace_extension(path, extension);
+    int error = extract_range(dest, pack, resource->offset + 8 + length, resource->size - 8 - length);
+
+    if(error != 0)
+    {
+        fprintf(cfg->output, "gdpc: Failed to write \"%s\"\n", dest);
+    }
+
+    if(dest != path) free(dest);
+
+    return error;
+}
+
+/* Layered texture (.texarr/.tex3d) header
+ * 1 x 4B  | String | Magic Number (GDAT for texture arrays, GD3T for 3D textures)
+ * 3 x 4B  | Int    | Width, height, depth (number of layers)
+ * 1 x 4B  | Int    | Flags
+ * 1 x 4B  | Int    | Image format
+ * 1 x 4B  | Int    | Compression (0: lossless, 1: VRAM, 2: uncompressed)
+ *
+ * Followed by each layer. Lossless layers are a list of mipmaps, each one packed as an image file:
+ * 1 x 4B  | Int    | Number of mipmaps
+ * 1 x 4B  | Int    | Size of the mipmap
+ * 1 x 4B  | String | Image type ("PNG " or "WEBP")
+ *         | Void   | Image file
+ *
+ * Other layers hold the pixel data of every mipmap, in the image format.
+*/
+typedef struct
+{
+    FILE* pack;
+    int64_t offset; // Offset of the layer's first mipmap
+    int format;
+    int width;
+    int height;
+
+    uint8_t* rgba; // Where to copy the decoded layer, NULL to write it to its own file
+    size_t stride;
+    char* dest;
+    uint8_t* scratch; // Room to read and decode the layer in, NULL to take it from the pool
+
+    int error;
+} layer_task;
+
+// Layers decoded one after the other by the same thread, in the scratch it owns
+typedef struct
+{
+    layer_task* layers;
+    uint32_t first;
+    uint32_t end;
+    uint32_t step;
+    uint8_t* scratch;
+} layer_lane;
+
+static void convert_layer(void* arg)
+{
+    layer_task* task = arg;
+    int64_t size = get_image_data_size(task->format, task->width, task->height, false);
+    size_t row_size = (size_t)task->width * 4;
+
+    uint8_t* rgba = (task->scratch != NULL) ? task->scratch : buffer_pool_acquire((int64_t)row_size * task->height + size);
+    uint8_t* data = rgba + row_size * task->height;
+
+    task->error = read_range(task->pack, task->offset, data, size);
+    if(task->error == 0)
+    {
+        decode_image(data, task->format, task->width, task->height, rgba, NULL);
+
+        if(task->rgba != NULL)
+        {
+            for(int y = 0; y < task->height; ++y) memcpy(task->rgba + y * task->stride, rgba + y * row_size, row_size);
+        }
+        else
+        {
+            task->error = write_png(task->dest, rgba, task->width, task->height, NULL);
+        }
+    }
+
+    if(task->scratch == NULL) buffer_pool_release(rgba);
+}
+
+static void convert_layers(void* arg)
+{
+    layer_lane* lane = arg;
+    for(uint32_t i = lane->first; i < lane->end; i += lane->step)
+    {
+        lane->layers[i].scratch = lane->scratch;
+        convert_layer(&lane->layers[i]);
+    }
+}
+
+/* Layers are decoded in parallel, each task holding a single layer. They are written either as one image per
+ * layer, or as the grid the texture was sliced from, a few rows of layers at a time.
+*/
+static int convert_texture_layered(gd_file* resource, FILE* pack, char* path, import_info* info, config* cfg)
+{
+    unsigned char header[28];
+
+    fseek(pack, resource->offset, SEEK_SET);
+    if(resource->size < 28 || fread(header, 1, 28, pack) != 28 ||
+       (strncmp((char*)header, "GDAT", 4) != 0 && strncmp((char*)header, "GD3T", 4) != 0))
+    {
+        fprintf(cfg->output, "gdpc: File is not a layered texture \"%s\"\n", resource->path);
+        return 1;
+    }
+
+    uint32_t width, height, depth, flags, format, compression;
+    memcpy(&width, header + 4, 4);
+    memcpy(&height, header + 8, 4);
+    memcpy(&depth, header + 12, 4);
+    memcpy(&flags, header + 16, 4);
+    memcpy(&format, header + 20, 4);
+    memcpy(&compression, header + 24, 4);
+
+    if(width < 1 || height < 1 || depth < 1 ||
+       width > TEXTURE_LAYERED_MAX_SIZE || height > TEXTURE_LAYERED_MAX_SIZE || depth > TEXTURE_LAYERED_MAX_SIZE)
+    {
+        fprintf(cfg->output, "gdpc: Invalid layered texture \"%s\"\n", resource->path);
+        return 1;
+    }
+
+    // Layers packed as image files are copied as-is
+    if(compression == TEXTURE_LAYERED_COMPRESSION_LOSSLESS)
+    {
+        return extract_lossless_layers(resource, pack, path, depth, cfg);
+    }
+
+    if(is_image_format_supported(format) == false)
+    {
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Ignoring \"%s\" (unsupported image format %u)\n", resource->path, format);
+        }
+        return 1;
+    }
+
+    int64_t layer_size = get_image_data_size(format, width, height, (flags & TEXTURE_FLAG_MIPMAPS) != 0);
+    if(28 + layer_size * depth > resource->size)
+    {
+        fprintf(cfg->output, "gdpc: Invalid layered texture \"%s\"\n", resource->path);
+        return 1;
+    }
+
+    // Rebuild the original grid if the layers fit in it, otherwise stack them
+    int columns = info->slices_horizontal;
+    int rows = info->slices_vertical;
+    if(columns < 1 || rows < 1 || (int64_t)columns * rows < depth || (int64_t)columns * width > TEXTURE_LAYERED_MAX_SIZE)
+    {
+        columns = 1;
+        rows = depth;
+    }
+
+    thread_pool pool;
+    thread_pool_init(&pool, get_processor_count());
+
+    layer_task* tasks = malloc(depth * sizeof(layer_task));
+    if(tasks == NULL)
     {
         fprintf(stderr, "malloc(): failed to allocate memory.\n");
         abort();
     }
 
-    fread(str, 1, len - 1, pack);
-    str[len - 1] = '\0';
+    for(uint32_t i = 0; i < depth; ++i)
+    {
+        tasks[i].pack = pack;
+        tasks[i].offset = resource->offset + 28 + layer_size * i;
+        tasks[i].format = format;
+        tasks[i].width = width;
+        tasks[i].height = height;
+        tasks[i].rgba = NULL;
+        tasks[i].stride = 0;
+        tasks[i].dest = NULL;
+        tasks[i].scratch = NULL;
+        tasks[i].error = 0;
+    }
 
-    // Clean-up
-    free(buf);
+    int error = 0;
+
+    if(cfg->split_layers == true)
+    {
+        // One image per layer, the pool only runs as many layers as it has threads
+        for(uint32_t i = 0; i < depth; ++i)
+        {
+            tasks[i].dest = get_layer_path(path, i, ".png");
+            thread_pool_submit(&pool, convert_layer, &tasks[i]);
+        }
+        thread_pool_wait(&pool);
+
+        for(uint32_t i = 0; i < depth; ++i)
+        {
+            if(tasks[i].error != 0)
+            {
+                fprintf(cfg->output, "gdpc: Failed to write \"%s\"\n", tasks[i].dest);
+                error = 1;
+            }
+            free(tasks[i].dest);
+        }
+    }
+    else
+    {
+        // A single image, decoded a few rows of layers at a time, enough to keep every thread busy
+        char* dest = replace_extension(path, ".png");
+        size_t stride = (size_t)columns * width * 4;
+        int batch = (pool.thread_count > columns) ? pool.thread_count / columns : 1;
+
+        // The strip and the room each thread decodes its layers in are taken from the pool at once, the threads
+        // don't wait on the pool while the strip is held
+        size_t scratch_size = (size_t)width * height * 4 + get_image_data_size(format, width, height, false);
+        uint8_t* strip = buffer_pool_acquire((int64_t)(stride * height * batch + scratch_size * pool.thread_count));
+        layer_lane* lanes = malloc(pool.thread_count * sizeof(layer_lane));
+        if(lanes == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        png_writer writer;
+        error = png_writer_open(&writer, dest, columns * width, rows * height);
+
+        for(int first = 0; first < rows && error == 0; first += batch)
+        {
+            int count = (rows - first < batch) ? rows - first : batch;
+            memset(strip, 0, stride * height * count);
+
+            uint32_t first_layer = first * columns;
+            uint32_t end_layer = ((uint32_t)(first + count) * columns < depth) ? (uint32_t)(first + count) * columns : depth;
+            for(uint32_t layer = first_layer; layer < end_layer; ++layer)
+            {
+                int row = layer / columns - first;
+                int column = layer % columns;
+
+                tasks[layer].rgba = strip + stride * height * row + (size_t)column * width * 4;
+                tasks[layer].stride = stride;
+            }
+
+            for(int i = 0; i < pool.thread_count && first_layer + i < end_layer; ++i)
+            {
+                lanes[i] = (layer_lane){ tasks, first_layer + i, end_layer, pool.thread_count, strip + stride * height * batch + scratch_size * i };
+                thread_pool_submit(&pool, convert_layers, &lanes[i]);
+            }
+            thread_pool_wait(&pool);
+
+            for(uint32_t layer = first * columns; layer < (uint32_t)(first + count) * columns && layer < depth; ++layer)
+            {
+                if(tasks[layer].error != 0) error = 1;
+            }
+
+            if(error == 0) png_writer_write_rows(&writer, strip, height * count, &pool);
+        }
+
+        if(writer.file != NULL && png_writer_close(&writer) != 0) error = 1;
+
+        if(error != 0)
+        {
+            fprintf(cfg->output, "gdpc: Failed to write \"%s\"\n", dest);
+        }
+
+        buffer_pool_release(strip);
+        free(lanes);
+        if(dest != path) free(dest);
+    }
+
+    free(tasks);
+    thread_pool_free(&pool);
+
+    return error;
+}
+
+// Copies the first mipmap of each layer, they can't be merged without decoding them
+static int extract_lossless_layers(gd_file* resource, FILE* pack, char* path, int depth, config* cfg)
+{
+    int64_t offset = resource->offset + 28;
+    int64_t end = resource->offset + resource->size;
+    int error = 0;
+
+    for(int i = 0; i < depth; ++i)
+    {
+        unsigned char layer_header[12];
+        if(offset + 12 > end || read_range(pack, offset, layer_header, 12) != 0)
+        {
+            fprintf(cfg->output, "gdpc: Invalid layered texture \"%s\"\n", resource->path);
+            return 1;
+        }
+
+        uint32_t mipmaps, size;
+        memcpy(&mipmaps, layer_header, 4);
+        memcpy(&size, layer_header + 4, 4);
+
+        const char* extension;
+        if(strncmp((char*)layer_header + 8, "PNG ", 4) == 0) extension = ".png";
+        else if(strncmp((char*)layer_header + 8, "WEBP", 4) == 0) extension = ".webp";
+        else extension = NULL;
+
+        if(mipmaps < 1 || size < 4 || extension == NULL || offset + 8 + (int64_t)size > end)
+        {
+            fprintf(cfg->output, "gdpc: Invalid layered texture \"%s\"\n", resource->path);
+            return 1;
+        }
+
+        char* dest = get_layer_path(path, i, extension);
+        if(extract_range(dest, pack, offset + 12, size - 4) != 0)
+        {
+            fprintf(cfg->output, "gdpc: Failed to write \"%s\"\n", dest);
+            error = 1;
+        }
+        free(dest);
+
+        // Skip the remaining mipmaps
+        offset += 8 + size;
+        for(uint32_t j = 1; j < mipmaps; ++j)
+        {
+            if(offset + 4 > end || read_range(pack, offset, &size, 4) != 0)
+            {
+                fprintf(cfg->output, "gdpc: Invalid layered texture \"%s\"\n", resource->path);
+                return 1;
+            }
+            offset += 4 + size;
+        }
+    }
+
+    return error;
+}
+
+typedef struct
+{
+    gd_file resource; // Its path is a copy, the pack's paths are decoded in a single buffer
+    FILE* pack;
+    char* dest;
+    int error;
+} binary_resource_task;
+
+static void convert_binary_resource_task(void* arg)
+{
+    binary_resource_task* task = arg;
+
+    create_path(task->dest);
+    task->error = convert_binary_resource(task->pack, task->resource.offset, task->resource.size, task->dest);
+}
+
+int convert_binary_resources(gd_pack* pack, FILE* file, config* cfg)
+{
+    // Collect the binary resources to convert
+    int count = 0;
+    binary_resource_task* tasks = malloc((pack->file_count + 1) * sizeof(binary_resource_task));
+    if(tasks == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    path_cursor cursor;
+    path_cursor_init(&cursor, pack);
+
+    int32_t selected_count;
+    int32_t* selected = select_files(pack, cfg, &selected_count);
+
+    gd_file file_entry;
+    for(int32_t i = 0; i < selected_count; ++i)
+    {
+        get_file(pack, &cursor, selected[i], &file_entry);
+        gd_file* file_info = &file_entry;
+        if(is_binary_resource(file_info->path) == false || is_blacklisted(file_info->path, file_info->len, cfg) == true ||
+           file_info->encrypted == true)
+        {
+            continue;
+        }
+
+        binary_resource_task* task = &tasks[count++];
+        task->resource = *file_info;
+        task->resource.path = malloc(file_info->len + 1);
+        if(task->resource.path == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+        memcpy(task->resource.path, file_info->path, file_info->len + 1);
+
+        task->pack = file;
+        task->dest = get_text_resource_path(file_info->path, cfg->destination);
+        task->error = BINARY_RESOURCE_OK;
+    }
+
+    path_cursor_free(&cursor);
+    free(selected);
+
+    // One resource per task, each one streams its text resource to disk
+    if(count > 0)
+    {
+        thread_pool pool;
+        thread_pool_init(&pool, (count < get_processor_count()) ? count : get_processor_count());
+
+        for(int i = 0; i < count; ++i) thread_pool_submit(&pool, convert_binary_resource_task, &tasks[i]);
+
+        thread_pool_wait(&pool);
+        thread_pool_free(&pool);
+    }
+
+    // Print the results in the order of the pack
+    int error = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        binary_resource_task* task = &tasks[i];
+
+        if(task->error == BINARY_RESOURCE_OK && cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Converting \"%s\" (%ldB)\n", task->resource.path, task->resource.size);
+        }
+        else if(task->error == BINARY_RESOURCE_UNSUPPORTED && cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Ignoring \"%s\" (unsupported resource format)\n", task->resource.path);
+        }
+        else if(task->error == BINARY_RESOURCE_INVALID)
+        {
+            fprintf(cfg->output, "gdpc: Invalid resource \"%s\"\n", task->resource.path);
+        }
+        else if(task->error == BINARY_RESOURCE_WRITE_FAILED)
+        {
+            fprintf(cfg->output, "gdpc: Failed to write \"%s\"\n", task->dest);
+        }
+
+        // Don't leave partial text resources behind
+        if(task->error == BINARY_RESOURCE_INVALID || task->error == BINARY_RESOURCE_WRITE_FAILED) remove(task->dest);
+        if(task->error != BINARY_RESOURCE_OK && task->error != BINARY_RESOURCE_UNSUPPORTED) error = 1;
+
+        free(task->resource.path);
+        free(task->dest);
+    }
+
+    free(tasks);
+
+    return error;
+}
+
+// "x.tscn.converted.scn" -> "x.tscn", "x.res" -> "x.tres", "x.scn" -> "x.tscn"
+static char* get_text_resource_path(const char* path, const char* destination)
+{
+    char* dest = generate_path(path, destination, strlen(destination));
+    size_t len = strlen(dest);
+
+    const char* converted = ".converted.";
+    size_t converted_len = strlen(converted);
+    if(len > converted_len + 3 && strncmp(dest + len - 3 - converted_len, converted, converted_len) == 0)
+    {
+        dest[len - 3 - converted_len] = '\0';
+        return dest;
+    }
+
+    char* text_path = malloc(len + 2);
+    if(text_path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    memcpy(text_path, dest, len - 3);
+    strcpy(text_path + len - 3, (strcmp(dest + len - 3, "res") == 0) ? "tres" : "tscn");
+    free(dest);
+
+    return text_path;
+}
+
+// "dir/name.png" -> "dir/name_<layer><extension>"
+static char* get_layer_path(const char* path, int layer, const char* extension)
+{
+    size_t len = strlen(path);
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    if(dot != NULL && (slash == NULL || dot > slash)) len = dot - path;
+
+    char* layer_path = malloc(len + strlen(extension) + 16);
+    if(layer_path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    sprintf(layer_path, "%.*s_%d%s", (int)len, path, layer, extension);
 
-    return str;
+    return layer_path;
+}
+
+// Returns the path if it already has the extension, or a new path with the extension appended
+static char* replace_extension(char* path, const char* extension)
+{
+    size_t len = strlen(path);
+    size_t extension_len = strlen(extension);
+
+    if(len >= extension_len && strcasecmp(path + len - extension_len, extension) == 0)
+    {
+        return path;
+    }
+
+    char* new_path = malloc(len + extension_len + 1);
+    if(new_path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    memcpy(new_path, path, len);
+    memcpy(new_path + len, extension, extension_len + 1);
+
+    return new_path;
+}
+
+static int get_resource_type(const char* type)
+{
+    int resource_type = GD_RESOURCE_TYPE_UNKNOWN;
+
+    if(strcmp(type, "StreamTexture") == 0) resource_type = GD_RESOURCE_TYPE_TEXTURE;
+    else if(strcmp(type, "Image") == 0)    resource_type = GD_RESOURCE_TYPE_IMAGE;
+    else if(strcmp(type, "Texture") == 0)  resource_type = GD_RESOURCE_TYPE_TEXTURE_ATLAS;
+    else if(strcmp(type, "TextureArray") == 0) resource_type = GD_RESOURCE_TYPE_TEXTURE_ARRAY;
+    else if(strcmp(type, "Texture3D") == 0) resource_type = GD_RESOURCE_TYPE_TEXTURE3D;
+
+    return resource_type;
 }
\ No newline at end of file
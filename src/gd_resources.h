@@ -3,11 +3,16 @@
 
 #include "config.h"
 #include "file_utils.h"
+#include "gdpc.h"
 #include <stdio.h>
 
 bool is_import(const char* path);
 bool is_pck(const char* path);
+bool is_binary_resource(const char* path);
 
-int convert_resource(gd_file* file_info, gd_file* file_list, int file_count, FILE* pack, config* cfg);
+char* get_mapped_path(gd_file* file_info, FILE* file, config* cfg);
+
+int convert_resource(gd_file* file_info, gd_pack* pack, FILE* file, config* cfg);
+int convert_binary_resources(gd_pack* pack, FILE* file, config* cfg);
 
 #endif
\ No newline at end of file
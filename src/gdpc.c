@@ -1,360 +1,3116 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include "gdpc.h"
 #include "gd_resources.h"
+#include "async_extract.h"
 #include "file_utils.h"
+#include "file_walker.h"
+#include "path_tree.h"
+#include "pack_index.h"
+#include "pack_crypto.h"
+#include "md5.h"
+#include "pack_search.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
+#include "progress.h"
+#include "tar_reader.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
-static int read_pack(const char* path, config* cfg);
-static int read_file_list(FILE* pack, gd_file* file_list, int file_count, config* cfg);
-static int read_files(FILE* pack, gd_file* file_list, int file_count, config* cfg);
+#define EXTRACT_WINDOW_SIZE (32 << 20) // Range of the pack read ahead, and dropped from the cache once extracted
+#define PACK_READ_THREADS 8 // Least number of packages read at once, reading them is mostly waiting on their disks
+#define JOURNAL_FOOTER_SIZE 36 // Size of the footer of the update journal
+#define TAR_LIST_RESERVE (1 << 20) // Space kept for the file list when packaging a tar stream whose size can't be measured first
+
+// Listings of several packages, printed in the order of the inputs as they're done
+typedef struct
+{
+    pthread_mutex_t mutex;
+    struct pack_job* jobs;
+    size_t count;
+    size_t next; // First package not printed yet, listed straight to the output if it wasn't already started
+    FILE* output;
+} listing_order;
+
+// Package read on its own thread when reading several, its output kept until the packages before it are printed
+typedef struct pack_job
+{
+    const char* path;
+    gd_pack pack;
+    bool loaded;
+
+    config cfg; // Copy of the configuration, writing to the output of the job
+    char* output;
+    size_t output_size;
+    int error;
+
+    listing_order* order;
+    size_t index;
+    bool listed;
+} pack_job;
+
+// File to package, read from its source file and stored under its name
+typedef struct
+{
+    gd_file source;
+    char* name;
+    int32_t name_len;
+} pack_entry;
+
+DEFINE_VECTOR(pack_entry_vector, pack_entry)
+DEFINE_VECTOR(hash_vector, uint32_t)
+DEFINE_VECTOR(size_vector, int64_t)
+
+typedef struct
+{
+    int32_t* slots; // Index of the path in the list of entries + 1, 0 if the slot is empty
+    size_t capacity;
+    size_t size;
+    hash_vector hashes; // Hash of each path in the list of entries, so growing the table doesn't hash them again
+} path_index;
+
+// File being assigned to a shard
+typedef struct
+{
+    const char* name;
+    size_t index;
+    int64_t cost; // Space it takes in a package, with its item in the file list
+    bool large;
+} shard_item;
+
+// Files packaged together, a run of the sorted files
+typedef struct
+{
+    size_t first;
+    size_t count;
+    int64_t cost;
+    int32_t shard;
+} shard_group;
+
+DEFINE_VECTOR(shard_group_vector, shard_group)
 
-static void write_file_list(FILE* pack, dynamic_array* files, dynamic_array* files_names, dynamic_array* files_names_lengths, config* cfg);
-static void write_file_list_item(FILE* pack, dynamic_array* files, dynamic_array* files_names, dynamic_array* files_names_lengths, char* path, int32_t path_len, char* file_path, int32_t file_path_len, int64_t offset, int64_t size);
-static void write_files(FILE* pack, dynamic_array* files, dynamic_array* files_names, dynamic_array* files_names_lengths, int64_t* list_offset, int64_t* file_offset, config* cfg);
+// Package written from part of the files when splitting
+typedef struct
+{
+    char* path;
+    const char* header;
+    int64_t header_size;
+    int32_t format_version;
+
+    pack_entry_vector files;
+
+    config* cfg;
+    int error;
+} pack_shard;
+
+static int read_header(FILE* file, const char* path, gd_pack* pack, config* cfg);
+static int read_file_list(FILE* pack, file_table* files, int file_count, int32_t format_version, int64_t file_base);
+static FILE* open_file_list(FILE* file, const char* path, gd_pack* pack, char** buffer, config* cfg);
+static void append_path(file_table* files, size_t* capacity, int32_t index, const char* path, int len, const char* previous, int previous_len);
+static void decode_path(gd_pack* pack, path_cursor* cursor);
+static int32_t find_file_index(gd_pack* pack, const char* path, gd_file* file);
+static int list_pack(const char* path, config* cfg);
+static bool is_streamed_listing(config* cfg);
+static int read_packs_concurrently(config* cfg);
+static void load_job(void* arg);
+static void process_job(void* arg);
+static void list_in_order(pack_job* job);
+static int32_t* select_whitelisted_files(gd_pack* pack, config* cfg, int32_t* count);
+static int32_t remove_overlaid_files(gd_pack* pack, int32_t* selected, int32_t count);
+
+static void print_pack_name(gd_pack* pack, config* cfg);
+static bool uses_path_tree(config* cfg);
+static void list_directories(gd_pack* pack, config* cfg);
+static int write_directory_path(path_tree* tree, int32_t node, char* path);
+static void print_directory(gd_pack* pack, int32_t node, char* path, int len, int indent, config* cfg);
+static void print_file(const char* pack_path, const char* path, int len, int64_t offset, int64_t size, const uint8_t* md5, config* cfg);
+static void print_field(const char* str, int len, config* cfg);
+static int read_files(FILE* file, gd_pack* pack, config* cfg);
+
+static int write_pack(const char* path, const char* base_header, int64_t header_size, int32_t format_version, pack_entry_vector* files, config* cfg);
+static int write_tar_pack(const char* base_header, int64_t header_size, int32_t format_version, config* cfg);
+static int64_t measure_tar_list(tar_reader* tar, int32_t format_version, config* cfg);
+static char* get_tar_name(const char* path, int32_t* len);
+static int move_data(FILE* file, int64_t offset, int64_t length, int64_t distance);
+static int write_shards(const char* header, int64_t header_size, int32_t format_version, pack_entry_vector* files, config* cfg);
+static void write_shard(void* arg);
+static int32_t partition_files(pack_entry_vector* files, int64_t header_size, int32_t format_version, config* cfg, int32_t* shard_of);
+static int compare_shard_items(const void* a, const void* b);
+static int compare_shard_groups(const void* a, const void* b);
+static bool is_same_directory(const char* a, const char* b);
+static char* get_shard_path(const char* destination, int32_t shard);
+static int write_shard_manifest(pack_shard* shards, int32_t shard_count, config* cfg);
+static int update_pack(const char* path, config* cfg);
+static int recover_update(FILE* pack, const char* path, config* cfg);
+static bool is_update_interrupted(FILE* pack);
+static char* read_update_journal(FILE* pack, int64_t size, int64_t* journal_offset, int64_t* front_size);
+static void write_file_list(pack_entry_vector* files, path_index* index, char** inputs, size_t input_count, config* cfg);
+static void write_file_list_item(pack_entry_vector* files, path_index* index, char* path, int32_t path_len, char* file_path, int32_t file_path_len, int64_t offset, int64_t size, bool encrypted);
+static int32_t insert_path(path_index* index, pack_entry_vector* files, char* path);
+static char* build_file_list(pack_entry_vector* files, int64_t list_offset, int32_t format_version, config* cfg, int64_t* list_size, int64_t* files_offset, int64_t* pack_size);
+static char* write_list_item(char* itr, pack_entry* entry, int64_t offset, bool encrypted, int32_t format_version);
+static int64_t get_list_item_size(int32_t path_len, int32_t format_version);
+static bool is_stored_encrypted(gd_file* file, int32_t format_version, config* cfg);
+static void write_files(FILE* pack, pack_entry_vector* files, int64_t list_offset, int64_t file_offset, int32_t format_version, config* cfg);
+static int64_t copy_file_data(FILE* pack, FILE* file, gd_file* gdf, bool encrypted, config* cfg);
 
 int read_packs(config* cfg)
 {
     int error = 0;
 
+    // Listing and searching only go through the output, give it a large buffer
+    if(cfg->operation_mode == OPERATION_MODE_LIST || cfg->operation_mode == OPERATION_MODE_GREP)
+    {
+        setvbuf(cfg->output, NULL, _IOFBF, 1 << 20);
+        print_list_header(cfg);
+    }
+
+    // Packages are read at once, each one on its own thread
+    if(cfg->input_files.size > 1)
+    {
+        return read_packs_concurrently(cfg);
+    }
+
     // For each pack in the inputs...
     for(size_t i = 0; i < cfg->input_files.size; ++i)
     {
         // Read the pack
-        char* file = ((char**)cfg->input_files.data)[i];
-        if(read_pack(file, cfg) != 0)
+        char* file = cfg->input_files.data[i];
+
+        // Stream the file list when listing, it doesn't need to be kept in memory unless its directories are
+        if(is_streamed_listing(cfg) == true)
+        {
+            if(list_pack(file, cfg) != 0)
+            {
+                error = 1;
+            }
+            continue;
+        }
+
+        gd_pack pack;
+        if(load_pack(file, &pack, cfg) != 0)
+        {
+            error = 1;
+            continue;
+        }
+
+        if(process_pack(&pack, cfg) != 0)
+        {
+            error = 1;
+        }
+
+        free_pack(&pack);
+    }
+
+    return error;
+}
+
+static bool is_streamed_listing(config* cfg)
+{
+    return cfg->operation_mode == OPERATION_MODE_LIST && cfg->list_format != LIST_FORMAT_TREE && cfg->list_format != LIST_FORMAT_DU &&
+           cfg->pack_index == false;
+}
+
+/* Reading several packages
+ * Every package is opened and its file list parsed on its own thread, then they're listed, searched or extracted
+ * at once by the same threads. Each one writes to its own buffer, printed in the order of the inputs once they're
+ * all done. Listings are streamed instead: the first package not printed yet lists straight to the output, only
+ * the ones listed ahead of it are buffered. When extracting, a file is only extracted from the last package that has it, as it would overwrite
+ * the others.
+*/
+static int read_packs_concurrently(config* cfg)
+{
+    size_t count = cfg->input_files.size;
+
+    pack_job* jobs = calloc(count, sizeof(pack_job));
+    gd_pack** loaded = calloc(count, sizeof(gd_pack*));
+    if(jobs == NULL || loaded == NULL)
+    {
+        fprintf(stderr, "calloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    int thread_count = (get_processor_count() > PACK_READ_THREADS) ? get_processor_count() : PACK_READ_THREADS;
+    if((size_t)thread_count > count) thread_count = count;
+
+    thread_pool pool;
+    thread_pool_init(&pool, thread_count);
+
+    listing_order order = { .jobs = jobs, .count = count, .next = 0, .output = cfg->output };
+    pthread_mutex_init(&order.mutex, NULL);
+
+    // Load every package
+    for(size_t i = 0; i < count; ++i)
+    {
+        jobs[i].path = cfg->input_files.data[i];
+        jobs[i].cfg = *cfg;
+        jobs[i].order = &order;
+        jobs[i].index = i;
+        thread_pool_submit(&pool, load_job, &jobs[i]);
+    }
+
+    thread_pool_wait(&pool);
+
+    size_t loaded_count = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(jobs[i].loaded == true) loaded[loaded_count++] = &jobs[i].pack;
+    }
+
+    for(size_t i = 0; i < loaded_count && cfg->operation_mode == OPERATION_MODE_EXTRACT; ++i)
+    {
+        loaded[i]->overlays = loaded + i + 1;
+        loaded[i]->overlay_count = loaded_count - i - 1;
+    }
+
+    // Then process them, the files of every package going through the same threads
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(jobs[i].loaded == true) thread_pool_submit(&pool, process_job, &jobs[i]);
+    }
+
+    thread_pool_wait(&pool);
+    thread_pool_free(&pool);
+
+    pthread_mutex_destroy(&order.mutex);
+
+    // Print the output of each package in order, listings already were
+    int error = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(jobs[i].cfg.output != NULL)
+        {
+            fclose(jobs[i].cfg.output);
+            fwrite(jobs[i].output, 1, jobs[i].output_size, cfg->output);
+            free(jobs[i].output);
+        }
+
+        if(jobs[i].error != 0)
         {
             error = 1;
         }
     }
 
+    // Clean up
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(jobs[i].loaded == true) free_pack(&jobs[i].pack);
+    }
+
+    free(loaded);
+    free(jobs);
+
     return error;
 }
 
+static void load_job(void* arg)
+{
+    pack_job* job = (pack_job*)arg;
+
+    job->cfg.output = open_memstream(&job->output, &job->output_size);
+    if(job->cfg.output == NULL)
+    {
+        fprintf(stderr, "open_memstream(): failed to allocate memory.\n");
+        abort();
+    }
+
+    if(is_streamed_listing(&job->cfg) == true)
+    {
+        list_in_order(job);
+        return;
+    }
+
+    if(load_pack(job->path, &job->pack, &job->cfg) != 0)
+    {
+        job->error = 1;
+        return;
+    }
+    job->loaded = true;
+
+    // The packages extracted before this one look their files up in it
+    if(job->cfg.operation_mode == OPERATION_MODE_EXTRACT && job->pack.index == NULL)
+    {
+        index_pack(&job->pack);
+    }
+}
+
+static void process_job(void* arg)
+{
+    pack_job* job = (pack_job*)arg;
+
+    if(process_pack(&job->pack, &job->cfg) != 0)
+    {
+        job->error = 1;
+    }
+}
+
+static void list_in_order(pack_job* job)
+{
+    listing_order* order = job->order;
+
+    // Only the first package not printed yet writes to the output, it stays first until it's done
+    pthread_mutex_lock(&order->mutex);
+    bool first = (order->next == job->index);
+    pthread_mutex_unlock(&order->mutex);
+
+    FILE* output = job->cfg.output;
+    if(first == true) job->cfg.output = order->output;
+    job->error = list_pack(job->path, &job->cfg);
+    job->cfg.output = output;
+
+    // Print the packages listed ahead of it, up to the first one still being listed
+    pthread_mutex_lock(&order->mutex);
+    job->listed = true;
+    while(order->next < order->count && order->jobs[order->next].listed == true)
+    {
+        pack_job* next = &order->jobs[order->next++];
+        fclose(next->cfg.output);
+        fwrite(next->output, 1, next->output_size, order->output);
+        free(next->output);
+        next->cfg.output = NULL;
+    }
+    pthread_mutex_unlock(&order->mutex);
+}
+
 /* File header
  * 1 x 4B  | String | Magic Number (0x47445043)
- * 1 x 4B  | Int    | ?
+ * 1 x 4B  | Int    | Format version (2 for Godot 4)
  * 3 x 4B  | Int    | Engine version
+ * 1 x 4B  | Int    | Flags (Godot 4 only)
+ * 1 x 8B  | Int    | Offset of the files (Godot 4 only)
  * 1 x 64B | Void   | Reserved
  * 1 x 4B  | Int    | Number of packaged files 
 */
-static int read_pack(const char* path, 
-                     config* cfg)
+static int read_header(FILE* file, 
+                       const char* path, 
+                       gd_pack* pack, 
+                       config* cfg)
 {
-    // Open file
-    FILE* pack = fopen(path, "r");
-    if(pack == NULL)
-    {
-        printf("gdpc: Failed to open file \"%s\"\n", path);
-        return 1;
-    }
-
     // Read magic number
     char magic[4];
-    fread(magic, 1, 4, pack);
-    if(strncmp(magic, "GDPC", 4) != 0)
+    if(fread(magic, 1, 4, file) != 4 || strncmp(magic, "GDPC", 4) != 0)
     {
-        printf("gdpc: File is not a .pck file \"%s\"\n", path);
+        fprintf(cfg->output, "gdpc: File is not a .pck file \"%s\"\n", path);
         return 1;
     }
 
     // Version
-    int32_t wtf, major, minor, revision;
-    fread(&wtf, 4, 1, pack);
-    fread(&major, 4, 1, pack);
-    fread(&minor, 4, 1, pack);
-    fread(&revision, 4, 1, pack);
+    pack->format_version = 0;
+    fread(&pack->format_version, 4, 1, file);
+    fread(&pack->version_major, 4, 1, file);
+    fread(&pack->version_minor, 4, 1, file);
+    fread(&pack->version_revision, 4, 1, file);
+
+    // Godot 4 packages can be encrypted, and place their files relative to a base offset
+    pack->pack_flags = 0;
+    pack->file_base = 0;
+    pack->header_size = 88;
+    if(pack->format_version > PACK_FORMAT_VERSION_4)
+    {
+        fprintf(cfg->output, "gdpc: Unsupported package format %d \"%s\"\n", pack->format_version, path);
+        return 1;
+    }
+    if(pack->format_version == PACK_FORMAT_VERSION_4)
+    {
+        fread(&pack->pack_flags, 4, 1, file);
+        fread(&pack->file_base, 8, 1, file);
+        pack->header_size = 100;
+    }
 
     // Skip reserved space
-    fseek(pack, 64, SEEK_CUR);
+    fseek(file, 64, SEEK_CUR);
 
     // Number of files
-    int32_t file_count = 0;
-    fread(&file_count, 4, 1, pack);
+    pack->file_count = 0;
+    fread(&pack->file_count, 4, 1, file);
 
-    gd_file* list = malloc(file_count * sizeof(gd_file));
-    if(list == NULL)
+    // The file list may be half written until the update is completed
+    if(is_update_interrupted(file) == true)
+    {
+        fprintf(cfg->output, "gdpc: \"%s\" has an interrupted update, run 'gdpc -u \"%s\"' to recover it\n", path, path);
+        return 1;
+    }
+
+    return 0;
+}
+
+int load_pack(const char* path, 
+              gd_pack* pack, 
+              config* cfg)
+{
+    // State of the pack before it's read, an index written from it is stale if the pack changes meanwhile
+    file_identity identity;
+    bool use_index = (cfg->pack_index == true && get_file_identity(path, &identity) == true);
+
+    // Open file
+    FILE* file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", path);
+        return 1;
+    }
+
+    // Read file header
+    if(read_header(file, path, pack, cfg) != 0)
+    {
+        fclose(file);
+        return 1;
+    }
+
+    char header[PACK_INDEX_HEADER_SIZE] = { 0 };
+    if(use_index == true)
+    {
+        fseek(file, 0, SEEK_SET);
+        fread(header, 1, PACK_INDEX_HEADER_SIZE, file);
+        fseek(file, pack->header_size, SEEK_SET);
+    }
+
+    pack->index = NULL;
+    pack->index_capacity = 0;
+    pack->tree = NULL;
+    pack->mapped_index = NULL;
+    pack->mapped_index_size = 0;
+    pack->overlays = NULL;
+    pack->overlay_count = 0;
+
+    // An encrypted file list isn't written to the index, it would be readable by anyone
+    if(pack->pack_flags & PACK_DIR_ENCRYPTED)
+    {
+        use_index = false;
+    }
+
+    // Map the file list from the index, or read it and write the index
+    bool indexed = (use_index == true && load_pack_index(path, &identity, header, pack) == true);
+    if(indexed == false)
+    {
+        char* buffer;
+        FILE* list = open_file_list(file, path, pack, &buffer, cfg);
+        if(list == NULL)
+        {
+            fclose(file);
+            return 1;
+        }
+
+        int error = read_file_list(list, &pack->files, pack->file_count, pack->format_version, pack->file_base);
+
+        if(list != file)
+        {
+            fclose(list);
+            buffer_pool_release(buffer);
+        }
+
+        if(error != 0)
+        {
+            fprintf(cfg->output, "gdpc: File list is truncated \"%s\"\n", path);
+            fclose(file);
+            return 1;
+        }
+    }
+    fclose(file);
+
+    // Store path
+    pack->path = malloc(strlen(path) + 1);
+    if(pack->path == NULL)
     {
         fprintf(stderr, "malloc(): failed to allocate memory.\n");
         abort();
     }
+    strcpy(pack->path, path);
 
-    // Print additional information if verbose
-    if(cfg->verbose == true)
+    if(use_index == true && indexed == false && write_pack_index(pack, &identity, header) != 0)
+    {
+        fprintf(cfg->output, "gdpc: Failed to write index \"%s.gdidx\"\n", path);
+    }
+
+    return 0;
+}
+
+int process_pack(gd_pack* pack, 
+                 config* cfg)
+{
+    print_pack_name(pack, cfg);
+
+    // Directories are found in the tree, it's built once per pack
+    if(pack->tree == NULL && uses_path_tree(cfg) == true)
+    {
+        pack->tree = build_path_tree(pack);
+    }
+
+    // List the directories
+    if(cfg->operation_mode == OPERATION_MODE_LIST && (cfg->list_format == LIST_FORMAT_TREE || cfg->list_format == LIST_FORMAT_DU))
     {
-        printf("\033[4m%s\033[24m (v%d.%d.%d) (%d files found)\n", path, major, minor, revision, file_count);
+        list_directories(pack, cfg);
     }
+    // List the files
     else if(cfg->operation_mode == OPERATION_MODE_LIST)
     {
-        printf("\033[4m%s\033[24m\n", path);
+        path_cursor cursor;
+        path_cursor_init(&cursor, pack);
+
+        gd_file file;
+        while(next_file(pack, &cursor, &file) == true)
+        {
+            print_file(pack->path, file.path, file.len, file.offset, file.size, file.md5, cfg);
+        }
+
+        path_cursor_free(&cursor);
     }
 
-    // Read the file list
-    read_file_list(pack, list, file_count, cfg);
+    // Search the files
+    if(cfg->operation_mode == OPERATION_MODE_GREP)
+    {
+        return search_pack(pack, cfg);
+    }
 
     // Extract the files
     if(cfg->operation_mode == OPERATION_MODE_EXTRACT)
     {
-        read_files(pack, list, file_count, cfg);
-    }
+        FILE* file = fopen(pack->path, "rb");
+        if(file == NULL)
+        {
+            fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", pack->path);
+            return 1;
+        }
 
-    // Clean-up
-    for(int i = 0; i < file_count; ++i) free(list[i].path);
-    free(list);
-    fclose(pack);
+        read_files(file, pack, cfg);
+
+        // Binary resources and scenes are converted to text on every core once the files are extracted
+        if(cfg->convert == true)
+        {
+            convert_binary_resources(pack, file, cfg);
+        }
+
+        fclose(file);
+    }
 
     return 0;
 }
 
-/* File list item
- * 1 x 4B  | Int    | String length
- *         | String | Path
- * 1 x 8B  | Int    | File offset
- * 1 x 8B  | Int    | File size
- * 1 x 16B | ?      | MD5
-*/
-static int read_file_list(FILE* pack, 
-                          gd_file* file_list, 
-                          int file_count, 
-                          config* cfg)
+void free_pack(gd_pack* pack)
 {
-    for(int i = 0; i < file_count; ++i)
+    // A mapped index holds the file table and the hash table
+    if(pack->mapped_index != NULL)
     {
-        // Get the length of the path
-        int len;
-        fread(&len, 4, 1, pack);
+        unmap_file(pack->mapped_index, pack->mapped_index_size);
+    }
+    else
+    {
+        free(pack->files.offsets);
+        free(pack->files.sizes);
+        free(pack->files.hashes);
+        free(pack->files.md5s);
+        free(pack->files.flags);
+        free(pack->files.paths);
+        free(pack->files.blocks);
+        free(pack->index);
+    }
+
+    free(pack->path);
+    free_path_tree(pack->tree);
+}
 
-        file_list[i].path = malloc(len + 1);
-        if(file_list[i].path == NULL)
+void index_pack(gd_pack* pack)
+{
+    // Keep the table at most half full
+    size_t capacity = 64;
+    while(capacity < (size_t)pack->file_count * 2) capacity *= 2;
+
+    int32_t* slots = calloc(capacity, sizeof(int32_t));
+    if(slots == NULL)
+    {
+        fprintf(stderr, "calloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // Paths are only decoded when their hashes collide
+    path_cursor cursor;
+    path_cursor_init(&cursor, pack);
+    path_cursor other;
+    path_cursor_init(&other, pack);
+
+    // Insert every file, the first one winning if a path is duplicated
+    uint32_t* hashes = pack->files.hashes;
+    for(int32_t i = 0; i < pack->file_count; ++i)
+    {
+        size_t slot = hashes[i] & (capacity - 1);
+        bool duplicate = false;
+
+        while(slots[slot] != 0)
         {
-            fprintf(stderr, "malloc(): failed to allocate memory.\n");
-            abort();
+            int32_t j = slots[slot] - 1;
+            if(hashes[j] == hashes[i])
+            {
+                gd_file file, other_file;
+                if(get_file(pack, &cursor, i, &file) == true && get_file(pack, &other, j, &other_file) == true &&
+                   file.len == other_file.len && memcmp(file.path, other_file.path, file.len) == 0)
+                {
+                    duplicate = true;
+                    break;
+                }
+            }
+
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if(duplicate == false) slots[slot] = i + 1;
+    }
+
+    path_cursor_free(&cursor);
+    path_cursor_free(&other);
+
+    free(pack->index);
+    pack->index = slots;
+    pack->index_capacity = capacity;
+}
+
+// Fills the file with the entry of the path, its path being the one looked up. Returns false if it isn't in the pack
+bool find_file(gd_pack* pack, const char* path, gd_file* file)
+{
+    int32_t index = find_file_index(pack, path, file);
+    if(index < 0) return false;
+
+    file->path = (char*)path;
+    file->len = strlen(path);
+    return true;
+}
+
+// Returns the index of the path's file and fills the file with its entry, -1 if it isn't in the pack
+static int32_t find_file_index(gd_pack* pack, const char* path, gd_file* file)
+{
+    int len = strlen(path);
+    uint32_t hash = hash_path(path, len);
+
+    path_cursor cursor;
+    path_cursor_init(&cursor, pack);
+
+    int32_t found = -1;
+
+    // Without an index, search the directory of the path if the pack has a tree, or every file
+    if(pack->index == NULL)
+    {
+        int32_t begin = 0;
+        int32_t end = pack->file_count;
+        int32_t* files = NULL;
+
+        if(pack->tree != NULL)
+        {
+            const char* relative = (strncmp(path, "res://", 6) == 0) ? path + 6 : path;
+            const char* separator = strrchr(relative, '/');
+            int32_t node = find_directory(pack->tree, relative, (separator != NULL) ? separator - relative : 0);
+
+            begin = (node != -1) ? pack->tree->nodes[node].files_begin : 0;
+            end = (node != -1) ? pack->tree->nodes[node].files_end : 0;
+            files = pack->tree->files;
         }
-        fread(file_list[i].path, 1, len, pack);
-        file_list[i].path[len] = '\0';
 
-        // Get the real length of the path and resize it if neccessary
-        file_list[i].len = strlen(file_list[i].path);
-        if(file_list[i].len != len)
+        for(int32_t j = begin; j < end && found < 0; ++j)
         {
-            char* new = realloc(file_list[i].path, file_list[i].len + 1);
-            if(new == NULL)
+            int32_t i = (files != NULL) ? files[j] : j;
+            if(pack->files.hashes[i] != hash) continue;
+
+            if(get_file(pack, &cursor, i, file) == true && file->len == len && memcmp(file->path, path, len) == 0) found = i;
+        }
+    }
+    else
+    {
+        size_t slot = hash & (pack->index_capacity - 1);
+        while(pack->index[slot] != 0 && found < 0)
+        {
+            int32_t i = pack->index[slot] - 1;
+            if(pack->files.hashes[i] == hash)
             {
-                fprintf(stderr, "malloc(): failed to allocate memory.\n");
-                abort();
+                if(get_file(pack, &cursor, i, file) == true && file->len == len && memcmp(file->path, path, len) == 0) found = i;
+            }
+
+            slot = (slot + 1) & (pack->index_capacity - 1);
+        }
+    }
+
+    path_cursor_free(&cursor);
+
+    return found;
+}
+
+static int compare_indices(const void* a, const void* b)
+{
+    int32_t index_a = *(const int32_t*)a;
+    int32_t index_b = *(const int32_t*)b;
+    return (index_a > index_b) - (index_a < index_b);
+}
+
+// Returns the index of every whitelisted file, in the order of the pack, except the files of its overlays
+int32_t* select_files(gd_pack* pack, config* cfg, int32_t* count)
+{
+    int32_t* selected = select_whitelisted_files(pack, cfg, count);
+
+    if(pack->overlay_count > 0)
+    {
+        *count = remove_overlaid_files(pack, selected, *count);
+    }
+
+    return selected;
+}
+
+// Returns the index of every whitelisted file, in the order of the pack. If the pack has a tree and every filter
+// is a directory ("dir/*") or a path, the files are found in time proportional to the number of files selected.
+// Otherwise, every file is checked.
+static int32_t* select_whitelisted_files(gd_pack* pack, config* cfg, int32_t* count)
+{
+    filter* filters = cfg->whitelist.data;
+    bool use_tree = (pack->tree != NULL && cfg->whitelist.size > 0);
+    size_t capacity = 0;
+
+    for(size_t i = 0; i < cfg->whitelist.size && use_tree == true; ++i)
+    {
+        filter* fil = &filters[i];
+        if(fil->wildcard == NULL)
+        {
+            capacity++;
+        }
+        else if(is_directory_filter(fil) == true)
+        {
+            int32_t node = find_directory(pack->tree, fil->data, fil->wildcard - fil->data);
+            if(node != -1) capacity += pack->tree->nodes[node].subtree_end - pack->tree->nodes[node].files_begin;
+        }
+        else
+        {
+            use_tree = false;
+        }
+    }
+
+    if(use_tree == false) capacity = pack->file_count;
+
+    int32_t* selected = malloc((capacity + 1) * sizeof(int32_t));
+    if(selected == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+    *count = 0;
+
+    if(use_tree == false)
+    {
+        path_cursor cursor;
+        path_cursor_init(&cursor, pack);
+
+        gd_file file;
+        while(next_file(pack, &cursor, &file) == true)
+        {
+            if(is_whitelisted(file.path, file.len, cfg) == true) selected[(*count)++] = cursor.index;
+        }
+
+        path_cursor_free(&cursor);
+        return selected;
+    }
+
+    for(size_t i = 0; i < cfg->whitelist.size; ++i)
+    {
+        filter* fil = &filters[i];
+        if(fil->wildcard == NULL)
+        {
+            // Filters don't include "res://"
+            char* path = malloc(strlen(fil->data) + 7);
+            if(path == NULL)
+            {
+                fprintf(stderr, "malloc(): failed to allocate memory.\n");
+                abort();
+            }
+            strcpy(path, "res://");
+            strcat(path, fil->data);
+
+            gd_file file;
+            int32_t index = find_file_index(pack, path, &file);
+            if(index >= 0) selected[(*count)++] = index;
+
+            free(path);
+        }
+        else
+        {
+            int32_t node = find_directory(pack->tree, fil->data, fil->wildcard - fil->data);
+            if(node == -1) continue;
+
+            path_tree_node* dir = &pack->tree->nodes[node];
+            memcpy(selected + *count, pack->tree->files + dir->files_begin, (dir->subtree_end - dir->files_begin) * sizeof(int32_t));
+            *count += dir->subtree_end - dir->files_begin;
+        }
+    }
+
+    // Back to the order of the pack, without the files selected by several filters
+    qsort(selected, *count, sizeof(int32_t), compare_indices);
+
+    int32_t unique = 0;
+    for(int32_t i = 0; i < *count; ++i)
+    {
+        if(unique == 0 || selected[unique - 1] != selected[i]) selected[unique++] = selected[i];
+    }
+    *count = unique;
+
+    return selected;
+}
+
+// Removes the files a later package replaces from the selection. Returns the number of files left
+static int32_t remove_overlaid_files(gd_pack* pack, int32_t* selected, int32_t count)
+{
+    path_cursor cursor;
+    path_cursor_init(&cursor, pack);
+
+    int32_t kept = 0;
+    for(int32_t i = 0; i < count; ++i)
+    {
+        gd_file file;
+        get_file(pack, &cursor, selected[i], &file);
+
+        bool overlaid = false;
+        for(size_t j = 0; j < pack->overlay_count && overlaid == false; ++j)
+        {
+            gd_file overlay_file;
+            overlaid = find_file(pack->overlays[j], file.path, &overlay_file);
+        }
+
+        if(overlaid == false) selected[kept++] = selected[i];
+    }
+
+    path_cursor_free(&cursor);
+
+    return kept;
+}
+
+void path_cursor_init(path_cursor* cursor, gd_pack* pack)
+{
+    cursor->index = -1;
+    cursor->position = 0;
+    cursor->len = 0;
+
+    cursor->path = malloc(pack->files.max_path_len + 1);
+    if(cursor->path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+    cursor->path[0] = '\0';
+}
+
+void path_cursor_free(path_cursor* cursor)
+{
+    free(cursor->path);
+}
+
+// Decodes the next path and fills the file with it. Returns false after the last file
+bool next_file(gd_pack* pack, path_cursor* cursor, gd_file* file)
+{
+    if(cursor->index + 1 >= pack->file_count)
+    {
+        return false;
+    }
+
+    decode_path(pack, cursor);
+
+    int32_t i = cursor->index;
+    file->path = cursor->path;
+    file->len = cursor->len;
+    file->offset = pack->files.offsets[i];
+    file->size = pack->files.sizes[i];
+    memcpy(file->md5, pack->files.md5s[i], 16);
+    file->encrypted = (pack->files.flags[i] & PACK_FILE_ENCRYPTED) != 0;
+
+    return true;
+}
+
+// Decodes any path, from the start of its block unless the cursor is already before it in the same block. Returns
+// false if there's no such file
+bool get_file(gd_pack* pack, path_cursor* cursor, int32_t index, gd_file* file)
+{
+    if(cursor->index >= index || cursor->index < index - index % PATH_BLOCK_SIZE - 1)
+    {
+        cursor->index = index - index % PATH_BLOCK_SIZE - 1;
+        cursor->position = pack->files.blocks[index / PATH_BLOCK_SIZE];
+    }
+
+    while(cursor->index < index - 1) decode_path(pack, cursor);
+    return next_file(pack, cursor, file);
+}
+
+static void decode_path(gd_pack* pack, path_cursor* cursor)
+{
+    const uint8_t* itr = pack->files.paths + cursor->position;
+
+    // Shared prefix and suffix lengths
+    size_t lengths[2] = { 0, 0 };
+    for(int i = 0; i < 2; ++i)
+    {
+        int shift = 0;
+        do
+        {
+            lengths[i] |= (size_t)(*itr & 0x7F) << shift;
+            shift += 7;
+        } while(*itr++ & 0x80);
+    }
+
+    memcpy(cursor->path + lengths[0], itr, lengths[1]);
+    cursor->len = lengths[0] + lengths[1];
+    cursor->path[cursor->len] = '\0';
+
+    cursor->position = (itr + lengths[1]) - pack->files.paths;
+    cursor->index++;
+}
+
+/* File list item
+ * 1 x 4B  | Int    | String length
+ *         | String | Path
+ * 1 x 8B  | Int    | File offset
+ * 1 x 8B  | Int    | File size
+ * 1 x 16B | ?      | MD5
+ * 1 x 4B  | Int    | Flags (Godot 4 only)
+*/
+static int read_file_list(FILE* pack, 
+                          file_table* files, 
+                          int file_count, 
+                          int32_t format_version, 
+                          int64_t file_base)
+{
+    files->offsets = malloc(file_count * sizeof(int64_t) + 1);
+    files->sizes = malloc(file_count * sizeof(int64_t) + 1);
+    files->hashes = malloc(file_count * sizeof(uint32_t) + 1);
+    files->md5s = malloc(file_count * 16 + 1);
+    files->flags = calloc(file_count + 1, 1);
+    files->blocks = malloc((file_count / PATH_BLOCK_SIZE + 1) * sizeof(size_t));
+    files->paths = NULL;
+    files->paths_size = 0;
+    files->max_path_len = 0;
+    if(files->offsets == NULL || files->sizes == NULL || files->hashes == NULL || files->md5s == NULL || files->flags == NULL || files->blocks == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // The current and previous paths, swapped after each file
+    size_t capacities[2] = { 256, 256 };
+    char* paths[2] = { malloc(256), malloc(256) };
+    int lengths[2] = { 0, 0 };
+    if(paths[0] == NULL || paths[1] == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // Godot 4 items end with their flags
+    int64_t item_size = (format_version == PACK_FORMAT_VERSION_4) ? 36 : 32;
+
+    // Paths can't be longer than what's left of the list
+    int64_t position = ftell(pack);
+    fseek(pack, 0, SEEK_END);
+    int64_t list_end = ftell(pack);
+    fseek(pack, position, SEEK_SET);
+
+    int error = 0;
+    size_t paths_capacity = 0;
+    for(int i = 0; i < file_count; ++i)
+    {
+        int current = i & 1;
+
+        // Get the length of the path
+        uint32_t len;
+        if(fread(&len, 4, 1, pack) != 1)
+        {
+            error = 1;
+            break;
+        }
+
+        position += 4;
+        if((int64_t)len > list_end - position || len > INT32_MAX)
+        {
+            error = 1;
+            break;
+        }
+        position += (int64_t)len + item_size;
+
+        if((size_t)len + 1 > capacities[current])
+        {
+            while((size_t)len + 1 > capacities[current]) capacities[current] *= 2;
+
+            char* new = realloc(paths[current], capacities[current]);
+            if(new == NULL)
+            {
+                fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+                abort();
+            }
+            paths[current] = new;
+        }
+
+        // Get the path and its real length, it can be padded with null characters
+        size_t read = fread(paths[current], 1, len, pack);
+        paths[current][read] = '\0';
+        lengths[current] = strlen(paths[current]);
+
+        append_path(files, &paths_capacity, i, paths[current], lengths[current], paths[current ^ 1], lengths[current ^ 1]);
+        files->hashes[i] = hash_path(paths[current], lengths[current]);
+
+        // Get the offset
+        files->offsets[i] = 0;
+        fread(&files->offsets[i], 8, 1, pack);
+        files->offsets[i] += file_base;
+        // Get the size
+        files->sizes[i] = 0;
+        fread(&files->sizes[i], 8, 1, pack);
+
+        // Get the MD5
+        fread(files->md5s[i], 1, 16, pack);
+
+        // Get the flags
+        if(format_version == PACK_FORMAT_VERSION_4)
+        {
+            uint32_t flags = 0;
+            fread(&flags, 4, 1, pack);
+            files->flags[i] = flags & PACK_FILE_ENCRYPTED;
+        }
+    }
+
+    free(paths[0]);
+    free(paths[1]);
+
+    if(error != 0)
+    {
+        free(files->offsets);
+        free(files->sizes);
+        free(files->hashes);
+        free(files->md5s);
+        free(files->flags);
+        free(files->blocks);
+        free(files->paths);
+        return 1;
+    }
+
+    // Give back the unused capacity
+    uint8_t* trimmed = realloc(files->paths, files->paths_size + 1);
+    if(trimmed == NULL)
+    {
+        fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+        abort();
+    }
+    files->paths = trimmed;
+
+    return 0;
+}
+
+// Returns the stream to read the file list from: the package itself, or its decrypted file list if it's encrypted.
+// The buffer holds the decrypted file list until the stream is closed. Returns NULL if it can't be decrypted
+static FILE* open_file_list(FILE* file, 
+                            const char* path, 
+                            gd_pack* pack, 
+                            char** buffer, 
+                            config* cfg)
+{
+    *buffer = NULL;
+    if((pack->pack_flags & PACK_DIR_ENCRYPTED) == 0)
+    {
+        return file;
+    }
+
+    if(cfg->has_encryption_key == false)
+    {
+        fprintf(cfg->output, "gdpc: \"%s\" is encrypted, set GODOT_SCRIPT_ENCRYPTION_KEY or use --key-file\n", path);
+        return NULL;
+    }
+
+    int64_t size;
+    *buffer = read_encrypted_data(file, pack->header_size, cfg->encryption_key, &size);
+    if(*buffer == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to decrypt the file list of \"%s\", the key may be wrong\n", path);
+        return NULL;
+    }
+
+    // The buffer has a null character after the file list, so the stream is never empty
+    FILE* list = fmemopen(*buffer, size + 1, "rb");
+    if(list == NULL)
+    {
+        fprintf(stderr, "fmemopen(): failed to allocate memory.\n");
+        abort();
+    }
+
+    return list;
+}
+
+// Front-codes the path after the previous one, or stores it whole if it starts a block
+static void append_path(file_table* files, 
+                        size_t* capacity, 
+                        int32_t index, 
+                        const char* path, 
+                        int len, 
+                        const char* previous, 
+                        int previous_len)
+{
+    int shared = 0;
+    if(index % PATH_BLOCK_SIZE == 0)
+    {
+        files->blocks[index / PATH_BLOCK_SIZE] = files->paths_size;
+    }
+    else
+    {
+        while(shared < len && shared < previous_len && path[shared] == previous[shared]) shared++;
+    }
+
+    if(files->paths_size + (len - shared) + 10 > *capacity)
+    {
+        *capacity = (*capacity == 0) ? 4096 : *capacity;
+        while(files->paths_size + (len - shared) + 10 > *capacity) *capacity *= 2;
+
+        uint8_t* new = realloc(files->paths, *capacity);
+        if(new == NULL)
+        {
+            fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+            abort();
+        }
+        files->paths = new;
+    }
+
+    uint8_t* itr = files->paths + files->paths_size;
+    uint32_t lengths[2] = { shared, len - shared };
+    for(int i = 0; i < 2; ++i)
+    {
+        uint32_t value = lengths[i];
+        do
+        {
+            *itr++ = (value & 0x7F) | ((value > 0x7F) ? 0x80 : 0);
+            value >>= 7;
+        } while(value != 0);
+    }
+
+    memcpy(itr, path + shared, len - shared);
+    files->paths_size = (itr + len - shared) - files->paths;
+
+    if(len > files->max_path_len) files->max_path_len = len;
+}
+
+/* File list item
+ * 1 x 4B  | Int    | String length
+ *         | String | Path
+ * 1 x 8B  | Int    | File offset
+ * 1 x 8B  | Int    | File size
+ * 1 x 16B | ?      | MD5
+*/
+static int list_pack(const char* path, 
+                     config* cfg)
+{
+    // Open file
+    FILE* file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", path);
+        return 1;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    // Read file header
+    gd_pack pack;
+    pack.path = (char*)path;
+    if(read_header(file, path, &pack, cfg) != 0)
+    {
+        fclose(file);
+        return 1;
+    }
+
+    print_pack_name(&pack, cfg);
+
+    char* list_buffer;
+    FILE* list = open_file_list(file, path, &pack, &list_buffer, cfg);
+    if(list == NULL)
+    {
+        fclose(file);
+        return 1;
+    }
+
+    // Godot 4 items end with their flags
+    size_t item_size = (pack.format_version == PACK_FORMAT_VERSION_4) ? 36 : 32;
+
+    // Paths can't be longer than what's left of the list
+    int64_t position = ftell(list);
+    fseek(list, 0, SEEK_END);
+    int64_t list_end = ftell(list);
+    fseek(list, position, SEEK_SET);
+
+    // Decode and print the items one at a time, reusing the same buffer for every path
+    size_t capacity = 256;
+    char* buf = malloc(capacity);
+    if(buf == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    int error = 0;
+    for(int32_t i = 0; i < pack.file_count; ++i)
+    {
+        // Get the length of the path
+        uint32_t len;
+        if(fread(&len, 4, 1, list) != 1)
+        {
+            error = 1;
+            break;
+        }
+
+        position += 4;
+        if((int64_t)len > list_end - position || len > INT32_MAX)
+        {
+            error = 1;
+            break;
+        }
+        position += (int64_t)len + item_size;
+
+        if((size_t)len + 1 > capacity)
+        {
+            while((size_t)len + 1 > capacity) capacity *= 2;
+
+            char* new = realloc(buf, capacity);
+            if(new == NULL)
+            {
+                fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+                abort();
+            }
+            buf = new;
+        }
+
+        // Get the path, offset, size and MD5
+        char item[36];
+        if(fread(buf, 1, len, list) != len || fread(item, 1, item_size, list) != item_size)
+        {
+            error = 1;
+            break;
+        }
+        buf[len] = '\0';
+
+        int64_t offset, size;
+        memcpy(&offset, item, 8);
+        memcpy(&size, item + 8, 8);
+        offset += pack.file_base;
+
+        print_file(path, buf, strlen(buf), offset, size, (uint8_t*)item + 16, cfg);
+    }
+
+    if(error != 0)
+    {
+        fprintf(cfg->output, "gdpc: File list is truncated \"%s\"\n", path);
+    }
+
+    // Clean-up
+    free(buf);
+    if(list != file)
+    {
+        fclose(list);
+        buffer_pool_release(list_buffer);
+    }
+    fclose(file);
+
+    return error;
+}
+
+void print_list_header(config* cfg)
+{
+    if(cfg->list_format == LIST_FORMAT_CSV)
+    {
+        fputs("pack,path,offset,size,md5\n", cfg->output);
+    }
+    else if(cfg->list_format == LIST_FORMAT_TSV)
+    {
+        fputs("pack\tpath\toffset\tsize\tmd5\n", cfg->output);
+    }
+}
+
+static void print_pack_name(gd_pack* pack, 
+                            config* cfg)
+{
+    // Structured formats name the pack on every line
+    if(cfg->list_format != LIST_FORMAT_TEXT && cfg->list_format != LIST_FORMAT_TREE && cfg->list_format != LIST_FORMAT_DU && cfg->operation_mode == OPERATION_MODE_LIST)
+    {
+        return;
+    }
+
+    // Print additional information if verbose
+    if(cfg->verbose == true)
+    {
+        fprintf(cfg->output, "\033[4m%s\033[24m (v%d.%d.%d) (%d files found)\n", pack->path, pack->version_major, pack->version_minor, pack->version_revision, pack->file_count);
+    }
+    else if(cfg->operation_mode == OPERATION_MODE_LIST)
+    {
+        fprintf(cfg->output, "\033[4m%s\033[24m\n", pack->path);
+    }
+}
+
+// Returns true if the tree of the pack's directories is needed: to list them, to resolve the files mapped by .import
+// files, or to select the files of whitelisted directories
+static bool uses_path_tree(config* cfg)
+{
+    if(cfg->operation_mode == OPERATION_MODE_LIST)
+    {
+        return cfg->list_format == LIST_FORMAT_TREE || cfg->list_format == LIST_FORMAT_DU;
+    }
+
+    if(cfg->convert == true)
+    {
+        return true;
+    }
+
+    for(size_t i = 0; i < cfg->whitelist.size; ++i)
+    {
+        if(is_directory_filter(&cfg->whitelist.data[i]) == true) return true;
+    }
+
+    return false;
+}
+
+// Prints the directories selected by the whitelist ("dir/*"), or every directory of the pack
+static void list_directories(gd_pack* pack, 
+                             config* cfg)
+{
+    char* path = malloc(pack->files.max_path_len + 8);
+    if(path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    bool listed = false;
+    for(size_t i = 0; i < cfg->whitelist.size; ++i)
+    {
+        filter* fil = &cfg->whitelist.data[i];
+        if(is_directory_filter(fil) == false)
+        {
+            continue;
+        }
+
+        listed = true;
+        int32_t node = find_directory(pack->tree, fil->data, fil->wildcard - fil->data);
+        if(node != -1)
+        {
+            print_directory(pack, node, path, write_directory_path(pack->tree, node, path), 0, cfg);
+        }
+    }
+
+    if(listed == false)
+    {
+        print_directory(pack, 0, path, write_directory_path(pack->tree, 0, path), 0, cfg);
+    }
+
+    free(path);
+}
+
+// Writes "res://dir/subdir/" and returns its length
+static int write_directory_path(path_tree* tree, 
+                                int32_t node, 
+                                char* path)
+{
+    if(node == 0)
+    {
+        memcpy(path, "res://", 6);
+        return 6;
+    }
+
+    path_tree_node* dir = &tree->nodes[node];
+    int len = write_directory_path(tree, dir->parent, path);
+    memcpy(path + len, tree->names + dir->name, dir->name_len);
+    path[len + dir->name_len] = '/';
+
+    return len + dir->name_len + 1;
+}
+
+// Prints the directory and its subdirectories, with the size and number of files under each one. The tree lists
+// parents before their subdirectories, du lists them after like du(1)
+static void print_directory(gd_pack* pack, 
+                            int32_t node, 
+                            char* path, 
+                            int len, 
+                            int indent, 
+                            config* cfg)
+{
+    path_tree* tree = pack->tree;
+    path_tree_node* dir = &tree->nodes[node];
+    int32_t files = dir->subtree_end - dir->files_begin;
+    path[len] = '\0';
+
+    if(cfg->list_format == LIST_FORMAT_TREE)
+    {
+        // The first directory is printed with its full path, subdirectories with their name
+        const char* name = (indent == 0) ? path : path + len - dir->name_len - 1;
+        fprintf(cfg->output, "%*s%s (%ldB, %d files)\n", indent * 2, "", name, dir->subtree_size, files);
+    }
+
+    for(int32_t child = dir->first_child; child != -1; child = tree->nodes[child].next_sibling)
+    {
+        path_tree_node* subdir = &tree->nodes[child];
+        memcpy(path + len, tree->names + subdir->name, subdir->name_len);
+        path[len + subdir->name_len] = '/';
+
+        print_directory(pack, child, path, len + subdir->name_len + 1, indent + 1, cfg);
+    }
+
+    if(cfg->list_format == LIST_FORMAT_DU)
+    {
+        path[len] = '\0';
+        fprintf(cfg->output, "%ld\t%d\t%s\n", dir->subtree_size, files, path);
+    }
+}
+
+static void print_file(const char* pack_path, 
+                       const char* path, 
+                       int len, 
+                       int64_t offset, 
+                       int64_t size, 
+                       const uint8_t* md5, 
+                       config* cfg)
+{
+    FILE* out = cfg->output;
+
+    if(cfg->list_format == LIST_FORMAT_TEXT)
+    {
+        fwrite(path, 1, len, out);
+        fputc('\n', out);
+        return;
+    }
+
+    char hex[33];
+    for(int i = 0; i < 16; ++i)
+    {
+        hex[i * 2] = "0123456789abcdef"[md5[i] >> 4];
+        hex[i * 2 + 1] = "0123456789abcdef"[md5[i] & 0xF];
+    }
+    hex[32] = '\0';
+
+    char separator = (cfg->list_format == LIST_FORMAT_TSV) ? '\t' : ',';
+
+    if(cfg->list_format == LIST_FORMAT_JSON)
+    {
+        // One object per line
+        fputs("{\"pack\":", out);
+        print_field(pack_path, strlen(pack_path), cfg);
+        fputs(",\"path\":", out);
+        print_field(path, len, cfg);
+        fprintf(out, ",\"offset\":%lld,\"size\":%lld,\"md5\":\"%s\"}\n", (long long)offset, (long long)size, hex);
+    }
+    else
+    {
+        print_field(pack_path, strlen(pack_path), cfg);
+        fputc(separator, out);
+        print_field(path, len, cfg);
+        fprintf(out, "%c%lld%c%lld%c%s\n", separator, (long long)offset, separator, (long long)size, separator, hex);
+    }
+}
+
+// Prints a string, quoted or escaped as the format requires
+static void print_field(const char* str, 
+                        int len, 
+                        config* cfg)
+{
+    FILE* out = cfg->output;
+
+    if(cfg->list_format == LIST_FORMAT_JSON)
+    {
+        fputc('"', out);
+        for(int i = 0; i < len; ++i)
+        {
+            unsigned char c = str[i];
+            if(c == '"' || c == '\\') 
+            {
+                fputc('\\', out);
+                fputc(c, out);
+            }
+            else if(c < 0x20) fprintf(out, "\\u%04x", c);
+            else fputc(c, out);
+        }
+        fputc('"', out);
+    }
+    else if(cfg->list_format == LIST_FORMAT_CSV)
+    {
+        // Quote the field only if needed
+        if(strcspn(str, ",\"\r\n") >= (size_t)len)
+        {
+            fwrite(str, 1, len, out);
+            return;
+        }
+
+        fputc('"', out);
+        for(int i = 0; i < len; ++i)
+        {
+            if(str[i] == '"') fputc('"', out);
+            fputc(str[i], out);
+        }
+        fputc('"', out);
+    }
+    else
+    {
+        for(int i = 0; i < len; ++i)
+        {
+            if(str[i] == '\t') fputs("\\t", out);
+            else if(str[i] == '\n') fputs("\\n", out);
+            else if(str[i] == '\\') fputs("\\\\", out);
+            else fputc(str[i], out);
+        }
+    }
+}
+
+static int compare_request_offsets(const void* a, const void* b)
+{
+    int64_t offset_a = ((const extract_request*)a)->offset;
+    int64_t offset_b = ((const extract_request*)b)->offset;
+    return (offset_a > offset_b) - (offset_a < offset_b);
+}
+
+// Orders the requests by the directory they're written to, then by offset
+static int compare_request_directories(const void* a, const void* b)
+{
+    const extract_request* request_a = (const extract_request*)a;
+    const extract_request* request_b = (const extract_request*)b;
+
+    const char* separator_a = strrchr(request_a->dest, '/');
+    const char* separator_b = strrchr(request_b->dest, '/');
+    size_t len_a = (separator_a != NULL) ? (size_t)(separator_a - request_a->dest) : 0;
+    size_t len_b = (separator_b != NULL) ? (size_t)(separator_b - request_b->dest) : 0;
+
+    int result = memcmp(request_a->dest, request_b->dest, (len_a < len_b) ? len_a : len_b);
+    if(result == 0) result = (len_a > len_b) - (len_a < len_b);
+    if(result == 0) result = compare_request_offsets(a, b);
+
+    return result;
+}
+
+static int read_files(FILE* file, 
+                      gd_pack* pack, 
+                      config* cfg)
+{
+    size_t dest_len = strlen(cfg->destination);
+
+    int request_count = 0;
+    extract_request* requests = malloc((pack->file_count + 1) * sizeof(extract_request));
+    if(requests == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // Directory of the previous file, files of the same directory are usually listed together
+    char* directory = NULL;
+    size_t directory_len = 0;
+
+    path_cursor cursor;
+    path_cursor_init(&cursor, pack);
+
+    int32_t selected_count;
+    int32_t* selected = select_files(pack, cfg, &selected_count);
+
+    // For each files in the pack, in the order of the list, create the directories of the files to extract. Only
+    // the whitelisted files are visited, unless every ignored file is printed
+    int32_t visited_count = (cfg->verbose == true) ? pack->file_count : selected_count;
+    int32_t next_selected = 0;
+
+    gd_file file_entry;
+    for(int32_t i = 0; i < visited_count; ++i)
+    {
+        int32_t index = (cfg->verbose == true) ? i : selected[i];
+        bool is_selected = (next_selected < selected_count && selected[next_selected] == index);
+        if(is_selected == true) next_selected++;
+
+        // Get file info
+        get_file(pack, &cursor, index, &file_entry);
+        gd_file* file_info = &file_entry;
+
+        // Encrypted files can't be extracted without the key
+        if(is_selected == true && file_info->encrypted == true && cfg->has_encryption_key == false)
+        {
+            fprintf(cfg->output, "gdpc: \"%s\" is encrypted, set GODOT_SCRIPT_ENCRYPTION_KEY or use --key-file\n", file_info->path);
+        }
+        // If the file should be extracted...
+        else if(is_selected == true && !is_blacklisted(file_info->path, file_info->len, cfg))
+        {
+            if(cfg->verbose == true)
+            {
+                fprintf(cfg->output, "Extracting \"%s\" (%ldB)\n", file_info->path, file_info->size);
+            }
+
+            // Create its directory only if it differs from the previous file's
+            char* path = generate_path(file_info->path, cfg->destination, dest_len);
+            char* separator = strrchr(path, '/');
+            size_t len = (separator != NULL) ? (size_t)(separator - path) : 0;
+
+            if(directory == NULL || len != directory_len || strncmp(path, directory, len) != 0)
+            {
+                create_path(path);
+
+                directory = realloc(directory, len + 1);
+                if(directory == NULL)
+                {
+                    fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+                    abort();
+                }
+                memcpy(directory, path, len);
+                directory[len] = '\0';
+                directory_len = len;
+            }
+
+            extract_request* request = &requests[request_count++];
+            request->dest = path;
+            request->offset = file_info->offset;
+            request->size = file_info->size;
+            request->key = (file_info->encrypted == true) ? cfg->encryption_key : NULL;
+            request->error = 0;
+        }
+        else if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Ignoring \"%s\"\n", file_info->path);
+        }
+    }
+
+    free(directory);
+
+    // Read the pack front to back, so disks don't seek between files
+    qsort(requests, request_count, sizeof(extract_request), compare_request_offsets);
+
+    int64_t total_size = 0;
+    for(int i = 0; i < request_count; ++i)
+    {
+        total_size += requests[i].size;
+    }
+    progress_add_total(total_size, request_count);
+
+    // Extract the files a window at a time: the next window is read ahead while the current one is written, and
+    // the windows already extracted are dropped from the page cache so large packs don't evict everything else.
+    // Within a window, the files are read from the cache, and written a directory at a time
+    for(int i = 0; i < request_count;)
+    {
+        int64_t window_start = requests[i].offset;
+        int64_t window_end = window_start + EXTRACT_WINDOW_SIZE;
+
+        int end = i + 1;
+        while(end < request_count && requests[end].offset < window_end) end++;
+
+        int64_t extracted_end = requests[end - 1].offset + requests[end - 1].size;
+        qsort(&requests[i], end - i, sizeof(extract_request), compare_request_directories);
+
+        if(i == 0) advise_file_range(file, window_start, EXTRACT_WINDOW_SIZE, true);
+        advise_file_range(file, window_end, EXTRACT_WINDOW_SIZE, true);
+
+        // With io_uring, the files of the window are extracted together
+        if(cfg->io_backend == IO_BACKEND_URING)
+        {
+            extract_files_async(file, &requests[i], end - i);
+        }
+        else
+        {
+            for(int j = i; j < end; ++j)
+            {
+                // Encrypted files are decrypted as they're copied
+                if(requests[j].key != NULL)
+                {
+                    requests[j].error = extract_encrypted_file(requests[j].dest, file, requests[j].offset, requests[j].key);
+                    continue;
+                }
+
+                fseek(file, requests[j].offset, SEEK_SET);
+                requests[j].error = extract_file(requests[j].dest, file, requests[j].size);
+            }
+        }
+
+        advise_file_range(file, window_start, extracted_end - window_start, false);
+
+        i = end;
+    }
+
+    for(int i = 0; i < request_count; ++i)
+    {
+        if(requests[i].key != NULL && requests[i].error != 0)
+        {
+            fprintf(cfg->output, "gdpc: Failed to decrypt \"%s\", the key may be wrong\n", requests[i].dest);
+        }
+        free((char*)requests[i].dest);
+    }
+    free(requests);
+
+    // Convert the resources once the files they may overwrite are extracted
+    for(int32_t i = 0; i < selected_count && cfg->convert == true; ++i)
+    {
+        get_file(pack, &cursor, selected[i], &file_entry);
+        if(is_import(file_entry.path) == true) convert_resource(&file_entry, pack, file, cfg);
+    }
+
+    path_cursor_free(&cursor);
+    free(selected);
+
+    return 0;
+}
+
+/* File header
+ * 1 x 4B  | String | Magic Number (0x47445043)
+ * 1 x 4B  | Int    | ?
+ * 3 x 4B  | Int    | Engine version
+ * 1 x 64B | Void   | Reserved
+ * 1 x 4B  | Int    | Number of packaged files 
+*/
+int create_pack(config* cfg)
+{
+    create_path(cfg->destination);
+
+    if(cfg->verbose == true)
+    {
+        // If creating a file...
+        if(cfg->operation_mode == OPERATION_MODE_CREATE)
+        {
+            fprintf(cfg->output, "Creating \033[4m%s\033[24m (v%d.%d.%d)\n", cfg->destination, cfg->version_major, cfg->version_minor, cfg->version_revision);
+        }
+        // If updating a file...
+        else
+        {
+            char** input_files = cfg->input_files.data;
+            fprintf(cfg->output, "Updating \033[4m%s\033[24m\n", input_files[cfg->input_files.size - 1]);
+        }
+    }
+
+    // Build file header
+    char header[100] = { 0 };
+    int32_t format_version = 0;
+    if(cfg->operation_mode == OPERATION_MODE_CREATE)
+    {
+        // Create file header from configuration
+        memcpy(header, "GDPC", 4); // Magic number
+        memcpy(header + 8, &cfg->version_major, 4); // Engine version
+        memcpy(header + 12, &cfg->version_minor, 4);
+        memcpy(header + 16, &cfg->version_revision, 4);
+
+        if(cfg->version_major >= 4 || cfg->encrypt == true)
+        {
+            format_version = PACK_FORMAT_VERSION_4;
+        }
+    }
+    else
+    {
+        // Copy file header from package
+        FILE* original = fopen(cfg->input_files.data[cfg->input_files.size - 1], "r");
+        if(original == NULL)
+        {
+            fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", cfg->input_files.data[cfg->input_files.size - 1]);
+            return 1;
+        }
+
+        fread(header, 1, 20, original);
+        memcpy(&format_version, header + 4, 4);
+
+        // Packages with an encrypted file list stay encrypted
+        uint32_t pack_flags = 0;
+        if(format_version == PACK_FORMAT_VERSION_4)
+        {
+            fread(&pack_flags, 4, 1, original);
+        }
+        fclose(original);
+
+        // Without files to add, an update only completes the one that was interrupted
+        if(cfg->input_files.size == 1)
+        {
+            return update_pack(cfg->input_files.data[0], cfg);
+        }
+
+        // Encrypting every file of a package means writing it again, otherwise the new files are added in place
+        bool rewrite = (cfg->encrypt == true && (pack_flags & PACK_DIR_ENCRYPTED) == 0);
+
+        if((pack_flags & PACK_DIR_ENCRYPTED) != 0)
+        {
+            cfg->encrypt = true;
+        }
+
+        if(cfg->encrypt == true && cfg->has_encryption_key == false)
+        {
+            fprintf(cfg->output, "gdpc: \"%s\" is encrypted, set GODOT_SCRIPT_ENCRYPTION_KEY or use --key-file\n", cfg->input_files.data[cfg->input_files.size - 1]);
+            return 1;
+        }
+
+        if(rewrite == false)
+        {
+            return update_pack(cfg->input_files.data[cfg->input_files.size - 1], cfg);
+        }
+
+        format_version = PACK_FORMAT_VERSION_4;
+    }
+
+    /* Godot 4 file header
+     * 1 x 4B  | String | Magic number "GDPC"
+     * 1 x 4B  | Int    | Format version (2)
+     * 3 x 4B  | Int    | Engine version
+     * 1 x 4B  | Int    | Flags (PACK_DIR_ENCRYPTED)
+     * 1 x 8B  | Int    | Offset the offsets of the files are relative to
+     * 16 x 4B | Int    | Reserved
+     * 1 x 4B  | Int    | Number of files
+    */
+    int64_t header_size = 88;
+    if(format_version == PACK_FORMAT_VERSION_4)
+    {
+        uint32_t pack_flags = (cfg->encrypt == true) ? PACK_DIR_ENCRYPTED : 0;
+        memcpy(header + 4, &format_version, 4);
+        memcpy(header + 20, &pack_flags, 4);
+        header_size = 100;
+    }
+    else
+    {
+        memset(header + 4, 0, 4);
+    }
+
+    // Package the files of a tar stream as they arrive
+    if(cfg->tar_file != NULL)
+    {
+        return write_tar_pack(header, header_size, format_version, cfg);
+    }
+
+    // Gather the files to package
+    pack_entry_vector files;
+    pack_entry_vector_init(&files);
+
+    path_index index = { NULL, 0, 0, { NULL, 0, 0 } };
+    hash_vector_init(&index.hashes);
+
+    write_file_list(&files, &index, cfg->input_files.data, cfg->input_files.size, cfg);
+
+    free(index.slots);
+    hash_vector_free(&index.hashes);
+
+    // Split the files between several packages if they don't fit in one
+    int error;
+    if(cfg->max_pack_size > 0)
+    {
+        error = write_shards(header, header_size, format_version, &files, cfg);
+    }
+    else
+    {
+        error = write_pack(cfg->destination, header, header_size, format_version, &files, cfg);
+    }
+
+    // Clean up
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        free(files.data[i].name);
+    }
+
+    pack_entry_vector_free(&files);
+
+    if(error != 0)
+    {
+        return 1;
+    }
+
+    // If updating a packge
+    if(cfg->operation_mode == OPERATION_MODE_UPDATE)
+    {
+        char* old_package = cfg->input_files.data[cfg->input_files.size - 1];
+
+        // Replace the old package at once, the new one is on disk already
+        if(rename(cfg->destination, old_package) != 0)
+        {
+            fprintf(cfg->output, "gdpc: Failed to replace \"%s\"\n", old_package);
+            remove(cfg->destination);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int write_pack(const char* path, 
+                      const char* base_header, 
+                      int64_t header_size, 
+                      int32_t format_version, 
+                      pack_entry_vector* files, 
+                      config* cfg
+                      )
+{
+    FILE* pack = fopen(path, "wb");
+    if(pack == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to create file \"%s\"\n", path);
+        return 1;
+    }
+
+    // Store number of files
+    char header[100];
+    memcpy(header, base_header, header_size);
+
+    uint32_t file_count = files->size;
+    memcpy(header + header_size - 4, &file_count, 4);
+
+    int64_t total_size = 0;
+    for(size_t i = 0; i < files->size; ++i)
+    {
+        total_size += files->data[i].source.size;
+    }
+    progress_add_total(total_size, files->size);
+
+    // Lay out the whole package in memory before writing anything
+    int64_t list_offset = header_size;
+    int64_t list_size, files_offset, pack_size;
+    char* list = build_file_list(files, list_offset, format_version, cfg, &list_size, &files_offset, &pack_size);
+
+    if(format_version == PACK_FORMAT_VERSION_4)
+    {
+        memcpy(header + 24, &files_offset, 8);
+    }
+
+    // The file list is encrypted as a whole
+    char* encrypted = NULL;
+    if(cfg->encrypt == true)
+    {
+        int64_t encrypted_size;
+        encrypted = encrypt_data(list, list_size, cfg->encryption_key, &encrypted_size);
+        free(list);
+        list = NULL;
+        list_size = encrypted_size;
+    }
+
+    // Reserve the package on disk, then write the header and file list at once
+    preallocate_file(pack, pack_size);
+
+    io_buffer buffers[2] = { { header, header_size }, { (encrypted != NULL) ? encrypted : list, list_size } };
+    int error = write_buffers(pack, buffers, 2);
+
+    // Write files
+    if(error == 0)
+    {
+        write_files(pack, files, list_offset, files_offset, format_version, cfg);
+    }
+
+    free(list);
+    buffer_pool_release(encrypted);
+
+    // An updated package replaces the old one, it must be complete first
+    if(error == 0 && cfg->operation_mode == OPERATION_MODE_UPDATE && cfg->durability != DURABILITY_NONE)
+    {
+        error = sync_file(pack, cfg->durability == DURABILITY_FULL);
+    }
+
+    if(fclose(pack) != 0)
+    {
+        error = 1;
+    }
+
+    if(error != 0)
+    {
+        fprintf(cfg->output, "gdpc: Failed to write to file \"%s\"\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Package created from a tar stream
+ * The archive is read once, front to back, so it can come from a pipe. The files are copied as they arrive after
+ * space reserved for the file list, which is only written at the end. The offsets of the files don't require them to
+ * follow the list, so unused reserve stays as a gap, and a list larger than its reserve moves the files further. An
+ * archive read from a file is scanned first to reserve the exact size of the list.
+*/
+static int write_tar_pack(const char* base_header, 
+                          int64_t header_size, 
+                          int32_t format_version, 
+                          config* cfg
+                          )
+{
+    // Open the archive, "-" being the standard input
+    FILE* source = stdin;
+    if(strcmp(cfg->tar_file, "-") != 0)
+    {
+        source = fopen(cfg->tar_file, "rb");
+        if(source == NULL)
+        {
+            fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", cfg->tar_file);
+            return 1;
+        }
+    }
+
+    tar_reader tar;
+    tar_reader_init(&tar, source);
+
+    // Reserve the space of the list as it's stored
+    int64_t reserve = cfg->list_reserve;
+    if(reserve == 0)
+    {
+        reserve = (source != stdin) ? measure_tar_list(&tar, format_version, cfg) : TAR_LIST_RESERVE;
+        if(reserve < 0 || fseek(source, 0, SEEK_SET) != 0)
+        {
+            reserve = TAR_LIST_RESERVE;
+            if(source != stdin)
+            {
+                fprintf(cfg->output, "gdpc: Invalid tar archive \"%s\"\n", cfg->tar_file);
+                tar_reader_free(&tar);
+                fclose(source);
+                return 1;
+            }
+        }
+        tar.unread = 0;
+    }
+    if(cfg->encrypt == true)
+    {
+        reserve = get_encrypted_size(reserve);
+    }
+
+    FILE* pack = fopen(cfg->destination, "wb+");
+    if(pack == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to create file \"%s\"\n", cfg->destination);
+        tar_reader_free(&tar);
+        if(source != stdin) fclose(source);
+        return 1;
+    }
+
+    pack_entry_vector files;
+    pack_entry_vector_init(&files);
+
+    path_index index = { NULL, 0, 0, { NULL, 0, 0 } };
+    hash_vector_init(&index.hashes);
+
+    // Copy each file after the reserve
+    int64_t files_offset = (header_size + reserve + 15) / 16 * 16;
+    int64_t file_offset = files_offset;
+    fseek(pack, files_offset, SEEK_SET);
+
+    int result;
+    while((result = next_tar_file(&tar)) == 1)
+    {
+        int32_t len;
+        char* name = get_tar_name(tar.path, &len);
+        if(name == NULL || !is_whitelisted(name, len, cfg) || is_blacklisted(name, len, cfg))
+        {
+            free(name);
+            continue;
+        }
+
+        progress_add_total(tar.size, 1);
+
+        // Print additional informative message if --verbose
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Packaging \"%s\"\n", name);
+        }
+
+        int64_t size;
+        if(cfg->encrypt == true)
+        {
+            size = copy_encrypted_data(pack, source, tar.size, cfg->encryption_key);
+        }
+        else
+        {
+            size = copy_data(pack, source, tar.size);
+        }
+        tar.unread -= size;
+        progress_add(0, 1);
+
+        if(size != tar.size)
+        {
+            free(name);
+            result = -1;
+            break;
+        }
+
+        // A later file with the same path replaces the earlier one, as extracting the archive would
+        pack_entry entry = { { NULL, 0, file_offset, tar.size, { 0 }, false }, name, len };
+        int32_t existing = insert_path(&index, &files, name);
+        if(existing >= 0)
+        {
+            free(files.data[existing].name);
+            files.data[existing] = entry;
+        }
+        else
+        {
+            pack_entry_vector_push_back(&files, entry);
+        }
+
+        file_offset += (cfg->encrypt == true) ? get_encrypted_size(tar.size) : tar.size;
+    }
+
+    free(index.slots);
+    hash_vector_free(&index.hashes);
+    tar_reader_free(&tar);
+    if(source != stdin) fclose(source);
+
+    int error = 0;
+    if(result < 0)
+    {
+        fprintf(cfg->output, "gdpc: Invalid tar archive \"%s\"\n", cfg->tar_file);
+        error = 1;
+    }
+
+    // Move the files further if the list doesn't fit its reserve
+    int64_t list_size = 0;
+    for(size_t i = 0; i < files.size && error == 0; ++i)
+    {
+        list_size += get_list_item_size(files.data[i].name_len, format_version);
+    }
+
+    int64_t stored_size = (cfg->encrypt == true) ? get_encrypted_size(list_size) : list_size;
+    int64_t list_end = (header_size + stored_size + 15) / 16 * 16;
+    if(error == 0 && list_end > files_offset)
+    {
+        int64_t distance = list_end - files_offset;
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Moving the files by %ldB to fit the file list\n", distance);
+        }
+
+        error = move_data(pack, files_offset, file_offset - files_offset, distance);
+        for(size_t i = 0; i < files.size; ++i)
+        {
+            files.data[i].source.offset += distance;
+        }
+        files_offset = list_end;
+    }
+
+    if(error == 0)
+    {
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "Storing %d files\n", (int)files.size);
+        }
+
+        // Fill in the header and the list, with the offsets the files were copied to
+        char header[100];
+        memcpy(header, base_header, header_size);
+
+        uint32_t file_count = files.size;
+        memcpy(header + header_size - 4, &file_count, 4);
+
+        int64_t file_base = 0;
+        if(format_version == PACK_FORMAT_VERSION_4)
+        {
+            file_base = files_offset;
+            memcpy(header + 24, &file_base, 8);
+        }
+
+        char* list = malloc(list_size > 0 ? list_size : 1);
+        if(list == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        char* itr = list;
+        for(size_t i = 0; i < files.size; ++i)
+        {
+            itr = write_list_item(itr, &files.data[i], files.data[i].source.offset - file_base, cfg->encrypt, format_version);
+        }
+
+        // The file list is encrypted as a whole
+        char* encrypted = NULL;
+        if(cfg->encrypt == true)
+        {
+            encrypted = encrypt_data(list, list_size, cfg->encryption_key, &list_size);
+        }
+
+        io_buffer buffers[2] = { { header, header_size }, { (encrypted != NULL) ? encrypted : list, list_size } };
+        error = (fseek(pack, 0, SEEK_SET) != 0) ? 1 : write_buffers(pack, buffers, 2);
+
+        free(list);
+        buffer_pool_release(encrypted);
+    }
+
+    if(fclose(pack) != 0 && error == 0)
+    {
+        error = 1;
+        fprintf(cfg->output, "gdpc: Failed to write to file \"%s\"\n", cfg->destination);
+    }
+
+    // Without its header and list, what was copied can't be read
+    if(error != 0)
+    {
+        remove(cfg->destination);
+    }
+
+    // Clean up
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        free(files.data[i].name);
+    }
+    pack_entry_vector_free(&files);
+
+    return error;
+}
+
+// Returns the size of the file list of the archive, -1 if it's invalid
+static int64_t measure_tar_list(tar_reader* tar, 
+                                int32_t format_version, 
+                                config* cfg
+                                )
+{
+    int64_t list_size = 0;
+
+    int result;
+    while((result = next_tar_file(tar)) == 1)
+    {
+        int32_t len;
+        char* name = get_tar_name(tar->path, &len);
+        if(name != NULL && is_whitelisted(name, len, cfg) && !is_blacklisted(name, len, cfg))
+        {
+            list_size += get_list_item_size(len, format_version);
+        }
+        free(name);
+    }
+
+    return (result < 0) ? -1 : list_size;
+}
+
+// Returns the path of the file of the archive in the package, NULL if it has none
+static char* get_tar_name(const char* path, 
+                          int32_t* len
+                          )
+{
+    // Paths are relative to the root of the project
+    while(path[0] == '/' || (path[0] == '.' && path[1] == '/'))
+    {
+        path += (path[0] == '/') ? 1 : 2;
+    }
+
+    size_t path_len = strlen(path);
+    if(path_len == 0)
+    {
+        return NULL;
+    }
+
+    char* name = malloc(path_len + 7);
+    if(name == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    memcpy(name, "res://", 6);
+    memcpy(name + 6, path, path_len + 1);
+    *len = path_len + 6;
+
+    return name;
+}
+
+// Moves a range of the file further, copying from its end so it isn't overwritten
+static int move_data(FILE* file, 
+                     int64_t offset, 
+                     int64_t length, 
+                     int64_t distance
+                     )
+{
+    char* buf = buffer_pool_acquire(BUFFER_BLOCK_SIZE);
+
+    int error = 0;
+    int64_t done = 0;
+    while(done < length && error == 0)
+    {
+        int64_t chunk = (length - done < BUFFER_BLOCK_SIZE) ? length - done : BUFFER_BLOCK_SIZE;
+        int64_t start = offset + length - done - chunk;
+
+        error = fseek(file, start, SEEK_SET) != 0 || fread(buf, 1, chunk, file) != (size_t)chunk
+             || fseek(file, start + distance, SEEK_SET) != 0 || fwrite(buf, 1, chunk, file) != (size_t)chunk;
+
+        done += chunk;
+    }
+
+    buffer_pool_release(buf);
+
+    return error;
+}
+
+static int write_shards(const char* header, 
+                        int64_t header_size, 
+                        int32_t format_version, 
+                        pack_entry_vector* files, 
+                        config* cfg
+                        )
+{
+    pack_entry* entries = files->data;
+
+    // Assign each file to a shard
+    int32_t* shard_of = malloc((files->size > 0 ? files->size : 1) * sizeof(int32_t));
+    if(shard_of == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    int32_t shard_count = partition_files(files, header_size, format_version, cfg, shard_of);
+
+    pack_shard* shards = calloc(shard_count, sizeof(pack_shard));
+    if(shards == NULL)
+    {
+        fprintf(stderr, "calloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(int32_t i = 0; i < shard_count; ++i)
+    {
+        shards[i].path = get_shard_path(cfg->destination, i);
+        shards[i].header = header;
+        shards[i].header_size = header_size;
+        shards[i].format_version = format_version;
+        shards[i].cfg = cfg;
+        pack_entry_vector_init(&shards[i].files);
+    }
+
+    // The paths are shared with the whole list, which frees them
+    for(size_t i = 0; i < files->size; ++i)
+    {
+        pack_shard* shard = &shards[shard_of[i]];
+        pack_entry_vector_push_back(&shard->files, entries[i]);
+    }
+
+    // Write every shard at once, each source file is read by the shard that holds it
+    thread_pool pool;
+    thread_pool_init(&pool, get_processor_count());
+
+    for(int32_t i = 0; i < shard_count; ++i)
+    {
+        thread_pool_submit(&pool, write_shard, &shards[i]);
+    }
+
+    thread_pool_wait(&pool);
+    thread_pool_free(&pool);
+
+    int error = 0;
+    for(int32_t i = 0; i < shard_count; ++i)
+    {
+        if(shards[i].error != 0)
+        {
+            error = 1;
+        }
+    }
+
+    if(error == 0)
+    {
+        error = write_shard_manifest(shards, shard_count, cfg);
+    }
+
+    if(cfg->verbose == true)
+    {
+        fprintf(cfg->output, "Split into %d packages\n", shard_count);
+    }
+
+    // Clean up
+    for(int32_t i = 0; i < shard_count; ++i)
+    {
+        free(shards[i].path);
+        pack_entry_vector_free(&shards[i].files);
+    }
+
+    free(shards);
+    free(shard_of);
+
+    return error;
+}
+
+static void write_shard(void* arg)
+{
+    pack_shard* shard = (pack_shard*)arg;
+    shard->error = write_pack(shard->path, shard->header, shard->header_size, shard->format_version, &shard->files, shard->cfg);
+}
+
+/* Shards of a package
+ * Files are sorted by path and grouped by directory. Files larger than a quarter of a package are placed on their own.
+ * Groups that don't fit in a package are split, then the groups and large files are bin-packed into as few packages
+ * as they fit in, largest first.
+*/
+static int32_t partition_files(pack_entry_vector* files, 
+                               int64_t header_size, 
+                               int32_t format_version, 
+                               config* cfg, 
+                               int32_t* shard_of
+                               )
+{
+    pack_entry* entries = files->data;
+    size_t count = files->size;
+
+    // Space left for the files once the header, the encryption of the list and the alignment of the files are counted
+    int64_t capacity = cfg->max_pack_size - header_size - 16;
+    if(cfg->encrypt == true)
+    {
+        capacity -= ENCRYPTED_HEADER_SIZE + 16;
+    }
+
+    // Small files sorted by path so directories are contiguous, then large files
+    shard_item* order = malloc((count > 0 ? count : 1) * sizeof(shard_item));
+    if(order == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        int64_t stored_size = is_stored_encrypted(&entries[i].source, format_version, cfg) ? get_encrypted_size(entries[i].source.size) : entries[i].source.size;
+        order[i].name = entries[i].name;
+        order[i].index = i;
+        order[i].cost = stored_size + get_list_item_size(entries[i].name_len, format_version);
+        order[i].large = order[i].cost > capacity / 4;
+    }
+
+    qsort(order, count, sizeof(shard_item), compare_shard_items);
+
+    // Split the files into groups: runs of small files of the same directory, and each large file
+    shard_group_vector groups;
+    shard_group_vector_init(&groups);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        shard_group* last = (groups.size > 0) ? &groups.data[groups.size - 1] : NULL;
+        bool joins = last != NULL && order[i].large == false && order[last->first].large == false &&
+                     last->cost + order[i].cost <= capacity &&
+                     is_same_directory(order[last->first].name, order[i].name);
+
+        if(joins == true)
+        {
+            last->count++;
+            last->cost += order[i].cost;
+        }
+        else
+        {
+            shard_group group = { i, 1, order[i].cost, 0 };
+            shard_group_vector_push_back(&groups, group);
+        }
+    }
+
+    // Bin-pack the groups, largest first, into the first shard they fit in
+    shard_group* group_list = groups.data;
+    shard_group** by_cost = malloc((groups.size > 0 ? groups.size : 1) * sizeof(shard_group*));
+    if(by_cost == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(size_t i = 0; i < groups.size; ++i)
+    {
+        by_cost[i] = &group_list[i];
+    }
+
+    qsort(by_cost, groups.size, sizeof(shard_group*), compare_shard_groups);
+
+    size_vector free_space;
+    size_vector_init(&free_space);
+
+    for(size_t i = 0; i < groups.size; ++i)
+    {
+        shard_group* group = by_cost[i];
+        int64_t* space = free_space.data;
+
+        size_t shard = 0;
+        while(shard < free_space.size && space[shard] < group->cost)
+        {
+            ++shard;
+        }
+
+        if(shard == free_space.size)
+        {
+            if(group->cost > capacity)
+            {
+                fprintf(cfg->output, "gdpc: \"%s\" is larger than the maximum package size, it's packaged on its own\n", order[group->first].name);
+            }
+
+            int64_t remaining = capacity - group->cost;
+            size_vector_push_back(&free_space, remaining);
+        }
+        else
+        {
+            space[shard] -= group->cost;
+        }
+
+        group->shard = shard;
+    }
+
+    // Files keep the order of their paths within each shard
+    for(size_t i = 0; i < groups.size; ++i)
+    {
+        for(size_t j = group_list[i].first; j < group_list[i].first + group_list[i].count; ++j)
+        {
+            shard_of[order[j].index] = group_list[i].shard;
+        }
+    }
+
+    int32_t shard_count = (free_space.size > 0) ? free_space.size : 1;
+
+    free(order);
+    free(by_cost);
+    shard_group_vector_free(&groups);
+    size_vector_free(&free_space);
+
+    return shard_count;
+}
+
+static int compare_shard_items(const void* a, const void* b)
+{
+    const shard_item* left = (const shard_item*)a;
+    const shard_item* right = (const shard_item*)b;
+
+    if(left->large != right->large)
+    {
+        return (left->large == false) ? -1 : 1;
+    }
+
+    return strcmp(left->name, right->name);
+}
+
+static int compare_shard_groups(const void* a, const void* b)
+{
+    const shard_group* left = *(const shard_group* const*)a;
+    const shard_group* right = *(const shard_group* const*)b;
+
+    if(left->cost != right->cost)
+    {
+        return (left->cost > right->cost) ? -1 : 1;
+    }
+
+    // Keep the order of the paths between groups of the same size
+    return (left->first < right->first) ? -1 : (left->first > right->first);
+}
+
+static bool is_same_directory(const char* a, const char* b)
+{
+    const char* a_end = strrchr(a, '/');
+    const char* b_end = strrchr(b, '/');
+
+    return (a_end - a) == (b_end - b) && strncmp(a, b, a_end - a) == 0;
+}
+
+// The first shard is the destination, the others are numbered before its extension: game.pck, game.1.pck, ...
+static char* get_shard_path(const char* destination, int32_t shard)
+{
+    size_t len = strlen(destination);
+    char* path = malloc(len + 16);
+    if(path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    if(shard == 0)
+    {
+        memcpy(path, destination, len + 1);
+        return path;
+    }
+
+    const char* extension = strrchr(destination, '.');
+    const char* name = strrchr(destination, '/');
+    if(extension == NULL || (name != NULL && extension < name))
+    {
+        extension = destination + len;
+    }
+
+    int stem_len = extension - destination;
+    sprintf(path, "%.*s.%d%s", stem_len, destination, shard, extension);
+
+    return path;
+}
+
+/* Manifest of the shards (<destination>.manifest)
+ * Tab separated lines of the package, path and size of each file, after a header line
+*/
+static int write_shard_manifest(pack_shard* shards, 
+                                int32_t shard_count, 
+                                config* cfg
+                                )
+{
+    size_t len = strlen(cfg->destination);
+    char* path = malloc(len + 10);
+    if(path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+    memcpy(path, cfg->destination, len);
+    memcpy(path + len, ".manifest", 10);
+
+    FILE* manifest = fopen(path, "w");
+    if(manifest == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to create file \"%s\"\n", path);
+        free(path);
+        return 1;
+    }
+
+    fputs("pack\tpath\tsize\n", manifest);
+    for(int32_t i = 0; i < shard_count; ++i)
+    {
+        pack_entry* entries = shards[i].files.data;
+        for(size_t j = 0; j < shards[i].files.size; ++j)
+        {
+            fprintf(manifest, "%s\t%s\t%ld\n", shards[i].path, entries[j].name, entries[j].source.size);
+        }
+    }
+
+    int error = 0;
+    if(fclose(manifest) != 0)
+    {
+        fprintf(cfg->output, "gdpc: Failed to write to file \"%s\"\n", path);
+        error = 1;
+    }
+
+    free(path);
+
+    return error;
+}
+
+/* Update journal, at the end of the package while an update is committed
+ * n x 1B  | Void   | Header and file list of the updated package, padded to 16B
+ * 1 x 8B  | Int    | Offset of the journal, where the files of the package end
+ * 1 x 8B  | Int    | Size of the header and file list
+ * 1 x 16B | ?      | MD5 of the header, file list and both sizes
+ * 1 x 4B  | String | Magic number "GDPJ"
+*/
+static int update_pack(const char* path, 
+                       config* cfg
+                       )
+{
+    FILE* pack = fopen(path, "rb+");
+    if(pack == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", path);
+        return 1;
+    }
+
+    // Finish an update interrupted once it was committed, before reading the package
+    if(recover_update(pack, path, cfg) != 0)
+    {
+        fclose(pack);
+        return 1;
+    }
+
+    if(cfg->input_files.size == 1)
+    {
+        fclose(pack);
+        return 0;
+    }
+
+    gd_pack package;
+    if(load_pack(path, &package, cfg) != 0)
+    {
+        fclose(pack);
+        return 1;
+    }
+
+    // The header stays as it is, but for the number of files and their base
+    char header[100];
+    int64_t header_size = package.header_size;
+    int32_t format_version = package.format_version;
+    read_range(pack, 0, header, header_size);
+
+    // Gather the new files, they replace the packaged files with the same path
+    pack_entry_vector files;
+    pack_entry_vector_init(&files);
+
+    path_index index = { NULL, 0, 0, { NULL, 0, 0 } };
+    hash_vector_init(&index.hashes);
+
+    write_file_list(&files, &index, cfg->input_files.data, cfg->input_files.size - 1, cfg);
+    size_t new_count = files.size;
+
+    // Keep the other packaged files where they are. Nothing the package references is overwritten before the commit
+    int64_t data_end = 0;
+    pack_entry_vector_reserve(&files, files.size + package.file_count);
+
+    path_cursor cursor;
+    path_cursor_init(&cursor, &package);
+
+    gd_file packaged;
+    while(next_file(&package, &cursor, &packaged) == true)
+    {
+        int64_t stored_size = (packaged.encrypted == true) ? get_encrypted_size(packaged.size) : packaged.size;
+        if(packaged.offset + stored_size > data_end)
+        {
+            data_end = packaged.offset + stored_size;
+        }
+
+        char* name = malloc(packaged.len + 1);
+        if(name == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+        memcpy(name, packaged.path, packaged.len + 1);
+
+        if(insert_path(&index, &files, name) >= 0)
+        {
+            free(name);
+            continue;
+        }
+
+        pack_entry entry = { { NULL, 0, packaged.offset, packaged.size, { 0 }, packaged.encrypted }, name, packaged.len };
+        pack_entry_vector_push_back(&files, entry);
+    }
+
+    path_cursor_free(&cursor);
+
+    free(index.slots);
+    hash_vector_free(&index.hashes);
+
+    // Size of the new header and file list
+    pack_entry* entries = files.data;
+    int64_t list_size = 0;
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        list_size += get_list_item_size(entries[i].name_len, format_version);
+    }
+
+    int64_t stored_size = (cfg->encrypt == true) ? get_encrypted_size(list_size) : list_size;
+    int64_t front_size = (header_size + stored_size + 15) / 16 * 16;
+
+    // When files have to make room for the list, make room for it to grow a quarter as well, so the next updates
+    // don't move files again
+    for(size_t i = new_count; i < files.size; ++i)
+    {
+        if(entries[i].source.offset < front_size)
+        {
+            front_size = (header_size + stored_size + stored_size / 4 + 15) / 16 * 16;
+            break;
+        }
+    }
+    if(front_size > data_end)
+    {
+        data_end = front_size;
+    }
+
+    // Append the new files, and the packaged files the larger list will overwrite
+    int64_t total_size = 0;
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        if(i < new_count || entries[i].source.offset < front_size)
+        {
+            total_size += entries[i].source.size;
+        }
+    }
+    progress_add_total(total_size, new_count);
+
+    int error = 0;
+    int64_t file_offset = data_end;
+    fseek(pack, file_offset, SEEK_SET);
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        gd_file* gdf = &entries[i].source;
+        bool moved = (i >= new_count && gdf->offset < front_size);
+        if(i >= new_count && moved == false)
+        {
+            continue;
+        }
+
+        // Packaged files are moved as they're stored
+        bool encrypted = (moved == true) ? gdf->encrypted : is_stored_encrypted(gdf, format_version, cfg);
+        int64_t stored_size = (encrypted == true) ? get_encrypted_size(gdf->size) : gdf->size;
+
+        FILE* file = fopen((moved == true) ? path : gdf->path, "rb");
+        bool missing_key = gdf->encrypted == true && encrypted == false && cfg->has_encryption_key == false;
+        if(file == NULL || missing_key == true)
+        {
+            if(file == NULL)
+            {
+                fprintf(cfg->output, "gdpc: Failed to read from file \"%s\"\n", (moved == true) ? path : gdf->path);
+            }
+            else
+            {
+                fprintf(cfg->output, "gdpc: \"%s\" is encrypted, set GODOT_SCRIPT_ENCRYPTION_KEY or use --key-file\n", entries[i].name);
+                fclose(file);
+            }
+
+            // A packaged file can't be lost, a new one is stored empty
+            if(moved == true)
+            {
+                error = 1;
+                break;
+            }
+
+            gdf->size = 0;
+            gdf->offset = file_offset;
+            gdf->encrypted = false;
+            continue;
+        }
+
+        // Print additional informative message if --verbose
+        if(cfg->verbose == true)
+        {
+            fprintf(cfg->output, "%s \"%s\"\n", (moved == true) ? "Moving" : "Packaging", entries[i].name);
+        }
+
+        int64_t size = copy_file_data(pack, file, gdf, encrypted, cfg);
+        fclose(file);
+        if(moved == false)
+        {
+            progress_add(0, 1);
+        }
+
+        if(size != gdf->size)
+        {
+            fprintf(cfg->output, "gdpc: Failed to read from file \"%s\"\n", (moved == true) ? path : gdf->path);
+            if(moved == true)
+            {
+                error = 1;
+                break;
             }
-
-            file_list[i].path = new;
+            fseek(pack, file_offset + stored_size, SEEK_SET);
         }
 
-        // Get the offset
-        fread(&file_list[i].offset, 8, 1, pack);
-        // Get the size
-        fread(&file_list[i].size, 8, 1, pack);
-
-        // Skip MD5
-        fseek(pack, 16, SEEK_CUR);
+        gdf->offset = file_offset;
+        gdf->encrypted = encrypted;
+        file_offset += stored_size;
     }
 
-    if(cfg->operation_mode == OPERATION_MODE_LIST)
+    // Lay out the new header and file list, the files following them from the 16B boundary
+    char* front = calloc(front_size, 1);
+    char* list = malloc(list_size > 0 ? list_size : 1);
+    if(front == NULL || list == NULL)
     {
-        for(int i = 0; i < file_count; ++i)
-        {
-            printf("%s\n", file_list[i].path);
-        }
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
     }
 
-    return 0;
-}
+    memcpy(front, header, header_size);
 
-static int read_files(FILE* pack, 
-                      gd_file* file_list, 
-                      int file_count, 
-                      config* cfg)
-{
-    size_t dest_len = strlen(cfg->destination);
+    uint32_t file_count = files.size;
+    memcpy(front + header_size - 4, &file_count, 4);
 
-    // For each files in the pack...
-    for(int i = 0; i < file_count; ++i)
+    int64_t file_base = 0;
+    if(format_version == PACK_FORMAT_VERSION_4)
     {
-        // Get file info
-        gd_file* file_info = &file_list[i];
+        file_base = front_size;
+        memcpy(front + 24, &file_base, 8);
+    }
 
-        // If the file should be extracted...
-        if(is_whitelisted(file_info->path, file_info->len, cfg) && !is_blacklisted(file_info->path, file_info->len, cfg))
-        {
-            if(cfg->verbose == true)
-            {
-                printf("Extracting \"%s\" (%ldB)\n", file_info->path, file_info->size);
-            }
+    char* itr = list;
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        itr = write_list_item(itr, &entries[i], entries[i].source.offset - file_base, entries[i].source.encrypted, format_version);
+    }
 
-            // Extract the file
-            char* path = generate_path(file_info->path, cfg->destination, dest_len);
-            create_path(path);
+    // The file list is encrypted as a whole
+    if(cfg->encrypt == true)
+    {
+        int64_t encrypted_size;
+        char* encrypted = encrypt_data(list, list_size, cfg->encryption_key, &encrypted_size);
+        memcpy(front + header_size, encrypted, encrypted_size);
+        buffer_pool_release(encrypted);
+    }
+    else
+    {
+        memcpy(front + header_size, list, list_size);
+    }
+    free(list);
 
-            fseek(pack, file_info->offset, SEEK_SET);
-            int success = extract_file(path, pack, file_info->size);
+    // Commit: the journal is written after the files, and is on disk with them before anything is overwritten
+    char footer[JOURNAL_FOOTER_SIZE];
+    memcpy(footer, &file_offset, 8);
+    memcpy(footer + 8, &front_size, 8);
+    memcpy(footer + 32, "GDPJ", 4);
 
-            // Clean up
-            free(path);
+    md5_context md5;
+    md5_init(&md5);
+    md5_update(&md5, (const uint8_t*)front, front_size);
+    md5_update(&md5, (const uint8_t*)footer, 16);
+    md5_final(&md5, (uint8_t*)footer + 16);
 
-            if(success != 0)
-            {
-                continue;
-            }
+    if(error == 0)
+    {
+        io_buffer journal[2] = { { front, front_size }, { footer, JOURNAL_FOOTER_SIZE } };
+        error = write_buffers(pack, journal, 2);
+    }
+    if(error == 0 && cfg->durability != DURABILITY_NONE)
+    {
+        error = sync_file(pack, cfg->durability == DURABILITY_FULL);
+    }
+
+    // Swap the header and file list, then drop the journal once they're on disk
+    if(error == 0)
+    {
+        io_buffer swap = { front, front_size };
+        error = (fseek(pack, 0, SEEK_SET) != 0) ? 1 : write_buffers(pack, &swap, 1);
+
+        if(error == 0 && cfg->durability != DURABILITY_NONE)
+        {
+            error = sync_file(pack, cfg->durability == DURABILITY_FULL);
         }
-        else if(cfg->verbose == true)
+        if(error == 0)
         {
-            printf("Ignoring \"%s\"\n", file_info->path);
+            error = truncate_file(pack, file_offset);
         }
-
-        // Else if it's an .import file and resource files should be converted...
-        if(cfg->convert == true && is_import(file_info->path) == true)
+        if(error == 0 && cfg->durability == DURABILITY_FULL)
         {
-            // Extract resource
-            convert_resource(file_info, file_list, file_count, pack, cfg);
+            error = sync_file(pack, true);
         }
     }
+    else
+    {
+        // Nothing was committed, the package is left as it was
+        truncate_file(pack, data_end);
+    }
 
-    return 0;
-}
+    free(front);
 
-/* File header
- * 1 x 4B  | String | Magic Number (0x47445043)
- * 1 x 4B  | Int    | ?
- * 3 x 4B  | Int    | Engine version
- * 1 x 64B | Void   | Reserved
- * 1 x 4B  | Int    | Number of packaged files 
-*/
-int create_pack(config* cfg)
-{
-    // Create file
-    create_path(cfg->destination);
-    FILE* pack = fopen(cfg->destination, "wb");
-    if(pack == NULL)
+    if(fclose(pack) != 0)
     {
-        printf("gdpc: Failed to create file \"%s\"\n", cfg->destination);
-        return 1;
+        error = 1;
     }
 
-    if(cfg->verbose == true)
+    if(error != 0)
     {
-        // If creating a file...
-        if(cfg->operation_mode == OPERATION_MODE_CREATE)
-        {
-            printf("Creating \033[4m%s\033[24m (v%d.%d.%d)\n", cfg->destination, cfg->version_major, cfg->version_minor, cfg->version_revision);
-        }
-        // If updating a file...
-        else
-        {
-            char** input_files = (char**)cfg->input_files.data;
-            printf("Updating \033[4m%s\033[24m\n", input_files[cfg->input_files.size - 1]);
-        }
+        fprintf(cfg->output, "gdpc: Failed to write to file \"%s\"\n", path);
     }
 
-    // Write file header
-    if(cfg->operation_mode == OPERATION_MODE_CREATE)
+    // Clean up
+    for(size_t i = 0; i < files.size; ++i)
     {
-        // Create file header from configuration
-        char magic[4] = {'G', 'D', 'P', 'C'}; // Magic number
-        fwrite(magic, 1, 4, pack);
-
-        int32_t zero = 0;
-        fwrite(&zero, 1, 4, pack); // ?
+        free(files.data[i].name);
+    }
+    pack_entry_vector_free(&files);
+    free_pack(&package);
 
-        fwrite(&cfg->version_major, 4, 1, pack); // Engine version
-        fwrite(&cfg->version_minor, 4, 1, pack);
-        fwrite(&cfg->version_revision, 4, 1, pack);
+    return error;
+}
 
-        for(int i = 0; i < 16; ++i) fwrite(&zero, 4, 1, pack); // Reserved space
+// Writes the header and file list of a committed update again if they weren't all written, then drops the journal
+static int recover_update(FILE* pack, 
+                          const char* path, 
+                          config* cfg
+                          )
+{
+    fseek(pack, 0, SEEK_END);
+    int64_t size = ftell(pack);
 
-        fwrite(&zero, 4, 1, pack); // Number of files
+    int64_t journal_offset, front_size;
+    char* front = read_update_journal(pack, size, &journal_offset, &front_size);
+    if(front == NULL)
+    {
+        return 0;
     }
-    else
+
+    int error = 0;
+    char* current = front + front_size;
+    if(read_range(pack, 0, current, front_size) != 0 || memcmp(front, current, front_size) != 0)
     {
-        // Copy file header from package
-        char buf[88];
-        FILE* original = fopen(((char**)cfg->input_files.data)[cfg->input_files.size - 1], "r");
-        if(original == NULL)
+        fprintf(cfg->output, "gdpc: Completing the interrupted update of \"%s\"\n", path);
+
+        io_buffer swap = { front, front_size };
+        error = (fseek(pack, 0, SEEK_SET) != 0) ? 1 : write_buffers(pack, &swap, 1);
+        if(error == 0 && cfg->durability != DURABILITY_NONE)
         {
-            printf("gdpc: Failed to open file \"%s\"\n", ((char**)cfg->input_files.data)[cfg->input_files.size - 1]);
-            return 1;
+            error = sync_file(pack, cfg->durability == DURABILITY_FULL);
         }
+    }
 
-        fread(buf, 1, 88, original);
-        fwrite(buf, 1, 88, pack);
+    if(error == 0)
+    {
+        error = truncate_file(pack, journal_offset);
+    }
 
-        fclose(original);
+    free(front);
+
+    if(error != 0)
+    {
+        fprintf(cfg->output, "gdpc: Failed to write to file \"%s\"\n", path);
     }
 
-    // Write file list
-    dynamic_array files;
-    dynamic_array files_names;
-    dynamic_array files_names_lengths;
-    dynamic_array_init(&files, sizeof(gd_file));
-    dynamic_array_init(&files_names, sizeof(char*));
-    dynamic_array_init(&files_names_lengths, sizeof(int32_t));
+    return error;
+}
+
+// Whether the header and file list of the package are being overwritten by an update, or were left half written
+static bool is_update_interrupted(FILE* pack)
+{
+    int64_t position = ftell(pack);
+    fseek(pack, 0, SEEK_END);
+    int64_t size = ftell(pack);
 
-    write_file_list(pack, &files, &files_names, &files_names_lengths, cfg);
+    int64_t journal_offset, front_size;
+    char* front = read_update_journal(pack, size, &journal_offset, &front_size);
 
-    // Write files
-    int64_t list_offset = 88;
-    int64_t file_offset = ftell(pack);
+    // Once they're all written, only the journal is left to drop and the package reads the same
+    bool interrupted = false;
+    if(front != NULL)
+    {
+        char* current = front + front_size;
+        interrupted = (read_range(pack, 0, current, front_size) != 0 || memcmp(front, current, front_size) != 0);
+        free(front);
+    }
 
-    write_files(pack, &files, &files_names, &files_names_lengths, &list_offset, &file_offset, cfg);
+    fseek(pack, position, SEEK_SET);
 
-    // Clean up
-    char** arr = (char**)files_names.data;
-    for(size_t i = 0; i < files_names.size; ++i)
+    return interrupted;
+}
+
+// Returns the header and file list journaled by a committed update, followed by as much room, NULL if there's none
+static char* read_update_journal(FILE* pack, 
+                                 int64_t size, 
+                                 int64_t* journal_offset, 
+                                 int64_t* front_size
+                                 )
+{
+    char footer[JOURNAL_FOOTER_SIZE];
+    if(size < JOURNAL_FOOTER_SIZE || read_range(pack, size - JOURNAL_FOOTER_SIZE, footer, JOURNAL_FOOTER_SIZE) != 0 || memcmp(footer + 32, "GDPJ", 4) != 0)
     {
-        free(arr[i]);
+        return NULL;
     }
 
-    dynamic_array_free(&files);
-    dynamic_array_free(&files_names);
-    dynamic_array_free(&files_names_lengths);
+    memcpy(journal_offset, footer, 8);
+    memcpy(front_size, footer + 8, 8);
+    if(*journal_offset <= 0 || *front_size <= 0 || *journal_offset + *front_size + JOURNAL_FOOTER_SIZE != size || *front_size > *journal_offset)
+    {
+        return NULL;
+    }
 
-    fclose(pack);
+    char* front = malloc(*front_size * 2);
+    if(front == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
 
-    // If updating a packge
-    if(cfg->operation_mode == OPERATION_MODE_UPDATE)
+    // A journal that wasn't fully written belongs to an update that was never committed
+    uint8_t digest[16];
+    md5_context md5;
+    md5_init(&md5);
+    if(read_range(pack, *journal_offset, front, *front_size) == 0)
     {
-        char* old_package = ((char**)cfg->input_files.data)[cfg->input_files.size - 1];
+        md5_update(&md5, (const uint8_t*)front, *front_size);
+        md5_update(&md5, (const uint8_t*)footer, 16);
+    }
+    md5_final(&md5, digest);
 
-        // Overwrite old package
-        remove(old_package);
-        rename(cfg->destination, old_package);
+    if(memcmp(digest, footer + 16, 16) != 0)
+    {
+        free(front);
+        return NULL;
     }
 
-    return 0;
+    return front;
 }
 
-/* File list item
- * 1 x 4B  | Int    | String length
- *         | String | Path
- * 1 x 8B  | Int    | File offset
- * 1 x 8B  | Int    | File size
- * 1 x 16B | ?      | MD5
-*/
-static void write_file_list(FILE* pack, 
-                            dynamic_array* files, 
-                            dynamic_array* files_names, 
-                            dynamic_array* files_names_lengths, 
+static void write_file_list(pack_entry_vector* files, 
+                            path_index* index, 
+                            char** inputs, 
+                            size_t input_count, 
                             config* cfg)
 {
-    char** file_list = (char**)cfg->input_files.data;
-
     // For each input file
-    for(size_t i = 0; i < cfg->input_files.size; ++i)
+    for(size_t i = 0; i < input_count; ++i)
     {
-        char* file = file_list[i];
+        char* file = inputs[i];
 
-        // If file isn't a regular file, ignore it
-        if(is_regular_file(file) == false)
+        // If the file is a directory, add every file it contains that passes the filters
+        int64_t file_size;
+        if(stat_regular_file(file, &file_size) == false)
         {
-            continue;
+            if(is_directory(file) == false)
+            {
+                continue;
+            }
+
+            walked_file_vector walked;
+            walked_file_vector_init(&walked);
+            walk_directory(file, &walked, cfg);
+
+            // Room for every file up front, duplicates only leave some of it unused
+            pack_entry_vector_reserve(files, files->size + walked.size);
+            hash_vector_reserve(&index->hashes, files->size + walked.size);
+
+            walked_file* arr = walked.data;
+            for(size_t j = 0; j < walked.size; ++j)
+            {
+                write_file_list_item(files, index, arr[j].path, arr[j].len, arr[j].path + 6, arr[j].len - 6, 0, arr[j].size, false);
+            }
+
+            walked_file_vector_free(&walked);
         }
         // If the file isn't a .pck, add the file to the list
         else if(is_pck(file) == false)
@@ -372,128 +3128,289 @@ static void write_file_list(FILE* pack,
             strcat(path, res);
             strcat(path, file);
 
-            // Write item
-            write_file_list_item(pack, files, files_names, files_names_lengths, path, len, file, len - 6, 0, -1);
+            // Add item
+            write_file_list_item(files, index, path, len, file, len - 6, 0, file_size, false);
         }
         // If the file is a .pck, add each packaged file to the list
         else
         {
-            // Open file
-            FILE* package = fopen(file, "rb");
-            if(package == NULL)
+            // Read the file list, decrypting it if needed
+            gd_pack package;
+            if(load_pack(file, &package, cfg) != 0)
             {
-                printf("gdpc: Failed to open file \"%s\"\n", cfg->destination);
-                return;
+                break;
             }
 
-            // Get the number of files in the package
-            fseek(package, 84, SEEK_SET);
+            pack_entry_vector_reserve(files, files->size + package.file_count);
+            hash_vector_reserve(&index->hashes, files->size + package.file_count);
 
-            int32_t file_count;
-            fread(&file_count, 4, 1, package);
+            path_cursor cursor;
+            path_cursor_init(&cursor, &package);
 
             // For each file in the package
-            for(int32_t j = 0; j < file_count; ++j)
+            gd_file packaged;
+            while(next_file(&package, &cursor, &packaged) == true)
             {
-                // Get the length of the string
-                int32_t str_len;
-                fread(&str_len, 4, 1, package);
-
                 // Get the path
-                char* path = malloc(str_len + 1);
-                fread(path, 1, str_len, package);
-                path[str_len] = '\0';
-
-                // Get the offset and size
-                int64_t offset, size;
-                fread(&offset, 8, 1, package);
-                fread(&size, 8, 1, package);
-
-                // Skip MD5
-                fseek(package, 16, SEEK_CUR);
-
-                // Write item
-                write_file_list_item(pack, files, files_names, files_names_lengths, path, str_len, file, strlen(file), offset, size);
+                char* path = malloc(packaged.len + 1);
+                if(path == NULL)
+                {
+                    fprintf(stderr, "malloc(): failed to allocate memory.\n");
+                    abort();
+                }
+                memcpy(path, packaged.path, packaged.len + 1);
+
+                // Add item
+                write_file_list_item(files, index, path, packaged.len, file, strlen(file), packaged.offset, packaged.size, packaged.encrypted);
             }
+
+            path_cursor_free(&cursor);
+            free_pack(&package);
         }
     }
 
-    // Store number of files
-    uint32_t file_count = files->size;
-
-    fseek(pack, 84, SEEK_SET);
-    fwrite(&file_count, 4, 1, pack);
-    fseek(pack, 0, SEEK_END);
-
     if(cfg->verbose == true)
     {
-        printf("Storing %d files:\n", (int)file_count);
+        fprintf(cfg->output, "Storing %d files:\n", (int)files->size);
     }
 }
 
-static void write_file_list_item(FILE* pack, 
-                                 dynamic_array* files, 
-                                 dynamic_array* files_names, 
-                                 dynamic_array* files_names_lengths, 
+static void write_file_list_item(pack_entry_vector* files, 
+                                 path_index* index, 
                                  char* path, 
                                  int32_t path_len, 
                                  char* file_path, 
                                  int32_t file_path_len, 
                                  int64_t offset, 
-                                 int64_t size
+                                 int64_t size, 
+                                 bool encrypted
                                  )
 {
     // Check if item is already present
-    char** items = (char**)files_names->data;
-    for(size_t i = 0; i < files_names->size; ++i)
+    if(insert_path(index, files, path) >= 0)
+    {
+        // Ignore this item
+        free(path);
+        return;
+    }
+
+    // Add file to list of files to package, under its path
+    pack_entry entry = { { file_path, file_path_len, offset, size, { 0 }, encrypted }, path, path_len };
+    pack_entry_vector_push_back(files, entry);
+}
+
+// Registers the path of the entry that is about to be pushed to the list. Returns the index of the entry already
+// under that path, -1 if it's new
+static int32_t insert_path(path_index* index, pack_entry_vector* files, char* path)
+{
+    // Keep the table at most half full
+    if((index->size + 1) * 2 > index->capacity)
     {
-        if(strcmp(items[i], path) == 0)
+        size_t capacity = (index->capacity == 0) ? 64 : index->capacity * 2;
+        int32_t* slots = calloc(capacity, sizeof(int32_t));
+        if(slots == NULL)
         {
-            // Ignore this item
-            free(path);
-            return;
+            fprintf(stderr, "calloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        // Re-insert the existing paths
+        uint32_t* hashes = index->hashes.data;
+        for(size_t i = 0; i < index->capacity; ++i)
+        {
+            if(index->slots[i] == 0) continue;
+
+            size_t slot = hashes[index->slots[i] - 1] & (capacity - 1);
+            while(slots[slot] != 0) slot = (slot + 1) & (capacity - 1);
+            slots[slot] = index->slots[i];
         }
+
+        free(index->slots);
+        index->slots = slots;
+        index->capacity = capacity;
+    }
+
+    // Probe for the path, only comparing the paths whose hashes match
+    pack_entry* entries = files->data;
+    uint32_t* hashes = index->hashes.data;
+    uint32_t hash = hash_path(path, strlen(path));
+    size_t slot = hash & (index->capacity - 1);
+    while(index->slots[slot] != 0)
+    {
+        int32_t i = index->slots[slot] - 1;
+        if(hashes[i] == hash && strcmp(entries[i].name, path) == 0)
+        {
+            return i;
+        }
+        slot = (slot + 1) & (index->capacity - 1);
     }
-    // Write item
-    char zero[32] = { 0 };
 
-    fwrite(&path_len, 4, 1, pack); // Length
-    fwrite(path, 1, path_len, pack); // Path
-    fwrite(zero, 1, 32, pack); // Set offset, size and MD5 to 0
+    index->slots[slot] = files->size + 1;
+    index->size++;
+    hash_vector_push_back(&index->hashes, hash);
 
-    // Add file to list of files to package
-    gd_file gdf = { file_path, file_path_len, offset, size};
-    dynamic_array_push_back(files, &gdf);
+    return -1;
+}
 
-    // Store path
-    dynamic_array_push_back(files_names, &path);
-    dynamic_array_push_back(files_names_lengths, &path_len);
+/* File list item
+ * 1 x 4B  | Int    | String length
+ *         | String | Path
+ * 1 x 8B  | Int    | File offset
+ * 1 x 8B  | Int    | File size
+ * 1 x 16B | ?      | MD5
+*/
+static char* build_file_list(pack_entry_vector* files, 
+                             int64_t list_offset, 
+                             int32_t format_version, 
+                             config* cfg, 
+                             int64_t* list_size, 
+                             int64_t* files_offset, 
+                             int64_t* pack_size
+                             )
+{
+    pack_entry* entries = files->data;
+
+    // Get the size of the file list
+    *list_size = 0;
+    for(size_t i = 0; i < files->size; ++i)
+    {
+        *list_size += get_list_item_size(entries[i].name_len, format_version);
+    }
+
+    char* list = malloc(*list_size > 0 ? *list_size : 1);
+    if(list == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // Godot 3 offsets are absolute and the files follow the list. Godot 4 offsets are relative to a base aligned to 16B
+    // after the list as it's stored
+    int64_t file_offset = list_offset + *list_size;
+    int64_t file_base = 0;
+    if(format_version == PACK_FORMAT_VERSION_4)
+    {
+        int64_t stored_size = (cfg->encrypt == true) ? get_encrypted_size(*list_size) : *list_size;
+        file_base = (list_offset + stored_size + 15) / 16 * 16;
+        file_offset = file_base;
+    }
+
+    *files_offset = file_offset;
+
+    // Write each item, placing the files one after the other
+    char* itr = list;
+    for(size_t i = 0; i < files->size; ++i)
+    {
+        bool encrypted = is_stored_encrypted(&entries[i].source, format_version, cfg);
+        itr = write_list_item(itr, &entries[i], file_offset - file_base, encrypted, format_version);
+
+        file_offset += (encrypted == true) ? get_encrypted_size(entries[i].source.size) : entries[i].source.size;
+    }
+
+    *pack_size = file_offset;
+
+    return list;
+}
+
+// Writes the item of the entry, stored at the offset. Returns the end of the item
+static char* write_list_item(char* itr, pack_entry* entry, int64_t offset, bool encrypted, int32_t format_version)
+{
+    // Godot 4 pads paths to 4B
+    int32_t len = entry->name_len;
+    if(format_version == PACK_FORMAT_VERSION_4)
+    {
+        len = (len + 3) / 4 * 4;
+    }
+
+    memcpy(itr, &len, 4); // Length
+    memcpy(itr + 4, entry->name, entry->name_len); // Path
+    memset(itr + 4 + entry->name_len, 0, len - entry->name_len);
+    itr += len + 4;
+
+    memcpy(itr, &offset, 8); // Offset
+    memcpy(itr + 8, &entry->source.size, 8); // Size
+    memset(itr + 16, 0, 16); // MD5
+    itr += 32;
+
+    if(format_version == PACK_FORMAT_VERSION_4)
+    {
+        uint32_t flags = (encrypted == true) ? PACK_FILE_ENCRYPTED : 0;
+        memcpy(itr, &flags, 4); // Flags
+        itr += 4;
+    }
+
+    return itr;
+}
+
+static int64_t get_list_item_size(int32_t path_len, int32_t format_version)
+{
+    if(format_version == PACK_FORMAT_VERSION_4)
+    {
+        return 4 + (path_len + 3) / 4 * 4 + 36;
+    }
+
+    return 4 + path_len + 32;
+}
+
+// Every file is encrypted when encrypting, and Godot 4 packages keep encrypted files as they are
+static bool is_stored_encrypted(gd_file* file, int32_t format_version, config* cfg)
+{
+    if(format_version != PACK_FORMAT_VERSION_4)
+    {
+        return false;
+    }
+
+    return cfg->encrypt == true || file->encrypted == true;
 }
 
 static void write_files(FILE* pack, 
-                        dynamic_array* files, 
-                        dynamic_array* files_names, 
-                        dynamic_array* files_names_lengths, 
-                        int64_t* list_offset, 
-                        int64_t* file_offset, 
+                        pack_entry_vector* files, 
+                        int64_t list_offset, 
+                        int64_t file_offset, 
+                        int32_t format_version, 
                         config* cfg
                         )
 {
-    gd_file* file_list = (gd_file*)files->data;
-    char** name_list = (char**)files_names->data;
-    int32_t* length_list = (int32_t*)files_names_lengths->data;
+    pack_entry* entries = files->data;
+
+    fseek(pack, file_offset, SEEK_SET);
 
     // For each file to be added to the package...
     for(size_t i = 0; i < files->size; ++i)
     {
-        gd_file* gdf = &file_list[i];
+        gd_file* gdf = &entries[i].source;
+        bool encrypted = is_stored_encrypted(gdf, format_version, cfg);
+        int64_t item_offset = list_offset;
+        int64_t item_size = get_list_item_size(entries[i].name_len, format_version);
+        int64_t next_offset = file_offset + ((encrypted == true) ? get_encrypted_size(gdf->size) : gdf->size);
+
+        list_offset += item_size;
+        file_offset = next_offset;
 
         // Open file
         FILE* file = fopen(gdf->path, "rb");
-        if(file == NULL)
+        bool missing_key = gdf->encrypted == true && encrypted == false && cfg->has_encryption_key == false;
+        if(file == NULL || missing_key == true)
         {
-            printf("gdpc: Failed to read from file \"%s\"\n", gdf->path);
-            *list_offset += length_list[i] + 36;
+            if(file == NULL)
+            {
+                fprintf(cfg->output, "gdpc: Failed to read from file \"%s\"\n", gdf->path);
+            }
+            else
+            {
+                fprintf(cfg->output, "gdpc: \"%s\" is encrypted, set GODOT_SCRIPT_ENCRYPTION_KEY or use --key-file\n", entries[i].name);
+                fclose(file);
+            }
+
+            // Clear the offset and size of the item and skip its reserved space, an encrypted list can't be patched
+            if(cfg->encrypt == false)
+            {
+                char zero[16] = { 0 };
+                int64_t trailer_size = (format_version == PACK_FORMAT_VERSION_4) ? 36 : 32;
+                fseek(pack, item_offset + item_size - trailer_size, SEEK_SET);
+                fwrite(zero, 1, 16, pack);
+            }
+            fseek(pack, next_offset, SEEK_SET);
 
             continue;
         }
@@ -501,46 +3418,47 @@ static void write_files(FILE* pack,
         // Print additional informative message if --verbose
         if(cfg->verbose == true)
         {
-            printf("Packaging \"%s\"\n", name_list[i]);
-        }
-
-        // Copy file
-        uint64_t size = 0;
-        fseek(file, gdf->offset, SEEK_SET);
-
-        if(gdf->size == -1)
-        {
-            int c = fgetc(file);
-            while(c != EOF)
-            {
-                ++size;
-                fputc(c, pack);
-                c = fgetc(file);
-            }
+            fprintf(cfg->output, "Packaging \"%s\"\n", entries[i].name);
         }
-        else
-        {
-            size = gdf->size;
-            int c;
 
-            for(int32_t i = 0; i < gdf->size; ++i)
-            {
-                c = fgetc(file);
-                fputc(c, pack);
-            }
-        }
+        int64_t size = copy_file_data(pack, file, gdf, encrypted, cfg);
 
         fclose(file);
+        progress_add(0, 1);
 
-        // Store offset and size
-        fseek(pack, *list_offset + length_list[i] + 4, SEEK_SET); // Go to file list
-
-        fwrite(file_offset, 8, 1, pack); // Store offset
-        fwrite(&size, 8, 1, pack); // Store size
+        // If the file shrunk since it was listed, leave the rest of its space zeroed
+        if(size != gdf->size)
+        {
+            fprintf(cfg->output, "gdpc: Failed to read from file \"%s\"\n", gdf->path);
+            fseek(pack, next_offset, SEEK_SET);
+        }
+    }
+}
 
-        // Adjust values
-        *list_offset += length_list[i] + 36;
-        *file_offset += size;
-        fseek(pack, 0, SEEK_END);
+// Copies the file to the package, encrypting or decrypting it if needed. Returns the size copied
+static int64_t copy_file_data(FILE* pack, 
+                              FILE* file, 
+                              gd_file* gdf, 
+                              bool encrypted, 
+                              config* cfg
+                              )
+{
+    if(gdf->encrypted == true && encrypted == true)
+    {
+        int64_t stored_size = get_encrypted_size(gdf->size);
+        fseek(file, gdf->offset, SEEK_SET);
+        return (copy_data(pack, file, stored_size) == stored_size) ? gdf->size : 0;
+    }
+    else if(gdf->encrypted == true)
+    {
+        return (copy_decrypted_data(pack, file, gdf->offset, cfg->encryption_key) == 0) ? gdf->size : 0;
     }
+    else if(encrypted == true)
+    {
+        fseek(file, gdf->offset, SEEK_SET);
+        return copy_encrypted_data(pack, file, gdf->size, cfg->encryption_key);
+    }
+
+    fseek(file, gdf->offset, SEEK_SET);
+    return copy_data(pack, file, gdf->size);
 }
\ No newline at end of file
@@ -2,8 +2,86 @@
 #define TOOL_GDPC_PARSER_H
 
 #include "config.h"
+#include "file_utils.h"
+
+#define PATH_BLOCK_SIZE 16 // Every PATH_BLOCK_SIZE-th path is stored whole
+
+#define PACK_FORMAT_VERSION_4 2 // Format of Godot 4 packages, older ones use the Godot 3 layout
+#define PACK_DIR_ENCRYPTED 1 // Package flag: the file list is encrypted
+#define PACK_FILE_ENCRYPTED 1 // File flag: the file is encrypted
+
+// File list of a package, stored by column so scanning offsets or hashes doesn't touch the paths.
+// Paths are front-coded: each one is stored as the length of the prefix it shares with the previous path
+// (LEB128), the length of the rest (LEB128) and the rest.
+typedef struct
+{
+    int64_t* offsets;
+    int64_t* sizes;
+    uint32_t* hashes; // hash_path of each path
+    uint8_t (*md5s)[16];
+    uint8_t* flags; // PACK_FILE_ENCRYPTED
+
+    uint8_t* paths;
+    size_t paths_size;
+    size_t* blocks; // Position of the first path of each block
+    int32_t max_path_len;
+} file_table;
+
+// Decodes the paths of a package one after the other
+typedef struct
+{
+    int32_t index; // File of the decoded path, -1 before the first one
+    size_t position; // Position of the next path
+    char* path;
+    int len;
+} path_cursor;
+
+struct path_tree;
+
+typedef struct gd_pack
+{
+    char* path;
+
+    int32_t version_major;
+    int32_t version_minor;
+    int32_t version_revision;
+
+    int32_t format_version;
+    uint32_t pack_flags; // PACK_DIR_ENCRYPTED
+    int64_t file_base; // Offset the file offsets are relative to
+    int64_t header_size;
+
+    int32_t file_count;
+    file_table files;
+
+    int32_t* index; // Index of the file + 1 for each slot, 0 if the slot is empty (NULL until index_pack is called)
+    size_t index_capacity;
+
+    struct path_tree* tree; // Directories of the pack (NULL until build_path_tree is called)
+
+    const char* mapped_index; // .gdidx the file table and index point into, NULL if the file list was parsed
+    size_t mapped_index_size;
+
+    struct gd_pack** overlays; // Packages extracted after this one, their files replace its own (NULL if there are none)
+    size_t overlay_count;
+} gd_pack;
 
 int read_packs(config* cfg);
 int create_pack(config* cfg);
 
+int load_pack(const char* path, gd_pack* pack, config* cfg);
+int process_pack(gd_pack* pack, config* cfg);
+void free_pack(gd_pack* pack);
+
+void print_list_header(config* cfg);
+
+void index_pack(gd_pack* pack);
+bool find_file(gd_pack* pack, const char* path, gd_file* file);
+int32_t* select_files(gd_pack* pack, config* cfg, int32_t* count);
+
+void path_cursor_init(path_cursor* cursor, gd_pack* pack);
+void path_cursor_free(path_cursor* cursor);
+bool next_file(gd_pack* pack, path_cursor* cursor, gd_file* file);
+bool get_file(gd_pack* pack, path_cursor* cursor, int32_t index, gd_file* file);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1054 @@
+#include "image_decoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define IMAGE_DECODER_SSSE3
+#endif
+
+#define DECODE_BAND_HEIGHT 64 // Rows decoded per task, a multiple of the block height
+
+typedef struct
+{
+    const uint8_t* data;
+    int format;
+    int width;
+    int height;
+    int first_row;
+    int last_row;
+    uint8_t* rgba;
+} decode_task;
+
+static void decode_band(void* arg);
+static void decode_row(const uint8_t* src, uint8_t* dst, int width, int format);
+static void decode_block(const uint8_t* src, uint8_t* dst, int format);
+
+static int get_pixel_size(int format);
+static int get_block_size(int format);
+
+static void decode_bc1(const uint8_t* src, uint8_t* dst, bool punchthrough);
+static void decode_bc4(const uint8_t* src, uint8_t* dst, int channel);
+static void decode_bc7(const uint8_t* src, uint8_t* dst);
+static void decode_etc2(const uint8_t* src, uint8_t* dst, bool punchthrough);
+static void decode_eac(const uint8_t* src, uint8_t* dst, int channel, bool eleven_bits, bool is_signed);
+
+bool is_image_format_supported(int format)
+{
+    if(format < 0 || format >= IMAGE_FORMAT_COUNT) return false;
+
+    // HDR BPTC and PVRTC aren't supported
+    if(format == IMAGE_FORMAT_BPTC_RGBF || format == IMAGE_FORMAT_BPTC_RGBFU) return false;
+    if(format >= IMAGE_FORMAT_PVRTC2 && format <= IMAGE_FORMAT_PVRTC4A) return false;
+
+    return true;
+}
+
+int64_t get_image_data_size(int format, int width, int height, bool mipmaps)
+{
+    if(is_image_format_supported(format) == false || width < 1 || height < 1) return -1;
+
+    int block_size = get_block_size(format);
+    int64_t size = 0;
+
+    // Mipmaps halve the size down to 1x1, block formats round each level up to whole blocks
+    while(true)
+    {
+        if(block_size != 0) size += (int64_t)((width + 3) / 4) * ((height + 3) / 4) * block_size;
+        else size += (int64_t)width * height * get_pixel_size(format);
+
+        if(mipmaps == false || (width == 1 && height == 1)) break;
+
+        width = (width > 1) ? width / 2 : 1;
+        height = (height > 1) ? height / 2 : 1;
+    }
+
+    return size;
+}
+
+// Decodes the image in bands of rows, in parallel if a thread pool is given
+void decode_image(const uint8_t* data, int format, int width, int height, uint8_t* rgba, thread_pool* pool)
+{
+    int band_count = (height + DECODE_BAND_HEIGHT - 1) / DECODE_BAND_HEIGHT;
+
+    decode_task* tasks = malloc(band_count * sizeof(decode_task));
+    if(tasks == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(int i = 0; i < band_count; ++i)
+    {
+        decode_task* task = &tasks[i];
+        task->data = data;
+        task->format = format;
+        task->width = width;
+        task->height = height;
+        task->first_row = i * DECODE_BAND_HEIGHT;
+        task->last_row = (i + 1) * DECODE_BAND_HEIGHT < height ? (i + 1) * DECODE_BAND_HEIGHT : height;
+        task->rgba = rgba;
+
+        if(pool != NULL && band_count > 1) thread_pool_submit(pool, decode_band, task);
+        else decode_band(task);
+    }
+
+    if(pool != NULL && band_count > 1) thread_pool_wait(pool);
+
+    free(tasks);
+}
+
+static void decode_band(void* arg)
+{
+    decode_task* task = arg;
+    size_t row_size = (size_t)task->width * 4;
+
+    int block_size = get_block_size(task->format);
+    if(block_size == 0)
+    {
+        size_t src_row_size = (size_t)task->width * get_pixel_size(task->format);
+        for(int y = task->first_row; y < task->last_row; ++y)
+        {
+            decode_row(task->data + y * src_row_size, task->rgba + y * row_size, task->width, task->format);
+        }
+        return;
+    }
+
+    // Block formats are decoded 4x4 pixels at a time, then clipped to the image
+    int blocks_x = (task->width + 3) / 4;
+    uint8_t block[16 * 4];
+
+    for(int y = task->first_row; y < task->last_row; y += 4)
+    {
+        const uint8_t* src = task->data + (size_t)(y / 4) * blocks_x * block_size;
+        int rows = (task->last_row - y < 4) ? task->last_row - y : 4;
+
+        for(int bx = 0; bx < blocks_x; ++bx)
+        {
+            decode_block(src + bx * block_size, block, task->format);
+
+            int columns = (task->width - bx * 4 < 4) ? task->width - bx * 4 : 4;
+            for(int row = 0; row < rows; ++row)
+            {
+                memcpy(task->rgba + (y + row) * row_size + bx * 16, block + row * 16, columns * 4);
+            }
+        }
+    }
+}
+
+static int get_pixel_size(int format)
+{
+    switch(format)
+    {
+        case IMAGE_FORMAT_L8:        return 1;
+        case IMAGE_FORMAT_LA8:       return 2;
+        case IMAGE_FORMAT_R8:        return 1;
+        case IMAGE_FORMAT_RG8:       return 2;
+        case IMAGE_FORMAT_RGB8:      return 3;
+        case IMAGE_FORMAT_RGBA8:     return 4;
+        case IMAGE_FORMAT_RGBA4444:  return 2;
+        case IMAGE_FORMAT_RGBA5551:  return 2;
+        case IMAGE_FORMAT_RF:        return 4;
+        case IMAGE_FORMAT_RGF:       return 8;
+        case IMAGE_FORMAT_RGBF:      return 12;
+        case IMAGE_FORMAT_RGBAF:     return 16;
+        case IMAGE_FORMAT_RH:        return 2;
+        case IMAGE_FORMAT_RGH:       return 4;
+        case IMAGE_FORMAT_RGBH:      return 6;
+        case IMAGE_FORMAT_RGBAH:     return 8;
+        case IMAGE_FORMAT_RGBE9995:  return 4;
+        default:                     return 0;
+    }
+}
+
+// Returns the size of a 4x4 block, or 0 if the format isn't block-compressed
+static int get_block_size(int format)
+{
+    switch(format)
+    {
+        case IMAGE_FORMAT_DXT1:
+        case IMAGE_FORMAT_RGTC_R:
+        case IMAGE_FORMAT_ETC:
+        case IMAGE_FORMAT_ETC2_R11:
+        case IMAGE_FORMAT_ETC2_R11S:
+        case IMAGE_FORMAT_ETC2_RGB8:
+        case IMAGE_FORMAT_ETC2_RGB8A1:
+            return 8;
+        case IMAGE_FORMAT_DXT3:
+        case IMAGE_FORMAT_DXT5:
+        case IMAGE_FORMAT_RGTC_RG:
+        case IMAGE_FORMAT_BPTC_RGBA:
+        case IMAGE_FORMAT_ETC2_RG11:
+        case IMAGE_FORMAT_ETC2_RG11S:
+        case IMAGE_FORMAT_ETC2_RGBA8:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+/* Raw formats
+ * Each row is converted to RGBA8. The 8-bit formats are expanded with SSE2 16 pixels at a time, RGB8 with
+ * SSSE3 if the CPU supports it, and everything else (packed, float and half-float formats) pixel by pixel.
+*/
+static uint8_t expand_4_bits(uint32_t value)
+{
+    return (uint8_t)(value << 4 | value);
+}
+
+static uint8_t expand_5_bits(uint32_t value)
+{
+    return (uint8_t)(value << 3 | value >> 2);
+}
+
+static uint8_t float_to_byte(float value)
+{
+    if(!(value > 0.0f)) return 0; // Also catches NaN
+    if(value >= 1.0f) return 255;
+    return (uint8_t)(value * 255.0f + 0.5f);
+}
+
+static float read_float(const uint8_t* src)
+{
+    float value;
+    memcpy(&value, src, 4);
+    return value;
+}
+
+static float read_half(const uint8_t* src)
+{
+    uint16_t half = (uint16_t)(src[0] | src[1] << 8);
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    uint32_t bits;
+    if(exponent == 0)
+    {
+        float value = mantissa / 16777216.0f; // Subnormal, mantissa * 2^-24
+        return sign ? -value : value;
+    }
+    else if(exponent == 31) bits = sign | 0x7F800000 | mantissa << 13;
+    else bits = sign | (exponent + 112) << 23 | mantissa << 13;
+
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+#ifdef IMAGE_DECODER_SSSE3
+__attribute__((target("ssse3")))
+static int decode_rgb8_ssse3(const uint8_t* src, uint8_t* dst, int width)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+    // Reads 16 bytes for every 12 used, so stop while a full load stays inside the row
+    int x = 0;
+    for(; x + 6 <= width; x += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 3));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha);
+        _mm_storeu_si128((__m128i*)(dst + x * 4), pixels);
+    }
+
+    return x;
+}
+#endif
+
+static void decode_row(const uint8_t* src, uint8_t* dst, int width, int format)
+{
+    int x = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8((char)0xFF);
+
+    if(format == IMAGE_FORMAT_L8)
+    {
+        for(; x + 16 <= width; x += 16)
+        {
+            __m128i l = _mm_loadu_si128((const __m128i*)(src + x));
+            __m128i ll_lo = _mm_unpacklo_epi8(l, l), ll_hi = _mm_unpackhi_epi8(l, l);
+            __m128i la_lo = _mm_unpacklo_epi8(l, ones), la_hi = _mm_unpackhi_epi8(l, ones);
+
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(ll_lo, la_lo));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(ll_lo, la_lo));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 32), _mm_unpacklo_epi16(ll_hi, la_hi));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 48), _mm_unpackhi_epi16(ll_hi, la_hi));
+        }
+    }
+    else if(format == IMAGE_FORMAT_LA8)
+    {
+        const __m128i low = _mm_set1_epi16(0x00FF);
+        for(; x + 8 <= width; x += 8)
+        {
+            __m128i la = _mm_loadu_si128((const __m128i*)(src + x * 2));
+            __m128i l = _mm_and_si128(la, low);
+            __m128i ll = _mm_or_si128(l, _mm_slli_epi16(l, 8));
+
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(ll, la));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(ll, la));
+        }
+    }
+    else if(format == IMAGE_FORMAT_R8)
+    {
+        const __m128i opaque = _mm_set1_epi16((short)0xFF00);
+        for(; x + 16 <= width; x += 16)
+        {
+            __m128i r = _mm_loadu_si128((const __m128i*)(src + x));
+            __m128i r_lo = _mm_unpacklo_epi8(r, zero), r_hi = _mm_unpackhi_epi8(r, zero);
+
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(r_lo, opaque));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(r_lo, opaque));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 32), _mm_unpacklo_epi16(r_hi, opaque));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 48), _mm_unpackhi_epi16(r_hi, opaque));
+        }
+    }
+    else if(format == IMAGE_FORMAT_RG8)
+    {
+        const __m128i opaque = _mm_set1_epi16((short)0xFF00);
+        for(; x + 8 <= width; x += 8)
+        {
+            __m128i rg = _mm_loadu_si128((const __m128i*)(src + x * 2));
+
+            _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(rg, opaque));
+            _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(rg, opaque));
+        }
+    }
+#endif
+
+#ifdef IMAGE_DECODER_SSSE3
+    if(format == IMAGE_FORMAT_RGB8 && __builtin_cpu_supports("ssse3"))
+    {
+        x = decode_rgb8_ssse3(src, dst, width);
+    }
+#endif
+
+    if(format == IMAGE_FORMAT_RGBA8)
+    {
+        memcpy(dst, src, (size_t)width * 4);
+        return;
+    }
+
+    // Remaining pixels
+    for(; x < width; ++x)
+    {
+        const uint8_t* in = src + x * get_pixel_size(format);
+        uint8_t* out = dst + x * 4;
+        uint32_t value;
+
+        switch(format)
+        {
+            case IMAGE_FORMAT_L8:
+                out[0] = out[1] = out[2] = in[0]; out[3] = 255;
+                break;
+            case IMAGE_FORMAT_LA8:
+                out[0] = out[1] = out[2] = in[0]; out[3] = in[1];
+                break;
+            case IMAGE_FORMAT_R8:
+                out[0] = in[0]; out[1] = 0; out[2] = 0; out[3] = 255;
+                break;
+            case IMAGE_FORMAT_RG8:
+                out[0] = in[0]; out[1] = in[1]; out[2] = 0; out[3] = 255;
+                break;
+            case IMAGE_FORMAT_RGB8:
+                out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255;
+                break;
+            case IMAGE_FORMAT_RGBA4444:
+                value = in[0] | in[1] << 8;
+                out[0] = expand_4_bits(value >> 12 & 0xF);
+                out[1] = expand_4_bits(value >> 8 & 0xF);
+                out[2] = expand_4_bits(value >> 4 & 0xF);
+                out[3] = expand_4_bits(value & 0xF);
+                break;
+            case IMAGE_FORMAT_RGBA5551:
+                value = in[0] | in[1] << 8;
+                out[0] = expand_5_bits(value >> 11 & 0x1F);
+                out[1] = expand_5_bits(value >> 6 & 0x1F);
+                out[2] = expand_5_bits(value >> 1 & 0x1F);
+                out[3] = (value & 1) ? 255 : 0;
+                break;
+            case IMAGE_FORMAT_RF:
+            case IMAGE_FORMAT_RGF:
+            case IMAGE_FORMAT_RGBF:
+            case IMAGE_FORMAT_RGBAF:
+            {
+                int channels = format - IMAGE_FORMAT_RF + 1;
+                out[0] = float_to_byte(read_float(in));
+                out[1] = channels > 1 ? float_to_byte(read_float(in + 4)) : 0;
+                out[2] = channels > 2 ? float_to_byte(read_float(in + 8)) : 0;
+                out[3] = channels > 3 ? float_to_byte(read_float(in + 12)) : 255;
+                break;
+            }
+            case IMAGE_FORMAT_RH:
+            case IMAGE_FORMAT_RGH:
+            case IMAGE_FORMAT_RGBH:
+            case IMAGE_FORMAT_RGBAH:
+            {
+                int channels = format - IMAGE_FORMAT_RH + 1;
+                out[0] = float_to_byte(read_half(in));
+                out[1] = channels > 1 ? float_to_byte(read_half(in + 2)) : 0;
+                out[2] = channels > 2 ? float_to_byte(read_half(in + 4)) : 0;
+                out[3] = channels > 3 ? float_to_byte(read_half(in + 6)) : 255;
+                break;
+            }
+            case IMAGE_FORMAT_RGBE9995:
+            {
+                // 9-bit mantissas sharing a 5-bit exponent, scale = 2^(exponent - 15 - 9)
+                value = in[0] | in[1] << 8 | in[2] << 16 | (uint32_t)in[3] << 24;
+                uint32_t scale_bits = ((value >> 27) + 103) << 23;
+                float scale;
+                memcpy(&scale, &scale_bits, 4);
+
+                out[0] = float_to_byte((value & 0x1FF) * scale);
+                out[1] = float_to_byte((value >> 9 & 0x1FF) * scale);
+                out[2] = float_to_byte((value >> 18 & 0x1FF) * scale);
+                out[3] = 255;
+                break;
+            }
+        }
+    }
+}
+
+// Decodes a 4x4 block into 16 RGBA8 pixels, row by row
+static void decode_block(const uint8_t* src, uint8_t* dst, int format)
+{
+    switch(format)
+    {
+        case IMAGE_FORMAT_DXT1:
+            decode_bc1(src, dst, true);
+            break;
+        case IMAGE_FORMAT_DXT3:
+            decode_bc1(src + 8, dst, false);
+            for(int i = 0; i < 16; ++i)
+            {
+                dst[i * 4 + 3] = expand_4_bits(src[i / 2] >> (i % 2 * 4) & 0xF);
+            }
+            break;
+        case IMAGE_FORMAT_DXT5:
+            decode_bc1(src + 8, dst, false);
+            decode_bc4(src, dst, 3);
+            break;
+        case IMAGE_FORMAT_RGTC_R:
+            memset(dst, 0, 64);
+            decode_bc4(src, dst, 0);
+            for(int i = 0; i < 16; ++i) dst[i * 4 + 3] = 255;
+            break;
+        case IMAGE_FORMAT_RGTC_RG:
+            memset(dst, 0, 64);
+            decode_bc4(src, dst, 0);
+            decode_bc4(src + 8, dst, 1);
+            for(int i = 0; i < 16; ++i) dst[i * 4 + 3] = 255;
+            break;
+        case IMAGE_FORMAT_BPTC_RGBA:
+            decode_bc7(src, dst);
+            break;
+        case IMAGE_FORMAT_ETC:
+        case IMAGE_FORMAT_ETC2_RGB8:
+            decode_etc2(src, dst, false);
+            break;
+        case IMAGE_FORMAT_ETC2_RGB8A1:
+            decode_etc2(src, dst, true);
+            break;
+        case IMAGE_FORMAT_ETC2_RGBA8:
+            decode_etc2(src + 8, dst, false);
+            decode_eac(src, dst, 3, false, false);
+            break;
+        case IMAGE_FORMAT_ETC2_R11:
+        case IMAGE_FORMAT_ETC2_R11S:
+            memset(dst, 0, 64);
+            decode_eac(src, dst, 0, true, format == IMAGE_FORMAT_ETC2_R11S);
+            for(int i = 0; i < 16; ++i) dst[i * 4 + 3] = 255;
+            break;
+        case IMAGE_FORMAT_ETC2_RG11:
+        case IMAGE_FORMAT_ETC2_RG11S:
+            memset(dst, 0, 64);
+            decode_eac(src, dst, 0, true, format == IMAGE_FORMAT_ETC2_RG11S);
+            decode_eac(src + 8, dst, 1, true, format == IMAGE_FORMAT_ETC2_RG11S);
+            for(int i = 0; i < 16; ++i) dst[i * 4 + 3] = 255;
+            break;
+    }
+}
+
+/* S3TC/RGTC blocks
+ * BC1: 2 x RGB565 endpoints, then 16 x 2-bit indices
+ * BC4: 2 x 8-bit endpoints, then 16 x 3-bit indices
+ * DXT3 prefixes a BC1 block with 16 x 4-bit alpha values and DXT5 with a BC4 block for alpha.
+ * RGTC_RG is two BC4 blocks, one per channel.
+*/
+static void decode_bc1(const uint8_t* src, uint8_t* dst, bool punchthrough)
+{
+    uint32_t color0 = src[0] | src[1] << 8;
+    uint32_t color1 = src[2] | src[3] << 8;
+    uint32_t indices = src[4] | src[5] << 8 | src[6] << 16 | (uint32_t)src[7] << 24;
+
+    uint8_t palette[4][4];
+    palette[0][0] = expand_5_bits(color0 >> 11);
+    palette[0][1] = (uint8_t)((color0 >> 5 & 0x3F) << 2 | (color0 >> 9 & 0x3));
+    palette[0][2] = expand_5_bits(color0 & 0x1F);
+    palette[1][0] = expand_5_bits(color1 >> 11);
+    palette[1][1] = (uint8_t)((color1 >> 5 & 0x3F) << 2 | (color1 >> 9 & 0x3));
+    palette[1][2] = expand_5_bits(color1 & 0x1F);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+    for(int c = 0; c < 3; ++c)
+    {
+        if(color0 > color1 || punchthrough == false)
+        {
+            palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+            palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+        }
+        else
+        {
+            palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c] + 1) / 2);
+            palette[3][c] = 0;
+        }
+    }
+    if(color0 <= color1 && punchthrough == true) palette[3][3] = 0;
+
+    for(int i = 0; i < 16; ++i)
+    {
+        memcpy(dst + i * 4, palette[indices >> (i * 2) & 0x3], 4);
+    }
+}
+
+static void decode_bc4(const uint8_t* src, uint8_t* dst, int channel)
+{
+    uint32_t palette[8];
+    palette[0] = src[0];
+    palette[1] = src[1];
+
+    if(palette[0] > palette[1])
+    {
+        for(int i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * palette[0] + i * palette[1] + 3) / 7;
+    }
+    else
+    {
+        for(int i = 1; i < 5; ++i) palette[i + 1] = ((5 - i) * palette[0] + i * palette[1] + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for(int i = 0; i < 6; ++i) indices |= (uint64_t)src[2 + i] << (i * 8);
+
+    for(int i = 0; i < 16; ++i)
+    {
+        dst[i * 4 + channel] = (uint8_t)palette[indices >> (i * 3) & 0x7];
+    }
+}
+
+/* BPTC (BC7) blocks
+ * 128 bits read from the least significant bit: the mode (a unary code), partition, rotation, index selection,
+ * then the endpoints channel by channel, the P-bits, and the indices. Each mode trades subsets for precision.
+*/
+typedef struct
+{
+    uint8_t subsets;
+    uint8_t partition_bits;
+    uint8_t rotation_bits;
+    uint8_t index_selection_bits;
+    uint8_t color_bits;
+    uint8_t alpha_bits;
+    uint8_t endpoint_pbits;
+    uint8_t shared_pbits;
+    uint8_t index_bits;
+    uint8_t index_bits2;
+} bc7_mode;
+
+static const bc7_mode bc7_modes[8] =
+{
+    { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+    { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+    { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+    { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+};
+
+// Subset of each pixel, one bit per pixel for two subsets and two bits per pixel for three
+static const uint16_t bc7_partitions2[64] =
+{
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+    0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+    0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+    0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+    0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+};
+
+static const uint32_t bc7_partitions3[64] =
+{
+    0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+    0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+    0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+    0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+    0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+    0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+    0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+    0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254
+};
+
+// Anchor pixel of the second subset (two subsets), and of the second and third subsets (three subsets)
+static const uint8_t bc7_anchors2[64] =
+{
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+};
+
+static const uint8_t bc7_anchors3[2][64] =
+{
+    {
+         3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+         3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+         8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+         3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3
+    },
+    {
+        15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+        15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+        15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+        15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8
+    }
+};
+
+static const uint8_t bc7_weights2[4] = { 0, 21, 43, 64 };
+static const uint8_t bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+typedef struct
+{
+    uint64_t low;
+    uint64_t high;
+    int position;
+} bit_reader;
+
+static uint32_t read_bits(bit_reader* reader, int count)
+{
+    if(count == 0) return 0;
+
+    uint64_t value;
+    int position = reader->position;
+
+    if(position >= 64) value = reader->high >> (position - 64);
+    else if(position + count > 64) value = reader->low >> position | reader->high << (64 - position);
+    else value = reader->low >> position;
+
+    reader->position += count;
+    return (uint32_t)(value & ((1u << count) - 1));
+}
+
+static uint8_t interpolate(uint8_t e0, uint8_t e1, int bits, uint32_t index)
+{
+    uint32_t weight = (bits == 2) ? bc7_weights2[index] : (bits == 3) ? bc7_weights3[index] : bc7_weights4[index];
+    return (uint8_t)(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+}
+
+static void decode_bc7(const uint8_t* src, uint8_t* dst)
+{
+    int mode = 0;
+    while(mode < 8 && (src[0] & (1 << mode)) == 0) mode++;
+
+    // Reserved mode
+    if(mode == 8)
+    {
+        memset(dst, 0, 64);
+        return;
+    }
+
+    const bc7_mode* info = &bc7_modes[mode];
+
+    bit_reader reader = { 0, 0, mode + 1 };
+    for(int i = 0; i < 8; ++i)
+    {
+        reader.low |= (uint64_t)src[i] << (i * 8);
+        reader.high |= (uint64_t)src[i + 8] << (i * 8);
+    }
+
+    uint32_t partition = read_bits(&reader, info->partition_bits);
+    uint32_t rotation = read_bits(&reader, info->rotation_bits);
+    uint32_t index_selection = read_bits(&reader, info->index_selection_bits);
+
+    // Endpoints
+    uint8_t endpoints[3][2][4];
+    int endpoint_count = info->subsets * 2;
+
+    for(int c = 0; c < 3; ++c)
+    {
+        for(int e = 0; e < endpoint_count; ++e) endpoints[e / 2][e % 2][c] = (uint8_t)read_bits(&reader, info->color_bits);
+    }
+    for(int e = 0; e < endpoint_count; ++e)
+    {
+        endpoints[e / 2][e % 2][3] = (uint8_t)read_bits(&reader, info->alpha_bits);
+    }
+
+    int color_bits = info->color_bits;
+    int alpha_bits = info->alpha_bits;
+    if(info->endpoint_pbits || info->shared_pbits)
+    {
+        uint32_t pbits[6];
+        for(int e = 0; e < endpoint_count; ++e)
+        {
+            if(info->endpoint_pbits) pbits[e] = read_bits(&reader, 1);
+            else if(e % 2 == 0) pbits[e] = pbits[e + 1] = read_bits(&reader, 1);
+        }
+
+        for(int e = 0; e < endpoint_count; ++e)
+        {
+            for(int c = 0; c < 4; ++c) endpoints[e / 2][e % 2][c] = (uint8_t)(endpoints[e / 2][e % 2][c] << 1 | pbits[e]);
+        }
+
+        color_bits++;
+        if(alpha_bits) alpha_bits++;
+    }
+
+    // Expand the endpoints to 8 bits by replicating their high bits
+    for(int e = 0; e < endpoint_count; ++e)
+    {
+        uint8_t* endpoint = endpoints[e / 2][e % 2];
+        for(int c = 0; c < 3; ++c) endpoint[c] = (uint8_t)(endpoint[c] << (8 - color_bits) | endpoint[c] >> (2 * color_bits - 8));
+
+        if(alpha_bits) endpoint[3] = (uint8_t)(endpoint[3] << (8 - alpha_bits) | endpoint[3] >> (2 * alpha_bits - 8));
+        else endpoint[3] = 255;
+    }
+
+    // Indices, the anchor pixel of each subset has an implicit leading zero
+    uint8_t subsets[16];
+    uint8_t anchors[3] = { 0, 0, 0 };
+    for(int i = 0; i < 16; ++i)
+    {
+        if(info->subsets == 2) subsets[i] = (uint8_t)(bc7_partitions2[partition] >> i & 0x1);
+        else if(info->subsets == 3) subsets[i] = (uint8_t)(bc7_partitions3[partition] >> (i * 2) & 0x3);
+        else subsets[i] = 0;
+    }
+    if(info->subsets == 2) anchors[1] = bc7_anchors2[partition];
+    if(info->subsets == 3)
+    {
+        anchors[1] = bc7_anchors3[0][partition];
+        anchors[2] = bc7_anchors3[1][partition];
+    }
+
+    uint32_t indices[16];
+    uint32_t indices2[16];
+    for(int i = 0; i < 16; ++i)
+    {
+        indices[i] = read_bits(&reader, info->index_bits - (i == anchors[subsets[i]] ? 1 : 0));
+    }
+    if(info->index_bits2)
+    {
+        for(int i = 0; i < 16; ++i) indices2[i] = read_bits(&reader, info->index_bits2 - (i == 0 ? 1 : 0));
+    }
+
+    // Interpolate, modes 4 and 5 have separate color and alpha indices
+    for(int i = 0; i < 16; ++i)
+    {
+        const uint8_t* e0 = endpoints[subsets[i]][0];
+        const uint8_t* e1 = endpoints[subsets[i]][1];
+        uint8_t* out = dst + i * 4;
+
+        int bits = info->index_bits, alpha_index_bits = info->index_bits;
+        uint32_t index = indices[i], alpha_index = indices[i];
+        if(info->index_bits2)
+        {
+            if(index_selection == 0)
+            {
+                alpha_index = indices2[i];
+                alpha_index_bits = info->index_bits2;
+            }
+            else
+            {
+                index = indices2[i];
+                bits = info->index_bits2;
+            }
+        }
+
+        for(int c = 0; c < 3; ++c) out[c] = interpolate(e0[c], e1[c], bits, index);
+        out[3] = interpolate(e0[3], e1[3], alpha_index_bits, alpha_index);
+
+        // Rotation swaps alpha with one of the color channels
+        if(rotation != 0)
+        {
+            uint8_t swap = out[3];
+            out[3] = out[rotation - 1];
+            out[rotation - 1] = swap;
+        }
+    }
+}
+
+/* ETC1/ETC2 blocks
+ * 64 bits read from the most significant bit: two base colors (individual, differential, or one of the
+ * ETC2 T, H and planar modes when the differential colors overflow), the modifier tables, the diff and flip
+ * bits, then 16 x 2-bit indices split in a most significant and a least significant half. Pixels are
+ * numbered column by column. ETC1 blocks never overflow so they decode the same way.
+ * EAC blocks (ETC2 alpha, R11, RG11) hold a base value, a multiplier, a modifier table and 16 x 3-bit indices.
+*/
+static const int etc_modifiers[8][4] =
+{
+    { 2, 8, -2, -8 },
+    { 5, 17, -5, -17 },
+    { 9, 29, -9, -29 },
+    { 13, 42, -13, -42 },
+    { 18, 60, -18, -60 },
+    { 24, 80, -24, -80 },
+    { 33, 106, -33, -106 },
+    { 47, 183, -47, -183 }
+};
+
+static const int etc_distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+static const int eac_modifiers[16][8] =
+{
+    { -3, -6, -9, -15, 2, 5, 8, 14 },
+    { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5, -8, -13, 1, 4, 7, 12 },
+    { -2, -4, -6, -13, 1, 3, 5, 12 },
+    { -3, -6, -8, -12, 2, 5, 7, 11 },
+    { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 },
+    { -3, -5, -8, -11, 2, 4, 7, 10 },
+    { -2, -6, -8, -10, 1, 5, 7, 9 },
+    { -2, -5, -8, -10, 1, 4, 7, 9 },
+    { -2, -4, -8, -10, 1, 3, 7, 9 },
+    { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 },
+    { -1, -2, -3, -10, 0, 1, 2, 9 },
+    { -4, -6, -8, -9, 3, 5, 7, 8 },
+    { -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+static uint8_t clamp_byte(int value)
+{
+    return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static void set_pixel(uint8_t* dst, int x, int y, const uint8_t* base, int modifier, bool transparent)
+{
+    uint8_t* out = dst + (y * 4 + x) * 4;
+
+    if(transparent)
+    {
+        memset(out, 0, 4);
+        return;
+    }
+
+    out[0] = clamp_byte(base[0] + modifier);
+    out[1] = clamp_byte(base[1] + modifier);
+    out[2] = clamp_byte(base[2] + modifier);
+    out[3] = 255;
+}
+
+static void decode_etc2(const uint8_t* src, uint8_t* dst, bool punchthrough)
+{
+    uint32_t pixel_bits = (uint32_t)src[4] << 24 | src[5] << 16 | src[6] << 8 | src[7];
+    bool differential = (src[3] & 0x2) != 0;
+    bool flip = (src[3] & 0x1) != 0;
+
+    // Punch-through blocks are always differential, the bit tells whether the block is opaque instead
+    bool opaque = true;
+    if(punchthrough)
+    {
+        opaque = differential;
+        differential = true;
+    }
+
+    uint8_t bases[2][3];
+    if(differential)
+    {
+        int r = src[0] >> 3, g = src[1] >> 3, b = src[2] >> 3;
+        int dr = (src[0] & 0x7) ^ 0x4, dg = (src[1] & 0x7) ^ 0x4, db = (src[2] & 0x7) ^ 0x4;
+        dr -= 4; dg -= 4; db -= 4; // Sign-extend the 3-bit deltas
+
+        if(r + dr < 0 || r + dr > 31 || g + dg < 0 || g + dg > 31 || b + db < 0 || b + db > 31)
+        {
+            // T, H or planar mode
+            uint8_t paint[4][3];
+            bool planar = false;
+
+            if(r + dr < 0 || r + dr > 31)
+            {
+                // T mode
+                uint8_t base0[3] = {
+                    expand_4_bits((src[0] >> 3 & 0x3) << 2 | (src[0] & 0x3)),
+                    expand_4_bits(src[1] >> 4),
+                    expand_4_bits(src[1] & 0xF)
+                };
+                uint8_t base1[3] = { expand_4_bits(src[2] >> 4), expand_4_bits(src[2] & 0xF), expand_4_bits(src[3] >> 4) };
+                int distance = etc_distances[(src[3] >> 2 & 0x3) << 1 | (src[3] & 0x1)];
+
+                for(int c = 0; c < 3; ++c)
+                {
+                    paint[0][c] = base0[c];
+                    paint[1][c] = clamp_byte(base1[c] + distance);
+                    paint[2][c] = base1[c];
+                    paint[3][c] = clamp_byte(base1[c] - distance);
+                }
+            }
+            else if(g + dg < 0 || g + dg > 31)
+            {
+                // H mode
+                uint8_t base0[3] = {
+                    expand_4_bits(src[0] >> 3 & 0xF),
+                    expand_4_bits((src[0] & 0x7) << 1 | (src[1] >> 4 & 0x1)),
+                    expand_4_bits((src[1] & 0x8) | (src[1] & 0x3) << 1 | (src[2] >> 7))
+                };
+                uint8_t base1[3] = {
+                    expand_4_bits(src[2] >> 3 & 0xF),
+                    expand_4_bits((src[2] & 0x7) << 1 | (src[3] >> 7)),
+                    expand_4_bits(src[3] >> 3 & 0xF)
+                };
+
+                uint32_t value0 = (uint32_t)base0[0] << 16 | base0[1] << 8 | base0[2];
+                uint32_t value1 = (uint32_t)base1[0] << 16 | base1[1] << 8 | base1[2];
+                int distance = etc_distances[(src[3] & 0x4) | (src[3] & 0x1) << 1 | (value0 >= value1 ? 1 : 0)];
+
+                for(int c = 0; c < 3; ++c)
+                {
+                    paint[0][c] = clamp_byte(base0[c] + distance);
+                    paint[1][c] = clamp_byte(base0[c] - distance);
+                    paint[2][c] = clamp_byte(base1[c] + distance);
+                    paint[3][c] = clamp_byte(base1[c] - distance);
+                }
+            }
+            else
+            {
+                planar = true;
+            }
+
+            if(planar)
+            {
+                // Colors at the origin, at the right of the block, and below it
+                int o[3], h[3], v[3];
+                o[0] = src[0] >> 1 & 0x3F;
+                o[1] = (src[0] & 0x1) << 6 | (src[1] >> 1 & 0x3F);
+                o[2] = (src[1] & 0x1) << 5 | (src[2] & 0x18) | (src[2] & 0x3) << 1 | (src[3] >> 7);
+                h[0] = (src[3] & 0x7C) >> 1 | (src[3] & 0x1);
+                h[1] = src[4] >> 1 & 0x7F;
+                h[2] = (src[4] & 0x1) << 5 | (src[5] >> 3 & 0x1F);
+                v[0] = (src[5] & 0x7) << 3 | (src[6] >> 5 & 0x7);
+                v[1] = (src[6] & 0x1F) << 2 | (src[7] >> 6 & 0x3);
+                v[2] = src[7] & 0x3F;
+
+                for(int c = 0; c < 3; ++c)
+                {
+                    if(c == 1)
+                    {
+                        o[c] = o[c] << 1 | o[c] >> 6;
+                        h[c] = h[c] << 1 | h[c] >> 6;
+                        v[c] = v[c] << 1 | v[c] >> 6;
+                    }
+                    else
+                    {
+                        o[c] = o[c] << 2 | o[c] >> 4;
+                        h[c] = h[c] << 2 | h[c] >> 4;
+                        v[c] = v[c] << 2 | v[c] >> 4;
+                    }
+                }
+
+                for(int y = 0; y < 4; ++y)
+                {
+                    for(int x = 0; x < 4; ++x)
+                    {
+                        uint8_t* out = dst + (y * 4 + x) * 4;
+                        for(int c = 0; c < 3; ++c)
+                        {
+                            out[c] = clamp_byte((x * (h[c] - o[c]) + y * (v[c] - o[c]) + 4 * o[c] + 2) >> 2);
+                        }
+                        out[3] = 255;
+                    }
+                }
+                return;
+            }
+
+            for(int j = 0; j < 16; ++j)
+            {
+                uint32_t index = (pixel_bits >> (j + 16) & 0x1) << 1 | (pixel_bits >> j & 0x1);
+                bool transparent = (opaque == false && index == 2);
+                set_pixel(dst, j / 4, j % 4, paint[index], 0, transparent);
+            }
+            return;
+        }
+
+        bases[0][0] = expand_5_bits(r);
+        bases[0][1] = expand_5_bits(g);
+        bases[0][2] = expand_5_bits(b);
+        bases[1][0] = expand_5_bits(r + dr);
+        bases[1][1] = expand_5_bits(g + dg);
+        bases[1][2] = expand_5_bits(b + db);
+    }
+    else
+    {
+        bases[0][0] = expand_4_bits(src[0] >> 4);
+        bases[0][1] = expand_4_bits(src[1] >> 4);
+        bases[0][2] = expand_4_bits(src[2] >> 4);
+        bases[1][0] = expand_4_bits(src[0] & 0xF);
+        bases[1][1] = expand_4_bits(src[1] & 0xF);
+        bases[1][2] = expand_4_bits(src[2] & 0xF);
+    }
+
+    int tables[2] = { src[3] >> 5 & 0x7, src[3] >> 2 & 0x7 };
+
+    for(int j = 0; j < 16; ++j)
+    {
+        int x = j / 4, y = j % 4;
+        int subblock = flip ? (y >= 2) : (x >= 2);
+        uint32_t index = (pixel_bits >> (j + 16) & 0x1) << 1 | (pixel_bits >> j & 0x1);
+
+        // Non-opaque punch-through blocks have no middle modifier and a transparent index
+        int modifier = etc_modifiers[tables[subblock]][index];
+        if(opaque == false && (index & 0x1) == 0) modifier = 0;
+
+        set_pixel(dst, x, y, bases[subblock], modifier, opaque == false && index == 2);
+    }
+}
+
+static void decode_eac(const uint8_t* src, uint8_t* dst, int channel, bool eleven_bits, bool is_signed)
+{
+    int base = is_signed ? (int8_t)src[0] : src[0];
+    int multiplier = src[1] >> 4;
+    const int* modifiers = eac_modifiers[src[1] & 0xF];
+
+    uint64_t indices = 0;
+    for(int i = 2; i < 8; ++i) indices = indices << 8 | src[i];
+
+    if(is_signed && base == -128) base = -127;
+
+    for(int j = 0; j < 16; ++j)
+    {
+        int modifier = modifiers[indices >> (45 - j * 3) & 0x7];
+        int value;
+
+        if(eleven_bits == false)
+        {
+            value = clamp_byte(base + modifier * multiplier);
+        }
+        else if(is_signed)
+        {
+            // 11-bit signed values in [-1023, 1023], mapped to [0, 255]
+            value = base * 8 + (multiplier ? modifier * multiplier * 8 : modifier);
+            value = value < -1023 ? -1023 : value > 1023 ? 1023 : value;
+            value = (value + 1023) * 255 / 2046;
+        }
+        else
+        {
+            // 11-bit unsigned values in [0, 2047]
+            value = base * 8 + 4 + (multiplier ? modifier * multiplier * 8 : modifier);
+            value = value < 0 ? 0 : value > 2047 ? 2047 : value;
+            value = value * 255 / 2047;
+        }
+
+        dst[((j % 4) * 4 + j / 4) * 4 + channel] = (uint8_t)value;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef TOOL_GDPC_IMAGE_DECODER_H
+#define TOOL_GDPC_IMAGE_DECODER_H
+
+#include "thread_pool.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Image formats, numbered as in Godot 3's Image::Format
+enum
+{
+    IMAGE_FORMAT_L8 = 0,
+    IMAGE_FORMAT_LA8 = 1,
+    IMAGE_FORMAT_R8 = 2,
+    IMAGE_FORMAT_RG8 = 3,
+    IMAGE_FORMAT_RGB8 = 4,
+    IMAGE_FORMAT_RGBA8 = 5,
+    IMAGE_FORMAT_RGBA4444 = 6,
+    IMAGE_FORMAT_RGBA5551 = 7,
+    IMAGE_FORMAT_RF = 8,
+    IMAGE_FORMAT_RGF = 9,
+    IMAGE_FORMAT_RGBF = 10,
+    IMAGE_FORMAT_RGBAF = 11,
+    IMAGE_FORMAT_RH = 12,
+    IMAGE_FORMAT_RGH = 13,
+    IMAGE_FORMAT_RGBH = 14,
+    IMAGE_FORMAT_RGBAH = 15,
+    IMAGE_FORMAT_RGBE9995 = 16,
+    IMAGE_FORMAT_DXT1 = 17,
+    IMAGE_FORMAT_DXT3 = 18,
+    IMAGE_FORMAT_DXT5 = 19,
+    IMAGE_FORMAT_RGTC_R = 20,
+    IMAGE_FORMAT_RGTC_RG = 21,
+    IMAGE_FORMAT_BPTC_RGBA = 22,
+    IMAGE_FORMAT_BPTC_RGBF = 23,
+    IMAGE_FORMAT_BPTC_RGBFU = 24,
+    IMAGE_FORMAT_PVRTC2 = 25,
+    IMAGE_FORMAT_PVRTC2A = 26,
+    IMAGE_FORMAT_PVRTC4 = 27,
+    IMAGE_FORMAT_PVRTC4A = 28,
+    IMAGE_FORMAT_ETC = 29,
+    IMAGE_FORMAT_ETC2_R11 = 30,
+    IMAGE_FORMAT_ETC2_R11S = 31,
+    IMAGE_FORMAT_ETC2_RG11 = 32,
+    IMAGE_FORMAT_ETC2_RG11S = 33,
+    IMAGE_FORMAT_ETC2_RGB8 = 34,
+    IMAGE_FORMAT_ETC2_RGBA8 = 35,
+    IMAGE_FORMAT_ETC2_RGB8A1 = 36,
+
+    IMAGE_FORMAT_COUNT = 37
+};
+
+bool is_image_format_supported(int format);
+int64_t get_image_data_size(int format, int width, int height, bool mipmaps); // Size of the first or of all mipmaps
+
+void decode_image(const uint8_t* data, int format, int width, int height, uint8_t* rgba, thread_pool* pool);
+
+#endif
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include "gdpc.h"
 #include "config.h"
+#include "batch.h"
+#include "server.h"
+#include "pack_analysis.h"
+#include "buffer_pool.h"
+#include "progress.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,14 +21,42 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    // If listing or extracting
-    if(cfg.operation_mode == OPERATION_MODE_LIST || cfg.operation_mode == OPERATION_MODE_EXTRACT)
+    // Every buffer the data goes through comes from the pool
+    buffer_pool_init(cfg.memory_limit);
+    progress_start(cfg.progress_format);
+    int error = 0;
+
+    // If running a batch of operations
+    if(cfg.operation_mode == OPERATION_MODE_BATCH)
+    {
+        if(run_batch(&cfg) != 0)
+        {
+            error = 1;
+        }
+    }
+    // Else if serving packages
+    else if(cfg.operation_mode == OPERATION_MODE_SERVE)
+    {
+        if(run_server(&cfg) != 0)
+        {
+            error = 1;
+        }
+    }
+    // Else if listing, extracting or searching
+    else if(cfg.operation_mode == OPERATION_MODE_LIST || cfg.operation_mode == OPERATION_MODE_EXTRACT || cfg.operation_mode == OPERATION_MODE_GREP)
     {
         // Read the packs
         if(read_packs(&cfg) != 0)
         {
-            free_config(&cfg);
-            return 1;
+            error = 1;
+        }
+    }
+    // Else if analyzing
+    else if(cfg.operation_mode == OPERATION_MODE_ANALYZE)
+    {
+        if(analyze_packs(&cfg) != 0)
+        {
+            error = 1;
         }
     }
     // Else if creating or updating
@@ -31,13 +64,20 @@ int main(int argc, char** argv)
     {
         if(create_pack(&cfg) !=0)
         {
-            free_config(&cfg);
-            return 1;
+            error = 1;
         }
     }
 
+    progress_stop();
+
+    if(cfg.print_stats == true)
+    {
+        print_buffer_pool_stats(stderr);
+    }
+
     // Clean-up
+    buffer_pool_free();
     free_config(&cfg);
 
-    return 0;
+    return error;
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef TOOL_GDPC_MD5_H
+#define TOOL_GDPC_MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t state[4];
+    uint64_t length; // Number of bytes hashed
+    uint8_t buffer[64];
+} md5_context;
+
+void md5_init(md5_context* ctx);
+void md5_update(md5_context* ctx, const uint8_t* data, size_t len);
+void md5_final(md5_context* ctx, uint8_t* digest);
+
+#endif
\ No newline at end of file
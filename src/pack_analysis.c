@@ -0,0 +1,816 @@
+#include "pack_analysis.h"
+#include "gdpc.h"
+#include "gd_resources.h"
+#include "pack_crypto.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ANALYSIS_CHUNK_SIZE (16 << 20) // Larger files are hashed in chunks of this size, on several cores
+
+typedef struct
+{
+    gd_pack pack;
+    bool loaded;
+
+    const char* data; // Mapped package
+    size_t data_size;
+} analyzed_pack;
+
+typedef struct
+{
+    int32_t pack;
+    int32_t file; // Index in the file list of its package
+    const char* path;
+    size_t path_offset; // Offset of the path in the names, until they stop moving
+    uint32_t path_hash;
+
+    int64_t offset;
+    int64_t size;
+    bool encrypted;
+
+    uint64_t hash[2]; // Hash of the content, only computed when other files have the same size
+    uint64_t* chunk_hashes; // Hash of each chunk of large files, combined once they're all hashed
+    int64_t chunk_count;
+} analyzed_file;
+
+DEFINE_VECTOR(analyzed_file_vector, analyzed_file)
+
+typedef struct
+{
+    analyzed_file* file;
+    analyzed_pack* pack;
+    int64_t begin;
+    int64_t end;
+    uint64_t* hash;
+    const uint8_t* key; // NULL without an encryption key
+} hash_task;
+
+DEFINE_VECTOR(hash_task_vector, hash_task)
+
+// Files with the same content, a run of the files sorted by content
+typedef struct
+{
+    size_t first;
+    size_t count;
+    int64_t size;
+    int64_t wasted;
+} duplicate_group;
+
+DEFINE_VECTOR(duplicate_group_vector, duplicate_group)
+
+typedef struct
+{
+    int64_t begin;
+    int64_t end;
+} byte_range;
+
+static void collect_files(analyzed_pack* packs, size_t pack_count, analyzed_file_vector* files);
+static void hash_duplicate_candidates(analyzed_pack* packs, analyzed_file** by_size, size_t count, config* cfg);
+static void hash_chunk(void* arg);
+static void hash_data(const void* data, size_t len, uint64_t seed, uint64_t* out);
+static void hash_decrypted_data(const char* data, int64_t size, uint64_t* out);
+static size_t find_duplicates(analyzed_file** by_size, size_t count, duplicate_group_vector* groups);
+
+static void report_duplicates(analyzed_pack* packs, size_t pack_count, analyzed_file** files, duplicate_group_vector* groups, config* cfg);
+static void report_shadowed_files(analyzed_pack* packs, analyzed_file** by_path, size_t count, config* cfg);
+static void report_orphaned_imports(analyzed_pack* packs, analyzed_file** by_path, size_t count, config* cfg);
+static void report_dead_space(analyzed_pack* packs, size_t pack_count, analyzed_file* files, size_t count, config* cfg);
+static int64_t get_file_list_end(analyzed_pack* pack);
+static analyzed_file* find_path(analyzed_file** by_path, size_t count, const char* path);
+
+static int compare_sizes(const void* a, const void* b);
+static int compare_contents(const void* a, const void* b);
+static int compare_paths(const void* a, const void* b);
+static int compare_waste(const void* a, const void* b);
+static int compare_ranges(const void* a, const void* b);
+
+int analyze_packs(config* cfg)
+{
+    int error = 0;
+    size_t pack_count = cfg->input_files.size;
+
+    analyzed_pack* packs = calloc(pack_count, sizeof(analyzed_pack));
+    if(packs == NULL)
+    {
+        fprintf(stderr, "calloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // Load and map every package, overlays are analyzed in the order they're given
+    for(size_t i = 0; i < pack_count; ++i)
+    {
+        char* path = cfg->input_files.data[i];
+        if(load_pack(path, &packs[i].pack, cfg) != 0)
+        {
+            error = 1;
+            continue;
+        }
+
+        packs[i].data = map_file(path, &packs[i].data_size);
+        if(packs[i].data == NULL)
+        {
+            fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", path);
+            free_pack(&packs[i].pack);
+            error = 1;
+            continue;
+        }
+
+        packs[i].loaded = true;
+    }
+
+    analyzed_file_vector files;
+    analyzed_file_vector_init(&files);
+    collect_files(packs, pack_count, &files);
+
+    analyzed_file* file_list = files.data;
+    analyzed_file** sorted = malloc((files.size + 1) * sizeof(analyzed_file*));
+    if(sorted == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        sorted[i] = &file_list[i];
+    }
+
+    // Only files whose size is shared can be duplicates, the others are never read
+    qsort(sorted, files.size, sizeof(analyzed_file*), compare_sizes);
+    hash_duplicate_candidates(packs, sorted, files.size, cfg);
+
+    duplicate_group_vector groups;
+    duplicate_group_vector_init(&groups);
+    find_duplicates(sorted, files.size, &groups);
+    report_duplicates(packs, pack_count, sorted, &groups, cfg);
+
+    // Overlays and imports resolve paths across every package
+    qsort(sorted, files.size, sizeof(analyzed_file*), compare_paths);
+    report_shadowed_files(packs, sorted, files.size, cfg);
+    report_orphaned_imports(packs, sorted, files.size, cfg);
+
+    report_dead_space(packs, pack_count, file_list, files.size, cfg);
+
+    // Clean up
+    for(size_t i = 0; i < files.size; ++i)
+    {
+        free(file_list[i].chunk_hashes);
+    }
+
+    if(files.size > 0)
+    {
+        free((char*)file_list[0].path);
+    }
+
+    for(size_t i = 0; i < pack_count; ++i)
+    {
+        if(packs[i].loaded == false) continue;
+
+        unmap_file(packs[i].data, packs[i].data_size);
+        free_pack(&packs[i].pack);
+    }
+
+    free(sorted);
+    free(packs);
+    analyzed_file_vector_free(&files);
+    duplicate_group_vector_free(&groups);
+
+    return error;
+}
+
+// Gathers the files of every package, their paths in a single buffer
+static void collect_files(analyzed_pack* packs,
+                          size_t pack_count,
+                          analyzed_file_vector* files)
+{
+    char* names = NULL;
+    size_t names_size = 0;
+    size_t names_capacity = 0;
+
+    // The file lists give the final count
+    size_t file_count = 0;
+    for(size_t i = 0; i < pack_count; ++i)
+    {
+        if(packs[i].loaded == true) file_count += packs[i].pack.file_count;
+    }
+    analyzed_file_vector_reserve(files, file_count);
+
+    for(size_t i = 0; i < pack_count; ++i)
+    {
+        if(packs[i].loaded == false) continue;
+
+        gd_pack* pack = &packs[i].pack;
+        path_cursor cursor;
+        path_cursor_init(&cursor, pack);
+
+        gd_file file;
+        while(next_file(pack, &cursor, &file) == true)
+        {
+            if(names_size + file.len + 1 > names_capacity)
+            {
+                names_capacity = (names_capacity + file.len + 1) * 2;
+                names = realloc(names, names_capacity);
+                if(names == NULL)
+                {
+                    fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+                    abort();
+                }
+            }
+
+            analyzed_file entry;
+            entry.pack = i;
+            entry.file = cursor.index;
+            entry.path = NULL;
+            entry.path_offset = names_size;
+            entry.path_hash = hash_path(file.path, file.len);
+            entry.offset = file.offset;
+            entry.size = file.size;
+            entry.encrypted = file.encrypted;
+            entry.hash[0] = 0;
+            entry.hash[1] = 0;
+            entry.chunk_hashes = NULL;
+            entry.chunk_count = 0;
+
+            memcpy(names + names_size, file.path, file.len + 1);
+            names_size += file.len + 1;
+
+            analyzed_file_vector_push_back(files, entry);
+        }
+
+        path_cursor_free(&cursor);
+    }
+
+    // The first path owns the buffer
+    analyzed_file* file_list = files->data;
+    for(size_t i = 0; i < files->size; ++i)
+    {
+        file_list[i].path = names + file_list[i].path_offset;
+    }
+
+    if(files->size == 0)
+    {
+        free(names);
+    }
+}
+
+// Hashes the content of the files sharing their size with another one, on every core
+static void hash_duplicate_candidates(analyzed_pack* packs,
+                                      analyzed_file** by_size,
+                                      size_t count,
+                                      config* cfg)
+{
+    hash_task_vector tasks;
+    hash_task_vector_init(&tasks);
+
+    for(size_t i = 0; i < count;)
+    {
+        size_t end = i + 1;
+        while(end < count && by_size[end]->size == by_size[i]->size) end++;
+
+        // Empty files waste nothing
+        for(size_t j = i; j < end && end - i > 1 && by_size[i]->size > 0; ++j)
+        {
+            analyzed_file* file = by_size[j];
+            analyzed_pack* pack = &packs[file->pack];
+
+            // Encrypted files are hashed decrypted, or as they're stored without the key
+            int64_t stored_size = (file->encrypted == true) ? get_encrypted_size(file->size) : file->size;
+            const uint8_t* key = (file->encrypted == true && cfg->has_encryption_key == true) ? cfg->encryption_key : NULL;
+
+            int64_t available = (file->offset < (int64_t)pack->data_size) ? (int64_t)pack->data_size - file->offset : 0;
+            if(stored_size > available) stored_size = available;
+
+            int64_t chunk_count = (stored_size + ANALYSIS_CHUNK_SIZE - 1) / ANALYSIS_CHUNK_SIZE;
+            if(key != NULL || chunk_count <= 1)
+            {
+                hash_task task = { file, pack, 0, stored_size, file->hash, key };
+                hash_task_vector_push_back(&tasks, task);
+                continue;
+            }
+
+            file->chunk_hashes = malloc(chunk_count * 2 * sizeof(uint64_t));
+            if(file->chunk_hashes == NULL)
+            {
+                fprintf(stderr, "malloc(): failed to allocate memory.\n");
+                abort();
+            }
+            file->chunk_count = chunk_count;
+
+            for(int64_t k = 0; k < chunk_count; ++k)
+            {
+                int64_t begin = k * ANALYSIS_CHUNK_SIZE;
+                int64_t chunk_end = (begin + ANALYSIS_CHUNK_SIZE < stored_size) ? begin + ANALYSIS_CHUNK_SIZE : stored_size;
+
+                hash_task task = { file, pack, begin, chunk_end, file->chunk_hashes + k * 2, NULL };
+                hash_task_vector_push_back(&tasks, task);
+            }
+        }
+
+        i = end;
+    }
+
+    thread_pool pool;
+    thread_pool_init(&pool, get_processor_count());
+
+    hash_task* task_list = tasks.data;
+    for(size_t i = 0; i < tasks.size; ++i)
+    {
+        thread_pool_submit(&pool, hash_chunk, &task_list[i]);
+    }
+
+    thread_pool_wait(&pool);
+    thread_pool_free(&pool);
+
+    // The hash of a large file is the hash of the hashes of its chunks
+    for(size_t i = 0; i < count; ++i)
+    {
+        analyzed_file* file = by_size[i];
+        if(file->chunk_hashes == NULL) continue;
+
+        hash_data(file->chunk_hashes, file->chunk_count * 2 * sizeof(uint64_t), file->size, file->hash);
+    }
+
+    hash_task_vector_free(&tasks);
+}
+
+static void hash_chunk(void* arg)
+{
+    hash_task* task = (hash_task*)arg;
+    const char* data = task->pack->data + task->file->offset;
+
+    if(task->key != NULL)
+    {
+        int64_t size;
+        char* decrypted = decrypt_data(data, task->end, task->key, &size);
+        if(decrypted != NULL)
+        {
+            hash_decrypted_data(decrypted, size, task->hash);
+            buffer_pool_release(decrypted);
+            return;
+        }
+    }
+
+    hash_data(data + task->begin, task->end - task->begin, 0, task->hash);
+}
+
+// Hashes the decrypted file as if it was stored plainly, chunk by chunk
+static void hash_decrypted_data(const char* data,
+                                int64_t size,
+                                uint64_t* out)
+{
+    int64_t chunk_count = (size + ANALYSIS_CHUNK_SIZE - 1) / ANALYSIS_CHUNK_SIZE;
+    if(chunk_count <= 1)
+    {
+        hash_data(data, size, 0, out);
+        return;
+    }
+
+    uint64_t* chunk_hashes = malloc(chunk_count * 2 * sizeof(uint64_t));
+    if(chunk_hashes == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(int64_t k = 0; k < chunk_count; ++k)
+    {
+        int64_t begin = k * ANALYSIS_CHUNK_SIZE;
+        int64_t length = (begin + ANALYSIS_CHUNK_SIZE < size) ? ANALYSIS_CHUNK_SIZE : size - begin;
+        hash_data(data + begin, length, 0, chunk_hashes + k * 2);
+    }
+
+    hash_data(chunk_hashes, chunk_count * 2 * sizeof(uint64_t), size, out);
+    free(chunk_hashes);
+}
+
+static uint64_t rotate_left(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t mix_final(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
+
+// 128-bit MurmurHash3 (x64), fast and well distributed but not cryptographic
+static void hash_data(const void* data,
+                      size_t len,
+                      uint64_t seed,
+                      uint64_t* out)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    size_t blocks = len / 16;
+    for(size_t i = 0; i < blocks; ++i)
+    {
+        uint64_t k1, k2;
+        memcpy(&k1, bytes + i * 16, 8);
+        memcpy(&k2, bytes + i * 16 + 8, 8);
+
+        k1 *= c1; k1 = rotate_left(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotate_left(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotate_left(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotate_left(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // Remaining bytes, little-endian
+    const uint8_t* tail = bytes + blocks * 16;
+    size_t remaining = len & 15;
+    uint64_t k1 = 0, k2 = 0;
+
+    for(size_t i = remaining; i > 8; --i)
+    {
+        k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+    }
+    for(size_t i = (remaining < 8) ? remaining : 8; i > 0; --i)
+    {
+        k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+    }
+
+    if(remaining > 8)
+    {
+        k2 *= c2; k2 = rotate_left(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if(remaining > 0)
+    {
+        k1 *= c1; k1 = rotate_left(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = mix_final(h1);
+    h2 = mix_final(h2);
+    h1 += h2;
+    h2 += h1;
+
+    out[0] = h1;
+    out[1] = h2;
+}
+
+// Sorts the files by content and groups the ones with the same size and hash. Returns the number of groups
+static size_t find_duplicates(analyzed_file** by_size,
+                              size_t count,
+                              duplicate_group_vector* groups)
+{
+    qsort(by_size, count, sizeof(analyzed_file*), compare_contents);
+
+    for(size_t i = 0; i < count;)
+    {
+        size_t end = i + 1;
+        while(end < count && by_size[end]->size == by_size[i]->size && by_size[end]->hash[0] == by_size[i]->hash[0] && by_size[end]->hash[1] == by_size[i]->hash[1]) end++;
+
+        if(end - i > 1 && by_size[i]->size > 0)
+        {
+            duplicate_group group = { i, end - i, by_size[i]->size, by_size[i]->size * (int64_t)(end - i - 1) };
+            duplicate_group_vector_push_back(groups, group);
+        }
+
+        i = end;
+    }
+
+    qsort(groups->data, groups->size, sizeof(duplicate_group), compare_waste);
+
+    return groups->size;
+}
+
+static void report_duplicates(analyzed_pack* packs,
+                              size_t pack_count,
+                              analyzed_file** files,
+                              duplicate_group_vector* groups,
+                              config* cfg)
+{
+    duplicate_group* group_list = groups->data;
+
+    // Space wasted by copies within each package, and content shared by each pair of packages
+    int64_t* wasted = calloc(pack_count, sizeof(int64_t));
+    int32_t* copies = calloc(pack_count, sizeof(int32_t));
+    int64_t* shared_size = calloc(pack_count * pack_count, sizeof(int64_t));
+    int32_t* shared_count = calloc(pack_count * pack_count, sizeof(int32_t));
+    if(wasted == NULL || copies == NULL || shared_size == NULL || shared_count == NULL)
+    {
+        fprintf(stderr, "calloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    int64_t total_wasted = 0;
+    fprintf(cfg->output, "Duplicates:\n");
+    for(size_t i = 0; i < groups->size; ++i)
+    {
+        duplicate_group* group = &group_list[i];
+        total_wasted += group->wasted;
+
+        fprintf(cfg->output, "  %ldB x %zu (%ldB wasted)\n", group->size, group->count, group->wasted);
+        for(size_t j = group->first; j < group->first + group->count; ++j)
+        {
+            fprintf(cfg->output, "    %s %s\n", packs[files[j]->pack].pack.path, files[j]->path);
+            copies[files[j]->pack]++;
+        }
+
+        for(size_t a = 0; a < pack_count; ++a)
+        {
+            if(copies[a] == 0) continue;
+
+            wasted[a] += group->size * (copies[a] - 1);
+            for(size_t b = a + 1; b < pack_count; ++b)
+            {
+                if(copies[b] == 0) continue;
+
+                shared_size[a * pack_count + b] += group->size;
+                shared_count[a * pack_count + b]++;
+            }
+        }
+
+        memset(copies, 0, pack_count * sizeof(int32_t));
+    }
+    fprintf(cfg->output, "  %zu groups, %ldB wasted\n", groups->size, total_wasted);
+
+    fprintf(cfg->output, "Wasted space:\n");
+    for(size_t i = 0; i < pack_count; ++i)
+    {
+        if(packs[i].loaded == false) continue;
+        fprintf(cfg->output, "  %s %ldB\n", packs[i].pack.path, wasted[i]);
+    }
+
+    if(pack_count > 1)
+    {
+        fprintf(cfg->output, "Overlap:\n");
+        for(size_t a = 0; a < pack_count; ++a)
+        {
+            for(size_t b = a + 1; b < pack_count; ++b)
+            {
+                if(shared_count[a * pack_count + b] == 0) continue;
+                fprintf(cfg->output, "  %s %s %d files, %ldB\n", packs[a].pack.path, packs[b].pack.path, shared_count[a * pack_count + b], shared_size[a * pack_count + b]);
+            }
+        }
+    }
+
+    free(wasted);
+    free(copies);
+    free(shared_size);
+    free(shared_count);
+}
+
+// Files listed again later, in the same package or a package loaded after it, are replaced by the last one
+static void report_shadowed_files(analyzed_pack* packs,
+                                  analyzed_file** by_path,
+                                  size_t count,
+                                  config* cfg)
+{
+    fprintf(cfg->output, "Shadowed files:\n");
+
+    size_t shadowed = 0;
+    for(size_t i = 0; i < count;)
+    {
+        size_t end = i + 1;
+        while(end < count && by_path[end]->path_hash == by_path[i]->path_hash && strcmp(by_path[end]->path, by_path[i]->path) == 0) end++;
+
+        analyzed_file* last = by_path[end - 1];
+        for(size_t j = i; j < end - 1; ++j)
+        {
+            fprintf(cfg->output, "  %s %s (by %s)\n", packs[by_path[j]->pack].pack.path, by_path[j]->path, packs[last->pack].pack.path);
+            shadowed++;
+        }
+
+        i = end;
+    }
+
+    fprintf(cfg->output, "  %zu files\n", shadowed);
+}
+
+// .import files whose resource isn't in any of the packages
+static void report_orphaned_imports(analyzed_pack* packs,
+                                    analyzed_file** by_path,
+                                    size_t count,
+                                    config* cfg)
+{
+    fprintf(cfg->output, "Orphaned imports:\n");
+
+    size_t orphaned = 0;
+    FILE* file = NULL;
+    int32_t file_pack = -1;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        analyzed_file* entry = by_path[i];
+        if(is_import(entry->path) == false) continue;
+
+        if(entry->pack != file_pack)
+        {
+            if(file != NULL) fclose(file);
+
+            file = fopen(packs[entry->pack].pack.path, "rb");
+            file_pack = entry->pack;
+            if(file == NULL) continue;
+        }
+        if(file == NULL) continue;
+
+        gd_file file_info = { (char*)entry->path, strlen(entry->path), entry->offset, entry->size, { 0 }, entry->encrypted };
+        char* mapped = get_mapped_path(&file_info, file, cfg);
+        if(mapped == NULL) continue;
+
+        if(find_path(by_path, count, mapped) == NULL)
+        {
+            fprintf(cfg->output, "  %s %s (%s)\n", packs[entry->pack].pack.path, entry->path, mapped);
+            orphaned++;
+        }
+
+        free(mapped);
+    }
+
+    if(file != NULL) fclose(file);
+
+    fprintf(cfg->output, "  %zu files\n", orphaned);
+}
+
+// Ranges of each package not used by the header, the file list or any file
+static void report_dead_space(analyzed_pack* packs,
+                              size_t pack_count,
+                              analyzed_file* files,
+                              size_t count,
+                              config* cfg)
+{
+    fprintf(cfg->output, "Dead space:\n");
+
+    byte_range* ranges = malloc((count + 1) * sizeof(byte_range));
+    if(ranges == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    size_t first = 0;
+    for(size_t i = 0; i < pack_count; ++i)
+    {
+        if(packs[i].loaded == false) continue;
+
+        int64_t pack_size = packs[i].data_size;
+        size_t range_count = 0;
+        ranges[range_count++] = (byte_range){ 0, get_file_list_end(&packs[i]) };
+
+        // Files of a package are contiguous in the list
+        while(first < count && files[first].pack == (int32_t)i)
+        {
+            int64_t stored_size = (files[first].encrypted == true) ? get_encrypted_size(files[first].size) : files[first].size;
+            ranges[range_count++] = (byte_range){ files[first].offset, files[first].offset + stored_size };
+            first++;
+        }
+
+        qsort(ranges, range_count, sizeof(byte_range), compare_ranges);
+
+        // Sweep the used ranges, what's between them is unused
+        int64_t covered = 0, dead = 0, largest = 0;
+        size_t dead_count = 0;
+        for(size_t j = 0; j <= range_count; ++j)
+        {
+            int64_t begin = (j < range_count) ? ranges[j].begin : pack_size;
+            if(begin > pack_size) begin = pack_size;
+
+            if(begin > covered)
+            {
+                if(cfg->verbose == true)
+                {
+                    fprintf(cfg->output, "    %ld %ldB\n", covered, begin - covered);
+                }
+
+                dead += begin - covered;
+                dead_count++;
+                if(begin - covered > largest) largest = begin - covered;
+            }
+
+            if(j < range_count && ranges[j].end > covered) covered = ranges[j].end;
+        }
+
+        fprintf(cfg->output, "  %s %ldB in %zu ranges (largest %ldB)\n", packs[i].pack.path, dead, dead_count, largest);
+    }
+
+    free(ranges);
+}
+
+static int64_t get_file_list_end(analyzed_pack* pack)
+{
+    gd_pack* info = &pack->pack;
+    int64_t size = pack->data_size;
+    int64_t position = info->header_size;
+
+    // An encrypted list is a single block
+    if((info->pack_flags & PACK_DIR_ENCRYPTED) != 0)
+    {
+        if(position + ENCRYPTED_HEADER_SIZE > size) return size;
+
+        int64_t list_size;
+        memcpy(&list_size, pack->data + position + 16, 8);
+        position += get_encrypted_size(list_size);
+
+        return (position < size && position > 0) ? position : size;
+    }
+
+    int64_t item_size = (info->format_version == PACK_FORMAT_VERSION_4) ? 36 : 32;
+    for(int32_t i = 0; i < info->file_count; ++i)
+    {
+        if(position + 4 > size) return size;
+
+        int32_t len;
+        memcpy(&len, pack->data + position, 4);
+        position += 4 + len + item_size;
+    }
+
+    return (position < size) ? position : size;
+}
+
+static analyzed_file* find_path(analyzed_file** by_path,
+                                size_t count,
+                                const char* path)
+{
+    analyzed_file key;
+    key.path = path;
+    key.path_hash = hash_path(path, strlen(path));
+    key.pack = 0;
+    key.file = 0;
+
+    // Binary search on the hash and path only
+    size_t low = 0, high = count;
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        analyzed_file* entry = by_path[middle];
+
+        int order = (entry->path_hash != key.path_hash) ? ((entry->path_hash < key.path_hash) ? -1 : 1) : strcmp(entry->path, key.path);
+        if(order == 0) return entry;
+        if(order < 0) low = middle + 1;
+        else high = middle;
+    }
+
+    return NULL;
+}
+
+static int compare_sizes(const void* a, const void* b)
+{
+    const analyzed_file* left = *(const analyzed_file* const*)a;
+    const analyzed_file* right = *(const analyzed_file* const*)b;
+
+    return (left->size > right->size) - (left->size < right->size);
+}
+
+static int compare_contents(const void* a, const void* b)
+{
+    const analyzed_file* left = *(const analyzed_file* const*)a;
+    const analyzed_file* right = *(const analyzed_file* const*)b;
+
+    if(left->size != right->size) return (left->size > right->size) - (left->size < right->size);
+    if(left->hash[0] != right->hash[0]) return (left->hash[0] > right->hash[0]) - (left->hash[0] < right->hash[0]);
+    if(left->hash[1] != right->hash[1]) return (left->hash[1] > right->hash[1]) - (left->hash[1] < right->hash[1]);
+
+    // Keep the files of a group in the order of the packages
+    if(left->pack != right->pack) return (left->pack > right->pack) - (left->pack < right->pack);
+    return (left->file > right->file) - (left->file < right->file);
+}
+
+// Sorts by hash then path, the files of a path in the order they're loaded in
+static int compare_paths(const void* a, const void* b)
+{
+    const analyzed_file* left = *(const analyzed_file* const*)a;
+    const analyzed_file* right = *(const analyzed_file* const*)b;
+
+    if(left->path_hash != right->path_hash) return (left->path_hash > right->path_hash) - (left->path_hash < right->path_hash);
+
+    int order = strcmp(left->path, right->path);
+    if(order != 0) return order;
+
+    if(left->pack != right->pack) return (left->pack > right->pack) - (left->pack < right->pack);
+    return (left->file > right->file) - (left->file < right->file);
+}
+
+static int compare_waste(const void* a, const void* b)
+{
+    const duplicate_group* left = (const duplicate_group*)a;
+    const duplicate_group* right = (const duplicate_group*)b;
+
+    if(left->wasted != right->wasted) return (left->wasted < right->wasted) - (left->wasted > right->wasted);
+    return (left->first > right->first) - (left->first < right->first);
+}
+
+static int compare_ranges(const void* a, const void* b)
+{
+    const byte_range* left = (const byte_range*)a;
+    const byte_range* right = (const byte_range*)b;
+
+    return (left->begin > right->begin) - (left->begin < right->begin);
+}
\ No newline at end of file
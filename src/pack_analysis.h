@@ -0,0 +1,9 @@
+#ifndef TOOL_GDPC_PACK_ANALYSIS_H
+#define TOOL_GDPC_PACK_ANALYSIS_H
+
+#include "config.h"
+
+// Reports duplicated files, files hidden by other packages, orphaned .import files and unused space in the packages
+int analyze_packs(config* cfg);
+
+#endif
\ No newline at end of file
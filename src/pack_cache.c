@@ -0,0 +1,215 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "pack_cache.h"
+#include "path_tree.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static cached_pack* get_entry(pack_cache* cache, const char* path);
+static cached_pack** find_slot(cached_pack** slots, size_t capacity, const char* key);
+static bool is_current(cached_pack* entry);
+static void unload(cached_pack* entry);
+
+void pack_cache_init(pack_cache* cache)
+{
+    cache->slots = NULL;
+    cache->capacity = 0;
+    cache->size = 0;
+
+    pthread_mutex_init(&cache->mutex, NULL);
+}
+
+void pack_cache_free(pack_cache* cache)
+{
+    for(size_t i = 0; i < cache->capacity; ++i)
+    {
+        cached_pack* entry = cache->slots[i];
+        if(entry == NULL) continue;
+
+        unload(entry);
+        pthread_rwlock_destroy(&entry->lock);
+        free(entry->key);
+        free(entry);
+    }
+
+    free(cache->slots);
+    pthread_mutex_destroy(&cache->mutex);
+}
+
+// Returns the pack loaded and locked for reading, reloading it if it changed on disk. Returns NULL if it can't be loaded
+cached_pack* pack_cache_acquire(pack_cache* cache, const char* path, config* cfg)
+{
+    cached_pack* entry = get_entry(cache, path);
+
+    while(1)
+    {
+        pthread_rwlock_rdlock(&entry->lock);
+        if(is_current(entry) == true)
+        {
+            return entry;
+        }
+        pthread_rwlock_unlock(&entry->lock);
+
+        // (Re)load the pack, unless another thread did it first
+        pthread_rwlock_wrlock(&entry->lock);
+        if(is_current(entry) == false)
+        {
+            unload(entry);
+
+            file_identity identity;
+            bool loaded = false;
+            if(get_file_identity(path, &identity) == false)
+            {
+                fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", path);
+            }
+            else if(load_pack(path, &entry->pack, cfg) == 0)
+            {
+                loaded = true;
+            }
+
+            if(loaded == false)
+            {
+                pthread_rwlock_unlock(&entry->lock);
+                return NULL;
+            }
+
+            if(entry->pack.index == NULL) index_pack(&entry->pack);
+            entry->pack.tree = build_path_tree(&entry->pack);
+            entry->data = map_file(path, &entry->data_size);
+            entry->identity = identity;
+            entry->loaded = true;
+        }
+        pthread_rwlock_unlock(&entry->lock);
+    }
+}
+
+void pack_cache_release(cached_pack* entry)
+{
+    pthread_rwlock_unlock(&entry->lock);
+}
+
+void pack_cache_invalidate(pack_cache* cache, const char* path)
+{
+    char* key = resolve_path(path);
+
+    pthread_mutex_lock(&cache->mutex);
+    cached_pack* entry = (cache->capacity > 0) ? *find_slot(cache->slots, cache->capacity, key) : NULL;
+    pthread_mutex_unlock(&cache->mutex);
+
+    free(key);
+
+    // Keep the entry, it will be loaded again the next time it is needed
+    if(entry != NULL)
+    {
+        pthread_rwlock_wrlock(&entry->lock);
+        unload(entry);
+        pthread_rwlock_unlock(&entry->lock);
+    }
+}
+
+static cached_pack* get_entry(pack_cache* cache, const char* path)
+{
+    // Use the absolute path as the key so that different spellings of a path share an entry
+    char* key = resolve_path(path);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    // Keep the table at most half full
+    if((cache->size + 1) * 2 > cache->capacity)
+    {
+        size_t capacity = (cache->capacity == 0) ? 64 : cache->capacity * 2;
+        cached_pack** slots = calloc(capacity, sizeof(cached_pack*));
+        if(slots == NULL)
+        {
+            fprintf(stderr, "calloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        for(size_t i = 0; i < cache->capacity; ++i)
+        {
+            if(cache->slots[i] != NULL) *find_slot(slots, capacity, cache->slots[i]->key) = cache->slots[i];
+        }
+
+        free(cache->slots);
+        cache->slots = slots;
+        cache->capacity = capacity;
+    }
+
+    // Find the entry, or create an empty one
+    cached_pack** slot = find_slot(cache->slots, cache->capacity, key);
+    if(*slot == NULL)
+    {
+        cached_pack* entry = malloc(sizeof(cached_pack));
+        if(entry == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        entry->key = key;
+        entry->loaded = false;
+        entry->data = NULL;
+        entry->data_size = 0;
+        pthread_rwlock_init(&entry->lock, NULL);
+
+        *slot = entry;
+        cache->size++;
+    }
+    else
+    {
+        free(key);
+    }
+
+    cached_pack* entry = *slot;
+    pthread_mutex_unlock(&cache->mutex);
+
+    return entry;
+}
+
+static cached_pack** find_slot(cached_pack** slots, size_t capacity, const char* key)
+{
+    size_t slot = hash_path(key, strlen(key)) & (capacity - 1);
+    while(slots[slot] != NULL && strcmp(slots[slot]->key, key) != 0)
+    {
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    return &slots[slot];
+}
+
+static bool is_current(cached_pack* entry)
+{
+    if(entry->loaded == false)
+    {
+        return false;
+    }
+
+    // Compare the pack on disk with the one that was loaded
+    file_identity identity;
+    if(get_file_identity(entry->key, &identity) == false)
+    {
+        return false;
+    }
+
+    return identity.size == entry->identity.size && 
+           identity.mtime_sec == entry->identity.mtime_sec && 
+           identity.mtime_nsec == entry->identity.mtime_nsec && 
+           identity.inode == entry->identity.inode && 
+           identity.device == entry->identity.device;
+}
+
+static void unload(cached_pack* entry)
+{
+    if(entry->loaded == false) return;
+
+    free_pack(&entry->pack);
+    unmap_file(entry->data, entry->data_size);
+
+    entry->data = NULL;
+    entry->data_size = 0;
+    entry->loaded = false;
+}
\ No newline at end of file
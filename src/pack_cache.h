@@ -0,0 +1,38 @@
+#ifndef TOOL_GDPC_PACK_CACHE_H
+#define TOOL_GDPC_PACK_CACHE_H
+
+#include "gdpc.h"
+#include "file_utils.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+typedef struct
+{
+    char* key; // Resolved path of the pack
+    bool loaded;
+
+    gd_pack pack; // Parsed and indexed file list
+    const char* data; // Mapping of the whole pack
+    size_t data_size;
+    file_identity identity; // State of the pack when it was loaded
+
+    pthread_rwlock_t lock;
+} cached_pack;
+
+typedef struct
+{
+    cached_pack** slots;
+    size_t capacity;
+    size_t size;
+
+    pthread_mutex_t mutex;
+} pack_cache;
+
+void pack_cache_init(pack_cache* cache);
+void pack_cache_free(pack_cache* cache);
+
+cached_pack* pack_cache_acquire(pack_cache* cache, const char* path, config* cfg);
+void pack_cache_release(cached_pack* entry);
+void pack_cache_invalidate(pack_cache* cache, const char* path);
+
+#endif
\ No newline at end of file
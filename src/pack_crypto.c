@@ -0,0 +1,317 @@
+#include "pack_crypto.h"
+#include "file_utils.h"
+#include "md5.h"
+#include "buffer_pool.h"
+#include "progress.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int64_t read_encrypted_header(const char* header, uint8_t* md5, uint8_t* iv);
+static void write_encrypted_header(char* header, const uint8_t* md5, int64_t size, const uint8_t* iv);
+static void generate_iv(uint8_t* iv);
+
+/* Encrypted data
+ * 1 x 16B | ?      | MD5 of the decrypted data
+ * 1 x 8B  | Int    | Size of the decrypted data
+ * 1 x 16B | ?      | IV
+ *         | ?      | Data encrypted with AES-256-CFB, padded to 16B
+*/
+int64_t get_encrypted_size(int64_t size)
+{
+    return ENCRYPTED_HEADER_SIZE + (size + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+}
+
+// Parses a key written as 64 hexadecimal digits, as the editor takes it
+bool parse_encryption_key(const char* hex, uint8_t* key)
+{
+    for(int i = 0; i < AES_KEY_SIZE * 2; ++i)
+    {
+        char c = hex[i];
+        int digit;
+        if(c >= '0' && c <= '9') digit = c - '0';
+        else if(c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+
+        if(i % 2 == 0) key[i / 2] = digit << 4;
+        else key[i / 2] |= digit;
+    }
+
+    // Allow trailing whitespace, key files usually end with a newline
+    for(const char* itr = hex + AES_KEY_SIZE * 2; *itr != '\0'; ++itr)
+    {
+        if(*itr != '\n' && *itr != '\r' && *itr != ' ' && *itr != '\t') return false;
+    }
+
+    return true;
+}
+
+// Reads and decrypts the data at the offset. Returns NULL if it's truncated or the key is wrong
+char* read_encrypted_data(FILE* source, int64_t offset, const uint8_t* key, int64_t* size)
+{
+    char header[ENCRYPTED_HEADER_SIZE];
+    uint8_t md5[16], iv[AES_BLOCK_SIZE];
+    if(read_range(source, offset, header, ENCRYPTED_HEADER_SIZE) != 0)
+    {
+        return NULL;
+    }
+
+    // The size is only trusted if the data it gives fits in the file
+    int64_t available = get_file_size(source) - offset;
+    int64_t data_size = read_encrypted_header(header, md5, iv);
+    if(data_size < 0 || data_size > available || get_encrypted_size(data_size) > available)
+    {
+        return NULL;
+    }
+
+    int64_t padded_size = get_encrypted_size(data_size) - ENCRYPTED_HEADER_SIZE;
+    char* data = buffer_pool_acquire(padded_size + 1);
+
+    if(read_range(source, offset + ENCRYPTED_HEADER_SIZE, data, padded_size) != 0)
+    {
+        buffer_pool_release(data);
+        return NULL;
+    }
+
+    aes_context ctx;
+    aes_init(&ctx, key);
+    aes_cfb_decrypt(&ctx, iv, (uint8_t*)data, padded_size);
+
+    uint8_t hash[16];
+    md5_context md5_ctx;
+    md5_init(&md5_ctx);
+    md5_update(&md5_ctx, (uint8_t*)data, data_size);
+    md5_final(&md5_ctx, hash);
+
+    if(memcmp(hash, md5, 16) != 0)
+    {
+        buffer_pool_release(data);
+        return NULL;
+    }
+
+    data[data_size] = '\0';
+    *size = data_size;
+
+    return data;
+}
+
+// Decrypts data already in memory, available being the number of bytes readable from it
+char* decrypt_data(const char* data, int64_t available, const uint8_t* key, int64_t* size)
+{
+    uint8_t md5[16], iv[AES_BLOCK_SIZE];
+    if(available < ENCRYPTED_HEADER_SIZE)
+    {
+        return NULL;
+    }
+
+    int64_t data_size = read_encrypted_header(data, md5, iv);
+    if(data_size < 0 || data_size > available || get_encrypted_size(data_size) > available)
+    {
+        return NULL;
+    }
+
+    int64_t padded_size = get_encrypted_size(data_size) - ENCRYPTED_HEADER_SIZE;
+    char* decrypted = buffer_pool_acquire(padded_size + 1);
+    memcpy(decrypted, data + ENCRYPTED_HEADER_SIZE, padded_size);
+
+    aes_context ctx;
+    aes_init(&ctx, key);
+    aes_cfb_decrypt(&ctx, iv, (uint8_t*)decrypted, padded_size);
+
+    uint8_t hash[16];
+    md5_context md5_ctx;
+    md5_init(&md5_ctx);
+    md5_update(&md5_ctx, (uint8_t*)decrypted, data_size);
+    md5_final(&md5_ctx, hash);
+
+    if(memcmp(hash, md5, 16) != 0)
+    {
+        buffer_pool_release(decrypted);
+        return NULL;
+    }
+
+    decrypted[data_size] = '\0';
+    *size = data_size;
+
+    return decrypted;
+}
+
+// Decrypts the data at the offset into dest a chunk at a time. Returns 1 if it's truncated or the key is wrong
+int copy_decrypted_data(FILE* dest, FILE* source, int64_t offset, const uint8_t* key)
+{
+    char header[ENCRYPTED_HEADER_SIZE];
+    uint8_t md5[16], iv[AES_BLOCK_SIZE];
+    if(read_range(source, offset, header, ENCRYPTED_HEADER_SIZE) != 0)
+    {
+        return 1;
+    }
+
+    int64_t remaining = read_encrypted_header(header, md5, iv);
+    if(remaining < 0)
+    {
+        return 1;
+    }
+
+    uint8_t* buf = buffer_pool_acquire(BUFFER_BLOCK_SIZE);
+
+    aes_context ctx;
+    aes_init(&ctx, key);
+
+    md5_context md5_ctx;
+    md5_init(&md5_ctx);
+
+    // The MD5 of the decrypted data is checked as it's written
+    int error = 0;
+    offset += ENCRYPTED_HEADER_SIZE;
+    while(remaining > 0 && error == 0)
+    {
+        int64_t chunk = (remaining < BUFFER_BLOCK_SIZE) ? remaining : BUFFER_BLOCK_SIZE;
+        int64_t padded = (chunk + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+
+        if(read_range(source, offset, buf, padded) != 0)
+        {
+            error = 1;
+            break;
+        }
+
+        aes_cfb_decrypt(&ctx, iv, buf, padded);
+        md5_update(&md5_ctx, buf, chunk);
+        if(fwrite(buf, 1, chunk, dest) != (size_t)chunk) error = 1;
+        progress_add(chunk, 0);
+
+        offset += padded;
+        remaining -= chunk;
+    }
+
+    buffer_pool_release(buf);
+
+    uint8_t hash[16];
+    md5_final(&md5_ctx, hash);
+
+    return (error == 0 && memcmp(hash, md5, 16) == 0) ? 0 : 1;
+}
+
+int extract_encrypted_file(const char* dest, FILE* source, int64_t offset, const uint8_t* key)
+{
+    FILE* file = fopen(dest, "wb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "fopen(): failed to open \"%s\"\n", dest);
+        return 1;
+    }
+
+    int error = copy_decrypted_data(file, source, offset, key);
+    if(fclose(file) != 0) error = 1;
+
+    progress_add(0, 1);
+
+    return error;
+}
+
+// Returns the data encrypted with a new IV, with its header
+char* encrypt_data(const char* data, int64_t size, const uint8_t* key, int64_t* encrypted_size)
+{
+    *encrypted_size = get_encrypted_size(size);
+    char* encrypted = buffer_pool_acquire(*encrypted_size);
+    memset(encrypted, 0, *encrypted_size);
+
+    uint8_t md5[16], iv[AES_BLOCK_SIZE];
+    md5_context md5_ctx;
+    md5_init(&md5_ctx);
+    md5_update(&md5_ctx, (const uint8_t*)data, size);
+    md5_final(&md5_ctx, md5);
+
+    generate_iv(iv);
+    write_encrypted_header(encrypted, md5, size, iv);
+
+    // The padding is encrypted zeroes
+    memcpy(encrypted + ENCRYPTED_HEADER_SIZE, data, size);
+
+    aes_context ctx;
+    aes_init(&ctx, key);
+    aes_cfb_encrypt(&ctx, iv, (uint8_t*)encrypted + ENCRYPTED_HEADER_SIZE, *encrypted_size - ENCRYPTED_HEADER_SIZE);
+
+    return encrypted;
+}
+
+// Encrypts length bytes of the source into dest a chunk at a time. Returns the number of bytes read, if the source
+// runs out the rest is encrypted as zeroes so the data keeps its size
+int64_t copy_encrypted_data(FILE* dest, FILE* source, int64_t length, const uint8_t* key)
+{
+    uint8_t md5[16] = { 0 }, iv[AES_BLOCK_SIZE];
+    generate_iv(iv);
+
+    // The MD5 is only known at the end, its place is written again then
+    char header[ENCRYPTED_HEADER_SIZE];
+    write_encrypted_header(header, md5, length, iv);
+
+    long header_position = ftell(dest);
+    fwrite(header, 1, ENCRYPTED_HEADER_SIZE, dest);
+
+    uint8_t* buf = buffer_pool_acquire(BUFFER_BLOCK_SIZE);
+
+    aes_context ctx;
+    aes_init(&ctx, key);
+
+    md5_context md5_ctx;
+    md5_init(&md5_ctx);
+
+    int64_t copied = 0;
+    int64_t remaining = length;
+    while(remaining > 0)
+    {
+        int64_t chunk = (remaining < BUFFER_BLOCK_SIZE) ? remaining : BUFFER_BLOCK_SIZE;
+        int64_t padded = (chunk + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+
+        size_t read = (source != NULL) ? fread(buf, 1, chunk, source) : 0;
+        memset(buf + read, 0, padded - read);
+        if(read < (size_t)chunk) source = NULL;
+
+        md5_update(&md5_ctx, buf, chunk);
+        aes_cfb_encrypt(&ctx, iv, buf, padded);
+        fwrite(buf, 1, padded, dest);
+        progress_add(chunk, 0);
+
+        copied += read;
+        remaining -= chunk;
+    }
+
+    buffer_pool_release(buf);
+
+    md5_final(&md5_ctx, md5);
+
+    long end_position = ftell(dest);
+    fseek(dest, header_position, SEEK_SET);
+    fwrite(md5, 1, 16, dest);
+    fseek(dest, end_position, SEEK_SET);
+
+    return copied;
+}
+
+// Returns the size of the decrypted data, -1 if the header is invalid
+static int64_t read_encrypted_header(const char* header, uint8_t* md5, uint8_t* iv)
+{
+    int64_t size;
+    memcpy(md5, header, 16);
+    memcpy(&size, header + 16, 8);
+    memcpy(iv, header + 24, AES_BLOCK_SIZE);
+
+    return (size >= 0 && size < INT64_MAX - ENCRYPTED_HEADER_SIZE - AES_BLOCK_SIZE) ? size : -1;
+}
+
+static void write_encrypted_header(char* header, const uint8_t* md5, int64_t size, const uint8_t* iv)
+{
+    memcpy(header, md5, 16);
+    memcpy(header + 16, &size, 8);
+    memcpy(header + 24, iv, AES_BLOCK_SIZE);
+}
+
+static void generate_iv(uint8_t* iv)
+{
+    if(get_random_bytes(iv, AES_BLOCK_SIZE) == false)
+    {
+        fprintf(stderr, "getrandom(): failed to generate random bytes.\n");
+        abort();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef TOOL_GDPC_PACK_CRYPTO_H
+#define TOOL_GDPC_PACK_CRYPTO_H
+
+#include "aes.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ENCRYPTED_HEADER_SIZE 40 // MD5, size and IV before the encrypted data
+
+int64_t get_encrypted_size(int64_t size);
+bool parse_encryption_key(const char* hex, uint8_t* key);
+
+// Buffers returned by the functions below come from the buffer pool, release them with buffer_pool_release
+char* read_encrypted_data(FILE* source, int64_t offset, const uint8_t* key, int64_t* size);
+char* decrypt_data(const char* data, int64_t available, const uint8_t* key, int64_t* size);
+int copy_decrypted_data(FILE* dest, FILE* source, int64_t offset, const uint8_t* key);
+int extract_encrypted_file(const char* dest, FILE* source, int64_t offset, const uint8_t* key);
+
+char* encrypt_data(const char* data, int64_t size, const uint8_t* key, int64_t* encrypted_size);
+int64_t copy_encrypted_data(FILE* dest, FILE* source, int64_t length, const uint8_t* key);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,290 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "pack_index.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#define PACK_INDEX_VERSION 2
+
+/* Index file header
+ * 1 x 4B  | String | Magic Number (0x58444947)
+ * 1 x 4B  | Int    | Index version
+ * 1 x 4B  | Int    | Size of the block positions (sizeof(size_t))
+ * 1 x 4B  | Int    | Number of packaged files
+ * 1 x 8B  | Int    | Size of the pack
+ * 2 x 8B  | Int    | Modification time of the pack (seconds, nanoseconds)
+ * 1 x 8B  | Int    | Inode of the pack
+ * 1 x 100B| Void   | Header of the pack
+ * 1 x 4B  | Int    | Length of the longest path
+ * 1 x 8B  | Void   | Reserved
+ * 1 x 8B  | Int    | Size of the paths
+ * 1 x 8B  | Int    | Number of slots of the hash table
+ *
+ * The columns of the file table follow, in the layout gdpc keeps them in memory, so the index is used where it's
+ * mapped: offsets (8B), sizes (8B), block positions, MD5s (16B), path hashes (4B), hash table slots (4B), flags (1B), paths.
+*/
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t word_size;
+    int32_t file_count;
+    int64_t pack_size;
+    int64_t pack_mtime_sec;
+    int64_t pack_mtime_nsec;
+    uint64_t pack_inode;
+    char pack_header[PACK_INDEX_HEADER_SIZE];
+    int32_t max_path_len;
+    uint32_t reserved[2];
+    uint64_t paths_size;
+    uint64_t index_capacity;
+} pack_index_header;
+
+static size_t get_pack_index_size(const pack_index_header* header);
+static bool is_valid_file_table(const gd_pack* pack);
+
+// Returns "<pack>.gdidx"
+char* get_pack_index_path(const char* path)
+{
+    char* index_path = malloc(strlen(path) + 7);
+    if(index_path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    strcpy(index_path, path);
+    strcat(index_path, ".gdidx");
+
+    return index_path;
+}
+
+// Maps the index of the pack and points its file table into it. Returns false, leaving the pack untouched, if there
+// is no index or it was made for another state of the pack
+bool load_pack_index(const char* path,
+                     const file_identity* identity,
+                     const char* header,
+                     gd_pack* pack)
+{
+    char* index_path = get_pack_index_path(path);
+    size_t size;
+    const char* data = map_file(index_path, &size);
+    free(index_path);
+
+    if(data == NULL)
+    {
+        return false;
+    }
+
+    pack_index_header index_header;
+    if(size < sizeof(pack_index_header))
+    {
+        unmap_file(data, size);
+        return false;
+    }
+    memcpy(&index_header, data, sizeof(pack_index_header));
+
+    // The index is stale if the pack changed since it was written
+    if(memcmp(index_header.magic, "GIDX", 4) != 0 ||
+       index_header.version != PACK_INDEX_VERSION ||
+       index_header.word_size != sizeof(size_t) ||
+       index_header.file_count != pack->file_count ||
+       index_header.pack_size != identity->size ||
+       index_header.pack_mtime_sec != identity->mtime_sec ||
+       index_header.pack_mtime_nsec != identity->mtime_nsec ||
+       index_header.pack_inode != identity->inode ||
+       memcmp(index_header.pack_header, header, PACK_INDEX_HEADER_SIZE) != 0 ||
+       index_header.file_count < 0 ||
+       index_header.index_capacity < (uint64_t)index_header.file_count * 2 ||
+       (index_header.index_capacity & (index_header.index_capacity - 1)) != 0 ||
+       index_header.index_capacity > size / 4 ||
+       index_header.paths_size > size ||
+       index_header.max_path_len < 0 ||
+       get_pack_index_size(&index_header) != size)
+    {
+        unmap_file(data, size);
+        return false;
+    }
+
+    size_t count = index_header.file_count;
+    size_t block_count = (count + PATH_BLOCK_SIZE - 1) / PATH_BLOCK_SIZE;
+    const char* itr = data + sizeof(pack_index_header);
+
+    // The pack only points to the columns once they're checked
+    gd_pack mapped = *pack;
+    mapped.files.offsets = (int64_t*)itr;
+    itr += count * 8;
+    mapped.files.sizes = (int64_t*)itr;
+    itr += count * 8;
+    mapped.files.blocks = (size_t*)itr;
+    itr += block_count * sizeof(size_t);
+    mapped.files.md5s = (uint8_t(*)[16])itr;
+    itr += count * 16;
+    mapped.files.hashes = (uint32_t*)itr;
+    itr += count * 4;
+    mapped.index = (int32_t*)itr;
+    itr += index_header.index_capacity * 4;
+    mapped.files.flags = (uint8_t*)itr;
+    itr += count;
+    mapped.files.paths = (uint8_t*)itr;
+
+    mapped.files.paths_size = index_header.paths_size;
+    mapped.files.max_path_len = index_header.max_path_len;
+    mapped.index_capacity = index_header.index_capacity;
+
+    // The columns are used as they are, a damaged index is treated as stale
+    if(is_valid_file_table(&mapped) == false)
+    {
+        unmap_file(data, size);
+        return false;
+    }
+
+    mapped.mapped_index = data;
+    mapped.mapped_index_size = size;
+    *pack = mapped;
+
+    return true;
+}
+
+// Writes the index of the pack next to it. It's written to a temporary file first, so processes reading the pack
+// meanwhile see either the previous index or the new one
+int write_pack_index(gd_pack* pack,
+                     const file_identity* identity,
+                     const char* header)
+{
+    if(pack->index == NULL)
+    {
+        index_pack(pack);
+    }
+
+    pack_index_header index_header;
+    memset(&index_header, 0, sizeof(pack_index_header));
+    memcpy(index_header.magic, "GIDX", 4);
+    index_header.version = PACK_INDEX_VERSION;
+    index_header.word_size = sizeof(size_t);
+    index_header.file_count = pack->file_count;
+    index_header.pack_size = identity->size;
+    index_header.pack_mtime_sec = identity->mtime_sec;
+    index_header.pack_mtime_nsec = identity->mtime_nsec;
+    index_header.pack_inode = identity->inode;
+    memcpy(index_header.pack_header, header, PACK_INDEX_HEADER_SIZE);
+    index_header.max_path_len = pack->files.max_path_len;
+    index_header.paths_size = pack->files.paths_size;
+    index_header.index_capacity = pack->index_capacity;
+
+    char* index_path = get_pack_index_path(pack->path);
+    char* temp_path = malloc(strlen(index_path) + 32);
+    if(temp_path == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+    sprintf(temp_path, "%s.%ld", index_path, (long)getpid());
+
+    FILE* file = fopen(temp_path, "wb");
+    if(file == NULL)
+    {
+        free(index_path);
+        free(temp_path);
+        return 1;
+    }
+
+    size_t count = pack->file_count;
+    size_t block_count = (count + PATH_BLOCK_SIZE - 1) / PATH_BLOCK_SIZE;
+
+    fwrite(&index_header, sizeof(pack_index_header), 1, file);
+    fwrite(pack->files.offsets, 8, count, file);
+    fwrite(pack->files.sizes, 8, count, file);
+    fwrite(pack->files.blocks, sizeof(size_t), block_count, file);
+    fwrite(pack->files.md5s, 16, count, file);
+    fwrite(pack->files.hashes, 4, count, file);
+    fwrite(pack->index, 4, pack->index_capacity, file);
+    fwrite(pack->files.flags, 1, count, file);
+    fwrite(pack->files.paths, 1, pack->files.paths_size, file);
+
+    int error = (ferror(file) != 0);
+    if(fclose(file) != 0) error = 1;
+
+    if(error == 0 && rename(temp_path, index_path) != 0) error = 1;
+    if(error != 0) remove(temp_path);
+
+    free(index_path);
+    free(temp_path);
+
+    return error;
+}
+
+static size_t get_pack_index_size(const pack_index_header* header)
+{
+    size_t count = header->file_count;
+    size_t block_count = (count + PATH_BLOCK_SIZE - 1) / PATH_BLOCK_SIZE;
+
+    return sizeof(pack_index_header) + count * (8 + 8 + 16 + 4 + 1) + block_count * sizeof(size_t) +
+           header->index_capacity * 4 + header->paths_size;
+}
+
+// Checks that the hash table only points to files, and that every path decodes from the start of its block within
+// the paths, no longer than the longest path
+static bool is_valid_file_table(const gd_pack* pack)
+{
+    size_t count = pack->file_count;
+    for(size_t i = 0; i < pack->index_capacity; ++i)
+    {
+        if(pack->index[i] < 0 || (size_t)pack->index[i] > count)
+        {
+            return false;
+        }
+    }
+
+    const uint8_t* paths = pack->files.paths;
+    size_t paths_size = pack->files.paths_size;
+    size_t position = 0;
+    size_t previous_len = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(i % PATH_BLOCK_SIZE == 0)
+        {
+            if(pack->files.blocks[i / PATH_BLOCK_SIZE] != position)
+            {
+                return false;
+            }
+            previous_len = 0;
+        }
+
+        // Shared prefix and suffix lengths
+        size_t lengths[2] = { 0, 0 };
+        for(int j = 0; j < 2; ++j)
+        {
+            int shift = 0;
+            uint8_t byte;
+            do
+            {
+                if(position >= paths_size || shift > 28)
+                {
+                    return false;
+                }
+                byte = paths[position++];
+                lengths[j] |= (size_t)(byte & 0x7F) << shift;
+                shift += 7;
+            } while(byte & 0x80);
+        }
+
+        if(lengths[0] > previous_len || lengths[1] > paths_size - position || lengths[0] + lengths[1] > (size_t)pack->files.max_path_len)
+        {
+            return false;
+        }
+
+        position += lengths[1];
+        previous_len = lengths[0] + lengths[1];
+    }
+
+    return true;
+}
\ No newline at end of file
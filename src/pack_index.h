@@ -0,0 +1,13 @@
+#ifndef TOOL_GDPC_PACK_INDEX_H
+#define TOOL_GDPC_PACK_INDEX_H
+
+#include "gdpc.h"
+#include "file_utils.h"
+
+#define PACK_INDEX_HEADER_SIZE 100 // Size of the pack header the index is checked against
+
+char* get_pack_index_path(const char* path);
+bool load_pack_index(const char* path, const file_identity* identity, const char* header, gd_pack* pack);
+int write_pack_index(gd_pack* pack, const file_identity* identity, const char* header);
+
+#endif
\ No newline at end of file
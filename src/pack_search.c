@@ -0,0 +1,606 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "pack_search.h"
+#include "pack_crypto.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <regex.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_X86
+#include <immintrin.h>
+#endif
+
+#define SEARCH_CHUNK_SIZE (4 << 20) // Files are split in chunks of about this size, searched on every core
+
+typedef struct
+{
+    char* literal; // Text every match contains, searched first so most lines are never matched against the pattern
+    size_t literal_len;
+    bool literal_only; // The pattern is a plain string
+
+    // One compiled pattern per worker, regexec() locks the one it's given
+    regex_t* regexes;
+    bool* regexes_used;
+    int regex_count;
+    pthread_mutex_t mutex;
+
+    const uint8_t* key; // NULL without an encryption key
+    bool avx2;
+} search_context;
+
+DEFINE_VECTOR(offset_vector, int64_t)
+
+typedef struct
+{
+    search_context* search;
+    const char* data; // Mapped package
+    size_t data_size;
+
+    int32_t file;
+    int64_t offset;
+    int64_t size;
+    bool encrypted;
+
+    int64_t begin; // Part of the file to search, moved to the next line so lines aren't split between chunks
+    int64_t end;
+
+    offset_vector matches; // Offset of each matching line's first match in the file
+    bool failed;
+} search_task;
+
+DEFINE_VECTOR(search_task_vector, search_task)
+
+static int init_search(search_context* search, config* cfg);
+static void free_search(search_context* search);
+static size_t extract_literal(const char* pattern, char* literal, bool* literal_only);
+static void search_chunk(void* arg);
+static void search_lines(search_task* task, const char* data, int64_t begin, int64_t end, regex_t* regex);
+static bool match_line(const char* data, int64_t line_begin, int64_t line_end, regex_t* regex, int64_t* offset);
+static int64_t next_line(const char* data, int64_t position, int64_t size);
+static const char* find_literal(const search_context* search, const char* data, size_t len);
+static int compare_task_offsets(const void* a, const void* b);
+
+#ifdef SEARCH_X86
+static size_t find_literal_sse2(const char* data, size_t len, const char* literal, size_t literal_len);
+static size_t find_literal_avx2(const char* data, size_t len, const char* literal, size_t literal_len);
+#endif
+
+int search_pack(gd_pack* pack,
+                config* cfg)
+{
+    size_t data_size;
+    const char* data = map_file(pack->path, &data_size);
+    if(data == NULL)
+    {
+        fprintf(cfg->output, "gdpc: Failed to open file \"%s\"\n", pack->path);
+        return 1;
+    }
+
+    search_context search;
+    if(init_search(&search, cfg) != 0)
+    {
+        unmap_file(data, data_size);
+        return 1;
+    }
+
+    path_cursor cursor;
+    path_cursor_init(&cursor, pack);
+
+    int32_t selected_count;
+    int32_t* selected = select_files(pack, cfg, &selected_count);
+
+    // At least a task per file
+    search_task_vector tasks;
+    search_task_vector_init(&tasks);
+    search_task_vector_reserve(&tasks, selected_count);
+
+    // Split the selected files into chunks, encrypted files are decrypted whole by a single task
+    gd_file file;
+    for(int32_t i = 0; i < selected_count; ++i)
+    {
+        get_file(pack, &cursor, selected[i], &file);
+
+        if(is_blacklisted(file.path, file.len, cfg))
+        {
+            continue;
+        }
+        if(file.encrypted == true && cfg->has_encryption_key == false)
+        {
+            fprintf(cfg->output, "gdpc: \"%s\" is encrypted, set GODOT_SCRIPT_ENCRYPTION_KEY or use --key-file\n", file.path);
+            continue;
+        }
+
+        // Files past the end of a truncated package are searched as far as they go
+        int64_t size = file.size;
+        if(file.offset >= (int64_t)data_size) size = 0;
+        else if(file.offset + size > (int64_t)data_size && file.encrypted == false) size = data_size - file.offset;
+
+        int64_t chunk_size = (file.encrypted == true) ? size : SEARCH_CHUNK_SIZE;
+        for(int64_t begin = 0; begin < size; begin += chunk_size)
+        {
+            search_task task;
+            task.search = &search;
+            task.data = data;
+            task.data_size = data_size;
+            task.file = selected[i];
+            task.offset = file.offset;
+            task.size = size;
+            task.encrypted = file.encrypted;
+            task.begin = begin;
+            task.end = (size - begin > chunk_size) ? begin + chunk_size : size;
+            task.failed = false;
+            offset_vector_init(&task.matches);
+
+            search_task_vector_push_back(&tasks, task);
+        }
+    }
+
+    // Read the package front to back
+    search_task* task_list = tasks.data;
+    search_task** by_offset = malloc((tasks.size + 1) * sizeof(search_task*));
+    if(by_offset == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(size_t i = 0; i < tasks.size; ++i)
+    {
+        by_offset[i] = &task_list[i];
+    }
+
+    qsort(by_offset, tasks.size, sizeof(search_task*), compare_task_offsets);
+
+    thread_pool pool;
+    thread_pool_init(&pool, search.regex_count);
+
+    for(size_t i = 0; i < tasks.size; ++i)
+    {
+        thread_pool_submit(&pool, search_chunk, by_offset[i]);
+    }
+
+    thread_pool_wait(&pool);
+    thread_pool_free(&pool);
+
+    // Print the matches in the order of the file list
+    int error = 0;
+    int32_t current = -1;
+    for(size_t i = 0; i < tasks.size; ++i)
+    {
+        // Large files span several tasks, their path is decoded once
+        search_task* task = &task_list[i];
+        if((task->failed == true || task->matches.size > 0) && task->file != current)
+        {
+            get_file(pack, &cursor, task->file, &file);
+            current = task->file;
+        }
+
+        if(task->failed == true)
+        {
+            fprintf(cfg->output, "gdpc: Failed to decrypt \"%s\", the key may be wrong\n", file.path);
+            error = 1;
+        }
+
+        int64_t* matches = task->matches.data;
+        for(size_t j = 0; j < task->matches.size; ++j)
+        {
+            fprintf(cfg->output, "%s:%ld\n", file.path, matches[j]);
+        }
+
+        offset_vector_free(&task->matches);
+    }
+
+    // Clean up
+    path_cursor_free(&cursor);
+    search_task_vector_free(&tasks);
+    free(by_offset);
+    free(selected);
+    free_search(&search);
+    unmap_file(data, data_size);
+
+    return error;
+}
+
+static int init_search(search_context* search,
+                       config* cfg)
+{
+    const char* pattern = cfg->grep_pattern;
+
+    search->literal = malloc(strlen(pattern) + 1);
+    if(search->literal == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+    search->literal_len = extract_literal(pattern, search->literal, &search->literal_only);
+
+    search->regex_count = get_processor_count();
+    search->regexes = malloc(search->regex_count * sizeof(regex_t));
+    search->regexes_used = calloc(search->regex_count, sizeof(bool));
+    if(search->regexes == NULL || search->regexes_used == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(int i = 0; i < search->regex_count; ++i)
+    {
+        int result = regcomp(&search->regexes[i], pattern, REG_EXTENDED | REG_NEWLINE);
+        if(result != 0)
+        {
+            char message[256];
+            regerror(result, &search->regexes[i], message, sizeof(message));
+            fprintf(cfg->output, "gdpc: Invalid pattern \"%s\" (%s)\n", pattern, message);
+
+            for(int j = 0; j < i; ++j)
+            {
+                regfree(&search->regexes[j]);
+            }
+            free(search->regexes);
+            free(search->regexes_used);
+            free(search->literal);
+            return 1;
+        }
+    }
+
+    pthread_mutex_init(&search->mutex, NULL);
+    search->key = (cfg->has_encryption_key == true) ? cfg->encryption_key : NULL;
+
+    search->avx2 = false;
+#ifdef SEARCH_X86
+    __builtin_cpu_init();
+    search->avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    return 0;
+}
+
+static void free_search(search_context* search)
+{
+    for(int i = 0; i < search->regex_count; ++i)
+    {
+        regfree(&search->regexes[i]);
+    }
+
+    pthread_mutex_destroy(&search->mutex);
+    free(search->regexes);
+    free(search->regexes_used);
+    free(search->literal);
+}
+
+/* Literal of an extended regular expression
+ * The longest run of plain characters outside of groups and brackets, none of them optional or repeated. Patterns
+ * with alternatives have none. Returns its length, and whether the pattern is only that literal.
+*/
+static size_t extract_literal(const char* pattern,
+                              char* literal,
+                              bool* literal_only)
+{
+    char* run = malloc(strlen(pattern) + 1);
+    if(run == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    size_t best = 0, run_len = 0;
+    int depth = 0;
+    bool plain = true;
+
+    for(const char* itr = pattern; *itr != '\0';)
+    {
+        char c = *itr;
+        bool is_literal = false;
+
+        if(c == '|')
+        {
+            best = 0;
+            plain = false;
+            break;
+        }
+        else if(c == '\\' && itr[1] != '\0')
+        {
+            // Escaped letters and digits are classes or back-references in GNU regexes
+            c = itr[1];
+            bool is_class = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+            is_literal = (is_class == false && depth == 0);
+            plain = false;
+            itr += 2;
+        }
+        else if(c == '[')
+        {
+            // Skip the bracket expression, a ']' right after the '[' or '[^' is part of it
+            ++itr;
+            if(*itr == '^') ++itr;
+            if(*itr == ']') ++itr;
+            while(*itr != '\0' && *itr != ']') ++itr;
+            if(*itr == ']') ++itr;
+            plain = false;
+        }
+        else
+        {
+            bool is_special = (strchr(".()*+?{}^$", c) != NULL);
+            if(c == '(') depth++;
+            else if(c == ')' && depth > 0) depth--;
+
+            is_literal = (is_special == false && depth == 0);
+            if(is_special == true) plain = false;
+            ++itr;
+        }
+
+        // A character followed by a quantifier may be missing
+        bool optional = (*itr == '*' || *itr == '?' || *itr == '{');
+        if(is_literal == true && optional == false)
+        {
+            run[run_len++] = c;
+            if(run_len > best)
+            {
+                memcpy(literal, run, run_len);
+                best = run_len;
+            }
+        }
+
+        // Nor can the run continue past a repeated character
+        if(is_literal == false || optional == true || *itr == '+')
+        {
+            run_len = 0;
+        }
+    }
+
+    free(run);
+
+    *literal_only = (plain == true);
+    literal[best] = '\0';
+
+    return best;
+}
+
+static void search_chunk(void* arg)
+{
+    search_task* task = (search_task*)arg;
+    search_context* search = task->search;
+
+    // Take a compiled pattern no other worker uses
+    regex_t* regex = NULL;
+    int regex_index = 0;
+    pthread_mutex_lock(&search->mutex);
+    while(search->regexes_used[regex_index] == true)
+    {
+        regex_index++;
+    }
+    search->regexes_used[regex_index] = true;
+    regex = &search->regexes[regex_index];
+    pthread_mutex_unlock(&search->mutex);
+
+    const char* data = task->data + task->offset;
+    int64_t size = task->size;
+    char* decrypted = NULL;
+
+    if(task->encrypted == true)
+    {
+        decrypted = decrypt_data(data, task->data_size - task->offset, search->key, &size);
+        if(decrypted == NULL)
+        {
+            task->failed = true;
+        }
+        data = decrypted;
+        task->end = size;
+    }
+
+    if(task->failed == false)
+    {
+        // Chunks start after the first line break they contain, and end where the next chunk starts
+        int64_t begin = (task->begin == 0) ? 0 : next_line(data, task->begin - 1, size);
+        int64_t end = (task->end >= size) ? size : next_line(data, task->end - 1, size);
+
+        if(begin < end)
+        {
+            if(decrypted == NULL) advise_mapped_range(task->data, task->offset + begin, end - begin);
+            search_lines(task, data, begin, end, regex);
+        }
+    }
+
+    buffer_pool_release(decrypted);
+
+    pthread_mutex_lock(&search->mutex);
+    search->regexes_used[regex_index] = false;
+    pthread_mutex_unlock(&search->mutex);
+}
+
+static void search_lines(search_task* task,
+                         const char* data,
+                         int64_t begin,
+                         int64_t end,
+                         regex_t* regex)
+{
+    search_context* search = task->search;
+    int64_t position = begin;
+
+    while(position < end)
+    {
+        int64_t line_begin, line_end, offset;
+
+        if(search->literal_len > 0)
+        {
+            // Only lines containing the literal can match
+            const char* hit = find_literal(search, data + position, end - position);
+            if(hit == NULL)
+            {
+                break;
+            }
+
+            int64_t hit_offset = hit - data;
+            const char* previous = memrchr(data + position, '\n', hit_offset - position);
+            line_begin = (previous != NULL) ? previous - data + 1 : position;
+            line_end = next_line(data, hit_offset, end);
+
+            offset = hit_offset;
+            if(search->literal_only == false && match_line(data, line_begin, line_end, regex, &offset) == false)
+            {
+                position = line_end;
+                continue;
+            }
+        }
+        else
+        {
+            line_begin = position;
+            line_end = next_line(data, position, end);
+
+            if(match_line(data, line_begin, line_end, regex, &offset) == false)
+            {
+                position = line_end;
+                continue;
+            }
+        }
+
+        offset_vector_push_back(&task->matches, offset);
+        position = line_end;
+    }
+}
+
+static bool match_line(const char* data,
+                       int64_t line_begin,
+                       int64_t line_end,
+                       regex_t* regex,
+                       int64_t* offset)
+{
+    // The line isn't NUL-terminated, REG_STARTEND gives its bounds instead
+    regmatch_t match;
+    match.rm_so = 0;
+    match.rm_eo = line_end - line_begin;
+    if(match.rm_eo > 0 && data[line_end - 1] == '\n') match.rm_eo--;
+
+    if(regexec(regex, data + line_begin, 1, &match, REG_STARTEND) != 0)
+    {
+        return false;
+    }
+
+    *offset = line_begin + match.rm_so;
+
+    return true;
+}
+
+// Returns the position after the next line break, or the size if there's none
+static int64_t next_line(const char* data,
+                         int64_t position,
+                         int64_t size)
+{
+    const char* line_break = memchr(data + position, '\n', size - position);
+    return (line_break != NULL) ? line_break - data + 1 : size;
+}
+
+static const char* find_literal(const search_context* search,
+                                const char* data,
+                                size_t len)
+{
+#ifdef SEARCH_X86
+    size_t found = search->avx2 ? find_literal_avx2(data, len, search->literal, search->literal_len)
+                                : find_literal_sse2(data, len, search->literal, search->literal_len);
+    if(found != len)
+    {
+        return data + found;
+    }
+
+    return NULL;
+#else
+    return memmem(data, len, search->literal, search->literal_len);
+#endif
+}
+
+static int compare_task_offsets(const void* a,
+                                const void* b)
+{
+    const search_task* left = *(const search_task* const*)a;
+    const search_task* right = *(const search_task* const*)b;
+
+    int64_t left_offset = left->offset + left->begin;
+    int64_t right_offset = right->offset + right->begin;
+
+    return (left_offset > right_offset) - (left_offset < right_offset);
+}
+
+// Platform-dependant
+#ifdef SEARCH_X86
+/* SIMD substring search
+ * The first and last characters of the literal are compared with a whole register of positions at once, the rest of
+ * the literal is only compared where both match. Returns the position of the first match, or len if there's none.
+*/
+__attribute__((target("sse2")))
+static size_t find_literal_sse2(const char* data,
+                                size_t len,
+                                const char* literal,
+                                size_t literal_len)
+{
+    if(literal_len > len)
+    {
+        return len;
+    }
+
+    const __m128i first = _mm_set1_epi8(literal[0]);
+    const __m128i last = _mm_set1_epi8(literal[literal_len - 1]);
+
+    size_t i = 0;
+    for(; i + 16 + literal_len - 1 <= len; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(data + i + literal_len - 1));
+
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        while(mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if(literal_len <= 2 || memcmp(data + i + bit + 1, literal + 1, literal_len - 2) == 0)
+            {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    const char* found = memmem(data + i, len - i, literal, literal_len);
+    return (found != NULL) ? (size_t)(found - data) : len;
+}
+
+__attribute__((target("avx2")))
+static size_t find_literal_avx2(const char* data,
+                                size_t len,
+                                const char* literal,
+                                size_t literal_len)
+{
+    if(literal_len > len)
+    {
+        return len;
+    }
+
+    const __m256i first = _mm256_set1_epi8(literal[0]);
+    const __m256i last = _mm256_set1_epi8(literal[literal_len - 1]);
+
+    size_t i = 0;
+    for(; i + 32 + literal_len - 1 <= len; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(data + i + literal_len - 1));
+
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+        while(mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if(literal_len <= 2 || memcmp(data + i + bit + 1, literal + 1, literal_len - 2) == 0)
+            {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    const char* found = memmem(data + i, len - i, literal, literal_len);
+    return (found != NULL) ? (size_t)(found - data) : len;
+}
+#endif
\ No newline at end of file
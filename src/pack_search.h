@@ -0,0 +1,9 @@
+#ifndef TOOL_GDPC_PACK_SEARCH_H
+#define TOOL_GDPC_PACK_SEARCH_H
+
+#include "gdpc.h"
+
+// Prints "res://path:offset" for each line of the selected files matching cfg->grep_pattern
+int search_pack(gd_pack* pack, config* cfg);
+
+#endif
\ No newline at end of file
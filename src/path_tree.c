@@ -0,0 +1,257 @@
+#include "path_tree.h"
+#include "file_utils.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+    int32_t* slots; // Node + 1, 0 if the slot is empty
+    size_t capacity;
+} child_index;
+
+static int32_t get_child(path_tree* tree, child_index* index, int32_t* capacity, size_t* names_capacity, int32_t** last_children, int32_t parent, const char* name, int len);
+static uint32_t hash_child(int32_t parent, const char* name, int len);
+
+/* Builds the tree of the directories of the pack in a single pass over its paths. Each directory keeps the range of
+ * its files, and the files of a subtree are contiguous, so a directory's files and everything under it are read
+ * without looking at the rest of the pack.
+*/
+path_tree* build_path_tree(gd_pack* pack)
+{
+    path_tree* tree = malloc(sizeof(path_tree));
+    int32_t* file_nodes = malloc((pack->file_count + 1) * sizeof(int32_t));
+    int32_t capacity = 64;
+    size_t names_capacity = 4096;
+    if(tree == NULL || file_nodes == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    tree->nodes = malloc(capacity * sizeof(path_tree_node));
+    tree->names = malloc(names_capacity);
+    tree->files = malloc((pack->file_count + 1) * sizeof(int32_t));
+    int32_t* last_children = malloc(capacity * sizeof(int32_t));
+    if(tree->nodes == NULL || tree->names == NULL || tree->files == NULL || last_children == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // Root
+    path_tree_node root = { -1, -1, -1, 0, 0, 0, 0, 0, 0, 0 };
+    tree->nodes[0] = root;
+    tree->node_count = 1;
+    last_children[0] = -1;
+
+    child_index index = { NULL, 0 };
+
+    // Insert the directories of every path, and count the files of each one
+    path_cursor cursor;
+    path_cursor_init(&cursor, pack);
+
+    gd_file file;
+    while(next_file(pack, &cursor, &file) == true)
+    {
+        const char* itr = file.path;
+        if(strncmp(itr, "res://", 6) == 0) itr += 6;
+
+        int32_t node = 0;
+        for(const char* separator = strchr(itr, '/'); separator != NULL; separator = strchr(itr, '/'))
+        {
+            // Empty components ("dir//subdir") are ignored, as when looking up a directory
+            if(separator > itr) node = get_child(tree, &index, &capacity, &names_capacity, &last_children, node, itr, separator - itr);
+            itr = separator + 1;
+        }
+
+        file_nodes[cursor.index] = node;
+        tree->nodes[node].files_end++; // Number of files for now
+    }
+
+    path_cursor_free(&cursor);
+    free(index.slots);
+    free(last_children);
+
+    // Number of files of each subtree, children are always created after their parent
+    path_tree_node* nodes = tree->nodes;
+    for(int32_t i = 0; i < tree->node_count; ++i) nodes[i].subtree_end = nodes[i].files_end;
+    for(int32_t i = tree->node_count - 1; i > 0; --i) nodes[nodes[i].parent].subtree_end += nodes[i].subtree_end;
+
+    // Place each directory's files, then each of its subdirectories, one after the other
+    nodes[0].files_begin = 0;
+    for(int32_t i = 0; i < tree->node_count; ++i)
+    {
+        int32_t count = nodes[i].files_end;
+        int32_t subtree_count = nodes[i].subtree_end;
+        nodes[i].files_end = nodes[i].files_begin + count;
+        nodes[i].subtree_end = nodes[i].files_begin + subtree_count;
+
+        int32_t begin = nodes[i].files_end;
+        for(int32_t child = nodes[i].first_child; child != -1; child = nodes[child].next_sibling)
+        {
+            int32_t child_count = nodes[child].subtree_end;
+            nodes[child].files_begin = begin;
+            begin += child_count;
+        }
+    }
+
+    // Fill the ranges, keeping the order of the pack in each directory
+    int32_t* positions = malloc(tree->node_count * sizeof(int32_t));
+    if(positions == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(int32_t i = 0; i < tree->node_count; ++i) positions[i] = nodes[i].files_begin;
+    for(int32_t i = 0; i < pack->file_count; ++i)
+    {
+        tree->files[positions[file_nodes[i]]++] = i;
+        nodes[file_nodes[i]].subtree_size += pack->files.sizes[i];
+    }
+
+    for(int32_t i = tree->node_count - 1; i > 0; --i) nodes[nodes[i].parent].subtree_size += nodes[i].subtree_size;
+
+    free(positions);
+    free(file_nodes);
+
+    return tree;
+}
+
+void free_path_tree(path_tree* tree)
+{
+    if(tree == NULL) return;
+
+    free(tree->nodes);
+    free(tree->names);
+    free(tree->files);
+    free(tree);
+}
+
+// Returns the node of the directory ("dir/subdir", without "res://"), -1 if the pack has no such directory
+int32_t find_directory(path_tree* tree, const char* path, int len)
+{
+    int32_t node = 0;
+
+    while(len > 0 && node != -1)
+    {
+        // Ignore empty components ("dir//subdir", trailing '/')
+        const char* separator = memchr(path, '/', len);
+        int name_len = (separator != NULL) ? (int)(separator - path) : len;
+
+        if(name_len > 0)
+        {
+            int32_t child = tree->nodes[node].first_child;
+            while(child != -1 && (tree->nodes[child].name_len != name_len ||
+                                  memcmp(tree->names + tree->nodes[child].name, path, name_len) != 0))
+            {
+                child = tree->nodes[child].next_sibling;
+            }
+            node = child;
+        }
+
+        path += name_len + ((separator != NULL) ? 1 : 0);
+        len -= name_len + ((separator != NULL) ? 1 : 0);
+    }
+
+    return node;
+}
+
+// Returns the subdirectory of the parent, creating it if needed
+static int32_t get_child(path_tree* tree,
+                         child_index* index,
+                         int32_t* capacity,
+                         size_t* names_capacity,
+                         int32_t** last_children,
+                         int32_t parent,
+                         const char* name,
+                         int len)
+{
+    uint32_t hash = hash_child(parent, name, len);
+
+    // Keep the table at most half full
+    if(((size_t)tree->node_count + 1) * 2 > index->capacity)
+    {
+        size_t new_capacity = (index->capacity == 0) ? 64 : index->capacity * 2;
+        int32_t* slots = calloc(new_capacity, sizeof(int32_t));
+        if(slots == NULL)
+        {
+            fprintf(stderr, "calloc(): failed to allocate memory.\n");
+            abort();
+        }
+
+        for(int32_t i = 1; i < tree->node_count; ++i)
+        {
+            path_tree_node* node = &tree->nodes[i];
+            size_t slot = hash_child(node->parent, tree->names + node->name, node->name_len) & (new_capacity - 1);
+            while(slots[slot] != 0) slot = (slot + 1) & (new_capacity - 1);
+            slots[slot] = i + 1;
+        }
+
+        free(index->slots);
+        index->slots = slots;
+        index->capacity = new_capacity;
+    }
+
+    size_t slot = hash & (index->capacity - 1);
+    while(index->slots[slot] != 0)
+    {
+        path_tree_node* node = &tree->nodes[index->slots[slot] - 1];
+        if(node->parent == parent && node->name_len == len && memcmp(tree->names + node->name, name, len) == 0)
+        {
+            return index->slots[slot] - 1;
+        }
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+
+    // Add the directory
+    if(tree->node_count == *capacity)
+    {
+        *capacity *= 2;
+        path_tree_node* nodes = realloc(tree->nodes, *capacity * sizeof(path_tree_node));
+        int32_t* last = realloc(*last_children, *capacity * sizeof(int32_t));
+        if(nodes == NULL || last == NULL)
+        {
+            fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+            abort();
+        }
+        tree->nodes = nodes;
+        *last_children = last;
+    }
+
+    size_t names_size = (tree->node_count > 1) ? tree->nodes[tree->node_count - 1].name + tree->nodes[tree->node_count - 1].name_len : 0;
+    if(names_size + len > *names_capacity)
+    {
+        while(names_size + len > *names_capacity) *names_capacity *= 2;
+
+        char* names = realloc(tree->names, *names_capacity);
+        if(names == NULL)
+        {
+            fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+            abort();
+        }
+        tree->names = names;
+    }
+    memcpy(tree->names + names_size, name, len);
+
+    int32_t id = tree->node_count++;
+    path_tree_node node = { parent, -1, -1, (uint32_t)names_size, len, tree->nodes[parent].depth + 1, 0, 0, 0, 0 };
+    tree->nodes[id] = node;
+
+    // Keep the subdirectories in the order they first appear in
+    if((*last_children)[parent] == -1) tree->nodes[parent].first_child = id;
+    else tree->nodes[(*last_children)[parent]].next_sibling = id;
+    (*last_children)[parent] = id;
+    (*last_children)[id] = -1;
+
+    index->slots[slot] = id + 1;
+
+    return id;
+}
+
+static uint32_t hash_child(int32_t parent, const char* name, int len)
+{
+    return hash_path(name, len) ^ ((uint32_t)parent * 2654435761u);
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef TOOL_GDPC_PATH_TREE_H
+#define TOOL_GDPC_PATH_TREE_H
+
+#include "gdpc.h"
+#include <stdint.h>
+
+typedef struct
+{
+    int32_t parent; // -1 for the root ("res://")
+    int32_t first_child; // -1 if the directory has no subdirectory
+    int32_t next_sibling;
+    uint32_t name; // Position of the name in the tree's names
+    int32_t name_len;
+    int32_t depth;
+
+    // The files of the directory, then the files of its subdirectories, are a range of the tree's files
+    int32_t files_begin;
+    int32_t files_end; // End of the directory's own files
+    int32_t subtree_end;
+    int64_t subtree_size;
+} path_tree_node;
+
+struct path_tree
+{
+    path_tree_node* nodes;
+    int32_t node_count;
+    char* names;
+    int32_t* files; // Index of each file in the pack, grouped by directory, subdirectories after their parent
+};
+typedef struct path_tree path_tree;
+
+path_tree* build_path_tree(gd_pack* pack);
+void free_path_tree(path_tree* tree);
+int32_t find_directory(path_tree* tree, const char* path, int len);
+
+#endif
\ No newline at end of file
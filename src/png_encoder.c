@@ -0,0 +1,501 @@
+#include "png_encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define PNG_BAND_SIZE (1 << 20) // Approximate size of the filtered rows compressed by a task
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MAX_CHAIN 32
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define ADLER_BASE 65521
+
+typedef struct
+{
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+
+    uint64_t bits;
+    int bit_count;
+} bit_writer;
+
+typedef struct
+{
+    const uint8_t* rgba;
+    const uint8_t* above; // Row above the first one, or NULL
+    int width;
+    int first_row;
+    int last_row;
+    bool first;
+
+    bit_writer output; // Compressed band, ending on a byte boundary
+    uint32_t adler; // Checksum of the filtered band
+    size_t length; // Length of the filtered band
+} encode_task;
+
+static void encode_band(void* arg);
+static void filter_rows(const uint8_t* rgba, const uint8_t* above, int width, int first_row, int last_row, uint8_t* filtered);
+static void deflate_band(const uint8_t* data, size_t size, bit_writer* writer);
+
+static uint32_t adler32(const uint8_t* data, size_t size);
+static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t length2);
+static void write_chunk(png_writer* writer, const char* type, const uint8_t* data, size_t size);
+
+/* PNG file
+ * Signature, IHDR (8-bit RGBA), one IDAT per band of rows, IEND
+ *
+ * The zlib stream is split in bands compressed independently: each band is a fixed-Huffman deflate block
+ * followed by an empty stored block, so it ends on a byte boundary and the bands can be concatenated.
+ * Matches never cross bands. The stream ends with an empty final stored block and the combined checksum.
+ * Bands are compressed in parallel if a thread pool is given, a few at a time to bound memory.
+*/
+int png_writer_open(png_writer* writer, const char* path, int width, int height)
+{
+    writer->file = fopen(path, "wb");
+    if(writer->file == NULL)
+    {
+        return 1;
+    }
+
+    writer->width = width;
+    writer->height = height;
+    writer->rows_written = 0;
+    writer->adler = 1;
+    writer->previous_row = malloc((size_t)width * 4);
+    if(writer->previous_row == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t crc = i;
+        for(int j = 0; j < 8; ++j) crc = (crc & 1) ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+        writer->crc_table[i] = crc;
+    }
+
+    // Header
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, writer->file);
+
+    uint8_t ihdr[13] = {
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 6, 0, 0, 0 // Bit depth, color type (RGBA), compression, filter, interlace
+    };
+    write_chunk(writer, "IHDR", ihdr, 13);
+
+    return 0;
+}
+
+// Compresses the next rows of the image, filtering the first one against the last row of the previous call
+void png_writer_write_rows(png_writer* writer, const uint8_t* rgba, int rows, thread_pool* pool)
+{
+    if(rows <= 0) return;
+
+    size_t row_size = (size_t)writer->width * 4 + 1;
+    int band_height = (row_size < PNG_BAND_SIZE) ? (int)(PNG_BAND_SIZE / row_size) : 1;
+    int band_count = (rows + band_height - 1) / band_height;
+    int window = (pool != NULL) ? pool->thread_count * 2 : 1;
+
+    encode_task* tasks = malloc(window * sizeof(encode_task));
+    if(tasks == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(int first = 0; first < band_count; first += window)
+    {
+        int count = (band_count - first < window) ? band_count - first : window;
+
+        for(int i = 0; i < count; ++i)
+        {
+            encode_task* task = &tasks[i];
+            task->rgba = rgba;
+            task->width = writer->width;
+            task->first_row = (first + i) * band_height;
+            task->last_row = (task->first_row + band_height < rows) ? task->first_row + band_height : rows;
+            task->first = (writer->rows_written == 0 && task->first_row == 0);
+
+            if(task->first_row > 0) task->above = rgba + (size_t)(task->first_row - 1) * writer->width * 4;
+            else task->above = (writer->rows_written > 0) ? writer->previous_row : NULL;
+
+            if(pool != NULL && count > 1) thread_pool_submit(pool, encode_band, task);
+            else encode_band(task);
+        }
+
+        if(pool != NULL && count > 1) thread_pool_wait(pool);
+
+        // Write the bands in order
+        for(int i = 0; i < count; ++i)
+        {
+            write_chunk(writer, "IDAT", tasks[i].output.data, tasks[i].output.size);
+            writer->adler = adler32_combine(writer->adler, tasks[i].adler, tasks[i].length);
+            free(tasks[i].output.data);
+        }
+    }
+
+    free(tasks);
+
+    memcpy(writer->previous_row, rgba + (size_t)(rows - 1) * writer->width * 4, (size_t)writer->width * 4);
+    writer->rows_written += rows;
+}
+
+int png_writer_close(png_writer* writer)
+{
+    // Final block and checksum
+    uint32_t adler = writer->adler;
+    uint8_t end[9] = { 0x01, 0x00, 0x00, 0xFF, 0xFF,
+                       (uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8), (uint8_t)adler };
+    write_chunk(writer, "IDAT", end, 9);
+    write_chunk(writer, "IEND", NULL, 0);
+
+    int error = (ferror(writer->file) || writer->rows_written != writer->height) ? 1 : 0;
+    if(fclose(writer->file) != 0) error = 1;
+
+    free(writer->previous_row);
+
+    return error;
+}
+
+int write_png(const char* path, const uint8_t* rgba, int width, int height, thread_pool* pool)
+{
+    png_writer writer;
+    if(png_writer_open(&writer, path, width, height) != 0)
+    {
+        return 1;
+    }
+
+    png_writer_write_rows(&writer, rgba, height, pool);
+
+    return png_writer_close(&writer);
+}
+
+static void encode_band(void* arg)
+{
+    encode_task* task = arg;
+
+    task->length = (size_t)(task->last_row - task->first_row) * ((size_t)task->width * 4 + 1);
+    uint8_t* filtered = malloc(task->length);
+    if(filtered == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    filter_rows(task->rgba, task->above, task->width, task->first_row, task->last_row, filtered);
+    task->adler = adler32(filtered, task->length);
+
+    // Reserve enough for incompressible data so the buffer rarely grows
+    bit_writer* writer = &task->output;
+    writer->capacity = task->length + task->length / 8 + 64;
+    writer->data = malloc(writer->capacity);
+    writer->size = 0;
+    writer->bits = 0;
+    writer->bit_count = 0;
+    if(writer->data == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    // zlib header (deflate, 32KB window, fastest)
+    if(task->first)
+    {
+        writer->data[writer->size++] = 0x78;
+        writer->data[writer->size++] = 0x01;
+    }
+
+    deflate_band(filtered, task->length, writer);
+
+    free(filtered);
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if(pa <= pb && pa <= pc) return a;
+    if(pb <= pc) return b;
+    return c;
+}
+
+// Filters each row with the filter that gives the smallest sum of absolute differences
+static void filter_rows(const uint8_t* rgba, const uint8_t* above, int width, int first_row, int last_row, uint8_t* filtered)
+{
+    size_t size = (size_t)width * 4;
+
+    uint8_t* candidates = malloc(size * 5);
+    if(candidates == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    for(int y = first_row; y < last_row; ++y)
+    {
+        const uint8_t* row = rgba + y * size;
+        if(y > first_row) above = row - size;
+
+        uint64_t sums[5] = { 0, 0, 0, 0, 0 };
+        for(size_t i = 0; i < size; ++i)
+        {
+            uint8_t a = (i >= 4) ? row[i - 4] : 0;
+            uint8_t b = (above != NULL) ? above[i] : 0;
+            uint8_t c = (above != NULL && i >= 4) ? above[i - 4] : 0;
+
+            uint8_t values[5] = {
+                row[i],
+                (uint8_t)(row[i] - a),
+                (uint8_t)(row[i] - b),
+                (uint8_t)(row[i] - ((a + b) >> 1)),
+                (uint8_t)(row[i] - paeth(a, b, c))
+            };
+
+            for(int f = 0; f < 5; ++f)
+            {
+                candidates[f * size + i] = values[f];
+                sums[f] += (values[f] < 128) ? values[f] : 256 - values[f];
+            }
+        }
+
+        int best = 0;
+        for(int f = 1; f < 5; ++f)
+        {
+            if(sums[f] < sums[best]) best = f;
+        }
+
+        uint8_t* out = filtered + (y - first_row) * (size + 1);
+        out[0] = (uint8_t)best;
+        memcpy(out + 1, candidates + best * size, size);
+    }
+
+    free(candidates);
+}
+
+/* Deflate (fixed Huffman codes)
+ * Literals/lengths 0-143: 8 bits, 144-255: 9 bits, 256-279: 7 bits, 280-287: 8 bits. Distances: 5 bits.
+ * Huffman codes are stored from the most significant bit, everything else from the least significant bit.
+*/
+static const uint16_t length_bases[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra_bits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distance_bases[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distance_extra_bits[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void write_bits(bit_writer* writer, uint32_t value, int count)
+{
+    writer->bits |= (uint64_t)value << writer->bit_count;
+    writer->bit_count += count;
+
+    while(writer->bit_count >= 8)
+    {
+        if(writer->size == writer->capacity)
+        {
+            writer->capacity *= 2;
+            writer->data = realloc(writer->data, writer->capacity);
+            if(writer->data == NULL)
+            {
+                fprintf(stderr, "malloc(): failed to allocate memory.\n");
+                abort();
+            }
+        }
+
+        writer->data[writer->size++] = (uint8_t)writer->bits;
+        writer->bits >>= 8;
+        writer->bit_count -= 8;
+    }
+}
+
+static uint32_t reverse_bits(uint32_t value, int count)
+{
+    uint32_t result = 0;
+    for(int i = 0; i < count; ++i) result |= ((value >> i) & 1) << (count - 1 - i);
+    return result;
+}
+
+static uint32_t hash_bytes(const uint8_t* data)
+{
+    uint32_t value = data[0] | data[1] << 8 | data[2] << 16;
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+static void deflate_band(const uint8_t* data, size_t size, bit_writer* writer)
+{
+    // Fixed Huffman codes, reversed to be written from the least significant bit
+    uint16_t codes[288];
+    uint8_t code_lengths[288];
+    for(int i = 0; i < 288; ++i)
+    {
+        if(i < 144)      { codes[i] = (uint16_t)reverse_bits(0x30 + i, 8); code_lengths[i] = 8; }
+        else if(i < 256) { codes[i] = (uint16_t)reverse_bits(0x190 + i - 144, 9); code_lengths[i] = 9; }
+        else if(i < 280) { codes[i] = (uint16_t)reverse_bits(i - 256, 7); code_lengths[i] = 7; }
+        else             { codes[i] = (uint16_t)reverse_bits(0xC0 + i - 280, 8); code_lengths[i] = 8; }
+    }
+
+    int32_t* head = malloc((1 << DEFLATE_HASH_BITS) * sizeof(int32_t));
+    int32_t* previous = malloc(DEFLATE_WINDOW_SIZE * sizeof(int32_t));
+    if(head == NULL || previous == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+    memset(head, 0xFF, (1 << DEFLATE_HASH_BITS) * sizeof(int32_t));
+
+    write_bits(writer, 0x2, 3); // Not final, fixed Huffman codes
+
+    size_t position = 0;
+    while(position < size)
+    {
+        size_t best_length = 0;
+        size_t best_distance = 0;
+
+        if(position + DEFLATE_MIN_MATCH <= size)
+        {
+            size_t max_length = (size - position < DEFLATE_MAX_MATCH) ? size - position : DEFLATE_MAX_MATCH;
+            uint32_t hash = hash_bytes(data + position);
+            int32_t candidate = head[hash];
+
+            for(int chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0; ++chain)
+            {
+                size_t distance = position - candidate;
+                if(distance > DEFLATE_WINDOW_SIZE) break;
+
+                if(data[candidate + best_length] == data[position + best_length])
+                {
+                    size_t length = 0;
+                    while(length < max_length && data[candidate + length] == data[position + length]) length++;
+
+                    if(length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = distance;
+                        if(length == max_length) break;
+                    }
+                }
+
+                candidate = previous[candidate & (DEFLATE_WINDOW_SIZE - 1)];
+            }
+
+            previous[position & (DEFLATE_WINDOW_SIZE - 1)] = head[hash];
+            head[hash] = (int32_t)position;
+        }
+
+        if(best_length < DEFLATE_MIN_MATCH)
+        {
+            write_bits(writer, codes[data[position]], code_lengths[data[position]]);
+            position++;
+            continue;
+        }
+
+        // Length
+        int symbol = 28;
+        while(length_bases[symbol] > best_length) symbol--;
+        write_bits(writer, codes[257 + symbol], code_lengths[257 + symbol]);
+        write_bits(writer, (uint32_t)(best_length - length_bases[symbol]), length_extra_bits[symbol]);
+
+        // Distance
+        symbol = 29;
+        while(distance_bases[symbol] > best_distance) symbol--;
+        write_bits(writer, reverse_bits(symbol, 5), 5);
+        write_bits(writer, (uint32_t)(best_distance - distance_bases[symbol]), distance_extra_bits[symbol]);
+
+        // Index the positions covered by the match
+        for(size_t i = 1; i < best_length; ++i)
+        {
+            size_t next = position + i;
+            if(next + DEFLATE_MIN_MATCH > size) break;
+
+            uint32_t hash = hash_bytes(data + next);
+            previous[next & (DEFLATE_WINDOW_SIZE - 1)] = head[hash];
+            head[hash] = (int32_t)next;
+        }
+        position += best_length;
+    }
+
+    write_bits(writer, codes[256], code_lengths[256]); // End of block
+
+    // Empty stored block to end on a byte boundary
+    write_bits(writer, 0, 3);
+    if(writer->bit_count > 0) write_bits(writer, 0, 8 - writer->bit_count);
+    write_bits(writer, 0x0000, 16);
+    write_bits(writer, 0xFFFF, 16);
+
+    free(previous);
+    free(head);
+}
+
+static uint32_t adler32(const uint8_t* data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+
+    while(size > 0)
+    {
+        size_t count = (size < 5552) ? size : 5552; // Largest run that can't overflow b
+        size -= count;
+
+        while(count-- > 0)
+        {
+            a += *data++;
+            b += a;
+        }
+
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+
+    return b << 16 | a;
+}
+
+// Checksum of two concatenated streams from their checksums and the length of the second one
+static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t length2)
+{
+    uint32_t remainder = (uint32_t)(length2 % ADLER_BASE);
+    uint32_t sum1 = adler1 & 0xFFFF;
+    uint32_t sum2 = (uint32_t)(((uint64_t)remainder * sum1) % ADLER_BASE);
+
+    sum1 += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - remainder;
+
+    if(sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if(sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if(sum2 >= ADLER_BASE * 2) sum2 -= ADLER_BASE * 2;
+    if(sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+
+    return sum2 << 16 | sum1;
+}
+
+// Length, type, data, CRC of the type and data
+static void write_chunk(png_writer* writer, const char* type, const uint8_t* data, size_t size)
+{
+    FILE* file = writer->file;
+    const uint32_t* crc_table = writer->crc_table;
+
+    uint8_t length[4] = { (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size };
+    fwrite(length, 1, 4, file);
+    fwrite(type, 1, 4, file);
+    if(size > 0) fwrite(data, 1, size, file);
+
+    uint32_t crc = 0xFFFFFFFF;
+    for(int i = 0; i < 4; ++i) crc = crc_table[(crc ^ (uint8_t)type[i]) & 0xFF] ^ (crc >> 8);
+    for(size_t i = 0; i < size; ++i) crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    crc ^= 0xFFFFFFFF;
+
+    uint8_t checksum[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+    fwrite(checksum, 1, 4, file);
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef TOOL_GDPC_PNG_ENCODER_H
+#define TOOL_GDPC_PNG_ENCODER_H
+
+#include "thread_pool.h"
+#include <stdio.h>
+#include <stdint.h>
+
+// Writes a PNG file a few rows at a time
+typedef struct
+{
+    FILE* file;
+    int width;
+    int height;
+    int rows_written;
+
+    uint32_t adler; // Checksum of the filtered rows written so far
+    uint8_t* previous_row; // Last row written, the next row is filtered against it
+    uint32_t crc_table[256];
+} png_writer;
+
+int png_writer_open(png_writer* writer, const char* path, int width, int height);
+void png_writer_write_rows(png_writer* writer, const uint8_t* rgba, int rows, thread_pool* pool);
+int png_writer_close(png_writer* writer);
+
+int write_png(const char* path, const uint8_t* rgba, int width, int height, thread_pool* pool);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,186 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "progress.h"
+#include "config.h"
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#define LINE_INTERVAL 250 // Milliseconds between two updates of the line
+#define JSON_INTERVAL 1000 // Milliseconds between two JSON lines
+#define RATE_SMOOTHING 0.25 // Weight of the last interval in the rate, so it follows changes without jumping around
+
+typedef struct
+{
+    // Updated atomically by the copies
+    int64_t bytes;
+    int64_t files;
+    int64_t total_bytes;
+    int64_t total_files;
+
+    int format;
+    bool running;
+    int64_t start_time;
+    double rate; // Bytes per second
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t stopped;
+} progress_state;
+
+static progress_state progress = { 0, 0, 0, 0, PROGRESS_FORMAT_NONE, false, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void* report_progress(void* arg);
+static void print_progress(int64_t now, bool done);
+static void get_deadline(struct timespec* deadline, int interval); // Platform-dependant
+
+void progress_start(int format)
+{
+    if(format == PROGRESS_FORMAT_NONE) return;
+
+    progress.format = format;
+    progress.running = true;
+    progress.start_time = get_monotonic_time();
+
+    if(pthread_create(&progress.thread, NULL, report_progress, NULL) != 0)
+    {
+        progress.running = false;
+        progress.format = PROGRESS_FORMAT_NONE;
+    }
+}
+
+void progress_stop()
+{
+    if(progress.format == PROGRESS_FORMAT_NONE) return;
+
+    pthread_mutex_lock(&progress.mutex);
+    progress.running = false;
+    pthread_cond_signal(&progress.stopped);
+    pthread_mutex_unlock(&progress.mutex);
+
+    pthread_join(progress.thread, NULL);
+
+    // The last report covers the whole run
+    int64_t now = get_monotonic_time();
+    if(now > progress.start_time)
+    {
+        progress.rate = progress.bytes / ((now - progress.start_time) / 1e9);
+    }
+    print_progress(now, true);
+
+    progress.format = PROGRESS_FORMAT_NONE;
+}
+
+// Totals grow as the packages are read, each one adds its files before copying them
+void progress_add_total(int64_t bytes, int64_t files)
+{
+    if(progress.format == PROGRESS_FORMAT_NONE) return;
+
+    __atomic_fetch_add(&progress.total_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&progress.total_files, files, __ATOMIC_RELAXED);
+}
+
+void progress_add(int64_t bytes, int64_t files)
+{
+    if(progress.format == PROGRESS_FORMAT_NONE) return;
+
+    if(bytes != 0) __atomic_fetch_add(&progress.bytes, bytes, __ATOMIC_RELAXED);
+    if(files != 0) __atomic_fetch_add(&progress.files, files, __ATOMIC_RELAXED);
+}
+
+static void* report_progress(void* arg)
+{
+    (void)arg;
+
+    int interval = (progress.format == PROGRESS_FORMAT_JSON) ? JSON_INTERVAL : LINE_INTERVAL;
+    int64_t last_time = progress.start_time;
+    int64_t last_bytes = 0;
+
+    pthread_mutex_lock(&progress.mutex);
+    while(progress.running == true)
+    {
+        struct timespec deadline;
+        get_deadline(&deadline, interval);
+        while(progress.running == true && pthread_cond_timedwait(&progress.stopped, &progress.mutex, &deadline) == 0);
+
+        if(progress.running == false)
+        {
+            break;
+        }
+
+        // Rate of the last interval, smoothed
+        int64_t now = get_monotonic_time();
+        int64_t bytes = __atomic_load_n(&progress.bytes, __ATOMIC_RELAXED);
+        double rate = (bytes - last_bytes) / ((now - last_time) / 1e9);
+        progress.rate = (last_time == progress.start_time) ? rate : progress.rate + (rate - progress.rate) * RATE_SMOOTHING;
+
+        last_time = now;
+        last_bytes = bytes;
+
+        print_progress(now, false);
+    }
+    pthread_mutex_unlock(&progress.mutex);
+
+    return NULL;
+}
+
+static void print_progress(int64_t now, bool done)
+{
+    int64_t bytes = __atomic_load_n(&progress.bytes, __ATOMIC_RELAXED);
+    int64_t files = __atomic_load_n(&progress.files, __ATOMIC_RELAXED);
+    int64_t total_bytes = __atomic_load_n(&progress.total_bytes, __ATOMIC_RELAXED);
+    int64_t total_files = __atomic_load_n(&progress.total_files, __ATOMIC_RELAXED);
+
+    // Encrypted files are stored a little larger than they are
+    if(bytes > total_bytes) total_bytes = bytes;
+
+    int64_t elapsed = (now - progress.start_time) / 1000000000;
+    int64_t eta = (progress.rate >= 1 && done == false) ? (int64_t)((total_bytes - bytes) / progress.rate) : -1;
+    if(done == true) eta = 0;
+
+    if(progress.format == PROGRESS_FORMAT_JSON)
+    {
+        fprintf(stderr, "{\"bytes\":%ld,\"total_bytes\":%ld,\"files\":%ld,\"total_files\":%ld,\"rate\":%ld,\"elapsed\":%ld,\"eta\":%ld,\"done\":%s}\n",
+                bytes, total_bytes, files, total_files, (int64_t)progress.rate, elapsed, eta, (done == true) ? "true" : "false");
+        return;
+    }
+
+    fprintf(stderr, "\r%.1f/%.1fMB, %ld/%ld files, %.1fMB/s, ", bytes / 1048576.0, total_bytes / 1048576.0, files, total_files, progress.rate / 1048576.0);
+    if(eta >= 0)
+    {
+        fprintf(stderr, "ETA %ld:%02ld:%02ld\033[K", eta / 3600, eta / 60 % 60, eta % 60);
+    }
+    else
+    {
+        fputs("ETA --:--:--\033[K", stderr);
+    }
+
+    if(done == true)
+    {
+        fputc('\n', stderr);
+    }
+    fflush(stderr);
+}
+
+// Platform-dependant functions
+#ifdef __linux__
+#include <time.h>
+
+// Condition variables wait until a time of the real-time clock
+static void get_deadline(struct timespec* deadline, int interval)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+
+    deadline->tv_sec += interval / 1000;
+    deadline->tv_nsec += (long)(interval % 1000) * 1000000;
+    if(deadline->tv_nsec >= 1000000000)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef TOOL_GDPC_PROGRESS_H
+#define TOOL_GDPC_PROGRESS_H
+
+#include <stdint.h>
+
+/* Progress of the copies, reported on the standard error
+ * Extractions and packaging add the bytes they copy and the files they're done with to counters, and a thread
+ * samples them at regular intervals to print the bytes and files done out of the total, the rate and the time left.
+ * The report is a single line rewritten in place, or a JSON object per line for logs.
+*/
+void progress_start(int format); // PROGRESS_FORMAT_NONE reports nothing
+void progress_stop();
+
+void progress_add_total(int64_t bytes, int64_t files);
+void progress_add(int64_t bytes, int64_t files);
+
+#endif
\ No newline at end of file
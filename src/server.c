@@ -0,0 +1,546 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "server.h"
+#include "gdpc.h"
+#include "pack_cache.h"
+#include "pack_crypto.h"
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+enum
+{
+    SERVER_REQUEST_LIST = 1,
+    SERVER_REQUEST_STAT = 2,
+    SERVER_REQUEST_READ = 3,
+    SERVER_REQUEST_EXTRACT = 4,
+    SERVER_REQUEST_STATS = 5,
+
+    SERVER_REQUEST_COUNT = 6
+};
+
+enum
+{
+    SERVER_STATUS_OK = 0,
+    SERVER_STATUS_ERROR = 1
+};
+
+#define SERVER_MAX_STRING_LENGTH 4096
+
+// Platform-dependant functions
+#ifdef __linux__
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} request_counter;
+
+DEFINE_VECTOR(client_vector, int)
+
+typedef struct
+{
+    config* cfg; // Options the server was started with
+    pack_cache cache;
+
+    request_counter counters[SERVER_REQUEST_COUNT];
+    pthread_mutex_t counters_mutex;
+
+    client_vector clients;
+    pthread_mutex_t clients_mutex;
+    pthread_cond_t clients_done;
+} server;
+
+typedef struct
+{
+    server* srv;
+    int fd;
+} client;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int signal);
+static void* handle_client(void* arg);
+static int handle_request(server* srv, int fd, uint8_t operation, const char* pack_path, const char* argument);
+static void remove_client(server* srv, int fd);
+
+static int receive_all(int fd, void* data, size_t size);
+static int send_all(int fd, const void* data, size_t size);
+static int receive_string(int fd, char* str);
+static int send_response(int fd, uint8_t status, const void* payload, uint64_t size);
+static int send_error(int fd, const char* message);
+
+static const char* request_names[SERVER_REQUEST_COUNT] = { "unknown", "list", "stat", "read", "extract", "stats" };
+
+int run_server(config* cfg)
+{
+    // Create the socket
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if(strlen(cfg->socket_path) >= sizeof(address.sun_path))
+    {
+        printf("gdpc: Socket path is too long \"%s\"\n", cfg->socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, cfg->socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0)
+    {
+        printf("gdpc: Failed to create socket \"%s\"\n", cfg->socket_path);
+        return 1;
+    }
+
+    unlink(cfg->socket_path); // Remove a stale socket
+    if(bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        printf("gdpc: Failed to listen on socket \"%s\"\n", cfg->socket_path);
+        close(listener);
+        return 1;
+    }
+
+    // Stop cleanly on SIGINT/SIGTERM. accept() is interrupted since SA_RESTART isn't set
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    server srv;
+    srv.cfg = cfg;
+    pack_cache_init(&srv.cache);
+    memset(srv.counters, 0, sizeof(srv.counters));
+    pthread_mutex_init(&srv.counters_mutex, NULL);
+    client_vector_init(&srv.clients);
+    pthread_mutex_init(&srv.clients_mutex, NULL);
+    pthread_cond_init(&srv.clients_done, NULL);
+
+    if(cfg->verbose == true)
+    {
+        printf("Serving on \033[4m%s\033[24m\n", cfg->socket_path);
+    }
+
+    // Accept clients, each one being served by its own thread
+    while(stop_requested == 0)
+    {
+        int fd = accept(listener, NULL, NULL);
+        if(fd < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+
+            printf("gdpc: Failed to accept connection on \"%s\"\n", cfg->socket_path);
+            break;
+        }
+
+        client* c = malloc(sizeof(client));
+        if(c == NULL)
+        {
+            fprintf(stderr, "malloc(): failed to allocate memory.\n");
+            abort();
+        }
+        c->srv = &srv;
+        c->fd = fd;
+
+        pthread_mutex_lock(&srv.clients_mutex);
+        client_vector_push_back(&srv.clients, fd);
+        pthread_mutex_unlock(&srv.clients_mutex);
+
+        // Keep the signals on the main thread
+        sigset_t signals, previous;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, &previous);
+
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, handle_client, c) == 0)
+        {
+            pthread_detach(thread);
+        }
+        else
+        {
+            remove_client(&srv, fd);
+            close(fd);
+            free(c);
+        }
+
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    }
+
+    close(listener);
+    unlink(cfg->socket_path);
+
+    // Disconnect the clients and wait for their threads
+    pthread_mutex_lock(&srv.clients_mutex);
+    for(size_t i = 0; i < srv.clients.size; ++i)
+    {
+        shutdown(srv.clients.data[i], SHUT_RDWR);
+    }
+    while(srv.clients.size > 0)
+    {
+        pthread_cond_wait(&srv.clients_done, &srv.clients_mutex);
+    }
+    pthread_mutex_unlock(&srv.clients_mutex);
+
+    // Clean-up
+    pack_cache_free(&srv.cache);
+    client_vector_free(&srv.clients);
+    pthread_mutex_destroy(&srv.counters_mutex);
+    pthread_mutex_destroy(&srv.clients_mutex);
+    pthread_cond_destroy(&srv.clients_done);
+
+    return 0;
+}
+
+static void on_signal(int signal)
+{
+    (void)signal;
+    stop_requested = 1;
+}
+
+/* Request
+ * 1 x 1B  | Int    | Operation (1: list, 2: stat, 3: read, 4: extract, 5: stats)
+ * 1 x 4B  | Int    | Package path length
+ *         | String | Package path
+ * 1 x 4B  | Int    | Argument length
+ *         | String | Argument (file path for stat/read, destination for extract)
+*/
+static void* handle_client(void* arg)
+{
+    client* c = (client*)arg;
+    server* srv = c->srv;
+
+    char pack_path[SERVER_MAX_STRING_LENGTH + 1];
+    char argument[SERVER_MAX_STRING_LENGTH + 1];
+
+    // Serve requests until the client disconnects
+    while(1)
+    {
+        uint8_t operation;
+        if(receive_all(c->fd, &operation, 1) != 0 ||
+           receive_string(c->fd, pack_path) != 0 ||
+           receive_string(c->fd, argument) != 0)
+        {
+            break;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        int status = handle_request(srv, c->fd, operation, pack_path, argument);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        uint64_t elapsed = (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+
+        // Update the latency counters
+        request_counter* counter = &srv->counters[(operation < SERVER_REQUEST_COUNT) ? operation : 0];
+
+        pthread_mutex_lock(&srv->counters_mutex);
+        counter->count++;
+        counter->total_ns += elapsed;
+        if(elapsed > counter->max_ns) counter->max_ns = elapsed;
+        if(status != SERVER_STATUS_OK) counter->errors++;
+        pthread_mutex_unlock(&srv->counters_mutex);
+
+        if(status < 0)
+        {
+            break; // The connection is broken
+        }
+    }
+
+    // Clean-up
+    remove_client(srv, c->fd);
+    close(c->fd);
+    free(c);
+
+    return NULL;
+}
+
+/* Response
+ * 1 x 1B  | Int    | Status (0: success, 1: error)
+ * 1 x 8B  | Int    | Payload length
+ *         | Void   | Payload
+ *
+ * Payloads
+ * list    | "path\n" for each file
+ * stat    | 8B offset, 8B size
+ * read    | Contents of the file
+ * extract | Messages printed while extracting
+ * stats   | "operation count errors average_us max_us\n" for each operation
+ * error   | Error message
+*/
+static int handle_request(server* srv, int fd, uint8_t operation, const char* pack_path, const char* argument)
+{
+    int result = 0;
+
+    // Report the latency counters
+    if(operation == SERVER_REQUEST_STATS)
+    {
+        char buf[SERVER_REQUEST_COUNT * 96];
+        int len = 0;
+
+        pthread_mutex_lock(&srv->counters_mutex);
+        for(int i = 1; i < SERVER_REQUEST_COUNT; ++i)
+        {
+            request_counter* counter = &srv->counters[i];
+            uint64_t average = (counter->count > 0) ? counter->total_ns / counter->count / 1000 : 0;
+            len += snprintf(buf + len, sizeof(buf) - len, "%s %llu %llu %llu %llu\n", request_names[i], (unsigned long long)counter->count, (unsigned long long)counter->errors, (unsigned long long)average, (unsigned long long)(counter->max_ns / 1000));
+        }
+        pthread_mutex_unlock(&srv->counters_mutex);
+
+        return (send_response(fd, SERVER_STATUS_OK, buf, len) == 0) ? SERVER_STATUS_OK : -1;
+    }
+
+    if(operation < SERVER_REQUEST_LIST || operation > SERVER_REQUEST_EXTRACT)
+    {
+        return (send_error(fd, "Unknown operation\n") == 0) ? SERVER_STATUS_ERROR : -1;
+    }
+
+    // Get the pack, collecting the loading errors to send them back
+    char* messages = NULL;
+    size_t messages_size = 0;
+
+    config cfg = *srv->cfg;
+    cfg.output = open_memstream(&messages, &messages_size);
+    if(cfg.output == NULL)
+    {
+        fprintf(stderr, "open_memstream(): failed to allocate memory.\n");
+        abort();
+    }
+
+    cached_pack* entry = pack_cache_acquire(&srv->cache, pack_path, &cfg);
+    fclose(cfg.output);
+
+    if(entry == NULL)
+    {
+        result = (send_response(fd, SERVER_STATUS_ERROR, messages, messages_size) == 0) ? SERVER_STATUS_ERROR : -1;
+        free(messages);
+        return result;
+    }
+    free(messages);
+
+    gd_pack* pack = &entry->pack;
+
+    if(operation == SERVER_REQUEST_LIST)
+    {
+        // Send the paths
+        char* list = NULL;
+        size_t list_size = 0;
+        FILE* stream = open_memstream(&list, &list_size);
+        if(stream == NULL)
+        {
+            fprintf(stderr, "open_memstream(): failed to allocate memory.\n");
+            abort();
+        }
+
+        path_cursor cursor;
+        path_cursor_init(&cursor, pack);
+
+        gd_file file;
+        while(next_file(pack, &cursor, &file) == true)
+        {
+            fwrite(file.path, 1, file.len, stream);
+            fputc('\n', stream);
+        }
+
+        path_cursor_free(&cursor);
+        fclose(stream);
+
+        result = (send_response(fd, SERVER_STATUS_OK, list, list_size) == 0) ? SERVER_STATUS_OK : -1;
+        free(list);
+    }
+    else if(operation == SERVER_REQUEST_STAT || operation == SERVER_REQUEST_READ)
+    {
+        gd_file found;
+        gd_file* file = (find_file(pack, argument, &found) == true) ? &found : NULL;
+
+        if(file == NULL)
+        {
+            result = (send_error(fd, "File not found\n") == 0) ? SERVER_STATUS_ERROR : -1;
+        }
+        else if(operation == SERVER_REQUEST_STAT)
+        {
+            int64_t info[2] = { file->offset, file->size };
+            result = (send_response(fd, SERVER_STATUS_OK, info, sizeof(info)) == 0) ? SERVER_STATUS_OK : -1;
+        }
+        else if(entry->data == NULL || file->offset < 0 || file->size < 0 || (uint64_t)(file->offset + file->size) > entry->data_size)
+        {
+            result = (send_error(fd, "File is out of the package's bounds\n") == 0) ? SERVER_STATUS_ERROR : -1;
+        }
+        else if(file->encrypted == true)
+        {
+            // Decrypt the contents from the mapping
+            int64_t size;
+            char* data = (cfg.has_encryption_key == true) ? decrypt_data(entry->data + file->offset, entry->data_size - file->offset, cfg.encryption_key, &size) : NULL;
+            if(data == NULL)
+            {
+                result = (send_error(fd, "Failed to decrypt the file\n") == 0) ? SERVER_STATUS_ERROR : -1;
+            }
+            else
+            {
+                result = (send_response(fd, SERVER_STATUS_OK, data, size) == 0) ? SERVER_STATUS_OK : -1;
+                buffer_pool_release(data);
+            }
+        }
+        else
+        {
+            // Send the contents straight from the mapping
+            result = (send_response(fd, SERVER_STATUS_OK, entry->data + file->offset, file->size) == 0) ? SERVER_STATUS_OK : -1;
+        }
+    }
+    else
+    {
+        // Extract the pack as "gdpc -e pack destination" would, with the options of the server. The destination isn't
+        // parsed as arguments, so it can't be taken for an option
+        size_t len = strlen(argument);
+        if(len == 0)
+        {
+            result = (send_error(fd, "Invalid destination\n") == 0) ? SERVER_STATUS_ERROR : -1;
+        }
+        else
+        {
+            config extract_cfg = *srv->cfg;
+            extract_cfg.operation_mode = OPERATION_MODE_EXTRACT;
+
+            // Extract into the destination as a folder
+            extract_cfg.destination = malloc(len + 2);
+            if(extract_cfg.destination == NULL)
+            {
+                fprintf(stderr, "malloc(): failed to allocate memory.\n");
+                abort();
+            }
+            memcpy(extract_cfg.destination, argument, len + 1);
+            if(argument[len - 1] != '/')
+            {
+                extract_cfg.destination[len] = '/';
+                extract_cfg.destination[len + 1] = '\0';
+            }
+
+            extract_cfg.output = open_memstream(&messages, &messages_size);
+            if(extract_cfg.output == NULL)
+            {
+                fprintf(stderr, "open_memstream(): failed to allocate memory.\n");
+                abort();
+            }
+
+            int status = (process_pack(pack, &extract_cfg) == 0) ? SERVER_STATUS_OK : SERVER_STATUS_ERROR;
+            fclose(extract_cfg.output);
+
+            result = (send_response(fd, status, messages, messages_size) == 0) ? status : -1;
+            free(messages);
+            free(extract_cfg.destination);
+        }
+    }
+
+    pack_cache_release(entry);
+
+    return result;
+}
+
+static void remove_client(server* srv, int fd)
+{
+    pthread_mutex_lock(&srv->clients_mutex);
+
+    int* clients = srv->clients.data;
+    for(size_t i = 0; i < srv->clients.size; ++i)
+    {
+        if(clients[i] == fd)
+        {
+            clients[i] = clients[srv->clients.size - 1];
+            client_vector_pop_back(&srv->clients);
+            break;
+        }
+    }
+
+    if(srv->clients.size == 0)
+    {
+        pthread_cond_broadcast(&srv->clients_done);
+    }
+
+    pthread_mutex_unlock(&srv->clients_mutex);
+}
+
+static int receive_all(int fd, void* data, size_t size)
+{
+    char* itr = (char*)data;
+    while(size > 0)
+    {
+        ssize_t received = recv(fd, itr, size, 0);
+        if(received < 0 && errno == EINTR) continue;
+        if(received <= 0) return 1;
+
+        itr += received;
+        size -= received;
+    }
+
+    return 0;
+}
+
+static int send_all(int fd, const void* data, size_t size)
+{
+    const char* itr = (const char*)data;
+    while(size > 0)
+    {
+        ssize_t sent = send(fd, itr, size, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR) continue;
+        if(sent <= 0) return 1;
+
+        itr += sent;
+        size -= sent;
+    }
+
+    return 0;
+}
+
+static int receive_string(int fd, char* str)
+{
+    uint32_t len;
+    if(receive_all(fd, &len, 4) != 0 || len > SERVER_MAX_STRING_LENGTH)
+    {
+        return 1;
+    }
+
+    if(receive_all(fd, str, len) != 0)
+    {
+        return 1;
+    }
+    str[len] = '\0';
+
+    return 0;
+}
+
+static int send_response(int fd, uint8_t status, const void* payload, uint64_t size)
+{
+    char header[9];
+    header[0] = status;
+    memcpy(header + 1, &size, 8);
+
+    if(send_all(fd, header, 9) != 0)
+    {
+        return 1;
+    }
+
+    return send_all(fd, payload, size);
+}
+
+static int send_error(int fd, const char* message)
+{
+    return send_response(fd, SERVER_STATUS_ERROR, message, strlen(message));
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,8 @@
+#ifndef TOOL_GDPC_SERVER_H
+#define TOOL_GDPC_SERVER_H
+
+#include "config.h"
+
+int run_server(config* cfg); // Platform-dependant
+
+#endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "tar_reader.h"
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define TAR_MAX_METADATA_SIZE (1 << 20) // Largest long name or pax header read
+
+static int skip_data(tar_reader* tar, int64_t length);
+static char* read_metadata(tar_reader* tar, int64_t size);
+static void parse_pax_records(tar_reader* tar, const char* data, int64_t size, bool* has_path, int64_t* file_size);
+static void set_path(tar_reader* tar, const char* path, size_t len);
+static int64_t parse_number(const uint8_t* field, int len);
+static bool is_valid_header(const uint8_t* header);
+
+void tar_reader_init(tar_reader* tar, FILE* stream)
+{
+    tar->stream = stream;
+    tar->path = NULL;
+    tar->path_capacity = 0;
+    tar->size = 0;
+    tar->unread = 0;
+}
+
+void tar_reader_free(tar_reader* tar)
+{
+    free(tar->path);
+    tar->path = NULL;
+    tar->path_capacity = 0;
+}
+
+/* Header block
+ * 100B | String | Name
+ * 8B   | Octal  | Mode
+ * 8B   | Octal  | Owner
+ * 8B   | Octal  | Group
+ * 12B  | Octal  | Size (base-256 if the high bit of the first byte is set)
+ * 12B  | Octal  | Modification time
+ * 8B   | Octal  | Checksum of the header, counting this field as spaces
+ * 1B   | Char   | Type ('0' file, '5' directory, 'L' GNU long name of the next entry, 'x' pax header...)
+ * 100B | String | Link name
+ * 6B   | String | Magic ("ustar")
+ * 82B  | ?      | Version, owner and group names, device numbers
+ * 155B | String | Prefix of the name (ustar)
+*/
+int next_tar_file(tar_reader* tar)
+{
+    // Path and size given to the next entry by a long name or pax header
+    bool has_path = false;
+    int64_t file_size = -1;
+
+    for(;;)
+    {
+        // Skip what's left of the previous entry
+        if(skip_data(tar, tar->unread) != 0)
+        {
+            return -1;
+        }
+        tar->unread = 0;
+
+        uint8_t header[TAR_BLOCK_SIZE];
+        size_t read = fread(header, 1, TAR_BLOCK_SIZE, tar->stream);
+        if(read == 0)
+        {
+            return 0;
+        }
+        if(read != TAR_BLOCK_SIZE)
+        {
+            return -1;
+        }
+
+        // The archive ends with zeroed blocks
+        bool empty = true;
+        for(int i = 0; i < TAR_BLOCK_SIZE && empty == true; ++i)
+        {
+            empty = (header[i] == 0);
+        }
+        if(empty == true)
+        {
+            return 0;
+        }
+
+        if(is_valid_header(header) == false)
+        {
+            return -1;
+        }
+
+        int64_t size = parse_number(header + 124, 12);
+        char type = header[156];
+        tar->unread = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+
+        if(type == 'L' || type == 'x')
+        {
+            char* data = read_metadata(tar, size);
+            if(data == NULL)
+            {
+                return -1;
+            }
+
+            if(type == 'L')
+            {
+                set_path(tar, data, strlen(data));
+                has_path = true;
+            }
+            else
+            {
+                parse_pax_records(tar, data, size, &has_path, &file_size);
+            }
+
+            free(data);
+            continue;
+        }
+
+        // Directories, links and the other entries have no file to package
+        if(type != '0' && type != '\0' && type != '7')
+        {
+            has_path = false;
+            file_size = -1;
+            continue;
+        }
+
+        if(has_path == false)
+        {
+            size_t name_len = strnlen((const char*)header, 100);
+            size_t prefix_len = (memcmp(header + 257, "ustar", 5) == 0) ? strnlen((const char*)header + 345, 155) : 0;
+
+            char path[257];
+            memcpy(path, header + 345, prefix_len);
+            if(prefix_len > 0) path[prefix_len++] = '/';
+            memcpy(path + prefix_len, header, name_len);
+
+            set_path(tar, path, prefix_len + name_len);
+        }
+
+        if(file_size >= 0)
+        {
+            size = file_size;
+            tar->unread = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+        }
+
+        tar->size = size;
+        return 1;
+    }
+}
+
+static int skip_data(tar_reader* tar, int64_t length)
+{
+    if(length == 0 || fseek(tar->stream, length, SEEK_CUR) == 0)
+    {
+        return 0;
+    }
+
+    // Pipes can't seek, the data is read instead
+    char* buf = buffer_pool_acquire(BUFFER_BLOCK_SIZE);
+    while(length > 0)
+    {
+        size_t chunk = (length < BUFFER_BLOCK_SIZE) ? (size_t)length : BUFFER_BLOCK_SIZE;
+        if(fread(buf, 1, chunk, tar->stream) != chunk)
+        {
+            break;
+        }
+        length -= chunk;
+    }
+    buffer_pool_release(buf);
+
+    return (length == 0) ? 0 : 1;
+}
+
+// Returns the data of the entry, NUL-terminated, NULL if it's too large or truncated
+static char* read_metadata(tar_reader* tar, int64_t size)
+{
+    if(size > TAR_MAX_METADATA_SIZE)
+    {
+        return NULL;
+    }
+
+    char* data = malloc(tar->unread + 1);
+    if(data == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    if(fread(data, 1, tar->unread, tar->stream) != (size_t)tar->unread)
+    {
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+    tar->unread = 0;
+
+    return data;
+}
+
+// Records are "<length> <key>=<value>\n", only the path and size are used
+static void parse_pax_records(tar_reader* tar, const char* data, int64_t size, bool* has_path, int64_t* file_size)
+{
+    const char* itr = data;
+    const char* end = data + size;
+    while(itr < end)
+    {
+        char* space;
+        long length = strtol(itr, &space, 10);
+        if(length <= 0 || space == itr || *space != ' ' || length > end - itr)
+        {
+            return;
+        }
+
+        const char* key = space + 1;
+        const char* record_end = itr + length - 1; // Newline
+        const char* equals = memchr(key, '=', record_end - key);
+        if(equals != NULL)
+        {
+            size_t key_len = equals - key;
+            if(key_len == 4 && strncmp(key, "path", 4) == 0)
+            {
+                set_path(tar, equals + 1, record_end - equals - 1);
+                *has_path = true;
+            }
+            else if(key_len == 4 && strncmp(key, "size", 4) == 0)
+            {
+                *file_size = strtoll(equals + 1, NULL, 10);
+            }
+        }
+
+        itr += length;
+    }
+}
+
+static void set_path(tar_reader* tar, const char* path, size_t len)
+{
+    if(len + 1 > tar->path_capacity)
+    {
+        tar->path_capacity = len + 1;
+        tar->path = realloc(tar->path, tar->path_capacity);
+        if(tar->path == NULL)
+        {
+            fprintf(stderr, "realloc(): failed to re-allocate memory.\n");
+            abort();
+        }
+    }
+
+    memcpy(tar->path, path, len);
+    tar->path[len] = '\0';
+}
+
+// Octal, or base-256 when the high bit of the first byte is set (sizes of 8GB and more)
+static int64_t parse_number(const uint8_t* field, int len)
+{
+    int64_t value = 0;
+    if(field[0] & 0x80)
+    {
+        value = field[0] & 0x7f;
+        for(int i = 1; i < len; ++i)
+        {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+
+    int i = 0;
+    while(i < len && field[i] == ' ') ++i;
+    for(; i < len && field[i] >= '0' && field[i] <= '7'; ++i)
+    {
+        value = value * 8 + (field[i] - '0');
+    }
+
+    return value;
+}
+
+static bool is_valid_header(const uint8_t* header)
+{
+    // Old archives summed the bytes as signed
+    int64_t sum = 0, signed_sum = 0;
+    for(int i = 0; i < TAR_BLOCK_SIZE; ++i)
+    {
+        uint8_t byte = (i >= 148 && i < 156) ? ' ' : header[i];
+        sum += byte;
+        signed_sum += (int8_t)byte;
+    }
+
+    int64_t checksum = parse_number(header + 148, 8);
+    return checksum == sum || checksum == signed_sum;
+}
\ No newline at end of file
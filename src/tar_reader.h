@@ -0,0 +1,25 @@
+#ifndef TOOL_GDPC_TAR_READER_H
+#define TOOL_GDPC_TAR_READER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TAR_BLOCK_SIZE 512
+
+// Reads the regular files of a tar archive (ustar, with GNU long names and pax paths) from a stream, front to back
+typedef struct
+{
+    FILE* stream;
+
+    char* path; // Path of the current file
+    size_t path_capacity;
+    int64_t size; // Size of the current file
+    int64_t unread; // Bytes of the current entry, with its padding, the reader skips before the next header
+} tar_reader;
+
+void tar_reader_init(tar_reader* tar, FILE* stream);
+void tar_reader_free(tar_reader* tar);
+
+int next_tar_file(tar_reader* tar); // 1 if a file was found, 0 at the end of the archive, -1 if it's invalid
+
+#endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "thread_pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+static void* worker(void* arg);
+
+void thread_pool_init(thread_pool* pool, int thread_count)
+{
+    if(pool == NULL) return;
+
+    if(thread_count < 1) thread_count = 1;
+
+    task_vector_init(&pool->tasks);
+    pool->next_task = 0;
+    pool->pending = 0;
+    pool->stopping = false;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->task_available, NULL);
+    pthread_cond_init(&pool->tasks_done, NULL);
+
+    // Start the workers
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if(pool->threads == NULL)
+    {
+        fprintf(stderr, "malloc(): failed to allocate memory.\n");
+        abort();
+    }
+
+    pool->thread_count = 0;
+    for(int i = 0; i < thread_count; ++i)
+    {
+        if(pthread_create(&pool->threads[i], NULL, worker, pool) != 0)
+        {
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    if(pool->thread_count == 0)
+    {
+        fprintf(stderr, "pthread_create(): failed to create thread.\n");
+        abort();
+    }
+}
+
+void thread_pool_free(thread_pool* pool)
+{
+    if(pool == NULL) return;
+
+    // Let the workers finish the remaining tasks, then stop them
+    thread_pool_wait(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->task_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(int i = 0; i < pool->thread_count; ++i)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    // Clean-up
+    free(pool->threads);
+    task_vector_free(&pool->tasks);
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->task_available);
+    pthread_cond_destroy(&pool->tasks_done);
+}
+
+void thread_pool_submit(thread_pool* pool, task_function function, void* arg)
+{
+    task t = { function, arg };
+
+    pthread_mutex_lock(&pool->mutex);
+
+    task_vector_push_back(&pool->tasks, t);
+    pool->pending++;
+
+    pthread_cond_signal(&pool->task_available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_wait(thread_pool* pool)
+{
+    // Wait until every task, including the ones submitted by other tasks, has completed
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->tasks_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void* worker(void* arg)
+{
+    thread_pool* pool = (thread_pool*)arg;
+
+    pthread_mutex_lock(&pool->mutex);
+    while(1)
+    {
+        // Wait for a task
+        while(pool->next_task == pool->tasks.size && pool->stopping == false)
+        {
+            pthread_cond_wait(&pool->task_available, &pool->mutex);
+        }
+
+        if(pool->next_task == pool->tasks.size)
+        {
+            break;
+        }
+
+        // Take the oldest task, rewinding the queue once it is drained
+        task t = pool->tasks.data[pool->next_task++];
+        if(pool->next_task == pool->tasks.size)
+        {
+            pool->next_task = 0;
+            pool->tasks.size = 0;
+        }
+
+        // Run it
+        pthread_mutex_unlock(&pool->mutex);
+        t.function(t.arg);
+        pthread_mutex_lock(&pool->mutex);
+
+        pool->pending--;
+        if(pool->pending == 0)
+        {
+            pthread_cond_broadcast(&pool->tasks_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+// Platform-dependant functions
+#ifdef __linux__
+#include <unistd.h>
+#include <time.h>
+
+int get_processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+}
+
+int64_t get_monotonic_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef TOOL_GDPC_THREAD_POOL_H
+#define TOOL_GDPC_THREAD_POOL_H
+
+#include "vector.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*task_function)(void* arg);
+
+typedef struct
+{
+    task_function function;
+    void* arg;
+} task;
+
+DEFINE_VECTOR(task_vector, task)
+
+typedef struct
+{
+    pthread_t* threads;
+    int thread_count;
+
+    task_vector tasks;
+    size_t next_task;
+    size_t pending; // Tasks queued or running
+    bool stopping;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t task_available;
+    pthread_cond_t tasks_done;
+} thread_pool;
+
+void thread_pool_init(thread_pool* pool, int thread_count);
+void thread_pool_free(thread_pool* pool);
+
+void thread_pool_submit(thread_pool* pool, task_function function, void* arg);
+void thread_pool_wait(thread_pool* pool);
+
+int get_processor_count(); // Platform-dependant
+int64_t get_monotonic_time(); // Platform-dependant, in nanoseconds
+
+#endif
\ No newline at end of file
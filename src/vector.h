@@ -0,0 +1,126 @@
+#ifndef TOOL_GDPC_VECTOR_H
+#define TOOL_GDPC_VECTOR_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VECTOR_MIN_CAPACITY 8 // First capacity of a vector growing out of its inline storage
+
+/* Typed growable arrays
+ * DEFINE_VECTOR(name, type) defines the struct `name` ({ type* data; size_t size; size_t capacity; }) and its
+ * functions: name_init, name_free, name_reserve, name_push_back, name_append, name_pop_back and name_shrink.
+ * data is NULL until something is pushed.
+ *
+ * DEFINE_SMALL_VECTOR(name, type, n) does the same with storage for n items inside the struct, so short lists never
+ * allocate. data points to that storage: a small vector can't be copied or moved once initialized.
+*/
+#define DEFINE_VECTOR(name, type) \
+    typedef struct \
+    { \
+        type* data; \
+        size_t size; \
+        size_t capacity; \
+    } name; \
+    VECTOR_FUNCTIONS(name, type, NULL, 0)
+
+#define DEFINE_SMALL_VECTOR(name, type, inline_capacity) \
+    typedef struct \
+    { \
+        type* data; \
+        size_t size; \
+        size_t capacity; \
+        type storage[inline_capacity]; \
+    } name; \
+    VECTOR_FUNCTIONS(name, type, vec->storage, inline_capacity)
+
+#define VECTOR_FUNCTIONS(name, type, inline_storage, inline_capacity) \
+    static inline void name##_init(name* vec) \
+    { \
+        vec->data = inline_storage; \
+        vec->size = 0; \
+        vec->capacity = inline_capacity; \
+    } \
+    \
+    static inline void name##_free(name* vec) \
+    { \
+        if(vec->data != inline_storage) free(vec->data); \
+        name##_init(vec); \
+    } \
+    \
+    /* Makes room for capacity items, so pushing up to that many items doesn't allocate */ \
+    static inline void name##_reserve(name* vec, size_t capacity) \
+    { \
+        if(capacity <= vec->capacity) return; \
+        \
+        type* storage = inline_storage; \
+        type* data = (vec->data == storage) ? malloc(capacity * sizeof(type)) : realloc(vec->data, capacity * sizeof(type)); \
+        if(data == NULL) \
+        { \
+            fprintf(stderr, "realloc(): failed to re-allocate memory.\n"); \
+            abort(); \
+        } \
+        if(storage != NULL && vec->data == storage && vec->size > 0) memcpy(data, storage, vec->size * sizeof(type)); \
+        \
+        vec->data = data; \
+        vec->capacity = capacity; \
+    } \
+    \
+    static inline void name##_grow(name* vec, size_t size) \
+    { \
+        if(size <= vec->capacity) return; \
+        \
+        size_t capacity = (vec->capacity < VECTOR_MIN_CAPACITY) ? VECTOR_MIN_CAPACITY : vec->capacity * 2; \
+        name##_reserve(vec, (capacity < size) ? size : capacity); \
+    } \
+    \
+    static inline void name##_push_back(name* vec, type item) \
+    { \
+        if(vec->size == vec->capacity) name##_grow(vec, vec->size + 1); \
+        vec->data[vec->size++] = item; \
+    } \
+    \
+    static inline void name##_append(name* vec, const type* items, size_t count) \
+    { \
+        if(count == 0) return; \
+        \
+        name##_grow(vec, vec->size + count); \
+        memcpy(vec->data + vec->size, items, count * sizeof(type)); \
+        vec->size += count; \
+    } \
+    \
+    static inline void name##_pop_back(name* vec) \
+    { \
+        vec->size--; \
+    } \
+    \
+    /* Gives the unused capacity back, a small vector whose items fit in its storage moves back to it */ \
+    static inline void name##_shrink(name* vec) \
+    { \
+        if(vec->data == inline_storage || vec->size == vec->capacity) return; \
+        \
+        type* storage = inline_storage; \
+        if(storage != NULL && vec->size <= inline_capacity) \
+        { \
+            memcpy(storage, vec->data, vec->size * sizeof(type)); \
+            free(vec->data); \
+            vec->data = storage; \
+            vec->capacity = inline_capacity; \
+            return; \
+        } \
+        \
+        if(vec->size == 0) \
+        { \
+            name##_free(vec); \
+            return; \
+        } \
+        \
+        type* data = realloc(vec->data, vec->size * sizeof(type)); \
+        if(data != NULL) \
+        { \
+            vec->data = data; \
+            vec->capacity = vec->size; \
+        } \
+    }
+
+#endif
\ No newline at end of file